@@ -20,6 +20,7 @@
 
 #include <svr/lockable.h>
 #include <svr/refcount.h>
+#include <svr/frame.h>
 
 #include <svr/logging.h>
 #include <svr/mempool.h>
@@ -27,19 +28,24 @@
 #include <svr/pack.h>
 #include <svr/stream.h>
 #include <svr/source.h>
+#include <svr/bandwidth.h>
 #include <svr/errors.h>
 #include <svr/optionstring.h>
 
 #include <svr/message.h>
 #include <svr/net.h>
 #include <svr/comm.h>
+#include <svr/context.h>
+#include <svr/datagram.h>
 
 #include <svr/messagerouting.h>
 #include <svr/messagehandlers.h>
 
 #include <svr/encoding.h>
 #include <svr/frameproperties.h>
+#include <svr/framepool.h>
 #include <svr/responseset.h>
+#include <svr/chunkqueue.h>
 
 #define SVR_CRASH(m) { \
     fprintf(stderr, "[SVR_CRASH in %s] %s\n", __func__, (m)); \
@@ -0,0 +1,8 @@
+
+#ifndef __SVR_BANDWIDTH_H
+#define __SVR_BANDWIDTH_H
+
+int SVR_setServerBandwidth(unsigned long bits_per_second);
+int SVR_setClientBandwidth(unsigned long bits_per_second);
+
+#endif // #ifndef __SVR_BANDWIDTH_H
@@ -16,6 +16,12 @@ struct SVR_BlockAllocator_s {
     size_t index;
     List* chunks;
     void** blocks;
+
+    /* Magazines of every thread which has used the allocator. Without a thread
+       specific data key every allocation takes the allocator lock instead */
+    List* magazines;
+    pthread_key_t magazine_key;
+    bool has_magazines;
     pthread_mutex_t lock;
 };
 
@@ -27,5 +33,6 @@ SVR_BlockAllocator* SVR_BlockAlloc_getSharedAllocator(uint32_t block_size);
 size_t SVR_BlockAlloc_getBlockSize(SVR_BlockAllocator* allocator);
 void* SVR_BlockAlloc_alloc(SVR_BlockAllocator* allocator);
 void SVR_BlockAlloc_free(SVR_BlockAllocator* allocator, void* p);
+size_t SVR_BlockAlloc_trim(SVR_BlockAllocator* allocator);
 
 #endif // #ifndef __SVR_BLOCKALLOC_H
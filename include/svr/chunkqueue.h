@@ -0,0 +1,59 @@
+
+#ifndef __SVR_CHUNKQUEUE_H
+#define __SVR_CHUNKQUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <svr/forward.h>
+
+/**
+ * \brief Ring buffer of a chunk queue
+ *
+ * Bytes ever written and read. Only the producer writes head, and only the
+ * consumer writes tail. Once the producer moves on to a larger buffer it sets
+ * next, and writes nothing more to this one.
+ */
+struct SVR_ChunkBuffer_s {
+    uint8_t* data;
+    size_t capacity;
+    size_t head;
+    size_t tail;
+    SVR_ChunkBuffer* next;
+};
+
+/**
+ * \brief Queue of data chunks between two threads
+ *
+ * Chunks are copied into a ring buffer by a single producer thread and read
+ * in place by a single consumer thread. The producer never waits: when the
+ * buffer is full it continues in one twice the size, which the consumer moves
+ * on to once it has read the chunks before. Only the consumer takes a lock,
+ * when the queue is empty and it has to wait.
+ */
+struct SVR_ChunkQueue_s {
+    /* Buffer the producer writes to, and the oldest buffer the consumer has
+       not finished reading */
+    SVR_ChunkBuffer* write_buffer;
+    SVR_ChunkBuffer* read_buffer;
+
+    /* Size of the chunk the consumer is reading, including its header */
+    size_t peeked;
+
+    bool closed;
+
+    /* Set while the consumer waits for a chunk */
+    int waiters;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+SVR_ChunkQueue* SVR_ChunkQueue_new(size_t capacity);
+void SVR_ChunkQueue_destroy(SVR_ChunkQueue* queue);
+bool SVR_ChunkQueue_push(SVR_ChunkQueue* queue, int tag, const void* data, size_t n);
+bool SVR_ChunkQueue_peek(SVR_ChunkQueue* queue, int* tag, void** data, size_t* n);
+void SVR_ChunkQueue_pop(SVR_ChunkQueue* queue);
+void SVR_ChunkQueue_close(SVR_ChunkQueue* queue);
+
+#endif // #ifndef __SVR_CHUNKQUEUE_H
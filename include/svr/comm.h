@@ -2,8 +2,19 @@
 #ifndef __SVR_COMM_H
 #define __SVR_COMM_H
 
+/* Called with the response to a request sent with
+   SVR_Comm_sendRequestWithCallback */
+typedef void (*SVR_Comm_ResponseCallback)(SVR_Message* response, void* data);
+
+int SVR_Comm_connect(const char* server_address);
 int SVR_Comm_init(const char* server_address);
+SVR_Context* SVR_Comm_getContext(void);
+bool SVR_Comm_isLocal(void);
 void* SVR_Comm_sendMessage(SVR_Message* message, bool is_request);
+int SVR_Comm_sendRequest(SVR_Message* message);
+SVR_Message* SVR_Comm_getResponse(int request);
+int SVR_Comm_sendRequestWithCallback(SVR_Message* message, SVR_Comm_ResponseCallback callback, void* data);
+void SVR_Comm_waitAll(void);
 int SVR_Comm_parseResponse(SVR_Message* response);
 
 #endif // #ifndef __SVR_COMM_H
@@ -0,0 +1,49 @@
+
+#ifndef __SVR_CONTEXT_H
+#define __SVR_CONTEXT_H
+
+#include <svr/forward.h>
+
+/**
+ * \brief A connection to a server
+ *
+ * Each context has its own socket, receive thread and request IDs, and the
+ * streams and sources opened over it. The context opened by SVR_init is used
+ * by every call which does not take a context.
+ */
+struct SVR_Context_s {
+    int socket;
+    SVR_NetReader* reader;
+    pthread_t receive_thread;
+    SVR_ResponseSet* response_set;
+    pthread_mutex_t send_lock;
+
+    /* Set while the context is destroyed, so losing the server is expected */
+    volatile bool closing;
+
+    /* Streams open over the connection by stream name, to route the messages
+       received for them */
+    Dictionary* streams;
+
+    /* Client sources provided over the connection by source name, to route
+       the credits granted to them. Also protected by stream_list_lock */
+    Dictionary* sources;
+    pthread_mutex_t stream_list_lock;
+
+    /* Protects the links between streams sharing frames, which are only
+       changed with stream_list_lock held too */
+    pthread_mutex_t share_lock;
+};
+
+SVR_Context* SVR_Context_new(const char* server_address);
+SVR_Context* SVR_Context_newWithSocket(int sock);
+void SVR_Context_destroy(SVR_Context* context);
+bool SVR_Context_isLocal(SVR_Context* context);
+void* SVR_Context_sendMessage(SVR_Context* context, SVR_Message* message, bool is_request);
+int SVR_Context_sendRequest(SVR_Context* context, SVR_Message* message);
+SVR_Message* SVR_Context_getResponse(SVR_Context* context, int request);
+int SVR_Context_sendRequestWithCallback(SVR_Context* context, SVR_Message* message,
+                                        SVR_Comm_ResponseCallback callback, void* data);
+void SVR_Context_waitAll(SVR_Context* context);
+
+#endif // #ifndef __SVR_CONTEXT_H
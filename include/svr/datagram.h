@@ -0,0 +1,60 @@
+
+#ifndef __SVR_DATAGRAM_H
+#define __SVR_DATAGRAM_H
+
+#include <svr/forward.h>
+
+/* Socket receive buffer requested for datagram transports. A whole frame
+   arrives in a burst, and datagrams which do not fit are lost */
+#define SVR_DATAGRAM_RECEIVE_BUFFER (4 * 1024 * 1024)
+
+/* Largest frame a receiver reassembles */
+#define SVR_DATAGRAM_MAX_FRAME_SIZE (64 * 1024 * 1024)
+
+/**
+ * \brief Receiving end of a datagram transport
+ *
+ * Receives the datagrams of one stream on a UDP socket and reassembles them
+ * into frames, which are passed on to the stream once complete. A frame is
+ * dropped as soon as a datagram of a newer frame arrives before it completes.
+ */
+struct SVR_DatagramReceiver_s {
+    int socket;
+    pthread_t thread;
+    volatile bool running;
+
+    SVR_Context* context;
+    char* stream_name;
+
+    /* Frame being reassembled */
+    uint8_t* frame;
+    size_t frame_buffer_size;
+    uint32_t frame_id;
+    uint32_t frame_size;
+    size_t received;
+    bool assembling;
+
+    /* Every datagram of a frame but its last carries fragment_size bytes, at
+       an offset which is a multiple of it. fragments has a bit set for each of
+       them which arrived, so repeated datagrams are told apart. fragment_size
+       is 0 until a datagram other than the last arrives */
+    uint8_t* fragments;
+    size_t fragments_buffer_size;
+    size_t fragment_size;
+
+    /* The last datagram of the frame arrived, at last_offset */
+    bool last_received;
+    uint32_t last_offset;
+
+    /* A frame has been seen, so frame_id is valid */
+    bool started;
+
+    /* Frames which were started but never completed */
+    unsigned int frames_lost;
+};
+
+SVR_DatagramReceiver* SVR_DatagramReceiver_new(SVR_Context* context, const char* stream_name, const char* group, int port);
+int SVR_DatagramReceiver_getPort(SVR_DatagramReceiver* receiver);
+void SVR_DatagramReceiver_destroy(SVR_DatagramReceiver* receiver);
+
+#endif // #ifndef __SVR_DATAGRAM_H
@@ -41,6 +41,12 @@ struct SVR_Encoding_s {
      */
     void (*encode)(SVR_Encoder* encoder, IplImage* frame);
 
+    /**
+     * Optional. Ask the encoder to aim for frames of the given size in bytes,
+     * or stop doing so if the size is 0
+     */
+    void (*setTargetFrameSize)(SVR_Encoder* encoder, size_t frame_size);
+
     /**
      * Provide data for decoding. Return number of frames ready
      */
@@ -60,12 +66,16 @@ struct SVR_Encoder_s {
 
 struct SVR_Decoder_s {
     List* ready_frames;
-    List* free_frames;
+    IplImage* current_frame;
     unsigned int write_offset;
 
     SVR_FrameProperties* frame_properties;
     SVR_Encoding* encoding;
     void* private_data;
+
+    /* Frames are written into frames from this allocator, or from the frame
+       pool if NULL */
+    SVR_FrameAllocator* frame_allocator;
     SVR_LOCKABLE;
 };
 
@@ -75,16 +85,20 @@ void SVR_Encoding_init(void);
 void SVR_Encoding_close(void);
 
 SVR_Encoding* SVR_Encoding_getByName(const char* name);
+SVR_Encoding* SVR_Encoding_getAuto(bool local);
 int SVR_Encoding_register(SVR_Encoding* encoding);
 
 SVR_Encoder* SVR_Encoder_new(SVR_Encoding* encoding, Dictionary* encoding_options, SVR_FrameProperties* frame_properties);
 void SVR_Encoder_destroy(SVR_Encoder* encoder);
 size_t SVR_Encoder_encode(SVR_Encoder* encoder, IplImage* frame);
+void SVR_Encoder_setTargetFrameSize(SVR_Encoder* encoder, size_t frame_size);
 size_t SVR_Encoder_dataReady(SVR_Encoder* encoder);
 size_t SVR_Encoder_readData(SVR_Encoder* encoder, void* buffer, size_t buffer_size);
+size_t SVR_Encoder_passThrough(SVR_Encoder* encoder, void* data, size_t n);
 
 SVR_Decoder* SVR_Decoder_new(SVR_Encoding* encoding, SVR_FrameProperties* frame_properties);
 void SVR_Decoder_destroy(SVR_Decoder* decoder);
+void SVR_Decoder_setFrameAllocator(SVR_Decoder* decoder, SVR_FrameAllocator* frame_allocator);
 int SVR_Decoder_decode(SVR_Decoder* decoder, void* data, size_t n);
 int SVR_Decoder_framesReady(SVR_Decoder* decoder);
 IplImage* SVR_Decoder_getFrame(SVR_Decoder* decoder);
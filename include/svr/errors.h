@@ -13,6 +13,7 @@
 #define SVR_INVALIDARGUMENT    6
 #define SVR_INVALIDSTATE       7
 #define SVR_PARSEERROR         8
+#define SVR_OVERLOADED         9
 
 #define SVR_UNKNOWNERROR       255
 
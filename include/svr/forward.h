@@ -9,13 +9,23 @@ struct SVR_BlockAllocator_s;
 struct SVR_RefCounter_s;
 struct SVR_Message_s;
 struct SVR_PackedMessage_s;
+struct SVR_NetReader_s;
+struct SVR_Context_s;
+struct SVR_DatagramReceiver_s;
 struct SVR_Encoding_s;
 struct SVR_Encoder_s;
 struct SVR_Decoder_s;
 struct SVR_Stream_s;
+struct SVR_StreamStats_s;
+struct SVR_StreamConfig_s;
 struct SVR_FrameProperties_s;
 struct SVR_ResponseSet_s;
+struct SVR_ChunkBuffer_s;
+struct SVR_ChunkQueue_s;
+struct SVR_Frame_s;
+struct SVR_FrameAllocator_s;
 struct SVR_Source_s;
+struct SVR_SourceStats_s;
 
 typedef struct SVR_MemPool_s SVR_MemPool;
 typedef struct SVR_MemPool_Block_s SVR_MemPool_Block;
@@ -24,12 +34,22 @@ typedef struct SVR_BlockAllocator_s SVR_BlockAllocator;
 typedef struct SVR_RefCounter_s SVR_RefCounter;
 typedef struct SVR_Message_s SVR_Message;
 typedef struct SVR_PackedMessage_s SVR_PackedMessage;
+typedef struct SVR_NetReader_s SVR_NetReader;
+typedef struct SVR_Context_s SVR_Context;
+typedef struct SVR_DatagramReceiver_s SVR_DatagramReceiver;
 typedef struct SVR_Encoding_s SVR_Encoding;
 typedef struct SVR_Encoder_s SVR_Encoder;
 typedef struct SVR_Decoder_s SVR_Decoder;
 typedef struct SVR_Stream_s SVR_Stream;
+typedef struct SVR_StreamStats_s SVR_StreamStats;
+typedef struct SVR_StreamConfig_s SVR_StreamConfig;
 typedef struct SVR_FrameProperties_s SVR_FrameProperties;
 typedef struct SVR_ResponseSet_s SVR_ResponseSet;
+typedef struct SVR_ChunkBuffer_s SVR_ChunkBuffer;
+typedef struct SVR_ChunkQueue_s SVR_ChunkQueue;
+typedef struct SVR_Frame_s SVR_Frame;
+typedef struct SVR_FrameAllocator_s SVR_FrameAllocator;
 typedef struct SVR_Source_s SVR_Source;
+typedef struct SVR_SourceStats_s SVR_SourceStats;
 
 #endif // #ifndef __SVR_FORWARDDECLARATIONS_H
@@ -0,0 +1,60 @@
+
+#ifndef __SVR_FRAME_H
+#define __SVR_FRAME_H
+
+#include <time.h>
+
+#include <svr/forward.h>
+#include <svr/cv.h>
+#include <svr/refcount.h>
+
+/**
+ * \brief Source of the frames a decoder writes into
+ *
+ * Frames from getFrame must have the width, height, depth and channels of the
+ * given frame properties, but may have any row alignment.
+ */
+struct SVR_FrameAllocator_s {
+    /* Return a frame matching the frame properties */
+    IplImage* (*getFrame)(SVR_FrameProperties* frame_properties, void* data);
+
+    /* Take back a frame from getFrame once nothing uses it any more */
+    void (*returnFrame)(IplImage* frame, void* data);
+
+    /* Passed to both functions */
+    void* data;
+};
+
+/**
+ * \brief A decoded frame shared by reference count
+ *
+ * A frame passed to a frame callback is valid until the callback returns. Take
+ * a reference with SVR_REF to keep it longer, and release it with SVR_UNREF.
+ * Streams sharing frames are passed the same frame, so it must not be modified.
+ */
+struct SVR_Frame_s {
+    IplImage* image;
+
+    /* Frames of the stream decoded before this one */
+    unsigned int sequence;
+
+    /* CLOCK_MONOTONIC time the frame finished decoding */
+    struct timespec decoded;
+
+    /* Degrade level the server applied to the stream */
+    int degrade_level;
+
+    /* Takes the image back once the frame is released, NULL for the frame
+       pool */
+    SVR_FrameAllocator* allocator;
+
+    SVR_REFCOUNTED;
+};
+
+/* Called with each frame of a stream */
+typedef void (*SVR_FrameCallback)(SVR_Stream* stream, SVR_Frame* frame, void* data);
+
+void SVR_Frame_init(void);
+SVR_Frame* SVR_Frame_new(IplImage* image, SVR_FrameAllocator* allocator);
+
+#endif // #ifndef __SVR_FRAME_H
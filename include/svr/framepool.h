@@ -0,0 +1,19 @@
+
+#ifndef __SVR_FRAMEPOOL_H
+#define __SVR_FRAMEPOOL_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <svr/forward.h>
+#include <svr/cv.h>
+
+void SVR_FramePool_init(void);
+void SVR_FramePool_close(void);
+void SVR_FramePool_setHugePages(bool enable);
+void SVR_FramePool_setIdleLimit(size_t frames, size_t bytes);
+IplImage* SVR_FramePool_getFrame(SVR_FrameProperties* frame_properties);
+void SVR_FramePool_returnFrame(IplImage* frame);
+size_t SVR_FramePool_trim(void);
+
+#endif // #ifndef __SVR_FRAMEPOOL_H
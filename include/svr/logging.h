@@ -40,9 +40,15 @@
  */
 #define SVR_LOGGING_OFF 0xff
 
+/**
+ * Maximum length of a message formatted by SVR_logf
+ */
+#define SVR_LOG_MAX_LENGTH 512
+
 void SVR_Logging_setThreshold(short level);
 char* SVR_Logging_getLevelName(short log_level);
 short SVR_Logging_getLevelFromName(const char* log_level);
 void SVR_log(short level, char* message);
+void SVR_logf(short level, const char* format, ...) __attribute__((format(printf, 2, 3)));
 
 #endif // #ifndef __SVR_LOGGING_INCLUDE_H
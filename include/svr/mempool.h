@@ -23,10 +23,10 @@
  * \brief A memory pool arena which allocations can be made from
  *
  * A MemPool arena is a linked list of SVR_Arenas, each acting as
- * a chunk in the total arena. The size of each chunk is determined
- * by the parameters passed to SVR_MemPool_new. If a resevation is
- * made that is too big to fit into a chunk then it is allocated
- * directly using malloc.
+ * a chunk in the total arena. Each chunk is a block taken from the block
+ * allocator given to SVR_Arena_alloc with its descriptor stored at the start
+ * of the block. If a resevation is made that is too big to fit into a chunk
+ * then it is allocated directly using malloc.
  */
 struct SVR_Arena_s {
     /**
@@ -39,6 +39,11 @@ struct SVR_Arena_s {
      */
     size_t write_index;
 
+    /**
+     * The number of usable bytes starting at base
+     */
+    size_t size;
+
     /**
      * The block this allocation was made from or NULL if this block is
      * directly allocated using malloc
@@ -49,6 +54,18 @@ struct SVR_Arena_s {
      * Pointer to the next chunk in this arena
      */
     struct SVR_Arena_s* next;
+
+    /**
+     * The chunk reservations are currently made from. Only valid for the
+     * first chunk of an arena
+     */
+    struct SVR_Arena_s* current;
+
+    /**
+     * Directly allocated chunks for oversized reservations. Only valid for the
+     * first chunk of an arena
+     */
+    struct SVR_Arena_s* large;
 };
 
 /** \} */
@@ -62,5 +79,6 @@ void* SVR_Arena_write(SVR_Arena* alloc, const void* data, size_t size);
 void* SVR_Arena_strdup(SVR_Arena* alloc, const char* s);
 void* SVR_Arena_reserve(SVR_Arena* alloc, size_t size);
 void SVR_Arena_free(SVR_Arena* alloc);
+void SVR_Arena_reset(SVR_Arena* alloc);
 
 #endif // #ifndef __SVR_ARENA_H
@@ -37,6 +37,14 @@ struct SVR_Message_s {
      */
     unsigned short count;
 
+    /**
+     * A file descriptor passed along with the message, or -1. Descriptors can
+     * only be passed over Unix domain sockets. The message owns the descriptor
+     * and SVR_Message_release closes it, so a receiver keeping it should set
+     * this back to -1
+     */
+    int fd;
+
     /**
      * The Arena allocation that backs this message
      */
@@ -73,6 +81,11 @@ struct SVR_PackedMessage_s {
 
     void* payload;
 
+    /**
+     * File descriptor sent with the message as SCM_RIGHTS ancillary data, or -1
+     */
+    int fd;
+
     /**
      * The Arena allocation that backs this message
      */
@@ -84,7 +97,10 @@ struct SVR_PackedMessage_s {
 void SVR_Message_init(void);
 
 SVR_Message* SVR_Message_new(unsigned int component_count);
+SVR_Message* SVR_Message_newWithAlloc(unsigned int component_count, SVR_Arena* alloc);
+SVR_Arena* SVR_Message_newArena(void);
 SVR_PackedMessage* SVR_Message_pack(SVR_Message* message);
+void SVR_Message_detach(SVR_Message* message);
 void SVR_Message_release(SVR_Message* message);
 
 SVR_PackedMessage* SVR_PackedMessage_new(size_t packed_length);
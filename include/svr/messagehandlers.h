@@ -2,8 +2,10 @@
 #ifndef __SVR_MESSAGEHANDLERS_H
 #define __SVR_MESSAGEHANDLERS_H
 
-int SVR_MessageHandler_streamOrphaned(SVR_Message* message);
-int SVR_MessageHandler_data(SVR_Message* message);
-int SVR_MessageHandler_kick(SVR_Message* message);
+int SVR_MessageHandler_streamOrphaned(SVR_Context* context, SVR_Message* message);
+int SVR_MessageHandler_streamAdjusted(SVR_Context* context, SVR_Message* message);
+int SVR_MessageHandler_sourceCredit(SVR_Context* context, SVR_Message* message);
+int SVR_MessageHandler_data(SVR_Context* context, SVR_Message* message);
+int SVR_MessageHandler_kick(SVR_Context* context, SVR_Message* message);
 
 #endif // #ifndef __SVR_MESSAGEHANDLERS_H
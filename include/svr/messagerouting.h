@@ -3,6 +3,6 @@
 #define __SVR_MESSAGEROUTING_H
 
 void SVR_MessageRouter_init(void);
-int SVR_MessageRouter_processMessage(SVR_Message* message);
+int SVR_MessageRouter_processMessage(SVR_Context* context, SVR_Message* message);
 
 #endif // #ifndef __SVR_MESSAGEROUTING_H
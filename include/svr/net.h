@@ -2,9 +2,77 @@
 #ifndef __SVR_NET_H
 #define __SVR_NET_H
 
+/** TCP port the server listens on */
+#define SVR_DEFAULT_PORT 33560
+
+/** Path of the server's Unix domain socket */
+#define SVR_DEFAULT_UNIX_PATH "/tmp/svr.sock"
+
+/* Frames sent over a datagram transport are split into datagrams. Each starts
+   with a header holding SVR_DATAGRAM_MAGIC, the frame ID, the size of the whole
+   frame and the offset of the datagram's data within the frame */
+#define SVR_DATAGRAM_MAGIC 0x5356
+#define SVR_DATAGRAM_HEADER_LEN 14
+#define SVR_DATAGRAM_MAX_SIZE 65507
+
+/** Receive buffer size of a SVR_NetReader, enough for a few maximum size messages */
+#define SVR_NETREADER_BUFFER_SIZE (256 * 1024)
+
+/** Number of received file descriptors a SVR_NetReader holds until their messages are parsed */
+#define SVR_NETREADER_MAX_FDS 4
+
+/**
+ * \brief Buffered message reader
+ *
+ * Receives from a socket with large reads into a single buffer and parses
+ * messages in place. Messages returned reference the buffer directly.
+ */
+struct SVR_NetReader_s {
+    /**
+     * Socket to read from
+     */
+    int socket;
+
+    /**
+     * Receive buffer of SVR_NETREADER_BUFFER_SIZE bytes
+     */
+    uint8_t* buffer;
+
+    /**
+     * Offset of the first unparsed byte in the buffer
+     */
+    size_t start;
+
+    /**
+     * Offset of the end of received data in the buffer
+     */
+    size_t end;
+
+    /**
+     * File descriptors received but not yet matched to a message
+     */
+    int fds[SVR_NETREADER_MAX_FDS];
+
+    /**
+     * Buffer offset at which the read carrying each file descriptor ended. The
+     * descriptor belongs to the message which spans this offset
+     */
+    size_t fd_ends[SVR_NETREADER_MAX_FDS];
+
+    /**
+     * Number of pending file descriptors
+     */
+    int fd_count;
+};
+
+bool SVR_Net_isLocal(int socket);
 int SVR_Net_sendPackedMessage(int socket, SVR_PackedMessage* packed_message);
 int SVR_Net_sendMessage(int socket, SVR_Message* message);
 SVR_Message* SVR_Net_receiveMessage(int socket);
 int SVR_Net_receivePayload(int socket, SVR_Message* message);
 
+SVR_NetReader* SVR_NetReader_new(int socket);
+void SVR_NetReader_destroy(SVR_NetReader* reader);
+SVR_Message* SVR_NetReader_receiveMessage(SVR_NetReader* reader);
+
 #endif // #ifndef __SVR_NET_H
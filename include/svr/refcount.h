@@ -9,6 +9,9 @@ struct SVR_RefCounter_s {
     void (*cleanup)(void*);
     void* object;
 
+    /* Next counter in the garbage collection queue */
+    SVR_RefCounter* next;
+
     SVR_LOCKABLE;
 };
 
@@ -4,21 +4,46 @@
 
 #include <svr/forward.h>
 
+/* Called with the response to a request, in the thread setting it. The
+   callback takes ownership of the response */
+typedef void (*SVR_ResponseCallback)(void* response, void* data);
+
+/* Request ID slot. Each slot has its own condition, so a response only wakes
+   the thread waiting for it */
+typedef struct {
+    bool pending;
+    void* response;
+    SVR_ResponseCallback callback;
+    void* callback_data;
+    pthread_cond_t answered;
+
+    /* Next slot in the free list, or -1 */
+    int next_free;
+} SVR_ResponseSlot;
+
 struct SVR_ResponseSet_s {
-    bool* response_pending;
-    void** response;
+    /* Slots indexed by request ID. Slots are allocated separately so their
+       conditions stay in place as the table grows */
+    SVR_ResponseSlot** slots;
     int max_request_id;
-    int next_request_id;
     int set_size;
 
-    pthread_cond_t new_response;
+    /* Free slots, oldest first so a freed ID is reused as late as possible */
+    int free_head;
+    int free_tail;
+
+    /* Requests without a response yet, or whose callback is running */
+    int outstanding;
+    pthread_cond_t all_answered;
     SVR_LOCKABLE;
 };
 
 SVR_ResponseSet* SVR_ResponseSet_new(int max_request_id);
 void SVR_ResponseSet_destroy(SVR_ResponseSet* response_set);
 int SVR_ResponseSet_getRequestId(SVR_ResponseSet* response_set);
+int SVR_ResponseSet_getCallbackRequestId(SVR_ResponseSet* response_set, SVR_ResponseCallback callback, void* data);
 void* SVR_ResponseSet_getResponse(SVR_ResponseSet* response_set, int response_id);
 int SVR_ResponseSet_setResponse(SVR_ResponseSet* response_set, int response_id, void* response);
+void SVR_ResponseSet_waitAll(SVR_ResponseSet* response_set);
 
 #endif // #ifndef __SVR_RESPONSESET_H
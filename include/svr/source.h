@@ -4,7 +4,18 @@
 
 #include <svr/forward.h>
 
+/* Largest payload of a Data message, whose size is sent in 16 bits */
+#define SVR_SOURCE_MAX_CHUNK_SIZE (60 * 1024)
+
+/* Called once a frame given to an asynchronous source is sent, or dropped
+   with SVR_OVERLOADED for a newer frame. sequence counts the frames given to
+   SVR_Source_sendFrame before this one */
+typedef void (*SVR_SourceCallback)(SVR_Source* source, unsigned int sequence, int return_code, void* data);
+
 struct SVR_Source_s {
+    /* Connection the source is provided over */
+    SVR_Context* context;
+
     char* name;
     SVR_Encoding* encoding;
     Dictionary* encoding_options;
@@ -12,16 +23,67 @@ struct SVR_Source_s {
     SVR_FrameProperties* frame_properties;
     void* payload_buffer;
     size_t payload_buffer_size;
+
+    /* Asynchronous upload. Copies of the newest frames wait in a ring of
+       upload_capacity frames, NULL if frames are sent synchronously, for the
+       upload thread to encode and send */
+    IplImage** upload_frames;
+    int upload_capacity;
+    int upload_head;
+    int upload_count;
+    unsigned int frames_submitted;
+    bool upload_busy;
+    bool upload_closing;
+    SVR_SourceCallback upload_callback;
+    void* upload_callback_data;
+    pthread_t upload_thread;
+    pthread_mutex_t upload_lock;
+    pthread_cond_t upload_changed;
+
+    /* Flow control. The server grants a credit for each frame it may be sent
+       and returns one as it takes each frame in, and frames are skipped while
+       there is none. Servers without flow control grant nothing, leaving
+       flow_control false. Protected by upload_lock */
+    bool flow_control;
+    int credits;
+    unsigned int frames_sent;
+    unsigned int frames_skipped;
+};
+
+/* Frame counters of a client source */
+struct SVR_SourceStats_s {
+    /* Frames sent to the server, counted by the client */
+    unsigned int frames_sent;
+
+    /* Frames the client skipped for want of credit or room in its upload queue,
+       counted by the client */
+    unsigned int frames_skipped;
+
+    /* Frames the server decoded */
+    unsigned int frames_received;
+
+    /* Frames the server replaced with a newer frame before any stream took them */
+    unsigned int frames_dropped;
 };
 
 SVR_Source* SVR_Source_new(const char* name);
+SVR_Source* SVR_Source_newOn(SVR_Context* context, const char* name);
 int SVR_Source_destroy(SVR_Source* source);
 int SVR_Source_setEncoding(SVR_Source* source, const char* encoding_name);
 int SVR_Source_setFrameProperties(SVR_Source* source, SVR_FrameProperties* frame_properties);
 int SVR_Source_sendFrame(SVR_Source* source, IplImage* frame);
+int SVR_Source_setAsync(SVR_Source* source, int queue_length, SVR_SourceCallback callback, void* data);
+void SVR_Source_flush(SVR_Source* source);
+int SVR_Source_getStats(SVR_Source* source, SVR_SourceStats* stats);
+void SVR_Source_grantCredits(SVR_Context* context, const char* name, int credits);
 int SVR_openServerSource(const char* name, const char* descriptor);
+int SVR_openServerSourceOn(SVR_Context* context, const char* name, const char* descriptor);
 int SVR_closeServerSource(const char* name);
+int SVR_closeServerSourceOn(SVR_Context* context, const char* name);
 List* SVR_getSourcesList(void);
+List* SVR_getSourcesListOn(SVR_Context* context);
 void SVR_freeSourcesList(List* sources_list);
+int SVR_getSourceStats(const char* name, SVR_SourceStats* stats);
+int SVR_getSourceStatsOn(SVR_Context* context, const char* name, SVR_SourceStats* stats);
 
 #endif // #ifndef __SVR_SOURCE_H
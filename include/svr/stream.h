@@ -6,41 +6,182 @@
 #include <svr/lockable.h>
 #include <svr/cv.h>
 
+/* Initial size of the buffer holding received data until it is decoded */
+#define SVR_STREAM_DECODE_QUEUE_SIZE (2 * 1024 * 1024)
+
 typedef enum {
     SVR_PAUSED,
     SVR_UNPAUSED
 } SVR_StreamState;
 
+/* Thread a frame callback is called on */
+typedef enum {
+    /* The stream's decode thread, for every frame as soon as it is decoded.
+       Decoding waits while the callback runs */
+    SVR_CALLBACK_DECODE_THREAD,
+
+    /* A thread of the callback's own, with the newest frame. Frames decoded
+       while the callback runs replace each other, so only the newest is
+       passed on */
+    SVR_CALLBACK_OWN_THREAD
+} SVR_CallbackThread;
+
 struct SVR_Stream_s {
+    /* Connection the stream is open over */
+    SVR_Context* context;
+
     char* stream_name;
     char* source_name;
-    IplImage* current_frame;
     SVR_StreamState state;
     SVR_FrameProperties* frame_properties;
     SVR_Encoding* encoding;
     SVR_Decoder* decoder;
     bool orphaned;
 
+    /* Pull mode state. frames_requested counts requests sent to the server
+       which have not yet been answered with a frame */
+    bool pull_mode;
+    int frames_requested;
+
+    /* Degrade level the server applied to the stream while overloaded, 0 if
+       the stream is running as configured */
+    int degrade_level;
+
+    /* Receives the frames of the stream if it uses a datagram transport */
+    SVR_DatagramReceiver* receiver;
+
+    /* Received data waiting for the stream's decode thread. The receive
+       thread, a datagram receiver and a leader's decode thread all queue
+       chunks, so each push is made under chunks_lock */
+    SVR_ChunkQueue* chunks;
+    pthread_mutex_t chunks_lock;
+    pthread_t decode_thread;
+
+    /* Frames decoded so far */
+    unsigned int frames_decoded;
+
+    /* Frame waiting for SVR_Stream_getFrame, and the frames it handed out
+       which have not been returned yet */
+    SVR_Frame* current_frame;
+    List* lent_frames;
+
+    /* Settings changing the frames sent which the client set, compared to
+       find streams which can share frames. NULL and -1 are the server's
+       defaults */
+    char* encoding_descriptor;
+    int drop_rate;
+    int max_rate;
+    int max_age;
+    int priority;
+
+    /* Subscription sharing. A follower's server stream stays paused while it
+       is given the frames its leader decodes, and the newest of them waits in
+       shared_frame for its decode thread. Leaders and followers are linked
+       under the context's stream list lock and share lock */
+    bool shared;
+    SVR_Stream* leader;
+    List* followers;
+    SVR_Frame* shared_frame;
+
+    /* Decoders write into frames from this allocator, or the frame pool */
+    SVR_FrameAllocator* frame_allocator;
+
+    /* Frames are passed to the callback instead of being kept for
+       SVR_Stream_getFrame. callback_lock is held while they are delivered on
+       the decode thread */
+    SVR_FrameCallback frame_callback;
+    void* frame_callback_data;
+    SVR_CallbackThread callback_thread;
+    pthread_mutex_t callback_lock;
+
+    /* Newest frame waiting for a callback's own thread */
+    SVR_Frame* callback_frame;
+    pthread_cond_t callback_frame_ready;
+    pthread_t callback_worker;
+    bool callback_worker_running;
+
+    /* Readable while a frame is waiting for SVR_Stream_getFrame, or once the
+       stream is orphaned */
+    int event_fd;
+    bool event_set;
+
     pthread_cond_t new_frame;
     SVR_LOCKABLE;
 };
 
+/* Frame counters of a stream, kept by the server */
+struct SVR_StreamStats_s {
+    /* Frames sent to the client */
+    unsigned int frames_sent;
+
+    /* Frames skipped due to the drop rate */
+    unsigned int frames_dropped;
+
+    /* Frames discarded for exceeding the maximum age */
+    unsigned int frames_expired;
+
+    /* Frames lost in transit over a datagram transport, counted by the client */
+    unsigned int frames_lost;
+};
+
+/* Settings applied together by SVR_Stream_configure. Negative values, and a
+   NULL encoding, leave a setting as it is */
+struct SVR_StreamConfig_s {
+    /* Encoding option string */
+    const char* encoding;
+
+    /* Frame size, set together */
+    int width;
+    int height;
+
+    /* 1 for grayscale, 3 for color */
+    int channels;
+
+    int drop_rate;
+    int max_rate;
+    int max_age;
+    int priority;
+
+    /* Unpause the stream once configured */
+    bool unpause;
+};
+
 void SVR_Stream_init(void);
 SVR_Stream* SVR_Stream_new(const char* source);
+SVR_Stream* SVR_Stream_newOn(SVR_Context* context, const char* source);
+int SVR_Stream_newMany(const char** source_names, int count, SVR_Stream** streams);
+int SVR_Stream_newManyOn(SVR_Context* context, const char** source_names, int count, SVR_Stream** streams);
+int SVR_Stream_newConfigured(const char** source_names, int count, SVR_StreamConfig* config, SVR_Stream** streams);
+int SVR_Stream_newConfiguredOn(SVR_Context* context, const char** source_names, int count, SVR_StreamConfig* config,
+                               SVR_Stream** streams);
+void SVR_StreamConfig_init(SVR_StreamConfig* config);
+int SVR_Stream_configure(SVR_Stream* stream, SVR_StreamConfig* config);
 void SVR_Stream_destroy(SVR_Stream* stream);
 int SVR_Stream_setEncoding(SVR_Stream* stream, const char* encoding);
 int SVR_Stream_resize(SVR_Stream* stream, int width, int height);
 int SVR_Stream_setGrayscale(SVR_Stream* stream, bool grayscale);
 int SVR_Stream_setPriority(SVR_Stream* stream, short priority);
 int SVR_Stream_setDropRate(SVR_Stream* stream, int drop_rate);
+int SVR_Stream_setMaxRate(SVR_Stream* stream, int max_rate);
+int SVR_Stream_setMaxAge(SVR_Stream* stream, int max_age);
+int SVR_Stream_getStats(SVR_Stream* stream, SVR_StreamStats* stats);
+int SVR_Stream_setTransport(SVR_Stream* stream, const char* transport_descriptor);
+int SVR_Stream_setPullMode(SVR_Stream* stream, bool pull_mode);
+int SVR_Stream_setFrameCallback(SVR_Stream* stream, SVR_FrameCallback callback, void* data, SVR_CallbackThread thread);
+int SVR_Stream_setFrameAllocator(SVR_Stream* stream, SVR_FrameAllocator* frame_allocator);
+int SVR_Stream_setShared(SVR_Stream* stream, bool shared);
+int SVR_Stream_requestFrame(SVR_Stream* stream);
 int SVR_Stream_unpause(SVR_Stream* stream);
 int SVR_Stream_pause(SVR_Stream* stream);
 SVR_FrameProperties* SVR_Stream_getFrameProperties(SVR_Stream* stream);
 IplImage* SVR_Stream_getFrame(SVR_Stream* stream, bool wait);
 void SVR_Stream_returnFrame(SVR_Stream* stream, IplImage* frame);
 bool SVR_Stream_isOrphaned(SVR_Stream* stream);
-void SVR_Stream_setOrphaned(const char* stream_name);
+void SVR_Stream_setOrphaned(SVR_Context* context, const char* stream_name);
+void SVR_Stream_setAdjusted(SVR_Context* context, const char* stream_name, int level, const char* frame_properties_string);
 void SVR_Stream_sync(void);
-void SVR_Stream_provideData(const char* stream_name, void* buffer, size_t n);
+int SVR_Stream_getEventFd(SVR_Stream* stream);
+int SVR_Stream_waitAny(SVR_Stream** streams, int count, int timeout);
+void SVR_Stream_provideData(SVR_Context* context, const char* stream_name, void* buffer, size_t n);
 
 #endif // #ifndef __SVR_STREAM_H
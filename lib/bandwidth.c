@@ -0,0 +1,65 @@
+/**
+ * \file
+ * \brief Bandwidth limits
+ */
+
+#include <svr.h>
+
+static int SVR_setBandwidthLimit(const char* scope, unsigned long bits_per_second);
+
+/**
+ * \defgroup Bandwidth Bandwidth
+ * \brief Limit the data sent by the server
+ *
+ * The server limits the data it sends with token buckets, one shared by all
+ * clients and one for each client. Frames which would exceed a limit are
+ * dropped rather than queued. While a limit is contended each stream is given
+ * a share in proportion to its priority, and streams sending more than their
+ * share lose frames first.
+ *
+ * \{
+ */
+
+/**
+ * Set the limit with the given scope, "server" or "client"
+ */
+static int SVR_setBandwidthLimit(const char* scope, unsigned long bits_per_second) {
+    SVR_Message* message;
+    SVR_Message* response;
+    int return_code;
+
+    message = SVR_Message_new(3);
+    message->components[0] = SVR_Arena_strdup(message->alloc, "Bandwidth.setLimit");
+    message->components[1] = SVR_Arena_strdup(message->alloc, scope);
+    message->components[2] = SVR_Arena_sprintf(message->alloc, "%lu", bits_per_second);
+
+    response = SVR_Comm_sendMessage(message, true);
+    return_code = SVR_Comm_parseResponse(response);
+
+    SVR_Message_release(message);
+    SVR_Message_release(response);
+
+    return return_code;
+}
+
+/**
+ * \brief Limit all data sent by the server
+ *
+ * \param bits_per_second The limit, or 0 to remove the limit
+ * \return An SVR return code
+ */
+int SVR_setServerBandwidth(unsigned long bits_per_second) {
+    return SVR_setBandwidthLimit("server", bits_per_second);
+}
+
+/**
+ * \brief Limit the data sent by the server to this client
+ *
+ * \param bits_per_second The limit, or 0 to remove the limit
+ * \return An SVR return code
+ */
+int SVR_setClientBandwidth(unsigned long bits_per_second) {
+    return SVR_setBandwidthLimit("client", bits_per_second);
+}
+
+/** \} */
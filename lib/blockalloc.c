@@ -7,13 +7,44 @@
 
 #define DEFAULT_GROW_SIZE 4
 
+/* Chunks double in size as an allocator grows, up to this many blocks */
+#define MAX_CHUNK_BLOCKS 1024
+
+/* Number of blocks each thread may cache per allocator */
+#define MAGAZINE_SIZE 32
+
+typedef struct {
+    void* base;
+    size_t num_blocks;
+} SVR_BlockChunk;
+
+typedef struct {
+    SVR_BlockAllocator* allocator;
+    size_t count;
+    void* blocks[MAGAZINE_SIZE];
+} SVR_BlockMagazine;
+
 static List* shared_allocators = NULL;
 static pthread_mutex_t piles_lock = PTHREAD_MUTEX_INITIALIZER;
 
+static SVR_BlockMagazine* SVR_BlockAlloc_getMagazine(SVR_BlockAllocator* allocator);
+static void SVR_BlockAlloc_destroyMagazine(void* _magazine);
+static void SVR_BlockAlloc_flushMagazine(SVR_BlockMagazine* magazine, size_t keep);
+static void SVR_BlockAlloc_refillMagazine(SVR_BlockMagazine* magazine);
+static void SVR_BlockAlloc_grow(SVR_BlockAllocator* allocator);
+static int SVR_BlockAlloc_compareBlocks(const void* a, const void* b);
+
 /**
  * \defgroup BlockAlloc Block allocator
  * \ingroup Util
  * \brief Fast allocator for fixed sized blocks
+ *
+ * Each thread keeps a small cache (magazine) of blocks for every allocator it
+ * uses, so the allocator lock is only taken when a magazine needs to be
+ * refilled or flushed. An allocator created once the process has run out of
+ * thread specific data keys has no magazines and takes its lock on every
+ * allocation.
+ *
  * \{
  */
 
@@ -47,19 +78,27 @@ void SVR_BlockAlloc_close(void) {
  * Create a new block allocator
  *
  * \param block_size Size of blocks to allocate in bytes
- * \param grow_size Number of blocks to allocate at once
+ * \param grow_size Number of blocks to allocate for the first chunk. Each
+ * following chunk is twice the size of the previous one.
  * \return New block allocator
  */
 SVR_BlockAllocator* SVR_BlockAlloc_newAllocator(size_t block_size, size_t grow_size) {
     SVR_BlockAllocator* allocator;
 
     allocator = malloc(sizeof(SVR_BlockAllocator));
+    allocator->has_magazines = true;
+    if(pthread_key_create(&allocator->magazine_key, &SVR_BlockAlloc_destroyMagazine) != 0) {
+        SVR_log(SVR_WARNING, "Out of thread keys, block allocator will not cache blocks per thread");
+        allocator->has_magazines = false;
+    }
+
     allocator->block_size = block_size;
     allocator->grow_size = grow_size;
     allocator->num_blocks = 0;
     allocator->index = 0;
     allocator->chunks = List_new();
     allocator->blocks = NULL;
+    allocator->magazines = List_new();
     pthread_mutex_init(&allocator->lock, NULL);
 
     return allocator;
@@ -68,17 +107,36 @@ SVR_BlockAllocator* SVR_BlockAlloc_newAllocator(size_t block_size, size_t grow_s
 /**
  * \brief Free a block allocator
  *
- * Free a previously allocated block allocator
+ * Free a previously allocated block allocator. No other thread may be using
+ * the allocator, or exiting after having used it, when it is freed. The
+ * magazines of all threads are freed with it.
  *
  * \param allocator The allocator to free
  */
 void SVR_BlockAlloc_freeAllocator(SVR_BlockAllocator* allocator) {
-    void* chunk;
+    SVR_BlockMagazine* magazine;
+    SVR_BlockChunk* chunk;
+
+    /* Deleting the key keeps the magazine destructor from running when the
+       other threads exit, so their magazines are freed here. The blocks they
+       cache belong to chunks freed below */
+    if(allocator->has_magazines) {
+        pthread_setspecific(allocator->magazine_key, NULL);
+        pthread_key_delete(allocator->magazine_key);
+    }
 
-    while((chunk = List_get(allocator->chunks, 0)) != NULL) {
+    while((magazine = List_remove(allocator->magazines, 0)) != NULL) {
+        free(magazine);
+    }
+    List_destroy(allocator->magazines);
+
+    while((chunk = List_remove(allocator->chunks, 0)) != NULL) {
+        free(chunk->base);
         free(chunk);
     }
 
+    List_destroy(allocator->chunks);
+    pthread_mutex_destroy(&allocator->lock);
     free(allocator->blocks);
     free(allocator);
 }
@@ -138,27 +196,26 @@ void* SVR_BlockAlloc_alloc(SVR_BlockAllocator* allocator) {
 #ifdef SVR_DUMMY_ALLOC
     p = malloc(allocator->block_size);
 #else
-    pthread_mutex_lock(&allocator->lock);
+    SVR_BlockMagazine* magazine = SVR_BlockAlloc_getMagazine(allocator);
 
-    if(allocator->index == 0) {
-        /* No blocks are available, so allocate a new chunk */
-        allocator->num_blocks += allocator->grow_size;
-        allocator->blocks = realloc(allocator->blocks, allocator->num_blocks * sizeof(void*));
-        allocator->index = allocator->grow_size;
-
-        allocator->blocks[0] = malloc(allocator->block_size * allocator->grow_size);
-
-        for(int i = 1; i < allocator->index; i++) {
-            allocator->blocks[i] = ((uint8_t*)allocator->blocks[0]) + (i * allocator->block_size);
+    if(magazine == NULL) {
+        pthread_mutex_lock(&allocator->lock);
+        if(allocator->index == 0) {
+            SVR_BlockAlloc_grow(allocator);
         }
+        allocator->index--;
+        p = allocator->blocks[allocator->index];
+        pthread_mutex_unlock(&allocator->lock);
 
-        List_append(allocator->chunks, allocator->blocks[0]);
+        return p;
     }
 
-    allocator->index -= 1;
-    p = allocator->blocks[allocator->index];
+    if(magazine->count == 0) {
+        SVR_BlockAlloc_refillMagazine(magazine);
+    }
 
-    pthread_mutex_unlock(&allocator->lock);
+    magazine->count -= 1;
+    p = magazine->blocks[magazine->count];
 #endif
 
     return p;
@@ -177,11 +234,231 @@ void SVR_BlockAlloc_free(SVR_BlockAllocator* allocator, void* p) {
 #ifdef SVR_DUMMY_ALLOC
     free(p);
 #else
+    SVR_BlockMagazine* magazine = SVR_BlockAlloc_getMagazine(allocator);
+
+    if(magazine == NULL) {
+        pthread_mutex_lock(&allocator->lock);
+        allocator->blocks[allocator->index] = p;
+        allocator->index++;
+        pthread_mutex_unlock(&allocator->lock);
+        return;
+    }
+
+    if(magazine->count == MAGAZINE_SIZE) {
+        SVR_BlockAlloc_flushMagazine(magazine, MAGAZINE_SIZE / 2);
+    }
+
+    magazine->blocks[magazine->count] = p;
+    magazine->count++;
+#endif
+}
+
+/**
+ * \brief Release unused memory
+ *
+ * Return every chunk of the allocator which has no blocks in use to the
+ * system. Blocks cached by the calling thread are given back to the allocator
+ * first, but blocks cached by other threads keep their chunks alive.
+ *
+ * \param allocator The allocator to trim
+ * \return Number of bytes released
+ */
+size_t SVR_BlockAlloc_trim(SVR_BlockAllocator* allocator) {
+#ifdef SVR_DUMMY_ALLOC
+    return 0;
+#else
+    SVR_BlockMagazine* magazine = SVR_BlockAlloc_getMagazine(allocator);
+    SVR_BlockChunk* chunk;
+    uintptr_t chunk_start, chunk_end;
+    size_t released = 0;
+    size_t first, last, lower, upper;
+    size_t j;
+    int i = 0;
+
+    if(magazine) {
+        SVR_BlockAlloc_flushMagazine(magazine, 0);
+    }
+
     pthread_mutex_lock(&allocator->lock);
-    allocator->blocks[allocator->index] = p;
-    allocator->index++;
+
+    /* Sort the free blocks by address so the free blocks of each chunk are
+       contiguous in the free list */
+    qsort(allocator->blocks, allocator->index, sizeof(void*), &SVR_BlockAlloc_compareBlocks);
+
+    while((chunk = List_get(allocator->chunks, i)) != NULL) {
+        chunk_start = (uintptr_t) chunk->base;
+        chunk_end = chunk_start + chunk->num_blocks * allocator->block_size;
+
+        /* Find the first free block at or after the chunk start */
+        lower = 0;
+        upper = allocator->index;
+        while(lower < upper) {
+            first = (lower + upper) / 2;
+            if((uintptr_t) allocator->blocks[first] < chunk_start) {
+                lower = first + 1;
+            } else {
+                upper = first;
+            }
+        }
+        first = lower;
+
+        for(last = first; last < allocator->index && (uintptr_t) allocator->blocks[last] < chunk_end; last++);
+
+        if(last - first < chunk->num_blocks) {
+            i++;
+            continue;
+        }
+
+        /* Every block of the chunk is free */
+        for(j = last; j < allocator->index; j++) {
+            allocator->blocks[j - chunk->num_blocks] = allocator->blocks[j];
+        }
+        allocator->index -= chunk->num_blocks;
+        allocator->num_blocks -= chunk->num_blocks;
+        released += chunk->num_blocks * allocator->block_size;
+
+        List_remove(allocator->chunks, i);
+        free(chunk->base);
+        free(chunk);
+    }
+
     pthread_mutex_unlock(&allocator->lock);
+
+    return released;
 #endif
 }
 
 /** \} */
+
+/**
+ * \brief Get the calling thread's magazine
+ *
+ * Get the magazine of the calling thread for the given allocator, creating it
+ * if needed
+ *
+ * \param allocator A block allocator
+ * \return The calling thread's magazine, or NULL if the allocator has none
+ */
+static SVR_BlockMagazine* SVR_BlockAlloc_getMagazine(SVR_BlockAllocator* allocator) {
+    SVR_BlockMagazine* magazine;
+
+    if(allocator->has_magazines == false) {
+        return NULL;
+    }
+
+    magazine = pthread_getspecific(allocator->magazine_key);
+
+    if(magazine == NULL) {
+        magazine = malloc(sizeof(SVR_BlockMagazine));
+        magazine->allocator = allocator;
+        magazine->count = 0;
+        pthread_setspecific(allocator->magazine_key, magazine);
+
+        pthread_mutex_lock(&allocator->lock);
+        List_append(allocator->magazines, magazine);
+        pthread_mutex_unlock(&allocator->lock);
+    }
+
+    return magazine;
+}
+
+/**
+ * \brief Release a magazine
+ *
+ * Called on thread exit to return the thread's cached blocks to the allocator
+ *
+ * \param _magazine The magazine to release
+ */
+static void SVR_BlockAlloc_destroyMagazine(void* _magazine) {
+    SVR_BlockMagazine* magazine = _magazine;
+    SVR_BlockAllocator* allocator = magazine->allocator;
+
+    SVR_BlockAlloc_flushMagazine(magazine, 0);
+
+    pthread_mutex_lock(&allocator->lock);
+    List_remove(allocator->magazines, List_indexOf(allocator->magazines, magazine));
+    pthread_mutex_unlock(&allocator->lock);
+
+    free(magazine);
+}
+
+/**
+ * \brief Return cached blocks to the allocator
+ *
+ * Move blocks from the magazine back to the allocator's free list
+ *
+ * \param magazine The magazine to flush
+ * \param keep Number of blocks to leave in the magazine
+ */
+static void SVR_BlockAlloc_flushMagazine(SVR_BlockMagazine* magazine, size_t keep) {
+    SVR_BlockAllocator* allocator = magazine->allocator;
+
+    pthread_mutex_lock(&allocator->lock);
+    while(magazine->count > keep) {
+        magazine->count--;
+        allocator->blocks[allocator->index] = magazine->blocks[magazine->count];
+        allocator->index++;
+    }
+    pthread_mutex_unlock(&allocator->lock);
+}
+
+/**
+ * \brief Fill an empty magazine
+ *
+ * Move half a magazine worth of blocks from the allocator's free list to the
+ * magazine, growing the allocator if needed
+ *
+ * \param magazine The magazine to refill
+ */
+static void SVR_BlockAlloc_refillMagazine(SVR_BlockMagazine* magazine) {
+    SVR_BlockAllocator* allocator = magazine->allocator;
+
+    pthread_mutex_lock(&allocator->lock);
+
+    if(allocator->index == 0) {
+        SVR_BlockAlloc_grow(allocator);
+    }
+
+    while(allocator->index > 0 && magazine->count < MAGAZINE_SIZE / 2) {
+        allocator->index--;
+        magazine->blocks[magazine->count] = allocator->blocks[allocator->index];
+        magazine->count++;
+    }
+
+    pthread_mutex_unlock(&allocator->lock);
+}
+
+/**
+ * \brief Add a chunk to an allocator
+ *
+ * Allocate a new chunk of blocks and add them to the free list. The allocator
+ * must be locked.
+ *
+ * \param allocator The allocator to grow
+ */
+static void SVR_BlockAlloc_grow(SVR_BlockAllocator* allocator) {
+    SVR_BlockChunk* chunk = malloc(sizeof(SVR_BlockChunk));
+
+    chunk->num_blocks = allocator->grow_size;
+    chunk->base = malloc(allocator->block_size * chunk->num_blocks);
+    List_append(allocator->chunks, chunk);
+
+    /* The free list only needs to grow along with the total block count, and
+       since chunks grow geometrically this happens rarely */
+    allocator->num_blocks += chunk->num_blocks;
+    allocator->blocks = realloc(allocator->blocks, allocator->num_blocks * sizeof(void*));
+
+    for(size_t i = 0; i < chunk->num_blocks; i++) {
+        allocator->blocks[allocator->index] = ((uint8_t*)chunk->base) + (i * allocator->block_size);
+        allocator->index++;
+    }
+
+    allocator->grow_size = Util_min(allocator->grow_size * 2, MAX_CHUNK_BLOCKS);
+}
+
+static int SVR_BlockAlloc_compareBlocks(const void* a, const void* b) {
+    uintptr_t block_a = (uintptr_t) *((void**)a);
+    uintptr_t block_b = (uintptr_t) *((void**)b);
+
+    return (block_a > block_b) - (block_a < block_b);
+}
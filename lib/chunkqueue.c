@@ -0,0 +1,298 @@
+/**
+ * \file
+ * \brief Chunk queue
+ */
+
+#include <svr.h>
+
+/* Chunks start on this alignment within the buffer */
+#define CHUNK_ALIGNMENT 8
+
+/* Tag of the filler written when a chunk does not fit before the end of the
+   buffer */
+#define CHUNK_TAG_WRAP (-1)
+
+typedef struct {
+    int32_t tag;
+    uint32_t size;
+} SVR_ChunkHeader;
+
+static size_t SVR_ChunkQueue_chunkSize(size_t n);
+static SVR_ChunkBuffer* SVR_ChunkQueue_newBuffer(size_t capacity);
+static void SVR_ChunkQueue_freeBuffer(SVR_ChunkBuffer* buffer);
+static void SVR_ChunkQueue_wait(SVR_ChunkQueue* queue);
+static void SVR_ChunkQueue_wake(SVR_ChunkQueue* queue);
+
+/**
+ * \defgroup ChunkQueue Chunk queue
+ * \ingroup Util
+ * \brief Single producer, single consumer queue of data chunks
+ * \{
+ *
+ * The producer copies each chunk into the buffer behind those already queued.
+ * The consumer peeks at the oldest chunk, uses it where it lies in the buffer
+ * and pops it once done. A chunk which would run past the end of the buffer
+ * starts again at its beginning, so every chunk is contiguous.
+ *
+ * A chunk which does not fit, because the consumer has fallen behind or the
+ * chunk is larger than half the buffer, goes into a new buffer at least twice
+ * the size. The consumer frees the old buffer once it has read every chunk in
+ * it, and the queue keeps the larger buffer from then on. The producer is
+ * never held up by the consumer, at the cost of memory while it lags behind.
+ */
+
+/**
+ * \brief Create a chunk queue
+ *
+ * \param capacity Initial size of the buffer in bytes
+ * \return A new chunk queue
+ */
+SVR_ChunkQueue* SVR_ChunkQueue_new(size_t capacity) {
+    SVR_ChunkQueue* queue = malloc(sizeof(SVR_ChunkQueue));
+
+    queue->write_buffer = SVR_ChunkQueue_newBuffer(SVR_ChunkQueue_chunkSize(capacity));
+    queue->read_buffer = queue->write_buffer;
+    queue->peeked = 0;
+    queue->closed = false;
+    queue->waiters = 0;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+
+    return queue;
+}
+
+/**
+ * \brief Destroy a chunk queue
+ *
+ * Neither thread may use the queue any more.
+ *
+ * \param queue The queue to destroy
+ */
+void SVR_ChunkQueue_destroy(SVR_ChunkQueue* queue) {
+    SVR_ChunkBuffer* buffer;
+
+    while(queue->read_buffer) {
+        buffer = queue->read_buffer;
+        queue->read_buffer = buffer->next;
+        SVR_ChunkQueue_freeBuffer(buffer);
+    }
+
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->changed);
+    free(queue);
+}
+
+/**
+ * Space a chunk of n bytes takes in the buffer, header included
+ */
+static size_t SVR_ChunkQueue_chunkSize(size_t n) {
+    return (sizeof(SVR_ChunkHeader) + n + CHUNK_ALIGNMENT - 1) & ~((size_t) CHUNK_ALIGNMENT - 1);
+}
+
+/**
+ * \brief Queue a chunk
+ *
+ * Copy a chunk into the queue. Never waits for the consumer; if the queue is
+ * too full to hold the chunk it grows. Only called by the producer thread.
+ *
+ * \param queue The queue
+ * \param tag Passed to the consumer along with the chunk. Must not be negative
+ * \param data The chunk
+ * \param n Size of the chunk in bytes
+ * \return False if the queue was closed, and the chunk dropped
+ */
+bool SVR_ChunkQueue_push(SVR_ChunkQueue* queue, int tag, const void* data, size_t n) {
+    SVR_ChunkBuffer* buffer = queue->write_buffer;
+    size_t chunk_size = SVR_ChunkQueue_chunkSize(n);
+    SVR_ChunkHeader* header;
+    size_t capacity;
+    size_t position;
+    size_t skip;
+    size_t used;
+
+    if(__atomic_load_n(&queue->closed, __ATOMIC_SEQ_CST)) {
+        return false;
+    }
+
+    /* Chunks do not wrap around the end of the buffer, so skip to its start if
+       the chunk does not fit before the end */
+    position = buffer->head % buffer->capacity;
+    skip = (position + chunk_size > buffer->capacity) ? buffer->capacity - position : 0;
+    used = buffer->head - __atomic_load_n(&buffer->tail, __ATOMIC_SEQ_CST);
+
+    /* With room for two chunks, a chunk would always fit once those before it
+       are read. Rather than wait for that, continue in a larger buffer */
+    if(2 * chunk_size > buffer->capacity || buffer->capacity - used < skip + chunk_size) {
+        capacity = buffer->capacity * 2;
+        while(capacity < 2 * chunk_size) {
+            capacity *= 2;
+        }
+
+        queue->write_buffer = SVR_ChunkQueue_newBuffer(capacity);
+        __atomic_store_n(&buffer->next, queue->write_buffer, __ATOMIC_SEQ_CST);
+
+        buffer = queue->write_buffer;
+        position = 0;
+        skip = 0;
+    }
+
+    if(skip) {
+        header = (SVR_ChunkHeader*) (buffer->data + position);
+        header->tag = CHUNK_TAG_WRAP;
+        header->size = skip;
+        position = 0;
+    }
+
+    header = (SVR_ChunkHeader*) (buffer->data + position);
+    header->tag = tag;
+    header->size = n;
+    memcpy(header + 1, data, n);
+
+    /* Publish the chunk */
+    __atomic_store_n(&buffer->head, buffer->head + skip + chunk_size, __ATOMIC_SEQ_CST);
+    SVR_ChunkQueue_wake(queue);
+
+    return true;
+}
+
+/**
+ * \brief Get the oldest chunk
+ *
+ * Block until a chunk is queued, and point data at it within the queue. The
+ * chunk stays valid until SVR_ChunkQueue_pop is called. Only called by the
+ * consumer thread.
+ *
+ * \param queue The queue
+ * \param tag Set to the tag the chunk was queued with
+ * \param data Set to the chunk
+ * \param n Set to the size of the chunk
+ * \return False once the queue is closed
+ */
+bool SVR_ChunkQueue_peek(SVR_ChunkQueue* queue, int* tag, void** data, size_t* n) {
+    SVR_ChunkBuffer* buffer;
+    SVR_ChunkBuffer* next;
+    SVR_ChunkHeader* header;
+
+    while(true) {
+        SVR_ChunkQueue_wait(queue);
+        if(__atomic_load_n(&queue->closed, __ATOMIC_SEQ_CST)) {
+            return false;
+        }
+
+        /* The producer sets next after its last write to the buffer, so once
+           next is seen an empty buffer stays empty */
+        buffer = queue->read_buffer;
+        next = __atomic_load_n(&buffer->next, __ATOMIC_SEQ_CST);
+        if(__atomic_load_n(&buffer->head, __ATOMIC_SEQ_CST) == buffer->tail) {
+            if(next) {
+                queue->read_buffer = next;
+                SVR_ChunkQueue_freeBuffer(buffer);
+            }
+            continue;
+        }
+
+        header = (SVR_ChunkHeader*) (buffer->data + buffer->tail % buffer->capacity);
+        if(header->tag != CHUNK_TAG_WRAP) {
+            break;
+        }
+
+        __atomic_store_n(&buffer->tail, buffer->tail + header->size, __ATOMIC_SEQ_CST);
+    }
+
+    *tag = header->tag;
+    *data = header + 1;
+    *n = header->size;
+    queue->peeked = SVR_ChunkQueue_chunkSize(header->size);
+
+    return true;
+}
+
+/**
+ * \brief Remove the chunk returned by SVR_ChunkQueue_peek
+ *
+ * \param queue The queue
+ */
+void SVR_ChunkQueue_pop(SVR_ChunkQueue* queue) {
+    SVR_ChunkBuffer* buffer = queue->read_buffer;
+
+    __atomic_store_n(&buffer->tail, buffer->tail + queue->peeked, __ATOMIC_SEQ_CST);
+    queue->peeked = 0;
+}
+
+/**
+ * \brief Close a queue
+ *
+ * Wake the consumer. Any chunk still queued is dropped, and later pushes fail.
+ *
+ * \param queue The queue
+ */
+void SVR_ChunkQueue_close(SVR_ChunkQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    __atomic_store_n(&queue->closed, true, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/** \} */
+
+/**
+ * Allocate an empty ring buffer
+ */
+static SVR_ChunkBuffer* SVR_ChunkQueue_newBuffer(size_t capacity) {
+    SVR_ChunkBuffer* buffer = malloc(sizeof(SVR_ChunkBuffer));
+
+    buffer->data = malloc(capacity);
+    buffer->capacity = capacity;
+    buffer->head = 0;
+    buffer->tail = 0;
+    buffer->next = NULL;
+
+    return buffer;
+}
+
+/**
+ * Free a ring buffer the consumer has read to the end
+ */
+static void SVR_ChunkQueue_freeBuffer(SVR_ChunkBuffer* buffer) {
+    free(buffer->data);
+    free(buffer);
+}
+
+/**
+ * Block the consumer until a chunk is queued or the producer has moved on to
+ * a new buffer. Returns early if the queue is closed
+ */
+static void SVR_ChunkQueue_wait(SVR_ChunkQueue* queue) {
+    SVR_ChunkBuffer* buffer = queue->read_buffer;
+
+    /* Check without the lock first, which is all the common case needs */
+    if(__atomic_load_n(&buffer->head, __ATOMIC_SEQ_CST) != buffer->tail ||
+       __atomic_load_n(&buffer->next, __ATOMIC_SEQ_CST) != NULL) {
+        return;
+    }
+
+    /* Announce the wait before checking again, so the producer either sees
+       the waiter or its change is seen here */
+    pthread_mutex_lock(&queue->lock);
+    __atomic_add_fetch(&queue->waiters, 1, __ATOMIC_SEQ_CST);
+
+    while(__atomic_load_n(&queue->closed, __ATOMIC_SEQ_CST) == false &&
+          __atomic_load_n(&buffer->head, __ATOMIC_SEQ_CST) == buffer->tail &&
+          __atomic_load_n(&buffer->next, __ATOMIC_SEQ_CST) == NULL) {
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+
+    __atomic_sub_fetch(&queue->waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * Wake the consumer if it is waiting
+ */
+static void SVR_ChunkQueue_wake(SVR_ChunkQueue* queue) {
+    if(__atomic_load_n(&queue->waiters, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&queue->lock);
+        pthread_cond_broadcast(&queue->changed);
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
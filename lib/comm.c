@@ -9,17 +9,11 @@
 #include <netinet/in.h>
 #include <pthread.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
-#define MAX_REQUEST_ID ((unsigned int)0xffff)
-
-static int client_sock = -1;
-static pthread_t receive_thread;
-static SVR_ResponseSet* response_set;
-static pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;
-static void* payload_buffer = NULL;
-static int payload_buffer_size = 0;
-
-static void* SVR_Comm_receiveThread(void* _unused);
+/* Connection used by every call without a context */
+static SVR_Context* default_context = NULL;
 
 /**
  * \defgroup ServComm Communication management
@@ -29,84 +23,125 @@ static void* SVR_Comm_receiveThread(void* _unused);
  */
 
 /**
- * \brief Initialize Comm module
+ * \brief Connect to a server over a Unix domain socket
  *
- * Initialize Comm module and connect to SVR server
+ * \param path Path of the server socket, or an empty string for the default
+ * \return A connected socket, or -1 on failure
+ */
+static int SVR_Comm_connectUnix(const char* path) {
+    struct sockaddr_un addr;
+    int sock;
+
+    if(path[0] == '\0') {
+        path = SVR_DEFAULT_UNIX_PATH;
+    }
+
+    if(strlen(path) >= sizeof(addr.sun_path)) {
+        SVR_logf(SVR_ERROR, "Server socket path \"%s\" is too long", path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(sock == -1) {
+        SVR_log(SVR_ERROR, "Unable to create socket");
+        return -1;
+    }
+
+    if(connect(sock, (struct sockaddr*) &addr, sizeof(addr))) {
+        SVR_logf(SVR_ERROR, "Unable to connect to SVR server at \"%s\"", path);
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+/**
+ * \brief Connect to a server over TCP
  *
- * \param server_address IP address of the server as a string
- * \return 0 on success, -1 on failure
+ * \param address IP address of the server
+ * \return A connected socket, or -1 on failure
  */
-int SVR_Comm_init(const char* server_address) {
+static int SVR_Comm_connectInet(const char* address) {
     struct sockaddr_in addr;
+    int sock;
 
     addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = inet_addr(server_address);
-    addr.sin_port = htons(33560);
+    addr.sin_addr.s_addr = inet_addr(address);
+    addr.sin_port = htons(SVR_DEFAULT_PORT);
 
-    client_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if(client_sock == -1) {
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if(sock == -1) {
         SVR_log(SVR_ERROR, "Unable to create socket");
         return -1;
     }
 
-    if(connect(client_sock, (struct sockaddr*) &addr, sizeof(addr))) {
+    if(connect(sock, (struct sockaddr*) &addr, sizeof(addr))) {
         SVR_log(SVR_ERROR, "Unable to connect to SVR server");
+        close(sock);
         return -1;
     }
 
-    response_set = SVR_ResponseSet_new(MAX_REQUEST_ID);
-
-    /* Spawn background thread */
-    pthread_create(&receive_thread, NULL, SVR_Comm_receiveThread, NULL);
+    return sock;
+}
 
-    return 0;
+/**
+ * \brief Open a connection to a server
+ *
+ * Open a connection without the Comm module managing it, e.g. for a server
+ * relaying the streams of another
+ *
+ * \param server_address IP address of the server as a string, or
+ * "unix:PATH" to connect over a Unix domain socket. An empty PATH selects
+ * SVR_DEFAULT_UNIX_PATH
+ * \return A connected socket, or -1 on failure
+ */
+int SVR_Comm_connect(const char* server_address) {
+    if(strncmp(server_address, "unix:", 5) == 0) {
+        return SVR_Comm_connectUnix(server_address + 5);
+    } else {
+        return SVR_Comm_connectInet(server_address);
+    }
 }
 
 /**
- * \brief Background message receive thread
+ * \brief Initialize Comm module
  *
- * Background thread started by SVR_Comm_init and responsible for handling
- * incoming messages and message response
+ * Initialize Comm module and open the default context
  *
- * \param _unused Unused
- * \return Always returns NULL
+ * \param server_address Address of the server, as given to SVR_Comm_connect
+ * \return 0 on success, -1 on failure
  */
-static void* SVR_Comm_receiveThread(void* _unused) {
-    SVR_Message* message;
-    int n;
-
-    while(true) {
-        message = SVR_Net_receiveMessage(client_sock);
-
-        if(message == NULL) {
-            SVR_log(SVR_ERROR, "Server has closed");
-            break;
-        }
-
-        /* Retrieve payload */
-        if(message->payload_size) {
-            if(message->payload_size > payload_buffer_size) {
-                payload_buffer = realloc(payload_buffer, message->payload_size);
-                payload_buffer_size = message->payload_size;
-            }
-
-            message->payload = payload_buffer;
-            n = SVR_Net_receivePayload(client_sock, message);
-            if(n <= 0) {
-                SVR_log(SVR_ERROR, "Server has closed");
-                break;
-            }
-        }
-
-        if(message->request_id) {
-            SVR_ResponseSet_setResponse(response_set, message->request_id - 1, message);
-        } else {
-            SVR_MessageRouter_processMessage(message);
-            SVR_Message_release(message);
-        }
+int SVR_Comm_init(const char* server_address) {
+    default_context = SVR_Context_new(server_address);
+    if(default_context == NULL) {
+        return -1;
     }
 
-    return NULL;
+    return 0;
+}
+
+/**
+ * \brief Get the default context
+ *
+ * \return The context opened by SVR_init, used by every call which does not
+ * take a context
+ */
+SVR_Context* SVR_Comm_getContext(void) {
+    return default_context;
+}
+
+/**
+ * \brief Check whether the server is on this machine
+ *
+ * \return True if the connection to the server is local
+ */
+bool SVR_Comm_isLocal(void) {
+    return SVR_Context_isLocal(default_context);
 }
 
 /**
@@ -124,21 +159,65 @@ static void* SVR_Comm_receiveThread(void* _unused) {
  * \return The response to the message if is_request is true, or NULL otherwise.
  */
 void* SVR_Comm_sendMessage(SVR_Message* message, bool is_request) {
-    void* response = NULL;
+    return SVR_Context_sendMessage(default_context, message, is_request);
+}
 
-    if(is_request) {
-        message->request_id = SVR_ResponseSet_getRequestId(response_set) + 1;
-    }
+/**
+ * \brief Send a request without waiting for its response
+ *
+ * Any number of requests may be in flight at once. The server answers them in
+ * the order they are sent, so a request may depend on the one before it, e.g.
+ * attaching a source to a stream opened by the previous request. This call
+ * will not release the message.
+ *
+ * \param message Request to send
+ * \return A handle to pass to SVR_Comm_getResponse, or -1 if too many
+ * requests are in flight
+ */
+int SVR_Comm_sendRequest(SVR_Message* message) {
+    return SVR_Context_sendRequest(default_context, message);
+}
 
-    pthread_mutex_lock(&send_lock);
-    SVR_Net_sendMessage(client_sock, message);
-    pthread_mutex_unlock(&send_lock);
+/**
+ * \brief Wait for the response to a request
+ *
+ * Every handle returned by SVR_Comm_sendRequest must be waited on exactly once.
+ *
+ * \param request Handle returned by SVR_Comm_sendRequest
+ * \return The response, which the caller releases, or NULL for an invalid
+ * handle
+ */
+SVR_Message* SVR_Comm_getResponse(int request) {
+    return SVR_Context_getResponse(default_context, request);
+}
 
-    if(is_request) {
-        response = SVR_ResponseSet_getResponse(response_set, message->request_id - 1);
-    }
+/**
+ * \brief Send a request answered through a callback
+ *
+ * The callback is called from the receive thread with the response, which is
+ * released once it returns. It should return quickly, since no other message
+ * is received while it runs, and must not wait on another response. This call
+ * will not release the message.
+ *
+ * \param message Request to send
+ * \param callback Called with the response and data
+ * \param data Passed to the callback
+ * \return 0 on success, -1 if too many requests are in flight
+ */
+int SVR_Comm_sendRequestWithCallback(SVR_Message* message, SVR_Comm_ResponseCallback callback, void* data) {
+    return SVR_Context_sendRequestWithCallback(default_context, message, callback, data);
+}
 
-    return response;
+/**
+ * \brief Wait for every request in flight
+ *
+ * Block until all requests sent so far have been answered, and the callbacks
+ * of those sent with SVR_Comm_sendRequestWithCallback have returned. Responses
+ * to requests sent with SVR_Comm_sendRequest are kept for
+ * SVR_Comm_getResponse.
+ */
+void SVR_Comm_waitAll(void) {
+    SVR_Context_waitAll(default_context);
 }
 
 /**
@@ -0,0 +1,287 @@
+/**
+ * \file
+ * \brief Server connections
+ */
+
+#include <svr.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MAX_REQUEST_ID ((unsigned int)0xffff)
+
+typedef struct {
+    SVR_Comm_ResponseCallback callback;
+    void* data;
+} SVR_Context_Callback;
+
+static void* SVR_Context_receiveThread(void* _context);
+static void SVR_Context_runCallback(void* _response, void* _callback);
+
+/**
+ * \defgroup Context Context
+ * \ingroup Comm
+ * \brief Independent connections to servers
+ *
+ * A context is a connection to a server along with the streams and sources
+ * opened over it. SVR_init opens a default context which every call without a
+ * context uses, and further contexts can be opened to use several servers from
+ * one process, e.g.
+ *
+ * \code
+ * SVR_Context* vehicle = SVR_Context_new("10.0.0.2");
+ * SVR_Stream* stream = SVR_Stream_newOn(vehicle, "cam0");
+ * \endcode
+ *
+ * \{
+ */
+
+/**
+ * \brief Open a connection to a server
+ *
+ * SVR_init must be called first.
+ *
+ * \param server_address Address of the server, as given to SVR_Comm_connect
+ * \return A new context, or NULL if the server could not be reached
+ */
+SVR_Context* SVR_Context_new(const char* server_address) {
+    int sock;
+
+    sock = SVR_Comm_connect(server_address);
+    if(sock == -1) {
+        return NULL;
+    }
+
+    return SVR_Context_newWithSocket(sock);
+}
+
+/**
+ * \brief Open a context over a connected socket
+ *
+ * As SVR_Context_new, over a socket already connected to a server, such as one
+ * end of a socket pair. The context closes the socket when destroyed.
+ *
+ * \param sock The connected socket
+ * \return A new context
+ */
+SVR_Context* SVR_Context_newWithSocket(int sock) {
+    SVR_Context* context;
+
+    context = malloc(sizeof(SVR_Context));
+    context->socket = sock;
+    context->reader = SVR_NetReader_new(sock);
+    context->response_set = SVR_ResponseSet_new(MAX_REQUEST_ID);
+    context->closing = false;
+    context->streams = Dictionary_new();
+    context->sources = Dictionary_new();
+    pthread_mutex_init(&context->send_lock, NULL);
+    pthread_mutex_init(&context->stream_list_lock, NULL);
+    pthread_mutex_init(&context->share_lock, NULL);
+
+    pthread_create(&context->receive_thread, NULL, SVR_Context_receiveThread, context);
+
+    return context;
+}
+
+/**
+ * \brief Close a connection to a server
+ *
+ * Every stream and source opened over the context must be destroyed first.
+ * Requests still in flight are never answered.
+ *
+ * \param context The context to close
+ */
+void SVR_Context_destroy(SVR_Context* context) {
+    /* Wakes the receive thread */
+    context->closing = true;
+    shutdown(context->socket, SHUT_RDWR);
+    pthread_join(context->receive_thread, NULL);
+
+    SVR_NetReader_destroy(context->reader);
+    SVR_ResponseSet_destroy(context->response_set);
+    close(context->socket);
+
+    Dictionary_destroy(context->streams);
+    Dictionary_destroy(context->sources);
+    pthread_mutex_destroy(&context->send_lock);
+    pthread_mutex_destroy(&context->stream_list_lock);
+    pthread_mutex_destroy(&context->share_lock);
+    free(context);
+}
+
+/**
+ * \brief Check whether the server of a context is on this machine
+ *
+ * \param context The context
+ * \return True if the connection to the server is local
+ */
+bool SVR_Context_isLocal(SVR_Context* context) {
+    return SVR_Net_isLocal(context->socket);
+}
+
+/**
+ * \brief Background message receive thread
+ *
+ * Background thread started by SVR_Context_new and responsible for handling
+ * incoming messages and message response
+ *
+ * \param _context The context receiving
+ * \return Always returns NULL
+ */
+static void* SVR_Context_receiveThread(void* _context) {
+    SVR_Context* context = (SVR_Context*) _context;
+    SVR_Message* message;
+
+    while(true) {
+        message = SVR_NetReader_receiveMessage(context->reader);
+
+        if(message == NULL) {
+            if(context->closing == false) {
+                SVR_log(SVR_ERROR, "Server has closed");
+            }
+            break;
+        }
+
+        if(message->request_id) {
+            /* Responses outlive the next receive, so copy them out of the
+               reader's buffer */
+            SVR_Message_detach(message);
+            if(SVR_ResponseSet_setResponse(context->response_set, message->request_id - 1, message) < 0) {
+                SVR_log(SVR_WARNING, "Received a response to no request");
+                SVR_Message_release(message);
+            }
+        } else {
+            SVR_MessageRouter_processMessage(context, message);
+            SVR_Message_release(message);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief Send a message
+ *
+ * Send a message to the server of a context, as SVR_Comm_sendMessage does.
+ *
+ * \param context The context to send over
+ * \param message Message to send
+ * \param is_request If true, then a request ID will be generated for the
+ * message and this call will block until a response becomes available. If
+ * false, then this function will return as soon as the message is sent.
+ * \return The response to the message if is_request is true, or NULL otherwise.
+ */
+void* SVR_Context_sendMessage(SVR_Context* context, SVR_Message* message, bool is_request) {
+    if(is_request) {
+        return SVR_Context_getResponse(context, SVR_Context_sendRequest(context, message));
+    }
+
+    pthread_mutex_lock(&context->send_lock);
+    SVR_Net_sendMessage(context->socket, message);
+    pthread_mutex_unlock(&context->send_lock);
+
+    return NULL;
+}
+
+/**
+ * \brief Send a request without waiting for its response
+ *
+ * As SVR_Comm_sendRequest, over the given context.
+ *
+ * \param context The context to send over
+ * \param message Request to send
+ * \return A handle to pass to SVR_Context_getResponse, or -1 if too many
+ * requests are in flight
+ */
+int SVR_Context_sendRequest(SVR_Context* context, SVR_Message* message) {
+    int request = SVR_ResponseSet_getRequestId(context->response_set);
+
+    if(request < 0) {
+        SVR_log(SVR_ERROR, "Too many requests in flight");
+        return -1;
+    }
+
+    message->request_id = request + 1;
+
+    pthread_mutex_lock(&context->send_lock);
+    SVR_Net_sendMessage(context->socket, message);
+    pthread_mutex_unlock(&context->send_lock);
+
+    return request;
+}
+
+/**
+ * \brief Wait for the response to a request
+ *
+ * \param context The context the request was sent over
+ * \param request Handle returned by SVR_Context_sendRequest
+ * \return The response, which the caller releases, or NULL for an invalid
+ * handle
+ */
+SVR_Message* SVR_Context_getResponse(SVR_Context* context, int request) {
+    if(request < 0) {
+        return NULL;
+    }
+
+    return SVR_ResponseSet_getResponse(context->response_set, request);
+}
+
+/**
+ * \brief Send a request answered through a callback
+ *
+ * As SVR_Comm_sendRequestWithCallback, over the given context. The callback is
+ * called from the context's receive thread.
+ *
+ * \param context The context to send over
+ * \param message Request to send
+ * \param callback Called with the response and data
+ * \param data Passed to the callback
+ * \return 0 on success, -1 if too many requests are in flight
+ */
+int SVR_Context_sendRequestWithCallback(SVR_Context* context, SVR_Message* message,
+                                        SVR_Comm_ResponseCallback callback, void* data) {
+    SVR_Context_Callback* request_callback = malloc(sizeof(SVR_Context_Callback));
+    int request;
+
+    request_callback->callback = callback;
+    request_callback->data = data;
+
+    request = SVR_ResponseSet_getCallbackRequestId(context->response_set, SVR_Context_runCallback, request_callback);
+    if(request < 0) {
+        SVR_log(SVR_ERROR, "Too many requests in flight");
+        free(request_callback);
+        return -1;
+    }
+
+    message->request_id = request + 1;
+
+    pthread_mutex_lock(&context->send_lock);
+    SVR_Net_sendMessage(context->socket, message);
+    pthread_mutex_unlock(&context->send_lock);
+
+    return 0;
+}
+
+/**
+ * Pass a response to the callback of its request and release it
+ */
+static void SVR_Context_runCallback(void* _response, void* _callback) {
+    SVR_Message* response = (SVR_Message*) _response;
+    SVR_Context_Callback* request_callback = (SVR_Context_Callback*) _callback;
+
+    request_callback->callback(response, request_callback->data);
+
+    SVR_Message_release(response);
+    free(request_callback);
+}
+
+/**
+ * \brief Wait for every request in flight over a context
+ *
+ * \param context The context
+ */
+void SVR_Context_waitAll(SVR_Context* context) {
+    SVR_ResponseSet_waitAll(context->response_set);
+}
+
+/** \} */
@@ -0,0 +1,280 @@
+/**
+ * \file
+ * \brief Datagram transport
+ */
+
+#include <svr.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static void* SVR_DatagramReceiver_worker(void* _receiver);
+static void SVR_DatagramReceiver_receive(SVR_DatagramReceiver* receiver, uint8_t* datagram, size_t n);
+static bool SVR_DatagramReceiver_addFragment(SVR_DatagramReceiver* receiver, uint32_t offset, size_t n);
+
+/**
+ * \defgroup Datagram Datagram transport
+ * \ingroup Comm
+ * \brief Receive stream frames over UDP
+ * \{
+ */
+
+/**
+ * \brief Create a datagram receiver
+ *
+ * Open a UDP socket for the stream and start receiving on it. Without a group
+ * the socket is bound to a free port, which the server should send to. With a
+ * group the socket joins the multicast group on the given port, shared with
+ * any other receivers of the group on this machine.
+ *
+ * \param context Context of the stream
+ * \param stream_name Name of the stream frames are provided to
+ * \param group IPv4 multicast group address, or NULL for unicast
+ * \param port Port of the multicast group, ignored for unicast
+ * \return A new receiver, or NULL on failure
+ */
+SVR_DatagramReceiver* SVR_DatagramReceiver_new(SVR_Context* context, const char* stream_name, const char* group, int port) {
+    const int receive_buffer = SVR_DATAGRAM_RECEIVE_BUFFER;
+    const int reuse = 1;
+    SVR_DatagramReceiver* receiver;
+    struct sockaddr_in addr;
+    struct ip_mreq membership;
+    int sock;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = 0;
+
+    if(group) {
+        if(inet_pton(AF_INET, group, &membership.imr_multiaddr) != 1 || port <= 0 || port > 0xffff) {
+            SVR_logf(SVR_ERROR, "Invalid multicast group %s:%d", group, port);
+            return NULL;
+        }
+
+        membership.imr_interface.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+    }
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if(sock == -1) {
+        SVR_log(SVR_ERROR, "Unable to create datagram socket");
+        return NULL;
+    }
+
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+    if(group) {
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    }
+
+    if(bind(sock, (struct sockaddr*) &addr, sizeof(addr))) {
+        SVR_logf(SVR_ERROR, "Unable to bind datagram socket: %s", strerror(errno));
+        close(sock);
+        return NULL;
+    }
+
+    if(group && setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership))) {
+        SVR_logf(SVR_ERROR, "Unable to join multicast group %s: %s", group, strerror(errno));
+        close(sock);
+        return NULL;
+    }
+
+    receiver = malloc(sizeof(SVR_DatagramReceiver));
+    receiver->socket = sock;
+    receiver->running = true;
+    receiver->context = context;
+    receiver->stream_name = strdup(stream_name);
+    receiver->frame = NULL;
+    receiver->frame_buffer_size = 0;
+    receiver->frame_id = 0;
+    receiver->frame_size = 0;
+    receiver->received = 0;
+    receiver->assembling = false;
+    receiver->fragments = NULL;
+    receiver->fragments_buffer_size = 0;
+    receiver->fragment_size = 0;
+    receiver->last_received = false;
+    receiver->last_offset = 0;
+    receiver->started = false;
+    receiver->frames_lost = 0;
+
+    pthread_create(&receiver->thread, NULL, SVR_DatagramReceiver_worker, receiver);
+
+    return receiver;
+}
+
+/**
+ * \brief Get the port a receiver is bound to
+ *
+ * \param receiver The receiver
+ * \return The local UDP port, or -1 on error
+ */
+int SVR_DatagramReceiver_getPort(SVR_DatagramReceiver* receiver) {
+    struct sockaddr_in addr;
+    socklen_t addr_length = sizeof(addr);
+
+    if(getsockname(receiver->socket, (struct sockaddr*) &addr, &addr_length)) {
+        return -1;
+    }
+
+    return ntohs(addr.sin_port);
+}
+
+/**
+ * \brief Stop and destroy a receiver
+ *
+ * \param receiver The receiver to destroy
+ */
+void SVR_DatagramReceiver_destroy(SVR_DatagramReceiver* receiver) {
+    /* Shutting the socket down wakes the receive thread */
+    receiver->running = false;
+    shutdown(receiver->socket, SHUT_RDWR);
+    pthread_join(receiver->thread, NULL);
+
+    close(receiver->socket);
+    free(receiver->stream_name);
+    free(receiver->frame);
+    free(receiver->fragments);
+    free(receiver);
+}
+
+static void* SVR_DatagramReceiver_worker(void* _receiver) {
+    SVR_DatagramReceiver* receiver = (SVR_DatagramReceiver*) _receiver;
+    uint8_t* datagram = malloc(SVR_DATAGRAM_MAX_SIZE);
+    ssize_t n;
+
+    while(receiver->running) {
+        n = recv(receiver->socket, datagram, SVR_DATAGRAM_MAX_SIZE, 0);
+
+        if(n < 0 && errno != EINTR) {
+            SVR_logf(SVR_ERROR, "Error receiving datagram: %s", strerror(errno));
+            break;
+        }
+
+        if(n > SVR_DATAGRAM_HEADER_LEN) {
+            SVR_DatagramReceiver_receive(receiver, datagram, n);
+        }
+    }
+
+    free(datagram);
+
+    return NULL;
+}
+
+/**
+ * Add a datagram to the frame being reassembled, and provide the frame to the
+ * stream once it is complete
+ */
+static void SVR_DatagramReceiver_receive(SVR_DatagramReceiver* receiver, uint8_t* datagram, size_t n) {
+    uint16_t magic;
+    uint32_t frame_id;
+    uint32_t frame_size;
+    uint32_t offset;
+
+    SVR_unpack(datagram, 0, "hiii", &magic, &frame_id, &frame_size, &offset);
+    n -= SVR_DATAGRAM_HEADER_LEN;
+
+    if(magic != SVR_DATAGRAM_MAGIC || frame_size > SVR_DATAGRAM_MAX_FRAME_SIZE ||
+       offset > frame_size || n > frame_size - offset) {
+        return;
+    }
+
+    /* Frame IDs wrap around, so compare them by their difference */
+    if(receiver->started && (int32_t) (frame_id - receiver->frame_id) < 0) {
+        return;
+    }
+
+    if(receiver->started == false || frame_id != receiver->frame_id) {
+        if(receiver->assembling) {
+            receiver->frames_lost++;
+        }
+
+        if(frame_size > receiver->frame_buffer_size) {
+            free(receiver->frame);
+            receiver->frame = malloc(frame_size);
+            receiver->frame_buffer_size = frame_size;
+        }
+
+        receiver->started = true;
+        receiver->assembling = true;
+        receiver->frame_id = frame_id;
+        receiver->frame_size = frame_size;
+        receiver->received = 0;
+        receiver->fragment_size = 0;
+        receiver->last_received = false;
+    }
+
+    /* A datagram of a frame which was already completed, or one which arrived
+       before */
+    if(receiver->assembling == false || frame_size != receiver->frame_size ||
+       SVR_DatagramReceiver_addFragment(receiver, offset, n) == false) {
+        return;
+    }
+
+    memcpy(receiver->frame + offset, datagram + SVR_DATAGRAM_HEADER_LEN, n);
+    receiver->received += n;
+
+    if(receiver->received >= receiver->frame_size) {
+        receiver->assembling = false;
+
+        /* The last datagram must line up with the others for them to cover
+           the frame without overlapping */
+        if(receiver->fragment_size &&
+           (receiver->last_offset % receiver->fragment_size ||
+            frame_size - receiver->last_offset > receiver->fragment_size)) {
+            receiver->frames_lost++;
+            return;
+        }
+
+        SVR_Stream_provideData(receiver->context, receiver->stream_name, receiver->frame, receiver->frame_size);
+    }
+}
+
+/**
+ * Mark a datagram of the frame being reassembled as arrived. Returns false if
+ * it arrived before, or does not fit the fragments of the frame
+ */
+static bool SVR_DatagramReceiver_addFragment(SVR_DatagramReceiver* receiver, uint32_t offset, size_t n) {
+    size_t fragment_count;
+    size_t index;
+
+    if(offset + n == receiver->frame_size) {
+        if(receiver->last_received) {
+            return false;
+        }
+
+        receiver->last_received = true;
+        receiver->last_offset = offset;
+        return true;
+    }
+
+    /* The first datagram other than the last sets the fragment size, and
+       clears a bit for each fragment */
+    if(receiver->fragment_size == 0) {
+        fragment_count = (receiver->frame_size + n - 1) / n;
+        if((fragment_count + 7) / 8 > receiver->fragments_buffer_size) {
+            free(receiver->fragments);
+            receiver->fragments_buffer_size = (fragment_count + 7) / 8;
+            receiver->fragments = malloc(receiver->fragments_buffer_size);
+        }
+
+        memset(receiver->fragments, 0, (fragment_count + 7) / 8);
+        receiver->fragment_size = n;
+    }
+
+    if(n != receiver->fragment_size || offset % n != 0) {
+        return false;
+    }
+
+    index = offset / n;
+    if(receiver->fragments[index / 8] & (1 << (index % 8))) {
+        return false;
+    }
+
+    receiver->fragments[index / 8] |= 1 << (index % 8);
+    return true;
+}
+
+/** \} */
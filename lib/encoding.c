@@ -33,13 +33,14 @@ static Dictionary* encodings = NULL;
  * data is read out, internal buffer space is freed. The buffer will grow as
  * large as necessary to keep all unread data buffered.
  *
- * A decoder maintains internal free, and ready frames lists. The free frames
- * list is the list of frames which are available for the decoder to buffer
- * incoming frames. The ready frames list is the list of fully buffered frames
- * available to be returned by a call to SVR_Decoder_getFrame. Decoded frames
- * are placed into the free frames list with a call to SVR_Decoder_returnFrame,
- * so it is important that frames obtained by a call to SVR_Decoder_getFrame be
- * returned to avoid memory leaks and excessive memory reallocation.
+ * A decoder buffers incoming data into a frame taken from the frame pool
+ * (see SVR_FramePool_getFrame) and maintains a ready frames list. The ready
+ * frames list is the list of fully buffered frames available to be returned by
+ * a call to SVR_Decoder_getFrame. Decoded frames are given back to the frame
+ * pool with a call to SVR_Decoder_returnFrame, so it is important that frames
+ * obtained by a call to SVR_Decoder_getFrame be returned to avoid memory leaks
+ * and excessive memory reallocation. A decoder can take its frames from an
+ * application's SVR_FrameAllocator instead of the frame pool.
  *
  * \{
  */
@@ -85,6 +86,21 @@ SVR_Encoding* SVR_Encoding_getByName(const char* name) {
     return Dictionary_get(encodings, name);
 }
 
+/**
+ * \brief Resolve the "auto" encoding
+ *
+ * The "auto" encoding stands for the cheapest encoding suited to the link
+ * frames are sent over. Local links have bandwidth to spare, so frames are sent
+ * raw to save the encoding and decoding time. Remote links use JPEG, which
+ * adapts its quality to the link rate.
+ *
+ * \param local True if frames stay on this machine
+ * \return The encoding to use
+ */
+SVR_Encoding* SVR_Encoding_getAuto(bool local) {
+    return SVR_Encoding_getByName(local ? "raw" : "jpeg");
+}
+
 /**
  * \brief Register an encoding
  *
@@ -167,6 +183,23 @@ size_t SVR_Encoder_encode(SVR_Encoder* encoder, IplImage* frame) {
     return SVR_Encoder_dataReady(encoder);
 }
 
+/**
+ * \brief Set the target frame size of an encoder
+ *
+ * Ask the encoder to adapt its output so frames are close to frame_size bytes,
+ * e.g. to match the rate of the link frames are sent over. Encodings without
+ * rate control ignore the target.
+ *
+ * \param encoder The encoder
+ * \param frame_size Target size of each encoded frame in bytes, or 0 for no
+ * target
+ */
+void SVR_Encoder_setTargetFrameSize(SVR_Encoder* encoder, size_t frame_size) {
+    if(encoder->encoding->setTargetFrameSize) {
+        encoder->encoding->setTargetFrameSize(encoder, frame_size);
+    }
+}
+
 /**
  * \brief Get the number of bytes ready to be read
  *
@@ -211,6 +244,23 @@ size_t SVR_Encoder_readData(SVR_Encoder* encoder, void* buffer, size_t buffer_si
     return read_size;
 }
 
+/**
+ * \brief Pass an encoded frame through an encoder
+ *
+ * Queue a frame which is already encoded with the encoder's encoding, as
+ * produced by another encoder of the same encoding, to be read like one the
+ * encoder encoded itself. The options of the encoder are not applied to it.
+ *
+ * \param encoder An encoder instance
+ * \param data The encoded frame
+ * \param n Size of the encoded frame
+ * \return The number of encoded bytes available to be read
+ */
+size_t SVR_Encoder_passThrough(SVR_Encoder* encoder, void* data, size_t n) {
+    SVR_Encoder_provideData(encoder, data, n);
+    return SVR_Encoder_dataReady(encoder);
+}
+
 /**
  * \private
  * \brief Store encoded data
@@ -226,30 +276,30 @@ void SVR_Encoder_provideData(SVR_Encoder* encoder, void* data, size_t n) {
     size_t used_space;
     size_t free_space;
     size_t end_space;
-    void* temp_space;
+    size_t new_size;
+    size_t wrapped_size;
 
     SVR_LOCK(encoder);
     used_space = SVR_Encoder_dataReady(encoder);
     free_space = encoder->buffer_size - used_space;
 
     if(free_space <= n) {
+        /* Grow geometrically so a steady stream of frames stops reallocating
+           once the buffer is large enough */
+        new_size = Util_max(encoder->buffer_size * 2, used_space + n + 1);
+        encoder->buffer = realloc(encoder->buffer, new_size);
+
         if(encoder->write_index < encoder->read_index) {
-            /* Temporarily store unread data */
-            temp_space = malloc(used_space);
-            SVR_Encoder_readData(encoder, temp_space, used_space);
-
-            /* Grow buffer and restore data */
-            encoder->buffer = realloc(encoder->buffer, used_space + n + 1);
-            memcpy(encoder->buffer, temp_space, used_space);
-            encoder->read_index = 0;
-            free(temp_space);
-
-            encoder->write_index = used_space;
-        } else{
-            encoder->buffer = realloc(encoder->buffer, used_space + n + 1);
+            /* Unread data wraps around the end of the buffer. Move the part at
+               the end of the old buffer to the end of the new buffer */
+            wrapped_size = encoder->buffer_size - encoder->read_index;
+            memmove(((uint8_t*)encoder->buffer) + new_size - wrapped_size,
+                    ((uint8_t*)encoder->buffer) + encoder->read_index,
+                    wrapped_size);
+            encoder->read_index = new_size - wrapped_size;
         }
 
-        encoder->buffer_size = used_space + n + 1;
+        encoder->buffer_size = new_size;
     }
 
     end_space = encoder->buffer_size - encoder->write_index;
@@ -279,9 +329,10 @@ SVR_Decoder* SVR_Decoder_new(SVR_Encoding* encoding, SVR_FrameProperties* frame_
 
     decoder->encoding = encoding;
     decoder->ready_frames = List_new();
-    decoder->free_frames = List_new();
+    decoder->current_frame = NULL;
     decoder->write_offset = 0;
     decoder->frame_properties = SVR_FrameProperties_clone(frame_properties);
+    decoder->frame_allocator = NULL;
     SVR_LOCKABLE_INIT(decoder);
 
     if(encoding->openDecoder) {
@@ -309,21 +360,35 @@ void SVR_Decoder_destroy(SVR_Decoder* decoder) {
 
     SVR_FrameProperties_destroy(decoder->frame_properties);
 
-    /* Free frames in free frames list */
-    for(int i = 0; (frame = List_get(decoder->free_frames, i)) != NULL; i++) {
-        cvReleaseImage(&frame);
+    /* Return the partially buffered frame */
+    if(decoder->current_frame) {
+        SVR_Decoder_returnFrame(decoder, decoder->current_frame);
     }
-    List_destroy(decoder->free_frames);
 
-    /* Free frames in ready frames list */
+    /* Return frames in ready frames list */
     for(int i = 0; (frame = List_get(decoder->ready_frames, i)) != NULL; i++) {
-        cvReleaseImage(&frame);
+        SVR_Decoder_returnFrame(decoder, frame);
     }
     List_destroy(decoder->ready_frames);
 
     free(decoder);
 }
 
+/**
+ * \brief Decode into frames from an allocator
+ *
+ * Have the decoder write frames into frames from the given allocator instead
+ * of the frame pool, e.g. into buffers the application owns. Must be set
+ * before any data is decoded. Frames from SVR_Decoder_getFrame are then given
+ * back to the allocator by SVR_Decoder_returnFrame.
+ *
+ * \param decoder A decoder instance
+ * \param frame_allocator The allocator, or NULL for the frame pool
+ */
+void SVR_Decoder_setFrameAllocator(SVR_Decoder* decoder, SVR_FrameAllocator* frame_allocator) {
+    decoder->frame_allocator = frame_allocator;
+}
+
 /**
  * \brief Provide data to be decoded
  *
@@ -377,15 +442,18 @@ IplImage* SVR_Decoder_getFrame(SVR_Decoder* decoder) {
  * \brief Return a frame to the decoder
  *
  * Return a frame obtained by a call to SVR_Decoder_getFrame to the decoder. The
- * frame will be reused for future frames.
+ * frame is given back to the frame pool, or the decoder's frame allocator, and
+ * will be reused for future frames.
  *
  * \param decoder A decoder instance
  * \param frame A frame obtained by a call to SVR_Decoder_getFrame
  */
 void SVR_Decoder_returnFrame(SVR_Decoder* decoder, IplImage* frame) {
-    SVR_LOCK(decoder);
-    List_append(decoder->free_frames, frame);
-    SVR_UNLOCK(decoder);
+    if(decoder->frame_allocator) {
+        decoder->frame_allocator->returnFrame(frame, decoder->frame_allocator->data);
+    } else {
+        SVR_FramePool_returnFrame(frame);
+    }
 }
 
 /**
@@ -397,16 +465,16 @@ void SVR_Decoder_returnFrame(SVR_Decoder* decoder, IplImage* frame) {
  * \param decoder A decoder instance
  */
 static IplImage* SVR_Decoder_getCurrentFrame(SVR_Decoder* decoder) {
-    IplImage* frame;
-
-    /* Allocate a new frame */
-    if(List_getSize(decoder->free_frames) == 0) {
-        frame = SVR_FrameProperties_imageFromProperties(decoder->frame_properties);
-        List_append(decoder->free_frames, frame);
+    if(decoder->current_frame == NULL) {
+        if(decoder->frame_allocator) {
+            decoder->current_frame = decoder->frame_allocator->getFrame(decoder->frame_properties,
+                                                                        decoder->frame_allocator->data);
+        } else {
+            decoder->current_frame = SVR_FramePool_getFrame(decoder->frame_properties);
+        }
     }
 
-    frame = List_get(decoder->free_frames, 0);
-    return frame;
+    return decoder->current_frame;
 }
 
 /**
@@ -419,9 +487,10 @@ static IplImage* SVR_Decoder_getCurrentFrame(SVR_Decoder* decoder) {
  * \param decoder A decoder instance
  */
 static void SVR_Decoder_currentFrameComplete(SVR_Decoder* decoder) {
-    if(List_getSize(decoder->free_frames) > 0) {
-        /* Move current item from free frames to end of ready frames */
-        List_append(decoder->ready_frames, List_remove(decoder->free_frames, 0));
+    if(decoder->current_frame) {
+        /* Move current frame to end of ready frames */
+        List_append(decoder->ready_frames, decoder->current_frame);
+        decoder->current_frame = NULL;
         decoder->write_offset = 0;
     }
 }
@@ -2,15 +2,33 @@
 #include <svr.h>
 
 #include <jpeglib.h>
+#include <math.h>
+#include <time.h>
 
 #include "encoding_internal.h"
 
 #define BUFFER_GROW_SIZE 1024
+
+/* Alignment of image memory, which libjpeg's SIMD code expects for sample rows */
+#define IMAGE_MEMORY_ALIGNMENT 64
+#define IMAGE_MEMORY_ALIGN(size) (((size) + IMAGE_MEMORY_ALIGNMENT - 1) & ~((size_t) IMAGE_MEMORY_ALIGNMENT - 1))
 #define JPEG_DEFAULT_QUALITY 70
 
+/* Quality bounds used by rate control unless given as options */
+#define JPEG_DEFAULT_MIN_QUALITY 10
+#define JPEG_DEFAULT_MAX_QUALITY 95
+
+/* Rate control models log2 of the frame size as linear in quality. The slope
+   starts at a typical value, frame size doubling every 15 points, and is then
+   measured from consecutive frames within these bounds */
+#define JPEG_DEFAULT_SIZE_SLOPE (1.0 / 15)
+#define JPEG_MIN_SIZE_SLOPE (1.0 / 80)
+#define JPEG_MAX_SIZE_SLOPE (1.0 / 4)
+
 static void* openEncoder(SVR_FrameProperties* frame_properties, Dictionary* options);
 static void closeEncoder(SVR_Encoder* encoder);
 static void encode(SVR_Encoder* encoder, IplImage* frame);
+static void setTargetFrameSize(SVR_Encoder* encoder, size_t frame_size);
 
 static void* openDecoder(SVR_FrameProperties* frame_properties);
 static void closeDecoder(SVR_Decoder* decoder);
@@ -21,30 +39,75 @@ SVR_Encoding SVR_ENCODING(jpeg) = {
         .openEncoder = openEncoder,
         .closeEncoder = closeEncoder,
         .encode = encode,
+        .setTargetFrameSize = setTargetFrameSize,
         .openDecoder = openDecoder,
         .closeDecoder = closeDecoder,
         .decode = decode
 };
 
+/* libjpeg allocates the working memory of each image from its image pool and
+   frees that pool when the image is finished. Image pool allocations are
+   instead carved from an arena kept with the encoder or decoder, which is
+   reset between images and grown to what the last image needed. libjpeg's own
+   methods still serve the permanent pool and anything the arena cannot hold */
+typedef struct {
+    struct jpeg_memory_mgr methods;
+
+    uint8_t* arena;
+    size_t arena_size;
+    size_t arena_used;
+    size_t arena_needed;
+} SVR_JpegMemory;
+
 typedef struct {
     struct jpeg_destination_mgr pub;
     struct jpeg_compress_struct cinfo;
     struct jpeg_error_mgr jerr;
+    SVR_JpegMemory memory;
     SVR_Encoder* encoder;
 
     unsigned char* buffer;
     unsigned long buffer_size;
+
+    /* Size of the last encoded frame */
+    unsigned long frame_length;
+
+    /* Rate control. The quality of each frame is chosen from the size of the
+       last one to bring frames to the smallest of the configured frame size,
+       the configured bitrate spread over the measured frame interval, and the
+       limit set by the sender from the link rate. Zero values are unset */
+    double quality;
+    double size_slope;
+    int min_quality;
+    int max_quality;
+    unsigned long target_frame_size;
+    unsigned long target_bitrate;
+    unsigned long link_frame_size;
+
+    /* Quality and size of the frame before last, for measuring the slope */
+    int previous_quality;
+    unsigned long previous_length;
+    int last_quality;
+
+    /* Smoothed seconds between frames, and the time of the last frame */
+    double frame_interval;
+    struct timespec last_frame;
 } SVR_JpegEncoder;
 
 typedef struct {
     struct jpeg_decompress_struct cinfo;
     struct jpeg_error_mgr jerr;
+    SVR_JpegMemory memory;
     JSAMPROW row;
 
     unsigned char* buffer;
     unsigned long buffer_size;
     unsigned long bytes_needed;
     unsigned long bytes_received;
+
+    /* Frame length prefix, which may be split across calls to decode */
+    uint32_t length_prefix;
+    unsigned int length_received;
 } SVR_JpegDecoder;
 
 #if JPEG_LIB_VERSION < 80
@@ -128,6 +191,135 @@ jpeg_mem_src (j_decompress_ptr cinfo,
 
 #endif
 
+/**
+ * Take size bytes of image memory from the arena, or return NULL if it is full
+ */
+static void* allocImageMemory(SVR_JpegMemory* memory, size_t size) {
+    void* object;
+
+    size = IMAGE_MEMORY_ALIGN(size);
+    memory->arena_needed += size;
+
+    if(memory->arena_used + size > memory->arena_size) {
+        return NULL;
+    }
+
+    object = memory->arena + memory->arena_used;
+    memory->arena_used += size;
+
+    return object;
+}
+
+METHODDEF(void*) alloc_svr_small(j_common_ptr cinfo, int pool_id, size_t size) {
+    SVR_JpegMemory* memory = cinfo->client_data;
+    void* object = NULL;
+
+    if(pool_id == JPOOL_IMAGE) {
+        object = allocImageMemory(memory, size);
+    }
+
+    return object ? object : memory->methods.alloc_small(cinfo, pool_id, size);
+}
+
+METHODDEF(void*) alloc_svr_large(j_common_ptr cinfo, int pool_id, size_t size) {
+    SVR_JpegMemory* memory = cinfo->client_data;
+    void* object = NULL;
+
+    if(pool_id == JPOOL_IMAGE) {
+        object = allocImageMemory(memory, size);
+    }
+
+    return object ? object : memory->methods.alloc_large(cinfo, pool_id, size);
+}
+
+/**
+ * Take an array of rows of the given size from the arena, or return NULL if
+ * it is full. Rows are padded to the alignment
+ */
+static void** allocImageRows(SVR_JpegMemory* memory, size_t row_size, JDIMENSION rows) {
+    size_t pointers_size = IMAGE_MEMORY_ALIGN(rows * sizeof(void*));
+    uint8_t* data;
+    void** array;
+
+    row_size = IMAGE_MEMORY_ALIGN(row_size);
+    array = allocImageMemory(memory, pointers_size + rows * row_size);
+    if(array == NULL) {
+        return NULL;
+    }
+
+    data = ((uint8_t*) array) + pointers_size;
+    for(JDIMENSION r = 0; r < rows; r++) {
+        array[r] = data + r * row_size;
+    }
+
+    return array;
+}
+
+METHODDEF(JSAMPARRAY) alloc_svr_sarray(j_common_ptr cinfo, int pool_id, JDIMENSION samples_per_row,
+                                       JDIMENSION rows) {
+    SVR_JpegMemory* memory = cinfo->client_data;
+    JSAMPARRAY array = NULL;
+
+    if(pool_id == JPOOL_IMAGE) {
+        array = (JSAMPARRAY) allocImageRows(memory, samples_per_row * sizeof(JSAMPLE), rows);
+    }
+
+    return array ? array : memory->methods.alloc_sarray(cinfo, pool_id, samples_per_row, rows);
+}
+
+METHODDEF(JBLOCKARRAY) alloc_svr_barray(j_common_ptr cinfo, int pool_id, JDIMENSION blocks_per_row,
+                                        JDIMENSION rows) {
+    SVR_JpegMemory* memory = cinfo->client_data;
+    JBLOCKARRAY array = NULL;
+
+    if(pool_id == JPOOL_IMAGE) {
+        array = (JBLOCKARRAY) allocImageRows(memory, blocks_per_row * sizeof(JBLOCK), rows);
+    }
+
+    return array ? array : memory->methods.alloc_barray(cinfo, pool_id, blocks_per_row, rows);
+}
+
+METHODDEF(void) free_svr_pool(j_common_ptr cinfo, int pool_id) {
+    SVR_JpegMemory* memory = cinfo->client_data;
+
+    if(pool_id == JPOOL_IMAGE) {
+        /* Grow the arena while no image memory is in use, so that the next
+           image of the same size is served from it entirely */
+        if(memory->arena_needed > memory->arena_size) {
+            free(memory->arena);
+            if(posix_memalign((void**) &memory->arena, IMAGE_MEMORY_ALIGNMENT, memory->arena_needed) == 0) {
+                memory->arena_size = memory->arena_needed;
+            } else {
+                memory->arena = NULL;
+                memory->arena_size = 0;
+            }
+        }
+
+        memory->arena_used = 0;
+        memory->arena_needed = 0;
+    }
+
+    memory->methods.free_pool(cinfo, pool_id);
+}
+
+/**
+ * Serve the image pool of the given libjpeg object from an arena
+ */
+static void initImageMemory(j_common_ptr cinfo, SVR_JpegMemory* memory) {
+    memory->methods = *cinfo->mem;
+    memory->arena = NULL;
+    memory->arena_size = 0;
+    memory->arena_used = 0;
+    memory->arena_needed = 0;
+
+    cinfo->client_data = memory;
+    cinfo->mem->alloc_small = alloc_svr_small;
+    cinfo->mem->alloc_large = alloc_svr_large;
+    cinfo->mem->alloc_sarray = alloc_svr_sarray;
+    cinfo->mem->alloc_barray = alloc_svr_barray;
+    cinfo->mem->free_pool = free_svr_pool;
+}
+
 METHODDEF(void) init_svr_destination(j_compress_ptr cinfo) {
     SVR_JpegEncoder* private_data = (SVR_JpegEncoder*) cinfo->dest;
 
@@ -151,17 +343,40 @@ METHODDEF(void) term_svr_destination(j_compress_ptr cinfo) {
     uint32_t data_length = private_data->buffer_size - private_data->pub.free_in_buffer;
     uint32_t encoded_length = htonl(data_length);
 
+    private_data->frame_length = data_length;
+
     /* Write data */
     SVR_Encoder_provideData(private_data->encoder, &encoded_length, sizeof(encoded_length));
     SVR_Encoder_provideData(private_data->encoder, private_data->buffer, data_length);
 }
 
+/**
+ * Read a quality bound from the encoder options
+ */
+static int getQualityOption(Dictionary* options, const char* name, int default_quality) {
+    int quality;
+
+    if(Dictionary_exists(options, name) == false) {
+        return default_quality;
+    }
+
+    quality = atoi(Dictionary_get(options, name));
+    if(quality < 5 || quality > 100) {
+        SVR_logf(SVR_WARNING, "Invalid JPEG %s %s. Falling back to default", name,
+                              (char*) Dictionary_get(options, name));
+        return default_quality;
+    }
+
+    return quality;
+}
+
 static void* openEncoder(SVR_FrameProperties* frame_properties, Dictionary* options) {
     SVR_JpegEncoder* private_data = malloc(sizeof(SVR_JpegEncoder));
     int quality = JPEG_DEFAULT_QUALITY;;
 
     private_data->cinfo.err = jpeg_std_error(&private_data->jerr);
     jpeg_create_compress(&private_data->cinfo);
+    initImageMemory((j_common_ptr) &private_data->cinfo, &private_data->memory);
 
     private_data->cinfo.image_width = frame_properties->width;
     private_data->cinfo.image_height = frame_properties->height;
@@ -178,14 +393,35 @@ static void* openEncoder(SVR_FrameProperties* frame_properties, Dictionary* opti
     if(Dictionary_exists(options, "quality")) {
         quality = atoi(Dictionary_get(options, "quality"));
         if(quality < 5 || quality > 100) {
-            SVR_log(SVR_WARNING, Util_format("Invalid JPEG quality %s. Falling back to default",
-                                             Dictionary_get(options, "quality")));
+            SVR_logf(SVR_WARNING, "Invalid JPEG quality %s. Falling back to default",
+                                  (char*) Dictionary_get(options, "quality"));
             quality = JPEG_DEFAULT_QUALITY;
         }
     }
 
     jpeg_set_quality(&private_data->cinfo, quality, true);
 
+    private_data->quality = quality;
+    private_data->size_slope = JPEG_DEFAULT_SIZE_SLOPE;
+    private_data->previous_quality = quality;
+    private_data->previous_length = 0;
+    private_data->last_quality = quality;
+    private_data->min_quality = getQualityOption(options, "min_quality", JPEG_DEFAULT_MIN_QUALITY);
+    private_data->max_quality = getQualityOption(options, "max_quality", JPEG_DEFAULT_MAX_QUALITY);
+    private_data->target_frame_size = Dictionary_exists(options, "frame_size") ?
+                                      strtoul(Dictionary_get(options, "frame_size"), NULL, 10) : 0;
+    private_data->target_bitrate = Dictionary_exists(options, "bitrate") ?
+                                   strtoul(Dictionary_get(options, "bitrate"), NULL, 10) : 0;
+    private_data->link_frame_size = 0;
+    private_data->frame_interval = 0;
+    private_data->frame_length = 0;
+
+    if(private_data->min_quality > private_data->max_quality) {
+        SVR_log(SVR_WARNING, "JPEG min_quality is above max_quality. Falling back to defaults");
+        private_data->min_quality = JPEG_DEFAULT_MIN_QUALITY;
+        private_data->max_quality = JPEG_DEFAULT_MAX_QUALITY;
+    }
+
     private_data->cinfo.dest = (struct jpeg_destination_mgr*) private_data;
     private_data->buffer_size = BUFFER_GROW_SIZE;
     private_data->buffer = malloc(private_data->buffer_size);
@@ -201,15 +437,101 @@ static void* openEncoder(SVR_FrameProperties* frame_properties, Dictionary* opti
 static void closeEncoder(SVR_Encoder* encoder) {
     SVR_JpegEncoder* private_data = encoder->private_data;
     jpeg_destroy_compress(&private_data->cinfo);
+    free(private_data->memory.arena);
     free(private_data->buffer);
     free(private_data);
 }
 
+static void setTargetFrameSize(SVR_Encoder* encoder, size_t frame_size) {
+    SVR_JpegEncoder* private_data = encoder->private_data;
+    private_data->link_frame_size = frame_size;
+}
+
+/**
+ * Get the frame size rate control should aim for, or 0 if rate control is off
+ */
+static unsigned long getTargetFrameSize(SVR_JpegEncoder* private_data) {
+    unsigned long target = private_data->target_frame_size;
+    unsigned long bitrate_frame_size;
+
+    if(private_data->target_bitrate && private_data->frame_interval > 0) {
+        bitrate_frame_size = private_data->target_bitrate / 8 * private_data->frame_interval;
+        if(target == 0 || bitrate_frame_size < target) {
+            target = bitrate_frame_size;
+        }
+    }
+
+    if(private_data->link_frame_size && (target == 0 || private_data->link_frame_size < target)) {
+        target = private_data->link_frame_size;
+    }
+
+    return target;
+}
+
+/**
+ * Update the smoothed interval between frames
+ */
+static void updateFrameInterval(SVR_JpegEncoder* private_data) {
+    struct timespec now;
+    double interval;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if(private_data->frame_length) {
+        interval = (now.tv_sec - private_data->last_frame.tv_sec) +
+                   (now.tv_nsec - private_data->last_frame.tv_nsec) / 1e9;
+
+        if(private_data->frame_interval == 0) {
+            private_data->frame_interval = interval;
+        } else {
+            private_data->frame_interval = 0.75 * private_data->frame_interval + 0.25 * interval;
+        }
+    }
+
+    private_data->last_frame = now;
+}
+
+/**
+ * Choose the quality of the next frame from the size of the last one, which
+ * reflects the complexity of the scene
+ */
+static void updateQuality(SVR_JpegEncoder* private_data, unsigned long target) {
+    double slope;
+
+    /* Measure how strongly size depends on quality for the current scene */
+    if(private_data->previous_length && private_data->last_quality != private_data->previous_quality) {
+        slope = (log2(private_data->frame_length) - log2(private_data->previous_length)) /
+                (private_data->last_quality - private_data->previous_quality);
+        slope = Util_max(slope, JPEG_MIN_SIZE_SLOPE);
+        slope = Util_min(slope, JPEG_MAX_SIZE_SLOPE);
+        private_data->size_slope = 0.5 * private_data->size_slope + 0.5 * slope;
+    }
+
+    private_data->previous_length = private_data->frame_length;
+    private_data->previous_quality = private_data->last_quality;
+
+    private_data->quality += log2((double) target / private_data->frame_length) / private_data->size_slope;
+    private_data->quality = Util_max(private_data->quality, private_data->min_quality);
+    private_data->quality = Util_min(private_data->quality, private_data->max_quality);
+
+    private_data->last_quality = (int) (private_data->quality + 0.5);
+    jpeg_set_quality(&private_data->cinfo, private_data->last_quality, true);
+}
+
 static void encode(SVR_Encoder* encoder, IplImage* frame) {
     SVR_JpegEncoder* private_data = encoder->private_data;
+    unsigned long target;
     JSAMPROW row;
 
     private_data->encoder = encoder;
+
+    updateFrameInterval(private_data);
+    target = getTargetFrameSize(private_data);
+
+    if(target && private_data->frame_length) {
+        updateQuality(private_data, target);
+    }
+
     jpeg_start_compress(&private_data->cinfo, true);
 
     for(int r = 0; r < frame->height; r++) {
@@ -225,11 +547,13 @@ static void* openDecoder(SVR_FrameProperties* frame_properties) {
 
     private_data->cinfo.err = jpeg_std_error(&private_data->jerr);
     jpeg_create_decompress(&private_data->cinfo);
+    initImageMemory((j_common_ptr) &private_data->cinfo, &private_data->memory);
 
     private_data->buffer = NULL;
     private_data->buffer_size = 0;
     private_data->bytes_needed = 0;
     private_data->bytes_received = 0;
+    private_data->length_received = 0;
 
     private_data->row = malloc(frame_properties->width * frame_properties->channels);
 
@@ -239,6 +563,7 @@ static void* openDecoder(SVR_FrameProperties* frame_properties) {
 static void closeDecoder(SVR_Decoder* decoder) {
     SVR_JpegDecoder* private_data = decoder->private_data;
     jpeg_destroy_decompress(&private_data->cinfo);
+    free(private_data->memory.arena);
     free(private_data->buffer);
     free(private_data->row);
     free(private_data);
@@ -253,17 +578,26 @@ static void decode(SVR_Decoder* decoder, void* data, size_t n) {
             private_data->bytes_received = 0;
 
             /* Read the first 4 bytes which give us the size of the encoded
-               frame */
-            private_data->bytes_needed = ntohl(((uint32_t*)data)[0]);
-            data = ((uint8_t*)data) + sizeof(uint32_t);
-            n -= sizeof(uint32_t);
+               frame. They may arrive in separate chunks */
+            chunk_size = Util_min(n, sizeof(uint32_t) - private_data->length_received);
+            memcpy(((uint8_t*) &private_data->length_prefix) + private_data->length_received, data, chunk_size);
+            private_data->length_received += chunk_size;
+            data = ((uint8_t*)data) + chunk_size;
+            n -= chunk_size;
+
+            if(private_data->length_received < sizeof(uint32_t)) {
+                break;
+            }
+
+            private_data->length_received = 0;
+            private_data->bytes_needed = ntohl(private_data->length_prefix);
 
             if(private_data->buffer_size < private_data->bytes_needed) {
                 private_data->buffer = realloc(private_data->buffer, private_data->bytes_needed);
                 private_data->buffer_size = private_data->bytes_needed;
             }
         } else {
-            chunk_size = Util_min(n, private_data->bytes_needed);
+            chunk_size = Util_min(n, private_data->bytes_needed - private_data->bytes_received);
             memcpy(private_data->buffer + private_data->bytes_received, data, chunk_size);
             private_data->bytes_received += chunk_size;
 
@@ -3,6 +3,20 @@
 
 #include "encoding_internal.h"
 
+/* Raw frame data is sent with each row padded to a multiple of this many
+   bytes, the default row alignment of an IplImage */
+#define RAW_ROW_ALIGNMENT 4
+
+typedef struct {
+    size_t row_size;
+    size_t wire_row_size;
+
+    /* Offset within the current row of the incoming data */
+    size_t row_offset;
+} RawDecoderData;
+
+static void* openDecoder(SVR_FrameProperties* frame_properties);
+static void closeDecoder(SVR_Decoder* decoder);
 static void encode(SVR_Encoder* encoder, IplImage* frame);
 static void decode(SVR_Decoder* decoder, void* data, size_t n);
 
@@ -11,15 +25,69 @@ SVR_Encoding SVR_ENCODING(raw) = {
         .openEncoder = NULL,
         .closeEncoder = NULL,
         .encode = encode,
-        .openDecoder = NULL,
-        .closeDecoder = NULL,
+        .openDecoder = openDecoder,
+        .closeDecoder = closeDecoder,
         .decode = decode
 };
 
+static size_t getWireRowSize(size_t row_size) {
+    return (row_size + RAW_ROW_ALIGNMENT - 1) & ~((size_t)RAW_ROW_ALIGNMENT - 1);
+}
+
+static void* openDecoder(SVR_FrameProperties* frame_properties) {
+    RawDecoderData* private_data = malloc(sizeof(RawDecoderData));
+
+    private_data->row_size = frame_properties->width * frame_properties->channels * ((frame_properties->depth & 255) / 8);
+    private_data->wire_row_size = getWireRowSize(private_data->row_size);
+    private_data->row_offset = 0;
+
+    return private_data;
+}
+
+static void closeDecoder(SVR_Decoder* decoder) {
+    free(decoder->private_data);
+}
+
 static void encode(SVR_Encoder* encoder, IplImage* frame) {
-    SVR_Encoder_provideData(encoder, frame->imageData, frame->imageSize);
+    static uint8_t padding[RAW_ROW_ALIGNMENT] = {0};
+    size_t row_size = frame->width * frame->nChannels * ((frame->depth & 255) / 8);
+    size_t wire_row_size = getWireRowSize(row_size);
+
+    if(frame->widthStep == wire_row_size) {
+        SVR_Encoder_provideData(encoder, frame->imageData, frame->imageSize);
+        return;
+    }
+
+    /* Rows are aligned differently from the wire format, so send them one at
+       a time */
+    for(int r = 0; r < frame->height; r++) {
+        SVR_Encoder_provideData(encoder, frame->imageData + r * frame->widthStep, row_size);
+        if(wire_row_size > row_size) {
+            SVR_Encoder_provideData(encoder, padding, wire_row_size - row_size);
+        }
+    }
 }
 
 static void decode(SVR_Decoder* decoder, void* data, size_t n) {
-    SVR_Decoder_writePaddedFrameData(decoder, data, n);
+    RawDecoderData* private_data = decoder->private_data;
+    size_t offset = 0;
+    size_t copy_size;
+
+    if(SVR_Decoder_getRowPadding(decoder) + private_data->row_size == private_data->wire_row_size) {
+        SVR_Decoder_writePaddedFrameData(decoder, data, n);
+        return;
+    }
+
+    /* Strip the wire padding and let the decoder apply the frame's own */
+    while(offset < n) {
+        if(private_data->row_offset < private_data->row_size) {
+            copy_size = Util_min(private_data->row_size - private_data->row_offset, n - offset);
+            SVR_Decoder_writeUnpaddedFrameData(decoder, ((uint8_t*)data) + offset, copy_size);
+        } else {
+            copy_size = Util_min(private_data->wire_row_size - private_data->row_offset, n - offset);
+        }
+
+        offset += copy_size;
+        private_data->row_offset = (private_data->row_offset + copy_size) % private_data->wire_row_size;
+    }
 }
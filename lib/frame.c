@@ -0,0 +1,67 @@
+/**
+ * \file
+ * \brief Frames
+ */
+
+#include <svr.h>
+
+static void SVR_Frame_release(void* _frame);
+
+static SVR_BlockAllocator* frame_blocks = NULL;
+
+/**
+ * \defgroup Frame Frame
+ * \ingroup Stream
+ * \brief Reference counted views of decoded frames
+ * \{
+ */
+
+/**
+ * \private
+ * \brief Initialize the frame component
+ */
+void SVR_Frame_init(void) {
+    frame_blocks = SVR_BlockAlloc_newAllocator(sizeof(SVR_Frame), 16);
+}
+
+/**
+ * \private
+ * \brief Wrap a decoded image in a frame
+ *
+ * The frame starts with a single reference. Once the last reference is
+ * released the image is given back to the allocator it came from, or to the
+ * frame pool if allocator is NULL.
+ *
+ * \param image The decoded image
+ * \param allocator The allocator the image came from, or NULL
+ * \return A new frame
+ */
+SVR_Frame* SVR_Frame_new(IplImage* image, SVR_FrameAllocator* allocator) {
+    SVR_Frame* frame = SVR_BlockAlloc_alloc(frame_blocks);
+
+    frame->image = image;
+    frame->sequence = 0;
+    frame->degrade_level = 0;
+    frame->allocator = allocator;
+    clock_gettime(CLOCK_MONOTONIC, &frame->decoded);
+    SVR_REFCOUNTED_INIT(frame, SVR_Frame_release);
+
+    return frame;
+}
+
+/**
+ * Give the image of a released frame back, on the garbage collector thread
+ */
+static void SVR_Frame_release(void* _frame) {
+    SVR_Frame* frame = (SVR_Frame*) _frame;
+
+    if(frame->allocator) {
+        frame->allocator->returnFrame(frame->image, frame->allocator->data);
+    } else {
+        SVR_FramePool_returnFrame(frame->image);
+    }
+
+    SVR_BlockAlloc_free(frame_blocks, frame);
+}
+
+/** \} */
@@ -0,0 +1,321 @@
+/**
+ * \file
+ * \brief Frame pool
+ */
+
+#include "svr.h"
+
+#include <sys/mman.h>
+
+/**
+ * Rows of pooled frames are aligned to this many bytes
+ */
+#define FRAME_ALIGNMENT 64
+
+/**
+ * Space reserved before the image data of each frame for pool bookkeeping
+ */
+#define FRAME_HEADER_SIZE FRAME_ALIGNMENT
+
+/**
+ * Frames at least this large are backed by huge pages when enabled
+ */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+#define DEFAULT_MAX_IDLE_FRAMES 16
+#define DEFAULT_MAX_IDLE_BYTES (64 * 1024 * 1024)
+
+typedef struct {
+    SVR_FrameProperties frame_properties;
+    size_t width_step;
+    size_t frame_size;
+
+    IplImage** idle_frames;
+    size_t idle_count;
+    size_t idle_capacity;
+} SVR_FramePoolBucket;
+
+typedef struct {
+    SVR_FramePoolBucket* bucket;
+
+    /* Size of the mapping backing this frame, or 0 if allocated from the heap */
+    size_t mapping_size;
+} SVR_FramePoolHeader;
+
+static SVR_FramePoolBucket* SVR_FramePool_getBucket(SVR_FrameProperties* frame_properties);
+static IplImage* SVR_FramePool_allocFrame(SVR_FramePoolBucket* bucket);
+static void SVR_FramePool_freeFrame(IplImage* frame);
+static SVR_FramePoolHeader* SVR_FramePool_getHeader(IplImage* frame);
+
+static List* buckets = NULL;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t max_idle_frames = DEFAULT_MAX_IDLE_FRAMES;
+static size_t max_idle_bytes = DEFAULT_MAX_IDLE_BYTES;
+static size_t idle_bytes = 0;
+static bool use_huge_pages = false;
+
+/**
+ * \defgroup FramePool Frame pool
+ * \ingroup Util
+ * \brief Process wide pool of reusable frames
+ *
+ * Frames are pooled by their frame properties, so a frame returned to the pool
+ * is handed out again to the next request for a frame of the same size, depth
+ * and channel count. Rows of pooled frames are aligned to 64 bytes. Large
+ * frames can optionally be backed by huge pages, either explicitly through
+ * MAP_HUGETLB or by hinting transparent huge pages where explicit huge pages
+ * are not available.
+ *
+ * Frames obtained from the pool must be given back with
+ * SVR_FramePool_returnFrame and never released with cvReleaseImage.
+ *
+ * \{
+ */
+
+/**
+ * \brief Initialize the frame pool
+ *
+ * Initialize the frame pool. Huge page backing is enabled if the SVR_HUGE_PAGES
+ * environment variable is set.
+ */
+void SVR_FramePool_init(void) {
+    buckets = List_new();
+
+    if(getenv("SVR_HUGE_PAGES")) {
+        SVR_FramePool_setHugePages(true);
+    }
+}
+
+/**
+ * \brief Close the frame pool
+ *
+ * Release all idle frames and the pool's data structures
+ */
+void SVR_FramePool_close(void) {
+    SVR_FramePoolBucket* bucket;
+
+    SVR_FramePool_trim();
+
+    while((bucket = List_remove(buckets, 0)) != NULL) {
+        free(bucket->idle_frames);
+        free(bucket);
+    }
+
+    List_destroy(buckets);
+}
+
+/**
+ * \brief Enable or disable huge page backing
+ *
+ * Enable or disable huge page backing for frames of at least 2 MB. Only frames
+ * allocated after this call are affected.
+ *
+ * \param enable True to back large frames with huge pages
+ */
+void SVR_FramePool_setHugePages(bool enable) {
+    pthread_mutex_lock(&pool_lock);
+    use_huge_pages = enable;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/**
+ * \brief Limit the number of idle frames
+ *
+ * Set the high-water marks for frames held idle in the pool. Frames returned
+ * beyond either limit are released immediately.
+ *
+ * \param frames Maximum number of idle frames kept for each set of frame
+ * properties
+ * \param bytes Maximum number of bytes held by idle frames in total
+ */
+void SVR_FramePool_setIdleLimit(size_t frames, size_t bytes) {
+    pthread_mutex_lock(&pool_lock);
+    max_idle_frames = frames;
+    max_idle_bytes = bytes;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/**
+ * \brief Get a frame
+ *
+ * Get a frame with the given properties, reusing an idle frame if one is
+ * available
+ *
+ * \param frame_properties Properties of the frame
+ * \return A frame which must be returned with SVR_FramePool_returnFrame
+ */
+IplImage* SVR_FramePool_getFrame(SVR_FrameProperties* frame_properties) {
+    SVR_FramePoolBucket* bucket;
+    IplImage* frame = NULL;
+
+    pthread_mutex_lock(&pool_lock);
+    bucket = SVR_FramePool_getBucket(frame_properties);
+    if(bucket->idle_count > 0) {
+        bucket->idle_count--;
+        frame = bucket->idle_frames[bucket->idle_count];
+        idle_bytes -= bucket->frame_size;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    if(frame == NULL) {
+        frame = SVR_FramePool_allocFrame(bucket);
+    }
+
+    return frame;
+}
+
+/**
+ * \brief Return a frame
+ *
+ * Return a frame obtained from SVR_FramePool_getFrame to the pool
+ *
+ * \param frame The frame to return
+ */
+void SVR_FramePool_returnFrame(IplImage* frame) {
+    SVR_FramePoolBucket* bucket = SVR_FramePool_getHeader(frame)->bucket;
+    bool keep = false;
+
+    pthread_mutex_lock(&pool_lock);
+    if(bucket->idle_count < max_idle_frames && idle_bytes + bucket->frame_size <= max_idle_bytes) {
+        if(bucket->idle_count == bucket->idle_capacity) {
+            bucket->idle_capacity = Util_max(bucket->idle_capacity * 2, 4);
+            bucket->idle_frames = realloc(bucket->idle_frames, bucket->idle_capacity * sizeof(IplImage*));
+        }
+
+        bucket->idle_frames[bucket->idle_count] = frame;
+        bucket->idle_count++;
+        idle_bytes += bucket->frame_size;
+        keep = true;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    if(!keep) {
+        SVR_FramePool_freeFrame(frame);
+    }
+}
+
+/**
+ * \brief Release idle frames
+ *
+ * Release every idle frame held by the pool
+ *
+ * \return Number of bytes released
+ */
+size_t SVR_FramePool_trim(void) {
+    SVR_FramePoolBucket* bucket;
+    List* frames = List_new();
+    IplImage* frame;
+    size_t released;
+
+    pthread_mutex_lock(&pool_lock);
+    for(int i = 0; (bucket = List_get(buckets, i)) != NULL; i++) {
+        while(bucket->idle_count > 0) {
+            bucket->idle_count--;
+            List_append(frames, bucket->idle_frames[bucket->idle_count]);
+        }
+    }
+    released = idle_bytes;
+    idle_bytes = 0;
+    pthread_mutex_unlock(&pool_lock);
+
+    while((frame = List_remove(frames, 0)) != NULL) {
+        SVR_FramePool_freeFrame(frame);
+    }
+    List_destroy(frames);
+
+    return released;
+}
+
+/** \} */
+
+/**
+ * \brief Find the bucket for a set of frame properties
+ *
+ * Find or create the bucket for the given frame properties. The pool must be
+ * locked.
+ *
+ * \param frame_properties Frame properties to look up
+ * \return The bucket for the frame properties
+ */
+static SVR_FramePoolBucket* SVR_FramePool_getBucket(SVR_FrameProperties* frame_properties) {
+    SVR_FramePoolBucket* bucket;
+    size_t row_size;
+
+    for(int i = 0; (bucket = List_get(buckets, i)) != NULL; i++) {
+        if(memcmp(&bucket->frame_properties, frame_properties, sizeof(SVR_FrameProperties)) == 0) {
+            return bucket;
+        }
+    }
+
+    row_size = frame_properties->width * frame_properties->channels * ((frame_properties->depth & 255) / 8);
+
+    bucket = malloc(sizeof(SVR_FramePoolBucket));
+    memcpy(&bucket->frame_properties, frame_properties, sizeof(SVR_FrameProperties));
+    bucket->width_step = (row_size + FRAME_ALIGNMENT - 1) & ~((size_t)FRAME_ALIGNMENT - 1);
+    bucket->frame_size = FRAME_HEADER_SIZE + bucket->width_step * frame_properties->height;
+    bucket->idle_frames = NULL;
+    bucket->idle_count = 0;
+    bucket->idle_capacity = 0;
+
+    List_append(buckets, bucket);
+
+    return bucket;
+}
+
+static IplImage* SVR_FramePool_allocFrame(SVR_FramePoolBucket* bucket) {
+    SVR_FrameProperties* frame_properties = &bucket->frame_properties;
+    SVR_FramePoolHeader* header = MAP_FAILED;
+    size_t mapping_size = 0;
+    IplImage* frame;
+
+    if(use_huge_pages && bucket->frame_size >= HUGE_PAGE_SIZE) {
+        mapping_size = (bucket->frame_size + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+
+#ifdef MAP_HUGETLB
+        header = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+
+        /* No explicit huge pages available, fall back to transparent huge pages */
+        if(header == MAP_FAILED) {
+            header = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+            if(header != MAP_FAILED) {
+                madvise(header, mapping_size, MADV_HUGEPAGE);
+            }
+#endif
+        }
+    }
+
+    if(header == MAP_FAILED) {
+        mapping_size = 0;
+        if(posix_memalign((void**) &header, FRAME_ALIGNMENT, bucket->frame_size) != 0) {
+            SVR_CRASH("Could not allocate frame");
+        }
+    }
+
+    frame = cvCreateImageHeader(cvSize(frame_properties->width, frame_properties->height),
+                                frame_properties->depth,
+                                frame_properties->channels);
+    cvSetData(frame, ((uint8_t*)header) + FRAME_HEADER_SIZE, bucket->width_step);
+
+    header->bucket = bucket;
+    header->mapping_size = mapping_size;
+
+    return frame;
+}
+
+static void SVR_FramePool_freeFrame(IplImage* frame) {
+    SVR_FramePoolHeader* header = SVR_FramePool_getHeader(frame);
+
+    cvReleaseImageHeader(&frame);
+
+    if(header->mapping_size) {
+        munmap(header, header->mapping_size);
+    } else {
+        free(header);
+    }
+}
+
+static SVR_FramePoolHeader* SVR_FramePool_getHeader(IplImage* frame) {
+    return (SVR_FramePoolHeader*) (frame->imageDataOrigin - FRAME_HEADER_SIZE);
+}
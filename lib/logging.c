@@ -94,4 +94,31 @@ void SVR_log(short level, char* message) {
     }
 }
 
+/**
+ * \brief Log a formatted message
+ *
+ * Format and log a message as SVR_log. The message is only formatted if it
+ * will be logged, and is formatted on the stack, so calling this with a log
+ * level below the threshold costs no allocation. Messages longer than
+ * SVR_LOG_MAX_LENGTH are truncated.
+ *
+ * \param level One of the log levels specified above
+ * \param format Format specifier, same as given to printf family
+ * \param ... arguments to format string
+ */
+void SVR_logf(short level, const char* format, ...) {
+    char message[SVR_LOG_MAX_LENGTH];
+    va_list ap;
+
+    if(level < min_log_level) {
+        return;
+    }
+
+    va_start(ap, format);
+    vsnprintf(message, sizeof(message), format, ap);
+    va_end(ap);
+
+    SVR_log(level, message);
+}
+
 /** \} */
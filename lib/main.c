@@ -26,6 +26,7 @@ void SVR_initCore(void) {
     SVR_RefCounter_init();
     SVR_BlockAlloc_init();
     SVR_MemPool_init();
+    SVR_FramePool_init();
     SVR_Message_init();
     SVR_Encoding_init();
 }
@@ -34,7 +35,8 @@ void SVR_initCore(void) {
  * \brief Set the SVR server address
  *
  * Specify the IP address of the SVR server to use. This must be called before
- * SVR_init
+ * SVR_init. An address of the form "unix:PATH" connects over a Unix domain
+ * socket instead, with "unix:" alone using the server's default path
  *
  * \param address Address of the server as a string
  */
@@ -67,10 +69,11 @@ int SVR_init(void) {
 
     if(getenv("SVR_SERVER")) {
         SVR_setServerAddress(getenv("SVR_SERVER"));
-        SVR_log(SVR_NORMAL, Util_format("Using SVR server \"%s\" from SVR_SERVER environment variable", server_address));
+        SVR_logf(SVR_NORMAL, "Using SVR server \"%s\" from SVR_SERVER environment variable", server_address);
     }
 
     SVR_Stream_init();
+    SVR_MessageRouter_init();
 
     if(server_address) {
         return SVR_Comm_init(server_address);
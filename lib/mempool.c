@@ -8,10 +8,16 @@
 /**
  * Align all allocations on a byte boundary of this alignment
  */
-#define ALLOC_ALIGNMENT 2
+#define ALLOC_ALIGNMENT 16
+
+/**
+ * Space reserved at the start of each chunk for the chunk's descriptor
+ */
+#define ARENA_HEADER_SIZE ((sizeof(SVR_Arena) + ALLOC_ALIGNMENT - 1) & ~((size_t)ALLOC_ALIGNMENT - 1))
 
-static SVR_BlockAllocator* descriptor_allocator = NULL;
 static SVR_Arena* SVR_Arena_allocExternal(size_t size);
+static void* SVR_Arena_fit(SVR_Arena* chunk, size_t size);
+static void SVR_Arena_freeChain(SVR_Arena* chunk);
 
 /**
  * \defgroup MemPool Memory pool
@@ -23,10 +29,10 @@ static SVR_Arena* SVR_Arena_allocExternal(size_t size);
 /**
  * \brief Initialize the SVR_MemPool component
  *
- * Initialize the SVR_MemPool component
+ * Initialize the SVR_MemPool component. Arena descriptors are stored at the
+ * start of their own chunks, so there is currently nothing to set up.
  */
 void SVR_MemPool_init(void) {
-    descriptor_allocator = SVR_BlockAlloc_newAllocator(sizeof(SVR_Arena), 4);
 }
 
 /**
@@ -35,7 +41,6 @@ void SVR_MemPool_init(void) {
  * Close the SVR_MemPool component
  */
 void SVR_MemPool_close(void) {
-    SVR_BlockAlloc_freeAllocator(descriptor_allocator);
 }
 
 /**
@@ -45,31 +50,39 @@ void SVR_MemPool_close(void) {
  * SVR_MemPool_write, SVR_MemPool_reserve, and SVR_MemPool_strdup. When the allocation is no
  * longer needed, it should be passed to SVR_MemPool_free
  *
+ * \param allocator The block allocator chunks of the arena are taken from.
+ * Blocks must be larger than the chunk descriptor.
  * \return The new allocation object
  */
 SVR_Arena* SVR_Arena_alloc(SVR_BlockAllocator* allocator) {
-    SVR_Arena* alloc = SVR_BlockAlloc_alloc(descriptor_allocator);
+    SVR_Arena* alloc;
 
 #ifdef SVR_DUMMY_ALLOC
-    alloc->base = NULL;
-    alloc->allocator = NULL;
+    alloc = SVR_Arena_allocExternal(0);
 #else
-    alloc->base = SVR_BlockAlloc_alloc(allocator);
+    alloc = SVR_BlockAlloc_alloc(allocator);
+    alloc->base = ((uint8_t*)alloc) + ARENA_HEADER_SIZE;
+    alloc->size = SVR_BlockAlloc_getBlockSize(allocator) - ARENA_HEADER_SIZE;
     alloc->allocator = allocator;
-#endif
     alloc->write_index = 0;
     alloc->next = NULL;
+    alloc->current = alloc;
+    alloc->large = NULL;
+#endif
 
     return alloc;
 }
 
 static SVR_Arena* SVR_Arena_allocExternal(size_t size) {
-    SVR_Arena* alloc = SVR_BlockAlloc_alloc(descriptor_allocator);
+    SVR_Arena* alloc = malloc(ARENA_HEADER_SIZE + size);
 
-    alloc->base = malloc(size);
+    alloc->base = ((uint8_t*)alloc) + ARENA_HEADER_SIZE;
+    alloc->size = size;
     alloc->allocator = NULL;
     alloc->write_index = 0;
     alloc->next = NULL;
+    alloc->current = alloc;
+    alloc->large = NULL;
 
     return alloc;
 }
@@ -82,17 +95,31 @@ static SVR_Arena* SVR_Arena_allocExternal(size_t size) {
  * \param alloc The allocation to free
  */
 void SVR_Arena_free(SVR_Arena* alloc) {
-    if(alloc->next) {
-        SVR_Arena_free(alloc->next);
-    }
+    SVR_Arena_freeChain(alloc->large);
+    SVR_Arena_freeChain(alloc);
+}
 
-    if(alloc->allocator == NULL) {
-        free(alloc->base);
-    } else {
-        SVR_BlockAlloc_free(alloc->allocator, alloc->base);
+/**
+ * \brief Reset an allocation for reuse
+ *
+ * Discard everything reserved in the arena while keeping its chunks, so the
+ * arena can be reused without returning its memory. Pointers previously
+ * returned from the arena become invalid.
+ *
+ * \param alloc The allocation to reset
+ */
+void SVR_Arena_reset(SVR_Arena* alloc) {
+    SVR_Arena* chunk;
+
+    /* Oversized reservations are not worth keeping */
+    SVR_Arena_freeChain(alloc->large);
+    alloc->large = NULL;
+
+    for(chunk = alloc; chunk != NULL; chunk = chunk->next) {
+        chunk->write_index = 0;
     }
 
-    SVR_BlockAlloc_free(descriptor_allocator, alloc);
+    alloc->current = alloc;
 }
 
 /**
@@ -163,59 +190,81 @@ void* SVR_Arena_sprintf(SVR_Arena* alloc, const char* format, ...) {
  *
  * Reserve space in the allocation that can be written to by the caller instead
  * of by one of SVR_MemPool_write or SVR_MemPool_strup. This call is therefore
- * analogous to malloc.
+ * analogous to malloc. The returned pointer is aligned to ALLOC_ALIGNMENT
+ * bytes.
  *
  * \param alloc The allocation to reserve space in
  * \param size The number of bytes to reserve
  * \return A pointer to the reserved space
  */
 void* SVR_Arena_reserve(SVR_Arena* alloc, size_t size) {
-#ifdef SVR_DUMMY_ALLOC
-    while(alloc->next) {
-        alloc = alloc->next;
-    }
-
-    alloc->next = SVR_Arena_allocExternal(size);
-    return alloc->next->base;
-#else
-    SVR_BlockAllocator* allocator = alloc->allocator;
-    size_t block_size = SVR_BlockAlloc_getBlockSize(allocator);
-    bool found;
+    SVR_Arena* chunk;
     void* p;
 
-    /* Round up to the nearest boundary to keep alignment if not already aligned */
-    if(size % ALLOC_ALIGNMENT > 0) {
-        size += (ALLOC_ALIGNMENT - (size % ALLOC_ALIGNMENT));
+#ifndef SVR_DUMMY_ALLOC
+    /* Only the current chunk is ever tried, chunks before it are full */
+    p = SVR_Arena_fit(alloc->current, size);
+    if(p) {
+        return p;
     }
 
-    /* Find a chunk with enough free space or exhaust the list */
-    found = false;
-    while(alloc->next) {
-        if(alloc->write_index + size < block_size) {
-            found = true;
-            break;
+    if(size + ALLOC_ALIGNMENT - 1 <= alloc->size) {
+        /* Move on to the next chunk, which is either kept from before the last
+           reset or newly allocated */
+        chunk = alloc->current;
+        if(chunk->next == NULL) {
+            chunk->next = SVR_Arena_alloc(alloc->allocator);
         }
 
-        alloc = alloc->next;
+        alloc->current = chunk->next;
+        return SVR_Arena_fit(alloc->current, size);
     }
+#endif
 
-    /* Allocate a new block if necessary */
-    if(!found) {
-        if(size > block_size) {
-            /* Too big for a block, allocate directly */
-            alloc->next = SVR_Arena_allocExternal(size);
-        } else {
-            alloc->next = SVR_Arena_alloc(allocator);
-        }
+    /* Too big for a block, allocate directly */
+    chunk = SVR_Arena_allocExternal(size);
+    chunk->write_index = size;
+    chunk->next = alloc->large;
+    alloc->large = chunk;
 
-        alloc = alloc->next;
-    }
+    return chunk->base;
+}
 
-    p = ((uint8_t*)alloc->base) + alloc->write_index;
-    alloc->write_index += size;
+/** \} */
 
-    return p;
-#endif
+/**
+ * \brief Bump allocate from a single chunk
+ *
+ * \param chunk The chunk to allocate from
+ * \param size The number of bytes to reserve
+ * \return Aligned pointer to the reserved space or NULL if the chunk does not
+ * have enough space left
+ */
+static void* SVR_Arena_fit(SVR_Arena* chunk, size_t size) {
+    uintptr_t start = ((uintptr_t) chunk->base) + chunk->write_index;
+    uintptr_t aligned = (start + ALLOC_ALIGNMENT - 1) & ~((uintptr_t)ALLOC_ALIGNMENT - 1);
+    size_t end = (aligned - ((uintptr_t) chunk->base)) + size;
+
+    if(end > chunk->size) {
+        return NULL;
+    }
+
+    chunk->write_index = end;
+    return (void*) aligned;
 }
 
-/** \} */
+static void SVR_Arena_freeChain(SVR_Arena* chunk) {
+    SVR_Arena* next;
+
+    while(chunk) {
+        next = chunk->next;
+
+        if(chunk->allocator == NULL) {
+            free(chunk);
+        } else {
+            SVR_BlockAlloc_free(chunk->allocator, chunk);
+        }
+
+        chunk = next;
+    }
+}
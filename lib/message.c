@@ -5,9 +5,10 @@
 
 #include "svr.h"
 
+#include <unistd.h>
+
 static SVR_BlockAllocator* message_allocator = NULL;
 
-static SVR_Message* SVR_Message_newWithAlloc(unsigned int component_count, SVR_Arena* alloc);
 static SVR_PackedMessage* SVR_PackedMessage_newWithAlloc(size_t packed_length, SVR_Arena* alloc);
 
 /**
@@ -49,6 +50,7 @@ SVR_PackedMessage* SVR_Message_pack(SVR_Message* message) {
 
     packed_message->payload = message->payload;
     packed_message->payload_size = message->payload_size;
+    packed_message->fd = message->fd;
 
     return packed_message;
 }
@@ -69,6 +71,7 @@ SVR_Message* SVR_PackedMessage_unpack(SVR_PackedMessage* packed_message) {
 
     /* Read header */
     pack_offset = SVR_unpack(packed_message->data, pack_offset, "hhhh", &data_length, &message->request_id, &message->count, &message->payload_size);
+    message->fd = packed_message->fd;
 
     /* Store points to components (does not copy) */
     message->components = SVR_Arena_reserve(packed_message->alloc, sizeof(char*) * message->count);
@@ -81,17 +84,22 @@ SVR_Message* SVR_PackedMessage_unpack(SVR_PackedMessage* packed_message) {
 }
 
 /**
- * \brief Create a new message
+ * \brief Create a new message in an existing arena
  *
  * Create a new message with space for the given number of components. Space is
  * only allocated for the char pointers to the components, not to the
  * components themselves. Space for the components should be allocated and freed
  * separately.
  *
+ * The message is released along with the arena, so a caller sending many
+ * messages can keep a single arena and call SVR_Arena_reset on it between
+ * messages instead of calling SVR_Message_release.
+ *
  * \param component_count The number of components to make space for. If component_count is 0, no allocation is done
+ * \param alloc The arena to allocate the message from
  * \return A new message
  */
-static SVR_Message* SVR_Message_newWithAlloc(unsigned int component_count, SVR_Arena* alloc) {
+SVR_Message* SVR_Message_newWithAlloc(unsigned int component_count, SVR_Arena* alloc) {
     SVR_Message* message = SVR_Arena_reserve(alloc, sizeof(SVR_Message));
 
     message->request_id = 0;
@@ -99,6 +107,7 @@ static SVR_Message* SVR_Message_newWithAlloc(unsigned int component_count, SVR_A
     message->components = NULL;
     message->payload = NULL;
     message->payload_size = 0;
+    message->fd = -1;
     message->alloc = alloc;
 
     if(component_count) {
@@ -113,6 +122,18 @@ SVR_Message* SVR_Message_new(unsigned int component_count) {
     return SVR_Message_newWithAlloc(component_count, alloc);
 }
 
+/**
+ * \brief Get a new arena for messages
+ *
+ * Return a new arena suitable for use with SVR_Message_newWithAlloc. The arena
+ * should be freed with SVR_Arena_free when no longer needed.
+ *
+ * \return A new arena
+ */
+SVR_Arena* SVR_Message_newArena(void) {
+    return SVR_Arena_alloc(message_allocator);
+}
+
 /**
  * \brief Create a new packed message object
  *
@@ -129,6 +150,7 @@ static SVR_PackedMessage* SVR_PackedMessage_newWithAlloc(size_t packed_length, S
     packed_message->length = packed_length;
     packed_message->payload = NULL;
     packed_message->payload_size = 0;
+    packed_message->fd = -1;
     packed_message->alloc = alloc;
 
     return packed_message;
@@ -143,7 +165,37 @@ void SVR_PackedMessage_release(SVR_PackedMessage* packed_message) {
     SVR_Arena_free(packed_message->alloc);
 }
 
+/**
+ * \brief Copy a message's data into its arena
+ *
+ * Copy the components and payload of a message into the message's own arena,
+ * so it no longer references a buffer owned by someone else, such as the
+ * buffer of the SVR_NetReader it was received through.
+ *
+ * \param message The message to detach
+ */
+void SVR_Message_detach(SVR_Message* message) {
+    for(int i = 0; i < message->count; i++) {
+        message->components[i] = SVR_Arena_strdup(message->alloc, message->components[i]);
+    }
+
+    if(message->payload_size) {
+        message->payload = SVR_Arena_write(message->alloc, message->payload, message->payload_size);
+    }
+}
+
+/**
+ * \brief Release a message
+ *
+ * Free the arena backing the message and close any file descriptor still
+ * attached to it
+ *
+ * \param message The message to release
+ */
 void SVR_Message_release(SVR_Message* message) {
+    if(message->fd >= 0) {
+        close(message->fd);
+    }
     SVR_Arena_free(message->alloc);
 }
 
@@ -17,10 +17,11 @@
  *
  * Process a stream orphaned message to mark the given stream as orphaned
  *
+ * \param context The context the message was received over
  * \param message Message to process
  * \return 0 on success, -1 otherwise
  */
-int SVR_MessageHandler_streamOrphaned(SVR_Message* message) {
+int SVR_MessageHandler_streamOrphaned(SVR_Context* context, SVR_Message* message) {
     const char* stream_name;
 
     if(message->count != 2) {
@@ -28,7 +29,45 @@ int SVR_MessageHandler_streamOrphaned(SVR_Message* message) {
     }
 
     stream_name = message->components[1];
-    SVR_Stream_setOrphaned(stream_name);
+    SVR_Stream_setOrphaned(context, stream_name);
+    return 0;
+}
+
+/**
+ * \brief Process a "stream adjusted" message
+ *
+ * Process a stream adjusted message sent when an overloaded server changes the
+ * degrade level of a stream
+ *
+ * \param context The context the message was received over
+ * \param message Message to process
+ * \return 0 on success, -1 otherwise
+ */
+int SVR_MessageHandler_streamAdjusted(SVR_Context* context, SVR_Message* message) {
+    if(message->count != 4) {
+        return -1;
+    }
+
+    SVR_Stream_setAdjusted(context, message->components[1], atoi(message->components[2]), message->components[3]);
+    return 0;
+}
+
+/**
+ * \brief Process a "source credit" message
+ *
+ * Process a source credit message by which the server lets a client source
+ * send more frames
+ *
+ * \param context The context the message was received over
+ * \param message Message to process
+ * \return 0 on success, -1 otherwise
+ */
+int SVR_MessageHandler_sourceCredit(SVR_Context* context, SVR_Message* message) {
+    if(message->count != 3) {
+        return -1;
+    }
+
+    SVR_Source_grantCredits(context, message->components[1], atoi(message->components[2]));
     return 0;
 }
 
@@ -37,10 +76,11 @@ int SVR_MessageHandler_streamOrphaned(SVR_Message* message) {
  *
  * Process a data message which provides frame data for a stream
  *
+ * \param context The context the message was received over
  * \param message Message to process
  * \return 0 on success, -1 otherwise
  */
-int SVR_MessageHandler_data(SVR_Message* message) {
+int SVR_MessageHandler_data(SVR_Context* context, SVR_Message* message) {
     const char* stream_name;
 
     if(message->count != 2 || message->payload_size == 0 || strcmp(message->components[0], "Data") != 0) {
@@ -48,7 +88,7 @@ int SVR_MessageHandler_data(SVR_Message* message) {
     }
 
     stream_name = message->components[1];
-    SVR_Stream_provideData(stream_name, message->payload, message->payload_size);
+    SVR_Stream_provideData(context, stream_name, message->payload, message->payload_size);
     return 0;
 }
 
@@ -58,10 +98,11 @@ int SVR_MessageHandler_data(SVR_Message* message) {
  * Process a kick message sent by the server when the client is being forcefully
  * dropped
  *
+ * \param context The context the message was received over
  * \param message Message to process
  * \return 0 on success, -1 otherwise
  */
-int SVR_MessageHandler_kick(SVR_Message* message) {
+int SVR_MessageHandler_kick(SVR_Context* context, SVR_Message* message) {
     SVR_log(SVR_CRITICAL, "Kicked from SVR server!");
     return 0;
 }
@@ -7,11 +7,13 @@
 
 typedef struct {
     const char* request_string;
-    int (*callback)(SVR_Message* message);
+    int (*callback)(SVR_Context* context, SVR_Message* message);
 } SVR_RequestMapping;
 
 static SVR_RequestMapping request_types[] = {
     {"Stream.orphaned", SVR_MessageHandler_streamOrphaned},
+    {"Stream.adjusted", SVR_MessageHandler_streamAdjusted},
+    {"Source.credit", SVR_MessageHandler_sourceCredit},
     {"Data", SVR_MessageHandler_data},
     {"SVR.kick", SVR_MessageHandler_kick}
 };
@@ -84,10 +86,11 @@ static SVR_RequestMapping* SVR_findRequestMapping(const char* request_string) {
  * Process an unsolicited message, i.e. a message that isn't a response to an
  * explicit request
  *
+ * \param context The context the message was received over
  * \param message The message to process
  * \return 0 and success, all other values indicate an error condition
  */
-int SVR_MessageRouter_processMessage(SVR_Message* message) {
+int SVR_MessageRouter_processMessage(SVR_Context* context, SVR_Message* message) {
     SVR_RequestMapping* request_type;
 
     if(message->count == 0) {
@@ -97,11 +100,11 @@ int SVR_MessageRouter_processMessage(SVR_Message* message) {
 
     request_type = SVR_findRequestMapping(message->components[0]);
     if(request_type == NULL) {
-        SVR_log(SVR_ERROR, Util_format("Unsupported message type: %s", message->components[0]));
+        SVR_logf(SVR_ERROR, "Unsupported message type: %s", message->components[0]);
         return -1;
     }
 
-    return request_type->callback(message);
+    return request_type->callback(context, message);
 }
 
 /** \} */
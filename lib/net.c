@@ -5,6 +5,10 @@
 
 #include "svr.h"
 
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 /**
  * \defgroup Net Message IO
  * \ingroup Comm
@@ -12,10 +16,146 @@
  * \{
  */
 
+/**
+ * \brief Check whether a connection stays on this machine
+ *
+ * A connection is local if it is a Unix socket, or if the peer address is a
+ * loopback address or the socket's own address.
+ *
+ * \param socket A connected socket
+ * \return True if the peer is on this machine
+ */
+bool SVR_Net_isLocal(int socket) {
+    struct sockaddr_storage local;
+    struct sockaddr_storage peer;
+    socklen_t local_length = sizeof(local);
+    socklen_t peer_length = sizeof(peer);
+    struct in6_addr* local6;
+    struct in6_addr* peer6;
+    in_addr_t peer4;
+
+    if(getsockname(socket, (struct sockaddr*) &local, &local_length) ||
+       getpeername(socket, (struct sockaddr*) &peer, &peer_length)) {
+        return false;
+    }
+
+    switch(peer.ss_family) {
+    case AF_UNIX:
+        return true;
+
+    case AF_INET:
+        peer4 = ((struct sockaddr_in*) &peer)->sin_addr.s_addr;
+        return (ntohl(peer4) >> 24) == IN_LOOPBACKNET ||
+               peer4 == ((struct sockaddr_in*) &local)->sin_addr.s_addr;
+
+    case AF_INET6:
+        local6 = &((struct sockaddr_in6*) &local)->sin6_addr;
+        peer6 = &((struct sockaddr_in6*) &peer)->sin6_addr;
+        return IN6_IS_ADDR_LOOPBACK(peer6) || memcmp(local6, peer6, sizeof(*peer6)) == 0 ||
+               (IN6_IS_ADDR_V4MAPPED(peer6) && peer6->s6_addr[12] == IN_LOOPBACKNET);
+    }
+
+    return false;
+}
+
+/**
+ * \brief Send data along with a file descriptor
+ *
+ * Send the start of a buffer with the descriptor attached as SCM_RIGHTS
+ * ancillary data. The socket must be a Unix domain socket.
+ *
+ * \param socket Socket to send over
+ * \param buffer Data to send
+ * \param len Length of the data
+ * \param fd File descriptor to pass
+ * \return The number of bytes sent, or -1 on error
+ */
+static ssize_t SVR_Net_sendWithFd(int socket, void* buffer, size_t len, int fd) {
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct cmsghdr* cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+
+    iov.iov_base = buffer;
+    iov.iov_len = len;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    return sendmsg(socket, &msg, 0);
+}
+
+/**
+ * \brief Receive data along with a file descriptor
+ *
+ * Receive into a buffer like recv, storing any descriptor passed with the data
+ * to fd. Descriptors received beyond the first are closed.
+ *
+ * \param socket Socket to receive from
+ * \param buffer Buffer to receive into
+ * \param len Length of the buffer
+ * \param flags Additional flags as described in recv(2)
+ * \param fd Set to a received file descriptor, if one was passed
+ * \return The number of bytes received, as for recv
+ */
+static ssize_t SVR_Net_recvWithFd(int socket, void* buffer, size_t len, int flags, int* fd) {
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(4 * sizeof(int))];
+    } control;
+    struct cmsghdr* cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    ssize_t n;
+    int received;
+
+    iov.iov_base = buffer;
+    iov.iov_len = len;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    n = recvmsg(socket, &msg, flags | MSG_CMSG_CLOEXEC);
+
+    for(cmsg = CMSG_FIRSTHDR(&msg); n >= 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+
+        for(size_t i = 0; i < (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int); i++) {
+            memcpy(&received, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if(*fd < 0) {
+                *fd = received;
+            } else {
+                close(received);
+            }
+        }
+    }
+
+    return n;
+}
+
 /**
  * \brief Send a packed message
  *
- * Send a packed message over a socket
+ * Send a packed message over a socket. If the message carries a file
+ * descriptor it is passed along with the first byte of the message, which
+ * requires a Unix domain socket.
  *
  * \param socket Socket to send the message over
  * \param packed_message Packed message to send
@@ -25,6 +165,15 @@ int SVR_Net_sendPackedMessage(int socket, SVR_PackedMessage* packed_message) {
 
     /* Send message body */
     sent_bytes = 0;
+    if(packed_message->fd >= 0) {
+        n = SVR_Net_sendWithFd(socket, packed_message->data, packed_message->length, packed_message->fd);
+        if(n < 0) {
+            return n;
+        }
+
+        sent_bytes += n;
+    }
+
     while(sent_bytes < packed_message->length) {
         n = send(socket, ((uint8_t*)packed_message->data) + sent_bytes, packed_message->length - sent_bytes, 0);
         if(n < 0) {
@@ -72,15 +221,20 @@ int SVR_Net_sendMessage(int socket, SVR_Message* message) {
  * \param buffer A pointer to a buffer to write to
  * \param len The amount of data to read
  * \param flags Additional flags as described in recv(2)
+ * \param fd If not NULL, set to a file descriptor passed with the data
  * \return Return the number of bytes read (len) or -1 if an error occurs or 0
  * if the remote partner performs a shutdown
  */
-static int SVR_Net_recv(int socket, void* buffer, size_t len, int flags) {
+static int SVR_Net_recv(int socket, void* buffer, size_t len, int flags, int* fd) {
     int read = 0;
     int n;
 
     while(read < len) {
-        n = recv(socket, ((char*)buffer) + read, len - read, flags | MSG_WAITALL);
+        if(fd) {
+            n = SVR_Net_recvWithFd(socket, ((char*)buffer) + read, len - read, flags | MSG_WAITALL, fd);
+        } else {
+            n = recv(socket, ((char*)buffer) + read, len - read, flags | MSG_WAITALL);
+        }
 
         if(n <= 0) {
             return n;
@@ -97,7 +251,8 @@ static int SVR_Net_recv(int socket, void* buffer, size_t len, int flags) {
  *
  * Receive a message from the given socket. Will not retrieve the payload. If a
  * payload accompanies the message a call to SVR_Net_receivePayload should be
- * made after this call
+ * made after this call. A file descriptor passed with the message is stored to
+ * message->fd and is owned by the message.
  */
 SVR_Message* SVR_Net_receiveMessage(int socket) {
     SVR_PackedMessage* packed_message;
@@ -106,7 +261,7 @@ SVR_Message* SVR_Net_receiveMessage(int socket) {
 
     /* The first byte received should be the size of the message that follows
        minus the header data */
-    n = SVR_Net_recv(socket, &message_length, sizeof(uint16_t), MSG_PEEK);
+    n = SVR_Net_recv(socket, &message_length, sizeof(uint16_t), MSG_PEEK, NULL);
 
     if(n <= 0) {
         return NULL;
@@ -116,8 +271,12 @@ SVR_Message* SVR_Net_receiveMessage(int socket) {
     message_length = ntohs(message_length);
     packed_message = SVR_PackedMessage_new(message_length + SVR_MESSAGE_PREFIX_LEN);
 
-    n = SVR_Net_recv(socket, packed_message->data, packed_message->length, 0);
+    /* A passed file descriptor arrives with the first byte of the body */
+    n = SVR_Net_recv(socket, packed_message->data, packed_message->length, 0, &packed_message->fd);
     if(n <= 0) {
+        if(packed_message->fd >= 0) {
+            close(packed_message->fd);
+        }
         SVR_PackedMessage_release(packed_message);
         return NULL;
     }
@@ -140,7 +299,209 @@ SVR_Message* SVR_Net_receiveMessage(int socket) {
  * one of the return codes for the recv function
  */
 int SVR_Net_receivePayload(int socket, SVR_Message* message) {
-    return SVR_Net_recv(socket, message->payload, message->payload_size, 0);
+    return SVR_Net_recv(socket, message->payload, message->payload_size, 0, NULL);
+}
+
+/**
+ * \brief Create a buffered reader
+ *
+ * Create a reader which receives messages from the given socket. Once a reader
+ * is used all messages from the socket must be received through it.
+ *
+ * \param socket The socket to read from
+ * \return A new reader
+ */
+SVR_NetReader* SVR_NetReader_new(int socket) {
+    SVR_NetReader* reader = malloc(sizeof(SVR_NetReader));
+
+    reader->socket = socket;
+    reader->buffer = malloc(SVR_NETREADER_BUFFER_SIZE);
+    reader->start = 0;
+    reader->end = 0;
+    reader->fd_count = 0;
+
+    return reader;
+}
+
+/**
+ * \brief Destroy a buffered reader
+ *
+ * Free the reader and close any received file descriptors not yet handed out
+ * with a message. The socket is not closed.
+ *
+ * \param reader The reader to destroy
+ */
+void SVR_NetReader_destroy(SVR_NetReader* reader) {
+    for(int i = 0; i < reader->fd_count; i++) {
+        close(reader->fds[i]);
+    }
+
+    free(reader->buffer);
+    free(reader);
+}
+
+/**
+ * \brief Read more data into the buffer
+ *
+ * Move any partial message to the front of the buffer and read as much as is
+ * available into the space after it.
+ *
+ * \param reader The reader to fill
+ * \return The number of bytes read, 0 if the socket was shut down, or -1 on error
+ */
+static ssize_t SVR_NetReader_fill(SVR_NetReader* reader) {
+    int fd = -1;
+    ssize_t n;
+
+    if(reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        for(int i = 0; i < reader->fd_count; i++) {
+            reader->fd_ends[i] -= reader->start;
+        }
+
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+
+    do {
+        n = SVR_Net_recvWithFd(reader->socket, reader->buffer + reader->end,
+                               SVR_NETREADER_BUFFER_SIZE - reader->end, 0, &fd);
+    } while(n < 0 && errno == EINTR);
+
+    if(n <= 0) {
+        if(fd >= 0) {
+            close(fd);
+        }
+        return n;
+    }
+
+    reader->end += n;
+
+    /* A read stops after the data a descriptor was sent with, so the
+       descriptor belongs to the message spanning the end of this read */
+    if(fd >= 0) {
+        if(reader->fd_count == SVR_NETREADER_MAX_FDS) {
+            SVR_log(SVR_WARNING, "Too many file descriptors received, dropping one");
+            close(fd);
+        } else {
+            reader->fds[reader->fd_count] = fd;
+            reader->fd_ends[reader->fd_count] = reader->end;
+            reader->fd_count++;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * \brief Attach a pending file descriptor to a message
+ *
+ * \param reader The reader the message was parsed from
+ * \param message The message
+ * \param message_start Buffer offset of the start of the message
+ * \param message_end Buffer offset of the end of the message
+ */
+static void SVR_NetReader_takeFd(SVR_NetReader* reader, SVR_Message* message,
+                                 size_t message_start, size_t message_end) {
+    int i = 0;
+
+    while(i < reader->fd_count) {
+        if(reader->fd_ends[i] > message_end) {
+            i++;
+            continue;
+        }
+
+        if(reader->fd_ends[i] > message_start && message->fd < 0) {
+            message->fd = reader->fds[i];
+        } else {
+            close(reader->fds[i]);
+        }
+
+        reader->fd_count--;
+        reader->fds[i] = reader->fds[reader->fd_count];
+        reader->fd_ends[i] = reader->fd_ends[reader->fd_count];
+    }
+}
+
+/**
+ * \brief Receive a message through a reader
+ *
+ * Receive the next message along with its payload. Data is read from the
+ * socket in large reads and the message is parsed in place, so its components
+ * and payload point into the reader's buffer and are only valid until the next
+ * call on the same reader. Call SVR_Message_detach to keep a message beyond
+ * that. The message itself must still be released with SVR_Message_release.
+ *
+ * \param reader The reader to receive from
+ * \return The next message, or NULL if the socket was shut down, an error
+ * occured or a malformed message was received
+ */
+SVR_Message* SVR_NetReader_receiveMessage(SVR_NetReader* reader) {
+    SVR_Message* message;
+    uint16_t data_length;
+    uint16_t request_id;
+    uint16_t count;
+    uint16_t payload_size;
+    size_t total_length;
+    size_t available;
+    size_t offset;
+    uint8_t* data;
+
+    /* Read until a complete message is buffered. The largest message is
+       smaller than the buffer */
+    while(true) {
+        available = reader->end - reader->start;
+        if(available >= SVR_MESSAGE_PREFIX_LEN) {
+            SVR_unpack(reader->buffer + reader->start, 0, "hhhh", &data_length, &request_id, &count, &payload_size);
+            total_length = SVR_MESSAGE_PREFIX_LEN + data_length + payload_size;
+            if(available >= total_length) {
+                break;
+            }
+        }
+
+        if(SVR_NetReader_fill(reader) <= 0) {
+            return NULL;
+        }
+    }
+
+    data = reader->buffer + reader->start;
+    offset = SVR_MESSAGE_PREFIX_LEN;
+
+    /* Components must be null terminated within the message data */
+    if((count > 0 && data_length == 0) ||
+       (data_length > 0 && data[SVR_MESSAGE_PREFIX_LEN + data_length - 1] != '\0')) {
+        SVR_log(SVR_ERROR, "Received a malformed message");
+        return NULL;
+    }
+
+    message = SVR_Message_new(count);
+    message->request_id = request_id;
+    message->payload_size = payload_size;
+
+    for(int i = 0; i < count; i++) {
+        offset = SVR_unpack(data, offset, "s", &message->components[i]);
+        if(offset > SVR_MESSAGE_PREFIX_LEN + data_length) {
+            SVR_log(SVR_ERROR, "Received a malformed message");
+            SVR_Message_release(message);
+            return NULL;
+        }
+    }
+
+    if(payload_size) {
+        message->payload = data + SVR_MESSAGE_PREFIX_LEN + data_length;
+    }
+
+    if(reader->fd_count) {
+        SVR_NetReader_takeFd(reader, message, reader->start, reader->start + total_length);
+    }
+
+    reader->start += total_length;
+    if(reader->start == reader->end) {
+        reader->start = 0;
+        reader->end = 0;
+    }
+
+    return message;
 }
 
 /** \} */
@@ -7,7 +7,14 @@
 
 #include "svr.h"
 
-static Queue* garbage_queue = NULL;
+/* Reference counters awaiting collection. The queue is linked through the
+   counters themselves so queueing an object never allocates */
+static SVR_RefCounter* garbage_head = NULL;
+static SVR_RefCounter* garbage_tail = NULL;
+static pthread_mutex_t garbage_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t garbage_available = PTHREAD_COND_INITIALIZER;
+static bool garbage_collector_closing = false;
+
 static SVR_BlockAllocator* allocator = NULL;
 static pthread_t garbage_collector_thread;
 
@@ -55,7 +62,7 @@ static void* SVR_RefCounter_garbageCollector(void* _unused);
  * SVR_initCore.
  */
 void SVR_RefCounter_init(void) {
-    garbage_queue = Queue_new();
+    garbage_collector_closing = false;
     allocator = SVR_BlockAlloc_newAllocator(sizeof(SVR_RefCounter), 8);
 
     pthread_create(&garbage_collector_thread, NULL, &SVR_RefCounter_garbageCollector, NULL);
@@ -68,7 +75,11 @@ void SVR_RefCounter_init(void) {
  * Deallocate global data structures used by reference counters
  */
 void SVR_RefCounter_close(void) {
-    Queue_append(garbage_queue, NULL);
+    pthread_mutex_lock(&garbage_lock);
+    garbage_collector_closing = true;
+    pthread_cond_signal(&garbage_available);
+    pthread_mutex_unlock(&garbage_lock);
+
     SVR_BlockAlloc_freeAllocator(allocator);
 }
 
@@ -92,6 +103,7 @@ SVR_RefCounter* SVR_RefCounter_new(void (*cleanup)(void*), void* object) {
     ref_counter->ref_count = 1;
     ref_counter->cleanup = cleanup;
     ref_counter->object = object;
+    ref_counter->next = NULL;
     SVR_LOCKABLE_INIT(ref_counter);
 
     return ref_counter;
@@ -124,7 +136,19 @@ static void* SVR_RefCounter_garbageCollector(void* _unused) {
     SVR_RefCounter* ref_counter;
 
     while(true) {
-        ref_counter = Queue_pop(garbage_queue, true);
+        pthread_mutex_lock(&garbage_lock);
+        while(garbage_head == NULL && !garbage_collector_closing) {
+            pthread_cond_wait(&garbage_available, &garbage_lock);
+        }
+
+        ref_counter = garbage_head;
+        if(ref_counter) {
+            garbage_head = ref_counter->next;
+            if(garbage_head == NULL) {
+                garbage_tail = NULL;
+            }
+        }
+        pthread_mutex_unlock(&garbage_lock);
 
         if(ref_counter == NULL) {
             break;
@@ -169,7 +193,16 @@ void SVR_RefCounter_unref(SVR_RefCounter* ref_counter) {
     SVR_LOCK(ref_counter);
     ref_counter->ref_count--;
     if(ref_counter->ref_count == 0) {
-        Queue_append(garbage_queue, ref_counter);
+        pthread_mutex_lock(&garbage_lock);
+        ref_counter->next = NULL;
+        if(garbage_tail) {
+            garbage_tail->next = ref_counter;
+        } else {
+            garbage_head = ref_counter;
+        }
+        garbage_tail = ref_counter;
+        pthread_cond_signal(&garbage_available);
+        pthread_mutex_unlock(&garbage_lock);
     }
     SVR_UNLOCK(ref_counter);
 }
@@ -7,6 +7,10 @@
 
 #define RESPONSE_SET_GROW 8
 
+static int SVR_ResponseSet_reserve(SVR_ResponseSet* response_set, SVR_ResponseCallback callback, void* data);
+static bool SVR_ResponseSet_grow(SVR_ResponseSet* response_set);
+static void SVR_ResponseSet_release(SVR_ResponseSet* response_set, int response_id);
+
 /**
  * \defgroup ResponseSet Response set
  * \ingroup Util
@@ -20,7 +24,12 @@
  *
  * A request is associated with a request ID generated by the ResponseSet
  * object. A response is received when a SVR_ResponseSet_setResponse called is
- * made for the same request ID.
+ * made for the same request ID. Requests given a callback are not waited for,
+ * the callback is passed the response instead.
+ *
+ * Request IDs index a table of slots directly. Free slots are kept in a list,
+ * so reserving and releasing an ID takes constant time, and each slot has its
+ * own condition so setting a response wakes only the thread waiting for it.
  */
 
 /**
@@ -34,14 +43,17 @@
 SVR_ResponseSet* SVR_ResponseSet_new(int max_request_id) {
     SVR_ResponseSet* response_set = malloc(sizeof(SVR_ResponseSet));
 
-    response_set->response_pending = calloc(RESPONSE_SET_GROW, sizeof(bool));
-    response_set->response = calloc(RESPONSE_SET_GROW, sizeof(void*));
+    response_set->slots = NULL;
     response_set->max_request_id = max_request_id;
-    response_set->next_request_id = 0;
-    response_set->set_size = RESPONSE_SET_GROW;
-    pthread_cond_init(&response_set->new_response, NULL);
+    response_set->set_size = 0;
+    response_set->free_head = -1;
+    response_set->free_tail = -1;
+    response_set->outstanding = 0;
+    pthread_cond_init(&response_set->all_answered, NULL);
     SVR_LOCKABLE_INIT(response_set);
 
+    SVR_ResponseSet_grow(response_set);
+
     return response_set;
 }
 
@@ -51,8 +63,13 @@ SVR_ResponseSet* SVR_ResponseSet_new(int max_request_id) {
  * \param response_set Object to destroy
  */
 void SVR_ResponseSet_destroy(SVR_ResponseSet* response_set) {
-    free(response_set->response_pending);
-    free(response_set->response);
+    for(int i = 0; i < response_set->set_size; i++) {
+        pthread_cond_destroy(&response_set->slots[i]->answered);
+        free(response_set->slots[i]);
+    }
+
+    pthread_cond_destroy(&response_set->all_answered);
+    free(response_set->slots);
     free(response_set);
 }
 
@@ -66,36 +83,101 @@ void SVR_ResponseSet_destroy(SVR_ResponseSet* response_set) {
  * \return The request ID, or -1 if all request IDs are in use
  */
 int SVR_ResponseSet_getRequestId(SVR_ResponseSet* response_set) {
-    unsigned int response_id;
+    return SVR_ResponseSet_reserve(response_set, NULL, NULL);
+}
 
-    SVR_LOCK(response_set);
-    response_id = response_set->next_request_id;
-    while(response_set->response_pending[response_id] == true) {
-        response_id = (response_id + 1) % response_set->set_size;
+/**
+ * \brief Get a request ID answered through a callback
+ *
+ * Get a request ID whose response is passed to callback instead of being
+ * waited for with SVR_ResponseSet_getResponse. The ID is reserved until the
+ * callback returns.
+ *
+ * \param response_set ResponseSet to get ID from
+ * \param callback Function called with the response and data
+ * \param data Passed to the callback
+ * \return The request ID, or -1 if all request IDs are in use
+ */
+int SVR_ResponseSet_getCallbackRequestId(SVR_ResponseSet* response_set, SVR_ResponseCallback callback, void* data) {
+    return SVR_ResponseSet_reserve(response_set, callback, data);
+}
 
-        if(response_id == response_set->next_request_id) {
-            if(response_set->set_size + RESPONSE_SET_GROW >= response_set->max_request_id) {
-                return -1;
-            }
+static int SVR_ResponseSet_reserve(SVR_ResponseSet* response_set, SVR_ResponseCallback callback, void* data) {
+    SVR_ResponseSlot* slot;
+    int response_id;
 
-            response_set->response_pending = realloc(response_set->response_pending, (response_set->set_size + RESPONSE_SET_GROW) * sizeof(bool));
-            response_set->response = realloc(response_set->response, (response_set->set_size + RESPONSE_SET_GROW) * sizeof(void*));
-            memset(response_set->response_pending + response_set->set_size, 0, RESPONSE_SET_GROW * sizeof(bool));
+    SVR_LOCK(response_set);
+    if(response_set->free_head == -1 && SVR_ResponseSet_grow(response_set) == false) {
+        SVR_UNLOCK(response_set);
+        return -1;
+    }
 
-            response_id = response_set->set_size;
-            response_set->set_size += RESPONSE_SET_GROW;
-        }
+    response_id = response_set->free_head;
+    slot = response_set->slots[response_id];
+
+    response_set->free_head = slot->next_free;
+    if(response_set->free_head == -1) {
+        response_set->free_tail = -1;
     }
 
-    response_set->next_request_id = (response_id + 1) % response_set->set_size;
-    response_set->response_pending[response_id] = true;
-    response_set->response[response_id] = NULL;
+    slot->pending = true;
+    slot->response = NULL;
+    slot->callback = callback;
+    slot->callback_data = data;
+    response_set->outstanding++;
 
     SVR_UNLOCK(response_set);
 
     return response_id;
 }
 
+/**
+ * Add a block of free slots to the table. Called with the set locked. Returns
+ * false if the table already holds every allowed request ID
+ */
+static bool SVR_ResponseSet_grow(SVR_ResponseSet* response_set) {
+    int old_size = response_set->set_size;
+    int new_size = Util_min(old_size + RESPONSE_SET_GROW, response_set->max_request_id);
+    SVR_ResponseSlot* slot;
+
+    if(new_size <= old_size) {
+        return false;
+    }
+
+    response_set->slots = realloc(response_set->slots, new_size * sizeof(SVR_ResponseSlot*));
+    response_set->set_size = new_size;
+
+    for(int i = old_size; i < new_size; i++) {
+        slot = malloc(sizeof(SVR_ResponseSlot));
+        slot->callback = NULL;
+        slot->callback_data = NULL;
+        pthread_cond_init(&slot->answered, NULL);
+
+        response_set->slots[i] = slot;
+        SVR_ResponseSet_release(response_set, i);
+    }
+
+    return true;
+}
+
+/**
+ * Return a slot to the free list. Called with the set locked
+ */
+static void SVR_ResponseSet_release(SVR_ResponseSet* response_set, int response_id) {
+    SVR_ResponseSlot* slot = response_set->slots[response_id];
+
+    slot->pending = false;
+    slot->response = NULL;
+    slot->next_free = -1;
+
+    if(response_set->free_tail == -1) {
+        response_set->free_head = response_id;
+    } else {
+        response_set->slots[response_set->free_tail]->next_free = response_id;
+    }
+    response_set->free_tail = response_id;
+}
+
 /**
  * \brief Get a response
  *
@@ -107,15 +189,17 @@ int SVR_ResponseSet_getRequestId(SVR_ResponseSet* response_set) {
  * \param response_id The response ID to wait for
  */
 void* SVR_ResponseSet_getResponse(SVR_ResponseSet* response_set, int response_id) {
+    SVR_ResponseSlot* slot;
     void* response;
 
     SVR_LOCK(response_set);
-    while(response_set->response[response_id] == NULL) {
-        SVR_LOCK_WAIT(response_set, &response_set->new_response);
+    slot = response_set->slots[response_id];
+    while(slot->response == NULL) {
+        SVR_LOCK_WAIT(response_set, &slot->answered);
     }
 
-    response = response_set->response[response_id];
-    response_set->response_pending[response_id] = false;
+    response = slot->response;
+    SVR_ResponseSet_release(response_set, response_id);
 
     SVR_UNLOCK(response_set);
 
@@ -133,18 +217,66 @@ void* SVR_ResponseSet_getResponse(SVR_ResponseSet* response_set, int response_id
  * \return 0 on success, -1 if the response ID is not valid
  */
 int SVR_ResponseSet_setResponse(SVR_ResponseSet* response_set, int response_id, void* response) {
-    int success = 0;
+    SVR_ResponseSlot* slot;
+    SVR_ResponseCallback callback;
+    void* data;
 
     SVR_LOCK(response_set);
-    if(response_set->response_pending[response_id]) {
-        response_set->response[response_id] = response;
-        pthread_cond_broadcast(&response_set->new_response);
-    } else {
-        success = -1;
+    if(response_id < 0 || response_id >= response_set->set_size) {
+        SVR_UNLOCK(response_set);
+        return -1;
+    }
+
+    slot = response_set->slots[response_id];
+    if(slot->pending == false || slot->response != NULL) {
+        SVR_UNLOCK(response_set);
+        return -1;
+    }
+
+    /* A callback keeps the ID reserved while it runs, so waitAll returns only
+       once every callback has finished */
+    slot->response = response;
+    callback = slot->callback;
+    data = slot->callback_data;
+
+    if(callback == NULL) {
+        response_set->outstanding--;
+        pthread_cond_signal(&slot->answered);
+        if(response_set->outstanding == 0) {
+            pthread_cond_broadcast(&response_set->all_answered);
+        }
+        SVR_UNLOCK(response_set);
+        return 0;
     }
     SVR_UNLOCK(response_set);
 
-    return success;
+    callback(response, data);
+
+    SVR_LOCK(response_set);
+    SVR_ResponseSet_release(response_set, response_id);
+    response_set->outstanding--;
+    if(response_set->outstanding == 0) {
+        pthread_cond_broadcast(&response_set->all_answered);
+    }
+    SVR_UNLOCK(response_set);
+
+    return 0;
+}
+
+/**
+ * \brief Wait for all requests to be answered
+ *
+ * Block until every request given an ID so far has its response, and the
+ * callbacks of those answered through one have returned.
+ *
+ * \param response_set The ResponseSet to wait on
+ */
+void SVR_ResponseSet_waitAll(SVR_ResponseSet* response_set) {
+    SVR_LOCK(response_set);
+    while(response_set->outstanding > 0) {
+        SVR_LOCK_WAIT(response_set, &response_set->all_answered);
+    }
+    SVR_UNLOCK(response_set);
 }
 
 /** \} */
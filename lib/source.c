@@ -5,6 +5,12 @@
 
 #include <svr.h>
 
+static int SVR_Source_upload(SVR_Source* source, IplImage* frame);
+static int SVR_Source_queueFrame(SVR_Source* source, IplImage* frame);
+static void* SVR_Source_uploadThread(void* _source);
+static void SVR_Source_stopUpload(SVR_Source* source);
+static void SVR_Source_free(SVR_Source* source);
+
 /**
  * \defgroup Source Source
  * \brief Manage sources including server sources and client sources
@@ -20,38 +26,85 @@
  * \return New source or NULL if an error occurs
  */
 SVR_Source* SVR_Source_new(const char* name) {
+    return SVR_Source_newOn(SVR_Comm_getContext(), name);
+}
+
+/**
+ * \brief Open a new source over a context
+ *
+ * As SVR_Source_new, providing the source to the context's server.
+ *
+ * \param context The context to open the source over
+ * \param name Name of the new source
+ * \return New source or NULL if an error occurs
+ */
+SVR_Source* SVR_Source_newOn(SVR_Context* context, const char* name) {
     SVR_Source* source;
     SVR_Message* message;
     SVR_Message* response;
     int return_code;
 
+    source = malloc(sizeof(SVR_Source));
+    source->context = context;
+    source->name = strdup(name);
+    source->encoding = NULL;
+    source->encoding_options = NULL;
+    source->encoder = NULL;
+    source->frame_properties = NULL;
+
+    source->payload_buffer_size = 4 * 1024;
+    source->payload_buffer = malloc(source->payload_buffer_size);
+
+    source->upload_frames = NULL;
+    source->upload_capacity = 0;
+    source->upload_head = 0;
+    source->upload_count = 0;
+    source->frames_submitted = 0;
+    source->upload_busy = false;
+    source->upload_closing = false;
+    source->upload_callback = NULL;
+    source->upload_callback_data = NULL;
+    pthread_mutex_init(&source->upload_lock, NULL);
+    pthread_cond_init(&source->upload_changed, NULL);
+
+    source->flow_control = false;
+    source->credits = 0;
+    source->frames_sent = 0;
+    source->frames_skipped = 0;
+
+    /* Registered before the source is opened, since the server grants the
+       first credits ahead of its reply */
+    pthread_mutex_lock(&context->stream_list_lock);
+    if(Dictionary_exists(context->sources, name)) {
+        pthread_mutex_unlock(&context->stream_list_lock);
+        SVR_Source_free(source);
+        return NULL;
+    }
+    Dictionary_set(context->sources, name, source);
+    pthread_mutex_unlock(&context->stream_list_lock);
+
     message = SVR_Message_new(3);
     message->components[0] = SVR_Arena_strdup(message->alloc, "Source.open");
     message->components[1] = SVR_Arena_strdup(message->alloc, "client");
     message->components[2] = SVR_Arena_strdup(message->alloc, name);
 
-    response = SVR_Comm_sendMessage(message, true);
+    response = SVR_Context_sendMessage(context, message, true);
     return_code = SVR_Comm_parseResponse(response);
 
     SVR_Message_release(message);
     SVR_Message_release(response);
 
     if(return_code != SVR_SUCCESS) {
+        pthread_mutex_lock(&context->stream_list_lock);
+        Dictionary_remove(context->sources, name);
+        pthread_mutex_unlock(&context->stream_list_lock);
+
+        SVR_Source_free(source);
         return NULL;
     }
 
-    source = malloc(sizeof(SVR_Source));
-    source->name = strdup(name);
-    source->encoding = NULL;
-    source->encoding_options = NULL;
-    source->encoder = NULL;
-    source->frame_properties = NULL;
-
-    source->payload_buffer_size = 4 * 1024;
-    source->payload_buffer = malloc(source->payload_buffer_size);
-
-    /* Attempt to set encoding to jpeg and try raw if that fails */
-    if(SVR_Source_setEncoding(source, "jpeg") != SVR_SUCCESS) {
+    /* Pick an encoding for the connection, and fall back to raw */
+    if(SVR_Source_setEncoding(source, "auto") != SVR_SUCCESS) {
         SVR_Source_setEncoding(source, "raw");
     }
 
@@ -62,6 +115,7 @@ SVR_Source* SVR_Source_new(const char* name) {
  * \brief Close and destroy a source
  *
  * Close and destroy a source, orphaning any streams associated with the source.
+ * Frames still queued by an asynchronous source are sent first.
  *
  * \param source The client source to close
  * \return 0 on success, otherwise an error has occurred
@@ -71,18 +125,37 @@ int SVR_Source_destroy(SVR_Source* source) {
     SVR_Message* response;
     int return_code;
 
+    SVR_Source_stopUpload(source);
+
     message = SVR_Message_new(2);
     message->components[0] = SVR_Arena_strdup(message->alloc, "Source.close");
     message->components[1] = SVR_Arena_strdup(message->alloc, source->name);
 
-    response = SVR_Comm_sendMessage(message, true);
+    response = SVR_Context_sendMessage(source->context, message, true);
     return_code = SVR_Comm_parseResponse(response);
 
     SVR_Message_release(message);
     SVR_Message_release(response);
 
+    pthread_mutex_lock(&source->context->stream_list_lock);
+    Dictionary_remove(source->context->sources, source->name);
+    pthread_mutex_unlock(&source->context->stream_list_lock);
+
+    SVR_Source_free(source);
+
+    return return_code;
+}
+
+/**
+ * Free a source and everything it holds
+ */
+static void SVR_Source_free(SVR_Source* source) {
     free(source->name);
 
+    if(source->encoding_options) {
+        SVR_freeParsedOptionString(source->encoding_options);
+    }
+
     if(source->encoder) {
         SVR_Encoder_destroy(source->encoder);
     }
@@ -95,15 +168,17 @@ int SVR_Source_destroy(SVR_Source* source) {
         free(source->payload_buffer);
     }
 
+    pthread_mutex_destroy(&source->upload_lock);
+    pthread_cond_destroy(&source->upload_changed);
     free(source);
-
-    return return_code;
 }
 
 /**
  * \brief Set the encoding for the source
  *
- * Set the encoding for the source from the option string describing the encoding
+ * Set the encoding for the source from the option string describing the
+ * encoding. The "auto" encoding picks raw if the server is on this machine, and
+ * JPEG otherwise.
  *
  * \param source The source to set the encoding for
  * \param encoding_descriptor The option string describing the encoding to use
@@ -120,23 +195,29 @@ int SVR_Source_setEncoding(SVR_Source* source, const char* encoding_descriptor)
     options = SVR_parseOptionString(encoding_descriptor);
     if(options == NULL) {
         err = SVR_getOptionStringErrorPosition();
-        SVR_log(SVR_DEBUG, Util_format("Parse error in \"%s\" at position %d '%c'",
-                                       encoding_descriptor, err, encoding_descriptor[err]));
+        SVR_logf(SVR_DEBUG, "Parse error in \"%s\" at position %d '%c'",
+                            encoding_descriptor, err, encoding_descriptor[err]);
         return SVR_PARSEERROR;
     }
 
-    encoding = SVR_Encoding_getByName(Dictionary_get(options, "%name"));
+    if(strcmp(Dictionary_get(options, "%name"), "auto") == 0) {
+        encoding = SVR_Encoding_getAuto(SVR_Context_isLocal(source->context));
+    } else {
+        encoding = SVR_Encoding_getByName(Dictionary_get(options, "%name"));
+    }
+
     if(encoding == NULL) {
         SVR_freeParsedOptionString(options);
         return SVR_NOSUCHENCODING;
     }
 
+    /* The server only needs the name of the encoding to decode frames */
     message = SVR_Message_new(3);
     message->components[0] = SVR_Arena_strdup(message->alloc, "Source.setEncoding");
     message->components[1] = SVR_Arena_strdup(message->alloc, source->name);
-    message->components[2] = SVR_Arena_strdup(message->alloc, encoding_descriptor);
+    message->components[2] = SVR_Arena_strdup(message->alloc, encoding->name);
 
-    response = SVR_Comm_sendMessage(message, true);
+    response = SVR_Context_sendMessage(source->context, message, true);
     return_code = SVR_Comm_parseResponse(response);
 
     SVR_Message_release(message);
@@ -178,7 +259,7 @@ int SVR_Source_setFrameProperties(SVR_Source* source, SVR_FrameProperties* frame
                                                                                frame_properties->depth,
                                                                                frame_properties->channels);
 
-    response = SVR_Comm_sendMessage(message, true);
+    response = SVR_Context_sendMessage(source->context, message, true);
     return_code = SVR_Comm_parseResponse(response);
 
     SVR_Message_release(message);
@@ -202,19 +283,167 @@ int SVR_Source_setFrameProperties(SVR_Source* source, SVR_FrameProperties* frame
  * properties for the stream. If no frames have been sent, the frame properties
  * will be derived form the first frame.
  *
+ * An asynchronous source copies the frame and returns at once, leaving the
+ * frame to the caller, and the result of sending it is passed to the source's
+ * callback instead.
+ *
+ * The server only lets a few frames be in flight at once, granting credit for
+ * another as it takes each one in. A frame sent while the server is still
+ * busy with those is skipped, and SVR_OVERLOADED returned, so that frames are
+ * never left waiting in the connection to grow stale.
+ *
  * \param source The source to send the frame through
  * \param frame The frame to send
  * \return An SVR error code or SVR_SUCCESS on success
  */
 int SVR_Source_sendFrame(SVR_Source* source, IplImage* frame) {
-    SVR_FrameProperties* frame_properties;
-    SVR_Message* message;
-    int return_code;
-
     if(source->encoding == NULL) {
         return SVR_INVALIDSTATE;
     }
 
+    if(source->upload_frames) {
+        return SVR_Source_queueFrame(source, frame);
+    }
+
+    pthread_mutex_lock(&source->upload_lock);
+    if(source->flow_control && source->credits <= 0) {
+        source->frames_skipped++;
+        pthread_mutex_unlock(&source->upload_lock);
+        return SVR_OVERLOADED;
+    }
+    pthread_mutex_unlock(&source->upload_lock);
+
+    return SVR_Source_upload(source, frame);
+}
+
+/**
+ * \brief Send frames from a background thread
+ *
+ * Have SVR_Source_sendFrame copy frames into a queue of queue_length frames
+ * and return, while a thread of the source's own encodes and sends them. When
+ * the queue is full the oldest frame waiting is dropped for the new one, so a
+ * producer faster than the server or the network never waits and the newest
+ * frames are sent. Frames wait in the queue while the server grants no credit,
+ * rather than being skipped. The callback is called with the outcome of each
+ * frame, on the upload thread, or on the thread of SVR_Source_sendFrame for a
+ * frame it drops.
+ *
+ * Frames already queued are sent before the queue changes. The encoding and
+ * frame properties must not be set while frames are queued, see
+ * SVR_Source_flush.
+ *
+ * \param source The source
+ * \param queue_length Frames waiting at most, or 0 to send synchronously again
+ * \param callback Called once each frame is sent or dropped, or NULL
+ * \param data Passed to the callback
+ * \return An SVR return code
+ */
+int SVR_Source_setAsync(SVR_Source* source, int queue_length, SVR_SourceCallback callback, void* data) {
+    if(queue_length < 0) {
+        return SVR_INVALIDARGUMENT;
+    }
+
+    SVR_Source_stopUpload(source);
+
+    if(queue_length == 0) {
+        return SVR_SUCCESS;
+    }
+
+    source->upload_frames = malloc(queue_length * sizeof(IplImage*));
+    source->upload_capacity = queue_length;
+    source->upload_head = 0;
+    source->upload_count = 0;
+    source->upload_busy = false;
+    source->upload_closing = false;
+    source->upload_callback = callback;
+    source->upload_callback_data = data;
+
+    pthread_create(&source->upload_thread, NULL, SVR_Source_uploadThread, source);
+
+    return SVR_SUCCESS;
+}
+
+/**
+ * \brief Wait for queued frames to be sent
+ *
+ * Block until every frame queued by an asynchronous source has been sent.
+ * Returns at once for a synchronous source.
+ *
+ * \param source The source
+ */
+void SVR_Source_flush(SVR_Source* source) {
+    pthread_mutex_lock(&source->upload_lock);
+    while(source->upload_count > 0 || source->upload_busy) {
+        pthread_cond_wait(&source->upload_changed, &source->upload_lock);
+    }
+    pthread_mutex_unlock(&source->upload_lock);
+}
+
+/**
+ * \brief Get the frame counters of a source
+ *
+ * Fill in the counters the client keeps for a source, and those the server
+ * keeps. Frames skipped by the client, or dropped by the server, show that the
+ * frames are produced faster than the server decodes or streams take them.
+ *
+ * \param source The source
+ * \param stats Filled with the counters
+ * \return An SVR error code or SVR_SUCCESS on success
+ */
+int SVR_Source_getStats(SVR_Source* source, SVR_SourceStats* stats) {
+    int return_code;
+
+    return_code = SVR_getSourceStatsOn(source->context, source->name, stats);
+
+    pthread_mutex_lock(&source->upload_lock);
+    stats->frames_sent = source->frames_sent;
+    stats->frames_skipped = source->frames_skipped;
+    pthread_mutex_unlock(&source->upload_lock);
+
+    return return_code;
+}
+
+/**
+ * \private
+ * \brief Grant a source credit to send frames
+ *
+ * Called as the server grants credits, each letting the source send one more
+ * frame. The first grant turns flow control on.
+ *
+ * \param context The context the source is provided over
+ * \param name The name of the source
+ * \param credits Number of frames granted
+ */
+void SVR_Source_grantCredits(SVR_Context* context, const char* name, int credits) {
+    SVR_Source* source;
+
+    pthread_mutex_lock(&context->stream_list_lock);
+    source = Dictionary_get(context->sources, name);
+    if(source == NULL) {
+        pthread_mutex_unlock(&context->stream_list_lock);
+        SVR_log(SVR_WARNING, "Received credit for unknown source");
+        return;
+    }
+
+    pthread_mutex_lock(&source->upload_lock);
+    source->flow_control = true;
+    source->credits += credits;
+    pthread_cond_broadcast(&source->upload_changed);
+    pthread_mutex_unlock(&source->upload_lock);
+    pthread_mutex_unlock(&context->stream_list_lock);
+}
+
+/**
+ * Encode a frame and send it in Data messages, on the thread sending frames
+ */
+static int SVR_Source_upload(SVR_Source* source, IplImage* frame) {
+    SVR_FrameProperties* frame_properties;
+    SVR_Message* message;
+    size_t data_ready;
+    bool flow_control;
+    bool sent = false;
+    int return_code;
+
     /* Automatically determine frame properties to use from the given frame */
     if(source->frame_properties == NULL) {
         frame_properties = SVR_FrameProperties_new();
@@ -247,20 +476,163 @@ int SVR_Source_sendFrame(SVR_Source* source, IplImage* frame) {
 
     SVR_Encoder_encode(source->encoder, frame);
 
-    message = SVR_Message_new(2);
+    pthread_mutex_lock(&source->upload_lock);
+    flow_control = source->flow_control;
+    pthread_mutex_unlock(&source->upload_lock);
+
+    /* The last message of the frame carries a third component, telling the
+       server to return the frame's credit once it is decoded */
+    message = SVR_Message_new(3);
     message->components[0] = SVR_Arena_strdup(message->alloc, "Data");
     message->components[1] = SVR_Arena_strdup(message->alloc, source->name);
-    message->payload = source->payload_buffer;
+    message->components[2] = SVR_Arena_strdup(message->alloc, "end");
+
+    while((data_ready = SVR_Encoder_dataReady(source->encoder)) > 0) {
+        /* Grow the chunks up to the largest payload, so that a frame takes
+           few messages and few turns at the connection */
+        if(data_ready > source->payload_buffer_size && source->payload_buffer_size < SVR_SOURCE_MAX_CHUNK_SIZE) {
+            source->payload_buffer_size = Util_min(data_ready, SVR_SOURCE_MAX_CHUNK_SIZE);
+            source->payload_buffer = realloc(source->payload_buffer, source->payload_buffer_size);
+        }
 
-    while(SVR_Encoder_dataReady(source->encoder) > 0) {
+        message->payload = source->payload_buffer;
         message->payload_size = SVR_Encoder_readData(source->encoder, message->payload, source->payload_buffer_size);
-        SVR_Comm_sendMessage(message, false);
+        message->count = (flow_control && SVR_Encoder_dataReady(source->encoder) == 0) ? 3 : 2;
+        SVR_Context_sendMessage(source->context, message, false);
+        sent = true;
     }
 
     SVR_Message_release(message);
+
+    if(sent) {
+        pthread_mutex_lock(&source->upload_lock);
+        if(flow_control) {
+            source->credits--;
+        }
+        source->frames_sent++;
+        pthread_mutex_unlock(&source->upload_lock);
+    }
+
     return SVR_SUCCESS;
 }
 
+/**
+ * Copy a frame into the upload queue of an asynchronous source, dropping the
+ * oldest frame waiting if the queue is full
+ */
+static int SVR_Source_queueFrame(SVR_Source* source, IplImage* frame) {
+    SVR_FrameProperties frame_properties;
+    IplImage* copy;
+    IplImage* dropped = NULL;
+    unsigned int dropped_sequence = 0;
+    size_t row_size;
+
+    frame_properties.width = frame->width;
+    frame_properties.height = frame->height;
+    frame_properties.depth = frame->depth;
+    frame_properties.channels = frame->nChannels;
+
+    copy = SVR_FramePool_getFrame(&frame_properties);
+    if(copy->widthStep == frame->widthStep) {
+        memcpy(copy->imageData, frame->imageData, frame->imageSize);
+    } else {
+        row_size = Util_min(copy->widthStep, frame->widthStep);
+        for(int r = 0; r < frame->height; r++) {
+            memcpy(copy->imageData + r * copy->widthStep, frame->imageData + r * frame->widthStep, row_size);
+        }
+    }
+
+    pthread_mutex_lock(&source->upload_lock);
+    if(source->upload_count == source->upload_capacity) {
+        dropped = source->upload_frames[source->upload_head];
+        dropped_sequence = source->frames_submitted - source->upload_count;
+        source->upload_head = (source->upload_head + 1) % source->upload_capacity;
+        source->upload_count--;
+        source->frames_skipped++;
+    }
+
+    source->upload_frames[(source->upload_head + source->upload_count) % source->upload_capacity] = copy;
+    source->upload_count++;
+    source->frames_submitted++;
+    pthread_cond_broadcast(&source->upload_changed);
+    pthread_mutex_unlock(&source->upload_lock);
+
+    if(dropped) {
+        SVR_FramePool_returnFrame(dropped);
+        if(source->upload_callback) {
+            source->upload_callback(source, dropped_sequence, SVR_OVERLOADED, source->upload_callback_data);
+        }
+    }
+
+    return SVR_SUCCESS;
+}
+
+/**
+ * Encode and send the frames queued for an asynchronous source, oldest first,
+ * as the server grants credit, until stopped and the queue is empty. Frames
+ * left once stopped are sent without waiting for credit
+ */
+static void* SVR_Source_uploadThread(void* _source) {
+    SVR_Source* source = (SVR_Source*) _source;
+    IplImage* frame;
+    unsigned int sequence;
+    int return_code;
+
+    pthread_mutex_lock(&source->upload_lock);
+    while(true) {
+        while((source->upload_count == 0 || (source->flow_control && source->credits <= 0)) &&
+              source->upload_closing == false) {
+            pthread_cond_wait(&source->upload_changed, &source->upload_lock);
+        }
+
+        if(source->upload_count == 0) {
+            break;
+        }
+
+        frame = source->upload_frames[source->upload_head];
+        sequence = source->frames_submitted - source->upload_count;
+        source->upload_head = (source->upload_head + 1) % source->upload_capacity;
+        source->upload_count--;
+        source->upload_busy = true;
+        pthread_mutex_unlock(&source->upload_lock);
+
+        return_code = SVR_Source_upload(source, frame);
+        SVR_FramePool_returnFrame(frame);
+
+        if(source->upload_callback) {
+            source->upload_callback(source, sequence, return_code, source->upload_callback_data);
+        }
+
+        pthread_mutex_lock(&source->upload_lock);
+        source->upload_busy = false;
+        pthread_cond_broadcast(&source->upload_changed);
+    }
+    pthread_mutex_unlock(&source->upload_lock);
+
+    return NULL;
+}
+
+/**
+ * Send the frames still queued by an asynchronous source and stop its upload
+ * thread, leaving the source synchronous
+ */
+static void SVR_Source_stopUpload(SVR_Source* source) {
+    if(source->upload_frames == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&source->upload_lock);
+    source->upload_closing = true;
+    pthread_cond_broadcast(&source->upload_changed);
+    pthread_mutex_unlock(&source->upload_lock);
+
+    pthread_join(source->upload_thread, NULL);
+
+    free(source->upload_frames);
+    source->upload_frames = NULL;
+    source->upload_capacity = 0;
+}
+
 /**
  * \brief Open a new server side source
  *
@@ -272,6 +644,20 @@ int SVR_Source_sendFrame(SVR_Source* source, IplImage* frame) {
  * \return An SVR error code or SVR_SUCCESS on success
  */
 int SVR_openServerSource(const char* name, const char* descriptor) {
+    return SVR_openServerSourceOn(SVR_Comm_getContext(), name, descriptor);
+}
+
+/**
+ * \brief Open a new server side source over a context
+ *
+ * As SVR_openServerSource, on the context's server.
+ *
+ * \param context The context of the server
+ * \param name The name of the new source
+ * \param descriptor An option string describing the source, and source options
+ * \return An SVR error code or SVR_SUCCESS on success
+ */
+int SVR_openServerSourceOn(SVR_Context* context, const char* name, const char* descriptor) {
     SVR_Message* message;
     SVR_Message* response;
     int return_code;
@@ -282,7 +668,7 @@ int SVR_openServerSource(const char* name, const char* descriptor) {
     message->components[2] = SVR_Arena_strdup(message->alloc, name);
     message->components[3] = SVR_Arena_strdup(message->alloc, descriptor);
 
-    response = SVR_Comm_sendMessage(message, true);
+    response = SVR_Context_sendMessage(context, message, true);
     return_code = SVR_Comm_parseResponse(response);
 
     SVR_Message_release(message);
@@ -300,6 +686,19 @@ int SVR_openServerSource(const char* name, const char* descriptor) {
  * \return An SVR error code or SVR_SUCCESS on success
  */
 int SVR_closeServerSource(const char* name) {
+    return SVR_closeServerSourceOn(SVR_Comm_getContext(), name);
+}
+
+/**
+ * \brief Close a server source over a context
+ *
+ * As SVR_closeServerSource, on the context's server.
+ *
+ * \param context The context of the server
+ * \param name Name of the server source
+ * \return An SVR error code or SVR_SUCCESS on success
+ */
+int SVR_closeServerSourceOn(SVR_Context* context, const char* name) {
     SVR_Message* message;
     SVR_Message* response;
     int return_code;
@@ -308,7 +707,7 @@ int SVR_closeServerSource(const char* name) {
     message->components[0] = SVR_Arena_strdup(message->alloc, "Source.close");
     message->components[1] = SVR_Arena_strdup(message->alloc, name);
 
-    response = SVR_Comm_sendMessage(message, true);
+    response = SVR_Context_sendMessage(context, message, true);
     return_code = SVR_Comm_parseResponse(response);
 
     SVR_Message_release(message);
@@ -327,6 +726,18 @@ int SVR_closeServerSource(const char* name) {
  * \return List of sources
  */
 List* SVR_getSourcesList(void) {
+    return SVR_getSourcesListOn(SVR_Comm_getContext());
+}
+
+/**
+ * \brief Get a list of the sources of a context's server
+ *
+ * As SVR_getSourcesList, on the context's server.
+ *
+ * \param context The context of the server
+ * \return List of sources
+ */
+List* SVR_getSourcesListOn(SVR_Context* context) {
     List* sources_list;
     SVR_Message* message;
     SVR_Message* response;
@@ -334,7 +745,7 @@ List* SVR_getSourcesList(void) {
     message = SVR_Message_new(1);
     message->components[0] = SVR_Arena_strdup(message->alloc, "Source.getSourcesList");
 
-    response = SVR_Comm_sendMessage(message, true);
+    response = SVR_Context_sendMessage(context, message, true);
 
     sources_list = List_new();
     for(int i = 1; i < response->count; i++) {
@@ -364,4 +775,57 @@ void SVR_freeSourcesList(List* sources_list) {
     List_destroy(sources_list);
 }
 
+/**
+ * \brief Get the frame counters of any source
+ *
+ * As SVR_Source_getStats, for a source of any client or a server source,
+ * filling in only the counters kept by the server. The others are zero.
+ *
+ * \param name Name of the source
+ * \param stats Filled with the counters
+ * \return An SVR error code or SVR_SUCCESS on success
+ */
+int SVR_getSourceStats(const char* name, SVR_SourceStats* stats) {
+    return SVR_getSourceStatsOn(SVR_Comm_getContext(), name, stats);
+}
+
+/**
+ * \brief Get the frame counters of any source of a context's server
+ *
+ * As SVR_getSourceStats, on the context's server.
+ *
+ * \param context The context of the server
+ * \param name Name of the source
+ * \param stats Filled with the counters
+ * \return An SVR error code or SVR_SUCCESS on success
+ */
+int SVR_getSourceStatsOn(SVR_Context* context, const char* name, SVR_SourceStats* stats) {
+    SVR_Message* message;
+    SVR_Message* response;
+    int return_code;
+
+    message = SVR_Message_new(2);
+    message->components[0] = SVR_Arena_strdup(message->alloc, "Source.getStats");
+    message->components[1] = SVR_Arena_strdup(message->alloc, name);
+    response = SVR_Context_sendMessage(context, message, true);
+
+    stats->frames_sent = 0;
+    stats->frames_skipped = 0;
+    stats->frames_received = 0;
+    stats->frames_dropped = 0;
+
+    if(response->count == 3 && strcmp(response->components[0], "Source.getStats") == 0) {
+        stats->frames_received = strtoul(response->components[1], NULL, 10);
+        stats->frames_dropped = strtoul(response->components[2], NULL, 10);
+        return_code = SVR_SUCCESS;
+    } else {
+        return_code = SVR_Comm_parseResponse(response);
+    }
+
+    SVR_Message_release(message);
+    SVR_Message_release(response);
+
+    return return_code;
+}
+
 /** \} */
@@ -5,15 +5,68 @@
 
 #include <svr.h>
 
-static SVR_Stream* SVR_Stream_getByName(const char* stream_name);
-static int SVR_Stream_updateInfo(SVR_Stream* stream);
-static int SVR_Stream_open(SVR_Stream* stream);
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+static SVR_Stream* SVR_Stream_getByName(SVR_Context* context, const char* stream_name);
+static SVR_Stream* SVR_Stream_alloc(SVR_Context* context, const char* source_name);
+static void SVR_Stream_free(SVR_Stream* stream);
+static int SVR_Stream_sendGetInfo(SVR_Stream* stream);
+static int SVR_Stream_readInfo(SVR_Stream* stream, int request);
+static int SVR_Stream_readCode(SVR_Context* context, int request);
+static int SVR_Stream_sendUpdate(SVR_Stream* stream, SVR_Message* message);
+static void SVR_Stream_sendOpen(SVR_Stream* stream, int requests[3]);
+static int SVR_Stream_finishOpen(SVR_Stream* stream, int requests[3]);
+static int SVR_Stream_sendConfig(SVR_Stream** streams, int count, bool open, SVR_StreamConfig* config, int* return_codes);
+static int SVR_Stream_writeConfig(SVR_Message* message, int index, SVR_Stream* stream, bool open, SVR_StreamConfig* config);
+static int SVR_Stream_writeSetting(SVR_Message* message, int index, const char* key, int value);
+static void SVR_Stream_readConfig(SVR_Message* response, void* _request);
+static void SVR_Stream_applyConfig(SVR_Stream* stream, bool open, bool unpause, const char* encoding_name,
+                                   const char* frame_properties_string);
 static int SVR_Stream_close(SVR_Stream* stream);
+static int SVR_Stream_sendCommand(SVR_Context* context, const char* command, const char* stream_name);
+static void SVR_Stream_recordConfig(SVR_Stream* stream, SVR_StreamConfig* config);
+static void* SVR_Stream_decodeThread(void* _stream);
+static void SVR_Stream_stopDecoding(SVR_Stream* stream);
+static void SVR_Stream_decode(SVR_Stream* stream, void* buffer, size_t n);
+static void SVR_Stream_applyAdjustment(SVR_Stream* stream, const char* adjustment);
+static void SVR_Stream_openDecoder(SVR_Stream* stream);
+static SVR_Frame* SVR_Stream_takeFrame(SVR_Stream* stream);
+static void SVR_Stream_deliverFrame(SVR_Stream* stream, SVR_Frame* frame);
+static void SVR_Stream_deliverShared(SVR_Stream* stream);
+static void SVR_Stream_shareFrame(SVR_Stream* stream, SVR_Frame* frame);
+static bool SVR_Stream_share(SVR_Stream* stream);
+static bool SVR_Stream_canFollow(SVR_Stream* stream, SVR_Stream* leader);
+static bool SVR_Stream_leave(SVR_Stream* stream);
+static void SVR_Stream_unshare(SVR_Stream* stream);
+static void SVR_Stream_releaseFrames(SVR_Stream* stream);
+static void* SVR_Stream_callbackWorker(void* _stream);
+static void SVR_Stream_stopCallbackWorker(SVR_Stream* stream);
+static bool SVR_Stream_isCallbackThread(SVR_Stream* stream);
+static void SVR_Stream_updateEvent(SVR_Stream* stream);
+static void SVR_Stream_notifySync(void);
+
+/* Tags of the chunks queued for a stream's decode thread */
+#define STREAM_CHUNK_DATA 0
+#define STREAM_CHUNK_ADJUSTED 1
+#define STREAM_CHUNK_SHARED 2
 
-static pthread_mutex_t stream_list_lock = PTHREAD_MUTEX_INITIALIZER;
-static Dictionary* streams;
 static unsigned int last_stream_num = 0;
 
+/* A Stream.configure request waiting for its response */
+typedef struct {
+    SVR_Stream** streams;
+    int count;
+    bool open;
+    bool unpause;
+    int* return_codes;
+
+    bool answered;
+    pthread_mutex_t lock;
+    pthread_cond_t answered_cond;
+} SVR_StreamConfigRequest;
+
 static pthread_mutex_t new_global_data_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t new_global_data_cond = PTHREAD_COND_INITIALIZER;
 static bool new_global_data = false;
@@ -30,14 +83,15 @@ static bool new_global_data = false;
  * Initialize the stream component
  */
 void SVR_Stream_init(void) {
-    streams = Dictionary_new();
+    SVR_Frame_init();
 }
 
 /**
- * Get a stream by name
+ * Get a stream of a context by name. Called with the context's stream list
+ * locked
  */
-static SVR_Stream* SVR_Stream_getByName(const char* stream_name) {
-    return Dictionary_get(streams, stream_name);
+static SVR_Stream* SVR_Stream_getByName(SVR_Context* context, const char* stream_name) {
+    return Dictionary_get(context->streams, stream_name);
 }
 
 /**
@@ -51,8 +105,216 @@ static SVR_Stream* SVR_Stream_getByName(const char* stream_name) {
  * \return The new stream
  */
 SVR_Stream* SVR_Stream_new(const char* source_name) {
+    return SVR_Stream_newOn(SVR_Comm_getContext(), source_name);
+}
+
+/**
+ * \brief Create a new stream over a context
+ *
+ * As SVR_Stream_new, for a source of the context's server.
+ *
+ * \param context The context to open the stream over
+ * \param source_name The name of the source which the steam should be created
+ * for
+ * \return The new stream
+ */
+SVR_Stream* SVR_Stream_newOn(SVR_Context* context, const char* source_name) {
+    SVR_Stream* stream = SVR_Stream_alloc(context, source_name);
+    int requests[3];
+
+    /* Communicate with server to open the stream */
+    SVR_Stream_sendOpen(stream, requests);
+    if(SVR_Stream_finishOpen(stream, requests) != SVR_SUCCESS) {
+        SVR_Stream_free(stream);
+        return NULL;
+    }
+
+    return stream;
+}
+
+/**
+ * \brief Create several streams
+ *
+ * Create a stream for each of the given sources, as SVR_Stream_new does. The
+ * requests opening every stream are in flight together, so the streams take
+ * one round trip to the server to open rather than one each.
+ *
+ * \param source_names Names of the sources to create streams for
+ * \param count Number of sources
+ * \param streams Filled with the new streams, with NULL for any stream which
+ * could not be created
+ * \return The number of streams created
+ */
+int SVR_Stream_newMany(const char** source_names, int count, SVR_Stream** streams) {
+    return SVR_Stream_newManyOn(SVR_Comm_getContext(), source_names, count, streams);
+}
+
+/**
+ * \brief Create several streams over a context
+ *
+ * As SVR_Stream_newMany, for sources of the context's server.
+ *
+ * \param context The context to open the streams over
+ * \param source_names Names of the sources to create streams for
+ * \param count Number of sources
+ * \param streams Filled with the new streams, with NULL for any stream which
+ * could not be created
+ * \return The number of streams created
+ */
+int SVR_Stream_newManyOn(SVR_Context* context, const char** source_names, int count, SVR_Stream** streams) {
+    int (*requests)[3] = malloc(count * sizeof(int[3]));
+    int created = 0;
+
+    for(int i = 0; i < count; i++) {
+        streams[i] = SVR_Stream_alloc(context, source_names[i]);
+        SVR_Stream_sendOpen(streams[i], requests[i]);
+    }
+
+    for(int i = 0; i < count; i++) {
+        if(SVR_Stream_finishOpen(streams[i], requests[i]) == SVR_SUCCESS) {
+            created++;
+        } else {
+            SVR_Stream_free(streams[i]);
+            streams[i] = NULL;
+        }
+    }
+
+    free(requests);
+
+    return created;
+}
+
+/**
+ * \brief Create several configured streams
+ *
+ * Create a stream for each of the given sources and apply the same settings to
+ * each of them, all in a single request. With config->unpause set the streams
+ * are running once this returns, so opening any number of streams takes one
+ * round trip to the server.
+ *
+ * \param source_names Names of the sources to create streams for
+ * \param count Number of sources
+ * \param config Settings for every stream
+ * \param streams Filled with the new streams, with NULL for any stream which
+ * could not be created or configured
+ * \return The number of streams created
+ */
+int SVR_Stream_newConfigured(const char** source_names, int count, SVR_StreamConfig* config, SVR_Stream** streams) {
+    return SVR_Stream_newConfiguredOn(SVR_Comm_getContext(), source_names, count, config, streams);
+}
+
+/**
+ * \brief Create several configured streams over a context
+ *
+ * As SVR_Stream_newConfigured, for sources of the context's server.
+ *
+ * \param context The context to open the streams over
+ * \param source_names Names of the sources to create streams for
+ * \param count Number of sources
+ * \param config Settings for every stream
+ * \param streams Filled with the new streams, with NULL for any stream which
+ * could not be created or configured
+ * \return The number of streams created
+ */
+int SVR_Stream_newConfiguredOn(SVR_Context* context, const char** source_names, int count, SVR_StreamConfig* config,
+                               SVR_Stream** streams) {
+    int* return_codes;
+    int created = 0;
+
+    if(count <= 0) {
+        return 0;
+    }
+
+    return_codes = malloc(count * sizeof(int));
+    for(int i = 0; i < count; i++) {
+        streams[i] = SVR_Stream_alloc(context, source_names[i]);
+    }
+
+    SVR_Stream_sendConfig(streams, count, true, config, return_codes);
+
+    /* The server closes any stream it opened but could not configure */
+    for(int i = 0; i < count; i++) {
+        if(return_codes[i] == SVR_SUCCESS) {
+            SVR_Stream_recordConfig(streams[i], config);
+            created++;
+        } else {
+            SVR_Stream_free(streams[i]);
+            streams[i] = NULL;
+        }
+    }
+
+    free(return_codes);
+
+    return created;
+}
+
+/**
+ * \brief Initialize stream settings
+ *
+ * Leave every setting unset, for the caller to fill in those it wants to
+ * change
+ *
+ * \param config The settings to initialize
+ */
+void SVR_StreamConfig_init(SVR_StreamConfig* config) {
+    config->encoding = NULL;
+    config->width = -1;
+    config->height = -1;
+    config->channels = -1;
+    config->drop_rate = -1;
+    config->max_rate = -1;
+    config->max_age = -1;
+    config->priority = -1;
+    config->unpause = false;
+}
+
+/**
+ * \brief Configure a stream
+ *
+ * Apply several settings to a stream, and optionally unpause it, in one
+ * request. The server checks every setting before applying any, so on failure
+ * the stream is left as it was. Encoding, size and channels can only be set
+ * while the stream is paused.
+ *
+ * \param stream The stream
+ * \param config The settings to apply
+ * \return An SVR return code
+ */
+int SVR_Stream_configure(SVR_Stream* stream, SVR_StreamConfig* config) {
+    int return_code;
+
+    SVR_Stream_unshare(stream);
+    SVR_Stream_sendConfig(&stream, 1, false, config, &return_code);
+
+    if(return_code == SVR_SUCCESS) {
+        SVR_Stream_recordConfig(stream, config);
+    }
+
+    return return_code;
+}
+
+/**
+ * Remember the settings of a configuration applied to a stream
+ */
+static void SVR_Stream_recordConfig(SVR_Stream* stream, SVR_StreamConfig* config) {
+    if(config->encoding) {
+        free(stream->encoding_descriptor);
+        stream->encoding_descriptor = strdup(config->encoding);
+    }
+
+    stream->drop_rate = (config->drop_rate < 0) ? stream->drop_rate : config->drop_rate;
+    stream->max_rate = (config->max_rate < 0) ? stream->max_rate : config->max_rate;
+    stream->max_age = (config->max_age < 0) ? stream->max_age : config->max_age;
+    stream->priority = (config->priority < 0) ? stream->priority : config->priority;
+}
+
+/**
+ * Allocate a stream, without opening it with the server
+ */
+static SVR_Stream* SVR_Stream_alloc(SVR_Context* context, const char* source_name) {
     SVR_Stream* stream = malloc(sizeof(SVR_Stream));
 
+    stream->context = context;
     stream->stream_name = strdup(Util_format("stream%u", last_stream_num++));
     stream->source_name = strdup(source_name);
     stream->state = SVR_PAUSED;
@@ -61,119 +323,190 @@ SVR_Stream* SVR_Stream_new(const char* source_name) {
     stream->encoding = NULL;
     stream->decoder = NULL;
     stream->orphaned = false;
-
+    stream->pull_mode = false;
+    stream->frames_requested = 0;
+    stream->degrade_level = 0;
+    stream->receiver = NULL;
+    stream->chunks = SVR_ChunkQueue_new(SVR_STREAM_DECODE_QUEUE_SIZE);
+    stream->frames_decoded = 0;
+    stream->lent_frames = List_new();
+    stream->encoding_descriptor = NULL;
+    stream->drop_rate = -1;
+    stream->max_rate = -1;
+    stream->max_age = -1;
+    stream->priority = -1;
+    stream->shared = false;
+    stream->leader = NULL;
+    stream->followers = List_new();
+    stream->shared_frame = NULL;
+    stream->frame_allocator = NULL;
+    stream->frame_callback = NULL;
+    stream->frame_callback_data = NULL;
+    stream->callback_thread = SVR_CALLBACK_DECODE_THREAD;
+    stream->callback_frame = NULL;
+    stream->callback_worker_running = false;
+    stream->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    stream->event_set = false;
+
+    pthread_mutex_init(&stream->chunks_lock, NULL);
+    pthread_mutex_init(&stream->callback_lock, NULL);
+    pthread_cond_init(&stream->callback_frame_ready, NULL);
     pthread_cond_init(&stream->new_frame, NULL);
     SVR_LOCKABLE_INIT(stream);
 
-    /* Communicate with server to open the stream */
-    if(SVR_Stream_open(stream) != SVR_SUCCESS) {
-        free(stream);
-        return NULL;
-    }
+    pthread_create(&stream->decode_thread, NULL, SVR_Stream_decodeThread, stream);
 
     return stream;
 }
 
+/**
+ * Free a stream which failed to open
+ */
+static void SVR_Stream_free(SVR_Stream* stream) {
+    SVR_Stream_stopDecoding(stream);
+
+    if(stream->frame_properties) {
+        SVR_FrameProperties_destroy(stream->frame_properties);
+    }
+
+    List_destroy(stream->lent_frames);
+    List_destroy(stream->followers);
+    pthread_mutex_destroy(&stream->chunks_lock);
+    close(stream->event_fd);
+    free(stream->stream_name);
+    free(stream->source_name);
+    free(stream);
+}
+
 /**
  * \brief Destroy a stream
  *
- * Close and destroy a stream
+ * Close and destroy a stream. Not from the stream's own frame callback
  *
  * \param stream The stream to close
  */
 void SVR_Stream_destroy(SVR_Stream* stream) {
+    if(SVR_Stream_isCallbackThread(stream)) {
+        SVR_log(SVR_ERROR, "Stream can not be destroyed from its own frame callback");
+        return;
+    }
+
+    /* Keep other streams from following this one, and hand its followers on */
+    pthread_mutex_lock(&stream->context->stream_list_lock);
+    stream->shared = false;
+    pthread_mutex_unlock(&stream->context->stream_list_lock);
+    SVR_Stream_leave(stream);
+
     SVR_Stream_close(stream);
 
-    pthread_mutex_lock(&stream_list_lock);
-    Dictionary_remove(streams, stream->stream_name);
-    SVR_LOCK(stream);
-    pthread_mutex_unlock(&stream_list_lock);
+    /* The receiver provides frames to the stream, so stop it first */
+    if(stream->receiver) {
+        SVR_DatagramReceiver_destroy(stream->receiver);
+    }
+
+    pthread_mutex_lock(&stream->context->stream_list_lock);
+    Dictionary_remove(stream->context->streams, stream->stream_name);
+    pthread_mutex_unlock(&stream->context->stream_list_lock);
+
+    /* No more data can be queued for the stream once it is out of the list */
+    SVR_Stream_stopDecoding(stream);
+    SVR_Stream_stopCallbackWorker(stream);
 
+    SVR_LOCK(stream);
     if(stream->frame_properties) {
         SVR_FrameProperties_destroy(stream->frame_properties);
     }
 
     if(stream->decoder) {
-        if(stream->current_frame) {
-            SVR_Decoder_returnFrame(stream->decoder, stream->current_frame);
-        }
-
         SVR_Decoder_destroy(stream->decoder);
     }
+    SVR_UNLOCK(stream);
 
+    SVR_Stream_releaseFrames(stream);
+    List_destroy(stream->lent_frames);
+    List_destroy(stream->followers);
+    pthread_mutex_destroy(&stream->chunks_lock);
+
+    close(stream->event_fd);
+    free(stream->encoding_descriptor);
     free(stream->stream_name);
     free(stream->source_name);
-
-    SVR_UNLOCK(stream);
     free(stream);
 }
 
 /**
- * Open a stream with the server
+ * Send the requests opening a stream with the server, without waiting for
+ * their responses. Each request fails if the one before it did
  */
-static int SVR_Stream_open(SVR_Stream* stream) {
+static void SVR_Stream_sendOpen(SVR_Stream* stream, int requests[3]) {
     SVR_Message* message;
-    SVR_Message* response;
-    int return_code;
 
     /* Open stream */
     message = SVR_Message_new(2);
     message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.open");
     message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
-
-    response = SVR_Comm_sendMessage(message, true);
-    return_code = SVR_Comm_parseResponse(response);
-
+    requests[0] = SVR_Context_sendRequest(stream->context, message);
     SVR_Message_release(message);
-    SVR_Message_release(response);
-
-    if(return_code != SVR_SUCCESS) {
-        return return_code;
-    }
 
     /* Attach source to stream */
     message = SVR_Message_new(3);
     message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.attachSource");
     message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
     message->components[2] = SVR_Arena_strdup(message->alloc, stream->source_name);
+    requests[1] = SVR_Context_sendRequest(stream->context, message);
+    SVR_Message_release(message);
 
-    response = SVR_Comm_sendMessage(message, true);
-    return_code = SVR_Comm_parseResponse(response);
+    requests[2] = SVR_Stream_sendGetInfo(stream);
+}
 
-    SVR_Message_release(message);
-    SVR_Message_release(response);
+/**
+ * Wait for the responses to the requests opening a stream, and save the
+ * stream if they all succeeded
+ */
+static int SVR_Stream_finishOpen(SVR_Stream* stream, int requests[3]) {
+    int open_code = SVR_Stream_readCode(stream->context, requests[0]);
+    int attach_code = SVR_Stream_readCode(stream->context, requests[1]);
+    int info_code = SVR_Stream_readInfo(stream, requests[2]);
 
-    if(return_code != SVR_SUCCESS) {
-        return return_code;
+    if(open_code != SVR_SUCCESS) {
+        return open_code;
     }
 
-    return_code = SVR_Stream_updateInfo(stream);
-    if(return_code != SVR_SUCCESS) {
-        return return_code;
+    if(attach_code != SVR_SUCCESS || info_code != SVR_SUCCESS) {
+        /* The stream was opened, so do not leave it behind on the server */
+        SVR_Stream_close(stream);
+        return attach_code != SVR_SUCCESS ? attach_code : info_code;
     }
 
     /* Save stream */
-    pthread_mutex_lock(&stream_list_lock);
-    Dictionary_set(streams, stream->stream_name, stream);
-    pthread_mutex_unlock(&stream_list_lock);
+    pthread_mutex_lock(&stream->context->stream_list_lock);
+    Dictionary_set(stream->context->streams, stream->stream_name, stream);
+    pthread_mutex_unlock(&stream->context->stream_list_lock);
 
-    return return_code;
+    return SVR_SUCCESS;
 }
 
 /**
  * Close a stream with the server
  */
 static int SVR_Stream_close(SVR_Stream* stream) {
+    return SVR_Stream_sendCommand(stream->context, "Stream.close", stream->stream_name);
+}
+
+/**
+ * Send a request naming only a stream, such as Stream.pause, and wait for its
+ * return code
+ */
+static int SVR_Stream_sendCommand(SVR_Context* context, const char* command, const char* stream_name) {
     SVR_Message* message;
     SVR_Message* response;
     int return_code;
 
-    /* Close stream */
     message = SVR_Message_new(2);
-    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.close");
-    message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
+    message->components[0] = SVR_Arena_strdup(message->alloc, command);
+    message->components[1] = SVR_Arena_strdup(message->alloc, stream_name);
 
-    response = SVR_Comm_sendMessage(message, true);
+    response = SVR_Context_sendMessage(context, message, true);
     return_code = SVR_Comm_parseResponse(response);
 
     SVR_Message_release(message);
@@ -183,18 +516,32 @@ static int SVR_Stream_close(SVR_Stream* stream) {
 }
 
 /**
- * Update the stream info from the server
+ * Request the stream info from the server
  */
-static int SVR_Stream_updateInfo(SVR_Stream* stream) {
+static int SVR_Stream_sendGetInfo(SVR_Stream* stream) {
     SVR_Message* message;
-    SVR_Message* response;
-    int return_code;
+    int request;
 
     /* Get encoding and frame properties */
     message = SVR_Message_new(2);
     message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.getInfo");
     message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
-    response = SVR_Comm_sendMessage(message, true);
+    request = SVR_Context_sendRequest(stream->context, message);
+    SVR_Message_release(message);
+
+    return request;
+}
+
+/**
+ * Update the stream info from the response to SVR_Stream_sendGetInfo
+ */
+static int SVR_Stream_readInfo(SVR_Stream* stream, int request) {
+    SVR_Message* response = SVR_Context_getResponse(stream->context, request);
+    int return_code;
+
+    if(response == NULL) {
+        return SVR_UNKNOWNERROR;
+    }
 
     if(response->count == 4 && strcmp(response->components[0], "Stream.getInfo") == 0) {
         if(stream->frame_properties) {
@@ -208,154 +555,332 @@ static int SVR_Stream_updateInfo(SVR_Stream* stream) {
         return_code = SVR_Comm_parseResponse(response);
     }
 
-    SVR_Message_release(message);
     SVR_Message_release(response);
 
     return return_code;
 }
 
 /**
- * \brief Set the stream encoding
- *
- * Set the encoding of the stream. The stream must be paused to set the
- * encoding.
- *
- * \param stream The stream
- * \param encoding_descriptor Option string describing the new encoding
- * \return An SVR return code
+ * Wait for the return code answering a request
  */
-int SVR_Stream_setEncoding(SVR_Stream* stream, const char* encoding_descriptor) {
-    SVR_Message* message;
-    SVR_Message* response;
+static int SVR_Stream_readCode(SVR_Context* context, int request) {
+    SVR_Message* response = SVR_Context_getResponse(context, request);
     int return_code;
 
-    /* Open stream */
-    message = SVR_Message_new(3);
-    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.setEncoding");
-    message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
-    message->components[2] = SVR_Arena_strdup(message->alloc, encoding_descriptor);
+    if(response == NULL) {
+        return SVR_UNKNOWNERROR;
+    }
 
-    response = SVR_Comm_sendMessage(message, true);
     return_code = SVR_Comm_parseResponse(response);
-
-    SVR_Message_release(message);
     SVR_Message_release(response);
 
-    if(return_code != SVR_SUCCESS) {
-        return return_code;
-    }
-
-    return_code = SVR_Stream_updateInfo(stream);
-
     return return_code;
 }
 
 /**
- * \brief Resize the stream
- *
- * Request the stream be resized on the server side being being sent
- *
- * \param stream The stream
- * \param width The new width
- * \param height The new height
- * \return An SVR return code
+ * Send a request changing the stream, and update the stream info. Both
+ * requests are in flight together, so this costs one round trip. A shared
+ * stream is given its own server stream first. The message is released
  */
-int SVR_Stream_resize(SVR_Stream* stream, int width, int height) {
-    SVR_Message* message;
-    SVR_Message* response;
+static int SVR_Stream_sendUpdate(SVR_Stream* stream, SVR_Message* message) {
+    int update_request;
+    int info_request;
     int return_code;
+    int info_code;
 
-    message = SVR_Message_new(4);
-    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.resize");
-    message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
-    message->components[2] = SVR_Arena_sprintf(message->alloc, "%d", width);
-    message->components[3] = SVR_Arena_sprintf(message->alloc, "%d", height);
-
-    response = SVR_Comm_sendMessage(message, true);
-    return_code = SVR_Comm_parseResponse(response);
+    SVR_Stream_unshare(stream);
 
+    update_request = SVR_Context_sendRequest(stream->context, message);
+    info_request = SVR_Stream_sendGetInfo(stream);
     SVR_Message_release(message);
-    SVR_Message_release(response);
+
+    return_code = SVR_Stream_readCode(stream->context, update_request);
+    info_code = SVR_Stream_readInfo(stream, info_request);
 
     if(return_code != SVR_SUCCESS) {
         return return_code;
     }
 
-    return_code = SVR_Stream_updateInfo(stream);
-
-    return return_code;
+    return info_code;
 }
 
 /**
- * \brief Change the color mode of the stream
- *
- * Set/unset the grayscale setting for the stream
- *
- * \param stream The stream
- * \param grayscale Grayscale flag for the stream
- * \return An SVR return code
+ * Send a Stream.configure request for the streams and wait until its response
+ * is applied. The response is applied on the receive thread, so that streams
+ * being unpaused have their decoder before the first frame arrives
  */
-int SVR_Stream_setGrayscale(SVR_Stream* stream, bool grayscale) {
+static int SVR_Stream_sendConfig(SVR_Stream** streams, int count, bool open, SVR_StreamConfig* config, int* return_codes) {
+    SVR_StreamConfigRequest request;
     SVR_Message* message;
-    SVR_Message* response;
-    int return_code;
+    int index = 1;
 
-    /* Open stream */
-    message = SVR_Message_new(3);
-    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.setChannels");
-    message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
-    if(grayscale) {
-        message->components[2] = SVR_Arena_strdup(message->alloc, "1");
-    } else {
-        message->components[2] = SVR_Arena_strdup(message->alloc, "0");
+    /* Count the components before writing them */
+    for(int i = 0; i < count; i++) {
+        index = SVR_Stream_writeConfig(NULL, index, streams[i], open, config);
     }
 
-    response = SVR_Comm_sendMessage(message, true);
-    return_code = SVR_Comm_parseResponse(response);
+    message = SVR_Message_new(index);
+    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.configure");
+
+    index = 1;
+    for(int i = 0; i < count; i++) {
+        index = SVR_Stream_writeConfig(message, index, streams[i], open, config);
+    }
+
+    request.streams = streams;
+    request.count = count;
+    request.open = open;
+    request.unpause = config->unpause;
+    request.return_codes = return_codes;
+    request.answered = false;
+    pthread_mutex_init(&request.lock, NULL);
+    pthread_cond_init(&request.answered_cond, NULL);
+
+    /* Streams configured together share a context */
+    if(SVR_Context_sendRequestWithCallback(streams[0]->context, message, SVR_Stream_readConfig, &request) < 0) {
+        for(int i = 0; i < count; i++) {
+            return_codes[i] = SVR_UNKNOWNERROR;
+        }
+        request.answered = true;
+    }
 
     SVR_Message_release(message);
-    SVR_Message_release(response);
 
-    if(return_code != SVR_SUCCESS) {
-        return return_code;
+    pthread_mutex_lock(&request.lock);
+    while(request.answered == false) {
+        pthread_cond_wait(&request.answered_cond, &request.lock);
     }
+    pthread_mutex_unlock(&request.lock);
 
-    return_code = SVR_Stream_updateInfo(stream);
+    pthread_mutex_destroy(&request.lock);
+    pthread_cond_destroy(&request.answered_cond);
 
-    return return_code;
+    return return_codes[0];
 }
 
 /**
- * \brief Set the priority of the stream
- *
- * Set the stream priority. This currently has not effect
- *
- * \param stream The stream
- * \param priority The stream priority
- * \return An SVR return code
+ * Write the settings of one stream to a Stream.configure request starting at
+ * index, or only count them if message is NULL. Returns the index following
+ * them
  */
-int SVR_Stream_setPriority(SVR_Stream* stream, short priority) {
-    SVR_Message* message;
-    SVR_Message* response;
-    int return_code;
+static int SVR_Stream_writeConfig(SVR_Message* message, int index, SVR_Stream* stream, bool open, SVR_StreamConfig* config) {
+    if(message) {
+        message->components[index] = SVR_Arena_strdup(message->alloc, stream->stream_name);
+    }
+    index++;
 
-    /* Open stream */
-    message = SVR_Message_new(3);
-    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.setPriority");
-    message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
-    message->components[2] = SVR_Arena_sprintf(message->alloc, "%d", (int) priority);
+    if(open) {
+        if(message) {
+            message->components[index] = SVR_Arena_sprintf(message->alloc, "source=%s", stream->source_name);
+        }
+        index++;
+    }
 
-    response = SVR_Comm_sendMessage(message, true);
-    return_code = SVR_Comm_parseResponse(response);
+    if(config->encoding) {
+        if(message) {
+            message->components[index] = SVR_Arena_sprintf(message->alloc, "encoding=%s", config->encoding);
+        }
+        index++;
+    }
 
-    SVR_Message_release(message);
-    SVR_Message_release(response);
+    index = SVR_Stream_writeSetting(message, index, "width", config->width);
+    index = SVR_Stream_writeSetting(message, index, "height", config->height);
+    index = SVR_Stream_writeSetting(message, index, "channels", config->channels);
+    index = SVR_Stream_writeSetting(message, index, "drop_rate", config->drop_rate);
+    index = SVR_Stream_writeSetting(message, index, "max_rate", config->max_rate);
+    index = SVR_Stream_writeSetting(message, index, "max_age", config->max_age);
+    index = SVR_Stream_writeSetting(message, index, "priority", config->priority);
+    index = SVR_Stream_writeSetting(message, index, "unpause", config->unpause ? 1 : -1);
+
+    /* An empty component ends the stream's settings */
+    if(message) {
+        message->components[index] = SVR_Arena_strdup(message->alloc, "");
+    }
 
-    if(return_code != SVR_SUCCESS) {
-        return return_code;
+    return index + 1;
+}
+
+/**
+ * Write a "key=value" setting if the value is set
+ */
+static int SVR_Stream_writeSetting(SVR_Message* message, int index, const char* key, int value) {
+    if(value < 0) {
+        return index;
+    }
+
+    if(message) {
+        message->components[index] = SVR_Arena_sprintf(message->alloc, "%s=%d", key, value);
+    }
+
+    return index + 1;
+}
+
+/**
+ * Apply the response to a Stream.configure request to its streams, and wake
+ * the thread waiting for it. Runs on the receive thread
+ */
+static void SVR_Stream_readConfig(SVR_Message* response, void* _request) {
+    SVR_StreamConfigRequest* request = (SVR_StreamConfigRequest*) _request;
+    bool valid = (response->count == 1 + 3 * request->count &&
+                  strcmp(response->components[0], "Stream.configure") == 0);
+    bool success;
+
+    for(int i = 0; i < request->count; i++) {
+        if(valid == false) {
+            request->return_codes[i] = SVR_Comm_parseResponse(response);
+            continue;
+        }
+
+        /* The server answers with the encoding and frame properties the
+           stream is left with even if configuring it failed, so the decoder
+           always matches what the server sends */
+        request->return_codes[i] = atoi(response->components[1 + 3 * i]);
+        success = (request->return_codes[i] == SVR_SUCCESS);
+        SVR_Stream_applyConfig(request->streams[i], request->open && success, request->unpause && success,
+                               response->components[2 + 3 * i], response->components[3 + 3 * i]);
+    }
+
+    pthread_mutex_lock(&request->lock);
+    request->answered = true;
+    pthread_cond_signal(&request->answered_cond);
+    pthread_mutex_unlock(&request->lock);
+}
+
+/**
+ * Update a configured stream with the encoding and frame properties the server
+ * answered with. A new stream is saved so its frames are delivered to it
+ */
+static void SVR_Stream_applyConfig(SVR_Stream* stream, bool open, bool unpause, const char* encoding_name,
+                                   const char* frame_properties_string) {
+    SVR_FrameProperties* frame_properties = SVR_FrameProperties_fromString(frame_properties_string);
+
+    SVR_LOCK(stream);
+    if(frame_properties) {
+        if(stream->frame_properties) {
+            SVR_FrameProperties_destroy(stream->frame_properties);
+        }
+
+        stream->encoding = SVR_Encoding_getByName(encoding_name);
+        stream->frame_properties = frame_properties;
+    }
+
+    /* The server starts sending frames right after the response */
+    if(unpause && stream->state == SVR_PAUSED) {
+        SVR_Stream_openDecoder(stream);
+        stream->state = SVR_UNPAUSED;
+    }
+    SVR_UNLOCK(stream);
+
+    if(open) {
+        pthread_mutex_lock(&stream->context->stream_list_lock);
+        Dictionary_set(stream->context->streams, stream->stream_name, stream);
+        pthread_mutex_unlock(&stream->context->stream_list_lock);
+    }
+}
+
+/**
+ * \brief Set the stream encoding
+ *
+ * Set the encoding of the stream. The stream must be paused to set the
+ * encoding. The "auto" encoding lets the server pick raw if this client is on
+ * the same machine, and JPEG otherwise. Options given with "auto" are passed
+ * to the encoding picked.
+ *
+ * \param stream The stream
+ * \param encoding_descriptor Option string describing the new encoding
+ * \return An SVR return code
+ */
+int SVR_Stream_setEncoding(SVR_Stream* stream, const char* encoding_descriptor) {
+    SVR_Message* message;
+    int return_code;
+
+    /* Open stream */
+    message = SVR_Message_new(3);
+    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.setEncoding");
+    message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
+    message->components[2] = SVR_Arena_strdup(message->alloc, encoding_descriptor);
+
+    return_code = SVR_Stream_sendUpdate(stream, message);
+    if(return_code == SVR_SUCCESS) {
+        free(stream->encoding_descriptor);
+        stream->encoding_descriptor = strdup(encoding_descriptor);
+    }
+
+    return return_code;
+}
+
+/**
+ * \brief Resize the stream
+ *
+ * Request the stream be resized on the server side being being sent
+ *
+ * \param stream The stream
+ * \param width The new width
+ * \param height The new height
+ * \return An SVR return code
+ */
+int SVR_Stream_resize(SVR_Stream* stream, int width, int height) {
+    SVR_Message* message;
+
+    message = SVR_Message_new(4);
+    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.resize");
+    message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
+    message->components[2] = SVR_Arena_sprintf(message->alloc, "%d", width);
+    message->components[3] = SVR_Arena_sprintf(message->alloc, "%d", height);
+
+    return SVR_Stream_sendUpdate(stream, message);
+}
+
+/**
+ * \brief Change the color mode of the stream
+ *
+ * Set/unset the grayscale setting for the stream
+ *
+ * \param stream The stream
+ * \param grayscale Grayscale flag for the stream
+ * \return An SVR return code
+ */
+int SVR_Stream_setGrayscale(SVR_Stream* stream, bool grayscale) {
+    SVR_Message* message;
+
+    /* Open stream */
+    message = SVR_Message_new(3);
+    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.setChannels");
+    message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
+    if(grayscale) {
+        message->components[2] = SVR_Arena_strdup(message->alloc, "1");
+    } else {
+        message->components[2] = SVR_Arena_strdup(message->alloc, "0");
     }
 
-    return_code = SVR_Stream_updateInfo(stream);
+    return SVR_Stream_sendUpdate(stream, message);
+}
+
+/**
+ * \brief Set the priority of the stream
+ *
+ * Set the stream priority. When the server is overloaded it degrades the
+ * lowest priority streams first and restores them last. Higher values are more
+ * important.
+ *
+ * \param stream The stream
+ * \param priority The stream priority
+ * \return An SVR return code
+ */
+int SVR_Stream_setPriority(SVR_Stream* stream, short priority) {
+    SVR_Message* message;
+    int return_code;
+
+    /* Open stream */
+    message = SVR_Message_new(3);
+    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.setPriority");
+    message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
+    message->components[2] = SVR_Arena_sprintf(message->alloc, "%d", (int) priority);
+
+    return_code = SVR_Stream_sendUpdate(stream, message);
+    if(return_code == SVR_SUCCESS) {
+        stream->priority = priority;
+    }
 
     return return_code;
 }
@@ -373,7 +898,6 @@ int SVR_Stream_setPriority(SVR_Stream* stream, short priority) {
  */
 int SVR_Stream_setDropRate(SVR_Stream* stream, int drop_rate) {
     SVR_Message* message;
-    SVR_Message* response;
     int return_code;
 
     /* Open stream */
@@ -382,189 +906,681 @@ int SVR_Stream_setDropRate(SVR_Stream* stream, int drop_rate) {
     message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
     message->components[2] = SVR_Arena_sprintf(message->alloc, "%d", drop_rate);
 
-    response = SVR_Comm_sendMessage(message, true);
-    return_code = SVR_Comm_parseResponse(response);
-
-    SVR_Message_release(message);
-    SVR_Message_release(response);
-
-    if(return_code != SVR_SUCCESS) {
-        return return_code;
+    return_code = SVR_Stream_sendUpdate(stream, message);
+    if(return_code == SVR_SUCCESS) {
+        stream->drop_rate = drop_rate;
     }
 
-    return_code = SVR_Stream_updateInfo(stream);
-
     return return_code;
 }
 
 /**
- * \brief Unpause the stream
+ * \brief Limit the stream frame rate
  *
- * Unpause a stream. A stream must be unpaused to receive frames
+ * Limit the stream to at most max_rate frames per second. Unlike a drop rate
+ * the limit does not depend on the rate of the source, and the server does not
+ * process the frames it skips.
  *
  * \param stream The stream
+ * \param max_rate The maximum rate in frames per second, or 0 for no limit
  * \return An SVR return code
  */
-int SVR_Stream_unpause(SVR_Stream* stream) {
+int SVR_Stream_setMaxRate(SVR_Stream* stream, int max_rate) {
     SVR_Message* message;
     SVR_Message* response;
     int return_code;
 
-    /* Reopen decoder */
-    if(stream->decoder) {
-        SVR_Decoder_destroy(stream->decoder);
-    }
-    stream->decoder = SVR_Decoder_new(stream->encoding, stream->frame_properties);
-
-    /* Open stream */
-    message = SVR_Message_new(2);
-    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.unpause");
+    message = SVR_Message_new(3);
+    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.setMaxRate");
     message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
+    message->components[2] = SVR_Arena_sprintf(message->alloc, "%d", max_rate);
 
-    response = SVR_Comm_sendMessage(message, true);
+    SVR_Stream_unshare(stream);
+    response = SVR_Context_sendMessage(stream->context, message, true);
     return_code = SVR_Comm_parseResponse(response);
 
     SVR_Message_release(message);
     SVR_Message_release(response);
 
-    if(return_code == 0) {
-        stream->state = SVR_UNPAUSED;
+    if(return_code == SVR_SUCCESS) {
+        stream->max_rate = max_rate;
     }
 
     return return_code;
 }
 
-
 /**
- * \brief Pause the stream
+ * \brief Set the maximum frame age
  *
- * Pause a stream.
+ * Frames which are older than max_age milliseconds by the time the server
+ * would process or send them are discarded instead. Use this when no frame is
+ * better than a stale one.
  *
  * \param stream The stream
+ * \param max_age The maximum age in milliseconds, or 0 for no limit
  * \return An SVR return code
  */
-int SVR_Stream_pause(SVR_Stream* stream) {
+int SVR_Stream_setMaxAge(SVR_Stream* stream, int max_age) {
     SVR_Message* message;
     SVR_Message* response;
     int return_code;
 
-    /* Open stream */
-    message = SVR_Message_new(2);
-    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.pause");
+    message = SVR_Message_new(3);
+    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.setMaxAge");
     message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
+    message->components[2] = SVR_Arena_sprintf(message->alloc, "%d", max_age);
 
-    response = SVR_Comm_sendMessage(message, true);
+    SVR_Stream_unshare(stream);
+    response = SVR_Context_sendMessage(stream->context, message, true);
     return_code = SVR_Comm_parseResponse(response);
 
     SVR_Message_release(message);
     SVR_Message_release(response);
 
-    if(return_code == 0) {
-        stream->state = SVR_PAUSED;
+    if(return_code == SVR_SUCCESS) {
+        stream->max_age = max_age;
     }
 
     return return_code;
 }
 
 /**
- * \brief Get the stream frame properties
+ * \brief Get stream statistics
  *
- * Get the frame properties for the stream
+ * Retrieve the frame counters the server keeps for the stream
  *
  * \param stream The stream
- * \return The stream's frame properties
+ * \param stats Filled with the stream counters on success
+ * \return An SVR return code
  */
-SVR_FrameProperties* SVR_Stream_getFrameProperties(SVR_Stream* stream) {
-    return stream->frame_properties;
+int SVR_Stream_getStats(SVR_Stream* stream, SVR_StreamStats* stats) {
+    SVR_Message* message;
+    SVR_Message* response;
+    int return_code;
+
+    message = SVR_Message_new(2);
+    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.getStats");
+    message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
+    response = SVR_Context_sendMessage(stream->context, message, true);
+
+    if(response->count == 4 && strcmp(response->components[0], "Stream.getStats") == 0) {
+        stats->frames_sent = strtoul(response->components[1], NULL, 10);
+        stats->frames_dropped = strtoul(response->components[2], NULL, 10);
+        stats->frames_expired = strtoul(response->components[3], NULL, 10);
+        stats->frames_lost = stream->receiver ? stream->receiver->frames_lost : 0;
+        return_code = SVR_SUCCESS;
+    } else {
+        return_code = SVR_Comm_parseResponse(response);
+    }
+
+    SVR_Message_release(message);
+    SVR_Message_release(response);
+
+    return return_code;
 }
 
 /**
- * \brief Get a frame from a stream
+ * \brief Choose how frames of the stream are delivered
  *
- * Get a frame from a stream. The most recent frame is always returned
- * (i.e. missed frame are silently dropped). When the caller is finished with
- * a frame it should be returned with a call to SVR_Stream_returnFrame
+ * By default frames arrive over the connection to the server ("tcp"). Over a
+ * lossy link a lost packet then holds up every later frame. With "udp" the
+ * server sends each frame as a series of datagrams instead, and a frame missing
+ * any of them is dropped, so the newest frame is never held up by an older one.
+ *
+ * With "multicast:group=ADDRESS,port=PORT" frames are sent to an IPv4
+ * multicast group. Streams of any number of clients may join the same group and
+ * the server sends each frame once for all of them, so they should all use the
+ * same source, encoding and frame size.
+ *
+ * The stream must be paused.
  *
  * \param stream The stream
- * \param wait A wait flag. If true, block until a frame is available. Otherwise
- * return NULL immediately if a frame is unavailable.
- * \return A frame, or NULL if wait was false and no frame was available
+ * \param transport_descriptor One of "tcp", "udp" or
+ * "multicast:group=ADDRESS,port=PORT"
+ * \return An SVR return code
  */
-IplImage* SVR_Stream_getFrame(SVR_Stream* stream, bool wait) {
-    IplImage* frame;
+int SVR_Stream_setTransport(SVR_Stream* stream, const char* transport_descriptor) {
+    SVR_DatagramReceiver* receiver = NULL;
+    SVR_Message* message;
+    SVR_Message* response;
+    Dictionary* options;
+    const char* type;
+    const char* group = NULL;
+    int port = 0;
+    int return_code;
 
-    SVR_LOCK(stream);
-    while(stream->current_frame == NULL && wait && stream->state == SVR_UNPAUSED) {
-        SVR_LOCK_WAIT(stream, &stream->new_frame);
+    if(stream->state == SVR_UNPAUSED) {
+        return SVR_INVALIDSTATE;
     }
 
-    frame = stream->current_frame;
-    stream->current_frame = NULL;
-    SVR_UNLOCK(stream);
+    options = SVR_parseOptionString(transport_descriptor);
+    if(options == NULL) {
+        return SVR_PARSEERROR;
+    }
 
-    return frame;
+    type = Dictionary_get(options, "%name");
+    if(strcmp(type, "multicast") == 0) {
+        group = Dictionary_get(options, "group");
+        port = Dictionary_get(options, "port") ? atoi(Dictionary_get(options, "port")) : 0;
+        if(group == NULL || port <= 0) {
+            SVR_freeParsedOptionString(options);
+            return SVR_INVALIDARGUMENT;
+        }
+    } else if(strcmp(type, "udp") != 0 && strcmp(type, "tcp") != 0) {
+        SVR_freeParsedOptionString(options);
+        return SVR_INVALIDARGUMENT;
+    }
+
+    if(strcmp(type, "tcp") == 0) {
+        message = SVR_Message_new(3);
+    } else {
+        receiver = SVR_DatagramReceiver_new(stream->context, stream->stream_name, group, port);
+        if(receiver == NULL) {
+            SVR_freeParsedOptionString(options);
+            return SVR_UNKNOWNERROR;
+        }
+
+        if(group) {
+            message = SVR_Message_new(5);
+            message->components[3] = SVR_Arena_strdup(message->alloc, group);
+            message->components[4] = SVR_Arena_sprintf(message->alloc, "%d", port);
+        } else {
+            message = SVR_Message_new(4);
+            message->components[3] = SVR_Arena_sprintf(message->alloc, "%d", SVR_DatagramReceiver_getPort(receiver));
+        }
+    }
+
+    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.setTransport");
+    message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
+    message->components[2] = SVR_Arena_strdup(message->alloc, type);
+    SVR_freeParsedOptionString(options);
+
+    response = SVR_Context_sendMessage(stream->context, message, true);
+    return_code = SVR_Comm_parseResponse(response);
+
+    SVR_Message_release(message);
+    SVR_Message_release(response);
+
+    if(return_code != SVR_SUCCESS) {
+        if(receiver) {
+            SVR_DatagramReceiver_destroy(receiver);
+        }
+        return return_code;
+    }
+
+    if(stream->receiver) {
+        SVR_DatagramReceiver_destroy(stream->receiver);
+    }
+    stream->receiver = receiver;
+
+    return SVR_SUCCESS;
 }
 
 /**
- * \brief Return a frame
+ * \brief Set pull mode
  *
- * When the caller is done with a frame returned by SVR_Stream_getFrame it
- * should be retuned via this function.
+ * In pull mode the server only processes and sends a frame once one is
+ * requested with SVR_Stream_requestFrame. SVR_Stream_getFrame requests a frame
+ * itself when asked to wait and no frame is available or requested, so a
+ * client may simply call SVR_Stream_getFrame at its own pace.
  *
  * \param stream The stream
- * \param frame The frame to return
+ * \param pull_mode True to enable pull mode, false to receive every frame
+ * \return An SVR return code
  */
-void SVR_Stream_returnFrame(SVR_Stream* stream, IplImage* frame) {
-    if(stream->decoder) {
-        SVR_Decoder_returnFrame(stream->decoder, frame);
+int SVR_Stream_setPullMode(SVR_Stream* stream, bool pull_mode) {
+    SVR_Message* message;
+    SVR_Message* response;
+    int return_code;
+
+    message = SVR_Message_new(3);
+    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.setPullMode");
+    message->components[1] = SVR_Arena_strdup(message->alloc, stream->stream_name);
+    message->components[2] = SVR_Arena_strdup(message->alloc, pull_mode ? "1" : "0");
+
+    SVR_Stream_unshare(stream);
+    response = SVR_Context_sendMessage(stream->context, message, true);
+    return_code = SVR_Comm_parseResponse(response);
+
+    SVR_Message_release(message);
+    SVR_Message_release(response);
+
+    if(return_code == SVR_SUCCESS) {
+        SVR_LOCK(stream);
+        stream->pull_mode = pull_mode;
+        stream->frames_requested = 0;
+        SVR_UNLOCK(stream);
     }
+
+    return return_code;
 }
 
 /**
- * \brief Check stream orphaned status
+ * \brief Receive frames through a callback
  *
- * Check if a stream has been orphaned. A stream is orphaned when its source
- * closes.
+ * Pass each frame of the stream to a callback rather than keeping the newest
+ * for SVR_Stream_getFrame. The frame is lent to the callback until it returns;
+ * it can be kept longer with SVR_REF and released with SVR_UNREF. Along with
+ * the image, the frame carries its sequence number, the time it was decoded
+ * and the degrade level of the stream.
  *
- * \param stream The stream
- * \return True if the stream has been orphaned, false otherwise
- */
-bool SVR_Stream_isOrphaned(SVR_Stream* stream) {
-    return stream->orphaned;
-}
-
-/**
- * \private
- * \brief Mark the stream as orphaned
+ * On SVR_CALLBACK_DECODE_THREAD the callback sees every frame as soon as it is
+ * decoded, and holds up decoding while it runs. On SVR_CALLBACK_OWN_THREAD it
+ * runs on a thread of its own and is given the newest frame each time it
+ * returns.
  *
- * Mark the stream as orphaned
+ * Either way the callback may use the other functions of its stream,
+ * including those waiting for the server. Data keeps being received while it
+ * runs. It must not set the frame callback of its stream or destroy it, which
+ * would wait for the callback itself to return; both are refused from the
+ * callback's thread.
  *
- * \param stream_name The name of the stream to mark as orphaned
+ * \param stream The stream
+ * \param callback The callback, or NULL to go back to SVR_Stream_getFrame
+ * \param data Passed to the callback
+ * \param thread The thread the callback is called on
+ * \return An SVR return code
  */
-void SVR_Stream_setOrphaned(const char* stream_name) {
+int SVR_Stream_setFrameCallback(SVR_Stream* stream, SVR_FrameCallback callback, void* data, SVR_CallbackThread thread) {
+    if(SVR_Stream_isCallbackThread(stream)) {
+        SVR_log(SVR_ERROR, "Frame callback can not be set from the stream's own callback");
+        return SVR_INVALIDSTATE;
+    }
+
+    /* Wait for any callback running to return */
+    SVR_Stream_stopCallbackWorker(stream);
+    pthread_mutex_lock(&stream->callback_lock);
+
+    SVR_LOCK(stream);
+    stream->frame_callback = callback;
+    stream->frame_callback_data = data;
+    stream->callback_thread = thread;
+
+    if(callback && thread == SVR_CALLBACK_OWN_THREAD) {
+        stream->callback_worker_running = true;
+        pthread_create(&stream->callback_worker, NULL, SVR_Stream_callbackWorker, stream);
+    }
+    SVR_UNLOCK(stream);
+
+    pthread_mutex_unlock(&stream->callback_lock);
+
+    return SVR_SUCCESS;
+}
+
+/**
+ * \brief Decode frames into frames from an allocator
+ *
+ * Have the stream decode into frames from the given allocator, such as
+ * aligned or shared buffers the application owns, instead of the frame pool.
+ * Frames passed to a frame callback are given back to the allocator once
+ * released, on the library's garbage collector thread. The stream must be
+ * paused, and frames got from SVR_Stream_getFrame must be returned before the
+ * allocator is changed. The allocator must outlive every frame taken from it.
+ *
+ * \param stream The stream
+ * \param frame_allocator The allocator, or NULL for the frame pool
+ * \return An SVR return code
+ */
+int SVR_Stream_setFrameAllocator(SVR_Stream* stream, SVR_FrameAllocator* frame_allocator) {
+    if(stream->state == SVR_UNPAUSED) {
+        return SVR_INVALIDSTATE;
+    }
+
+    SVR_LOCK(stream);
+    stream->frame_allocator = frame_allocator;
+    SVR_UNLOCK(stream);
+
+    return SVR_SUCCESS;
+}
+
+/**
+ * \brief Allow a stream to share frames with other streams
+ *
+ * Streams are not shared unless this is called. A shared stream unpaused with
+ * SVR_Stream_unpause while another shared stream of the same context is
+ * running with the same source and settings follows that stream instead of
+ * having the server send the frames again. Its own server stream stays
+ * paused, and the frames the other stream decodes are passed to it as well,
+ * so each frame is encoded, sent and decoded once for both. The frames are
+ * then the same for every stream sharing them, so a stream may only be shared
+ * if its frames are never modified. SVR_Stream_getStats counts the frames of
+ * the stream's own server stream, which sends none while it follows another.
+ *
+ * Streams sharing frames part again as soon as either of them changes a
+ * setting, is paused or is destroyed. Streams using pull mode, a datagram
+ * transport or a frame allocator of their own are not shared.
+ *
+ * \param stream The stream
+ * \param shared True to share frames, false to always have the server send the
+ * stream's frames
+ * \return An SVR return code
+ */
+int SVR_Stream_setShared(SVR_Stream* stream, bool shared) {
+    pthread_mutex_lock(&stream->context->stream_list_lock);
+    stream->shared = shared;
+    pthread_mutex_unlock(&stream->context->stream_list_lock);
+
+    if(shared == false) {
+        SVR_Stream_unshare(stream);
+    }
+
+    return SVR_SUCCESS;
+}
+
+/**
+ * \brief Request a frame
+ *
+ * Ask the server to send the next frame of a stream in pull mode. No response
+ * is waited for.
+ *
+ * \param stream The stream
+ * \return An SVR return code
+ */
+int SVR_Stream_requestFrame(SVR_Stream* stream) {
+    SVR_Message* message;
+
+    SVR_LOCK(stream);
+    if(stream->pull_mode == false) {
+        SVR_UNLOCK(stream);
+        return SVR_INVALIDSTATE;
+    }
+    stream->frames_requested++;
+    SVR_UNLOCK(stream);
+
+    message = SVR_Message_new(2);
+    message->components[0] = "Stream.requestFrame";
+    message->components[1] = stream->stream_name;
+
+    SVR_Context_sendMessage(stream->context, message, false);
+    SVR_Message_release(message);
+
+    return SVR_SUCCESS;
+}
+
+/**
+ * \brief Unpause the stream
+ *
+ * Unpause a stream. A stream must be unpaused to receive frames. A stream
+ * made shared may follow another stream receiving the same frames instead,
+ * see SVR_Stream_setShared
+ *
+ * \param stream The stream
+ * \return An SVR return code. SVR_OVERLOADED if the server is over its load
+ * budget and has no lower priority stream to degrade in favour of this one
+ */
+int SVR_Stream_unpause(SVR_Stream* stream) {
+    int return_code;
+
+    /* Reopen decoder */
+    SVR_LOCK(stream);
+    SVR_Stream_openDecoder(stream);
+    SVR_UNLOCK(stream);
+
+    /* Follow a stream already receiving the same frames if there is one */
+    if(SVR_Stream_share(stream)) {
+        return SVR_SUCCESS;
+    }
+
+    return_code = SVR_Stream_sendCommand(stream->context, "Stream.unpause", stream->stream_name);
+
+    if(return_code == 0) {
+        stream->state = SVR_UNPAUSED;
+    }
+
+    return return_code;
+}
+
+
+/**
+ * \brief Pause the stream
+ *
+ * Pause a stream.
+ *
+ * \param stream The stream
+ * \return An SVR return code
+ */
+int SVR_Stream_pause(SVR_Stream* stream) {
+    int return_code;
+
+    /* A follower's own server stream is paused already */
+    if(SVR_Stream_leave(stream)) {
+        stream->state = SVR_PAUSED;
+        return SVR_SUCCESS;
+    }
+
+    return_code = SVR_Stream_sendCommand(stream->context, "Stream.pause", stream->stream_name);
+
+    if(return_code == 0) {
+        stream->state = SVR_PAUSED;
+    }
+
+    return return_code;
+}
+
+/**
+ * \brief Get the stream frame properties
+ *
+ * Get the frame properties for the stream
+ *
+ * \param stream The stream
+ * \return The stream's frame properties
+ */
+SVR_FrameProperties* SVR_Stream_getFrameProperties(SVR_Stream* stream) {
+    return stream->frame_properties;
+}
+
+/**
+ * \brief Get a frame from a stream
+ *
+ * Get a frame from a stream. The most recent frame is always returned
+ * (i.e. missed frame are silently dropped). When the caller is finished with
+ * a frame it should be returned with a call to SVR_Stream_returnFrame
+ *
+ * \param stream The stream
+ * \param wait A wait flag. If true, block until a frame is available. Otherwise
+ * return NULL immediately if a frame is unavailable.
+ * \return A frame, or NULL if wait was false and no frame was available
+ */
+IplImage* SVR_Stream_getFrame(SVR_Stream* stream, bool wait) {
+    SVR_Frame* frame;
+    bool request;
+
+    /* In pull mode, ask for a frame if none is coming */
+    SVR_LOCK(stream);
+    request = (stream->current_frame == NULL && wait && stream->state == SVR_UNPAUSED &&
+               stream->pull_mode && stream->frames_requested == 0);
+    SVR_UNLOCK(stream);
+
+    if(request) {
+        SVR_Stream_requestFrame(stream);
+    }
+
+    SVR_LOCK(stream);
+    while(stream->current_frame == NULL && wait && stream->state == SVR_UNPAUSED) {
+        SVR_LOCK_WAIT(stream, &stream->new_frame);
+    }
+
+    frame = stream->current_frame;
+    stream->current_frame = NULL;
+    if(frame) {
+        List_append(stream->lent_frames, frame);
+    }
+    SVR_Stream_updateEvent(stream);
+    SVR_UNLOCK(stream);
+
+    return frame ? frame->image : NULL;
+}
+
+/**
+ * \brief Return a frame
+ *
+ * When the caller is done with a frame returned by SVR_Stream_getFrame it
+ * should be retuned via this function.
+ *
+ * \param stream The stream
+ * \param frame The frame to return
+ */
+void SVR_Stream_returnFrame(SVR_Stream* stream, IplImage* frame) {
+    SVR_Frame* lent_frame;
+
+    SVR_LOCK(stream);
+    for(int i = 0; (lent_frame = List_get(stream->lent_frames, i)) != NULL; i++) {
+        if(lent_frame->image == frame) {
+            List_remove(stream->lent_frames, i);
+            break;
+        }
+    }
+    SVR_UNLOCK(stream);
+
+    if(lent_frame) {
+        SVR_UNREF(lent_frame);
+    }
+}
+
+/**
+ * \brief Check stream orphaned status
+ *
+ * Check if a stream has been orphaned. A stream is orphaned when its source
+ * closes.
+ *
+ * \param stream The stream
+ * \return True if the stream has been orphaned, false otherwise
+ */
+bool SVR_Stream_isOrphaned(SVR_Stream* stream) {
+    return stream->orphaned;
+}
+
+/**
+ * \private
+ * \brief Mark the stream as orphaned
+ *
+ * Mark the stream as orphaned
+ *
+ * \param context The context the stream is open over
+ * \param stream_name The name of the stream to mark as orphaned
+ */
+void SVR_Stream_setOrphaned(SVR_Context* context, const char* stream_name) {
     SVR_Stream* stream;
+    SVR_Stream* follower;
 
-    pthread_mutex_lock(&stream_list_lock);
-    stream = SVR_Stream_getByName(stream_name);
+    pthread_mutex_lock(&context->stream_list_lock);
+    stream = SVR_Stream_getByName(context, stream_name);
     if(stream == NULL) {
+        pthread_mutex_unlock(&context->stream_list_lock);
         SVR_log(SVR_WARNING, "Received orphaned signal for uknown stream");
         return;
     }
+
+    /* Streams sharing frames share the source, so every one of them is
+       orphaned along with it */
+    pthread_mutex_lock(&context->share_lock);
+    if(stream->leader) {
+        List_remove(stream->leader->followers, List_indexOf(stream->leader->followers, stream));
+        stream->leader = NULL;
+    }
+    while((follower = List_remove(stream->followers, 0)) != NULL) {
+        follower->leader = NULL;
+    }
+    pthread_mutex_unlock(&context->share_lock);
+
     SVR_LOCK(stream);
-    pthread_mutex_unlock(&stream_list_lock);
+    pthread_mutex_unlock(&context->stream_list_lock);
 
     /* We've been orphaned, pause the stream, mark as orphaned and wake up any
        getFrame calls */
     stream->orphaned = true;
     stream->state = SVR_PAUSED;
     pthread_cond_broadcast(&stream->new_frame);
+    SVR_Stream_updateEvent(stream);
     SVR_UNLOCK(stream);
 
     /* Notify SVR_Stream_sync that something happened */
-    pthread_mutex_lock(&new_global_data_lock);
-    new_global_data = true;
-    pthread_cond_broadcast(&new_global_data_cond);
-    pthread_mutex_unlock(&new_global_data_lock);
+    SVR_Stream_notifySync();
+}
+
+/**
+ * \private
+ * \brief Apply a server side adjustment to a stream
+ *
+ * Called when an overloaded server changes the degrade level of a stream. Level
+ * 1 halves the frame rate, level 2 lowers the JPEG quality and level 3 halves
+ * the resolution. The adjustment is queued behind the data already received,
+ * as the frames which follow it may be encoded at a new size.
+ *
+ * \param context The context the stream is open over
+ * \param stream_name The name of the adjusted stream
+ * \param level The new degrade level, 0 if the stream was restored
+ * \param frame_properties_string The new frame properties of the stream
+ */
+void SVR_Stream_setAdjusted(SVR_Context* context, const char* stream_name, int level, const char* frame_properties_string) {
+    SVR_Stream* stream;
+    SVR_Stream* follower;
+    char adjustment[64];
+    int n;
+
+    n = snprintf(adjustment, sizeof(adjustment), "%d %s", level, frame_properties_string);
+    if(n < 0 || n >= sizeof(adjustment)) {
+        SVR_log(SVR_WARNING, "Received invalid frame properties for adjusted stream");
+        return;
+    }
+
+    pthread_mutex_lock(&context->stream_list_lock);
+    stream = SVR_Stream_getByName(context, stream_name);
+    if(stream == NULL) {
+        pthread_mutex_unlock(&context->stream_list_lock);
+        SVR_log(SVR_WARNING, "Received adjustment for unknown stream");
+        return;
+    }
+
+    pthread_mutex_lock(&stream->chunks_lock);
+    SVR_ChunkQueue_push(stream->chunks, STREAM_CHUNK_ADJUSTED, adjustment, n + 1);
+    pthread_mutex_unlock(&stream->chunks_lock);
+
+    /* Followers are given the adjusted frames too */
+    for(int i = 0; (follower = List_get(stream->followers, i)) != NULL; i++) {
+        pthread_mutex_lock(&follower->chunks_lock);
+        SVR_ChunkQueue_push(follower->chunks, STREAM_CHUNK_ADJUSTED, adjustment, n + 1);
+        pthread_mutex_unlock(&follower->chunks_lock);
+    }
+    pthread_mutex_unlock(&context->stream_list_lock);
+}
+
+/**
+ * Apply an adjustment queued by SVR_Stream_setAdjusted, given as the level
+ * followed by the frame properties. If the frame size changed the decoder is
+ * reopened
+ */
+static void SVR_Stream_applyAdjustment(SVR_Stream* stream, const char* adjustment) {
+    SVR_FrameProperties* frame_properties;
+    char* frame_properties_string;
+    int level;
+
+    level = strtol(adjustment, &frame_properties_string, 10);
+    frame_properties = SVR_FrameProperties_fromString(frame_properties_string + 1);
+    if(frame_properties == NULL) {
+        SVR_log(SVR_WARNING, "Received invalid frame properties for adjusted stream");
+        return;
+    }
+
+    SVR_LOCK(stream);
+    SVR_logf(SVR_INFO, "Server set degrade level of stream %s to %d (%dx%d)", stream->stream_name, level,
+                       frame_properties->width, frame_properties->height);
+
+    stream->degrade_level = level;
+
+    if(stream->frame_properties->width != frame_properties->width ||
+       stream->frame_properties->height != frame_properties->height) {
+        SVR_FrameProperties_destroy(stream->frame_properties);
+        stream->frame_properties = frame_properties;
+
+        if(stream->decoder) {
+            SVR_Stream_openDecoder(stream);
+        }
+    } else {
+        SVR_FrameProperties_destroy(frame_properties);
+    }
+
+    SVR_UNLOCK(stream);
 }
 
 /**
@@ -581,49 +1597,549 @@ void SVR_Stream_sync(void) {
     pthread_mutex_unlock(&new_global_data_lock);
 }
 
+/**
+ * \brief Get a file descriptor signaling a stream's frames
+ *
+ * The descriptor polls readable while a frame is waiting to be taken with
+ * SVR_Stream_getFrame, and once the stream is orphaned. It becomes unreadable
+ * again when the frame is taken, so it can be added to an epoll or poll loop
+ * as is. It must not be read, written or closed by the caller. Frames passed
+ * to a frame callback do not signal it.
+ *
+ * \param stream The stream
+ * \return The descriptor, or -1 if it could not be created
+ */
+int SVR_Stream_getEventFd(SVR_Stream* stream) {
+    return stream->event_fd;
+}
+
+/**
+ * \brief Wait for a frame from any of several streams
+ *
+ * Block until one of the streams has a frame waiting or is orphaned, without
+ * waking for the frames of other streams.
+ *
+ * \param streams The streams to wait on
+ * \param count The number of streams
+ * \param timeout Milliseconds to wait at most, or -1 to wait indefinitely
+ * \return The index of a ready stream, or -1 if the timeout expired first
+ */
+int SVR_Stream_waitAny(SVR_Stream** streams, int count, int timeout) {
+    struct pollfd* fds = malloc(count * sizeof(struct pollfd));
+    int ready = -1;
+
+    for(int i = 0; i < count; i++) {
+        fds[i].fd = streams[i]->event_fd;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+
+    while(poll(fds, count, timeout) < 0 && errno == EINTR);
+
+    for(int i = 0; i < count; i++) {
+        if(fds[i].revents & POLLIN) {
+            ready = i;
+            break;
+        }
+    }
+
+    free(fds);
+
+    return ready;
+}
+
+/**
+ * Make the event descriptor of a stream readable if a frame is waiting or the
+ * stream is orphaned, and unreadable otherwise. Called with the stream locked
+ */
+static void SVR_Stream_updateEvent(SVR_Stream* stream) {
+    bool set = (stream->current_frame != NULL || stream->orphaned);
+    uint64_t value = 1;
+
+    if(set == stream->event_set || stream->event_fd == -1) {
+        return;
+    }
+
+    if(set) {
+        write(stream->event_fd, &value, sizeof(value));
+    } else {
+        read(stream->event_fd, &value, sizeof(value));
+    }
+
+    stream->event_set = set;
+}
+
+/**
+ * Wake SVR_Stream_sync
+ */
+static void SVR_Stream_notifySync(void) {
+    pthread_mutex_lock(&new_global_data_lock);
+    new_global_data = true;
+    pthread_cond_broadcast(&new_global_data_cond);
+    pthread_mutex_unlock(&new_global_data_lock);
+}
+
 /**
  * \private
  * \brief Provide encoded source data to a stream
  *
- * Provide encoded source data to a stream
+ * Queue encoded source data for the stream's decode thread, so the caller can
+ * go back to receiving. Never waits for decoding, which may be held up by a
+ * frame callback: the queue grows instead while decoding falls behind.
  *
+ * \param context The context the data was received over
  * \param stream_name Name of the stream the data is for
  * \param buffer A buffer of encoded frame data
  * \param n Number of bytes in the buffer
  */
-void SVR_Stream_provideData(const char* stream_name, void* buffer, size_t n) {
+void SVR_Stream_provideData(SVR_Context* context, const char* stream_name, void* buffer, size_t n) {
     SVR_Stream* stream;
 
-    pthread_mutex_lock(&stream_list_lock);
-    stream = SVR_Stream_getByName(stream_name);
+    pthread_mutex_lock(&context->stream_list_lock);
+    stream = SVR_Stream_getByName(context, stream_name);
     if(stream == NULL) {
+        pthread_mutex_unlock(&context->stream_list_lock);
         SVR_log(SVR_WARNING, "Data arrived for unknown stream\n");
         return;
     }
-    SVR_LOCK(stream);
-    pthread_mutex_unlock(&stream_list_lock);
 
-    SVR_Decoder_decode(stream->decoder, buffer, n);
+    /* The chunks lock is taken before the list lock is let go, and
+       SVR_Stream_destroy takes it once the stream is out of the list, so the
+       queue outlives the push */
+    pthread_mutex_lock(&stream->chunks_lock);
+    pthread_mutex_unlock(&context->stream_list_lock);
 
-    if(SVR_Decoder_framesReady(stream->decoder)) {
-        if(stream->current_frame) {
-            SVR_Decoder_returnFrame(stream->decoder, stream->current_frame);
+    SVR_ChunkQueue_push(stream->chunks, STREAM_CHUNK_DATA, buffer, n);
+    pthread_mutex_unlock(&stream->chunks_lock);
+}
+
+/**
+ * Decode the data queued for a stream, in the order it arrived, until the
+ * stream is destroyed
+ */
+static void* SVR_Stream_decodeThread(void* _stream) {
+    SVR_Stream* stream = (SVR_Stream*) _stream;
+    void* data;
+    size_t n;
+    int tag;
+
+    while(SVR_ChunkQueue_peek(stream->chunks, &tag, &data, &n)) {
+        if(tag == STREAM_CHUNK_ADJUSTED) {
+            SVR_Stream_applyAdjustment(stream, data);
+        } else if(tag == STREAM_CHUNK_SHARED) {
+            SVR_Stream_deliverShared(stream);
+        } else {
+            SVR_Stream_decode(stream, data, n);
         }
 
-        while(SVR_Decoder_framesReady(stream->decoder) > 1) {
-            SVR_Decoder_returnFrame(stream->decoder, SVR_Decoder_getFrame(stream->decoder));
+        SVR_ChunkQueue_pop(stream->chunks);
+    }
+
+    return NULL;
+}
+
+/**
+ * Stop a stream's decode thread and free its queue. Nothing may provide data
+ * to the stream any more
+ */
+static void SVR_Stream_stopDecoding(SVR_Stream* stream) {
+    /* Wait out a push which found the stream before it left the list */
+    pthread_mutex_lock(&stream->chunks_lock);
+    SVR_ChunkQueue_close(stream->chunks);
+    pthread_mutex_unlock(&stream->chunks_lock);
+
+    pthread_join(stream->decode_thread, NULL);
+    SVR_ChunkQueue_destroy(stream->chunks);
+}
+
+/**
+ * Decode received data, and pass each complete frame on to the stream and its
+ * followers
+ */
+static void SVR_Stream_decode(SVR_Stream* stream, void* buffer, size_t n) {
+    SVR_Frame* frame;
+    int frames_ready;
+
+    SVR_LOCK(stream);
+    if(stream->decoder == NULL) {
+        SVR_UNLOCK(stream);
+        return;
+    }
+
+    frames_ready = SVR_Decoder_decode(stream->decoder, buffer, n);
+    stream->frames_requested = Util_max(stream->frames_requested - frames_ready, 0);
+    SVR_UNLOCK(stream);
+
+    while(frames_ready) {
+        SVR_LOCK(stream);
+        frame = SVR_Stream_takeFrame(stream);
+        SVR_UNLOCK(stream);
+
+        if(frame == NULL) {
+            break;
         }
 
-        stream->current_frame = SVR_Decoder_getFrame(stream->decoder);
+        SVR_Stream_shareFrame(stream, frame);
+        SVR_Stream_deliverFrame(stream, frame);
+        SVR_UNREF(frame);
+    }
+}
+
+/**
+ * Pass a frame to the frame callback of a stream, on to the callback's own
+ * thread, or keep it as the current frame in place of an older one
+ */
+static void SVR_Stream_deliverFrame(SVR_Stream* stream, SVR_Frame* frame) {
+    SVR_Frame* replaced;
+
+    /* The callback can not change while it is held */
+    pthread_mutex_lock(&stream->callback_lock);
+    if(stream->frame_callback && stream->callback_thread == SVR_CALLBACK_DECODE_THREAD) {
+        stream->frame_callback(stream, frame, stream->frame_callback_data);
+        pthread_mutex_unlock(&stream->callback_lock);
+        return;
+    }
+
+    SVR_REF(frame);
+    SVR_LOCK(stream);
+    if(stream->frame_callback) {
+        replaced = stream->callback_frame;
+        stream->callback_frame = frame;
+        pthread_cond_signal(&stream->callback_frame_ready);
+    } else {
+        replaced = stream->current_frame;
+        stream->current_frame = frame;
         pthread_cond_broadcast(&stream->new_frame);
+        SVR_Stream_updateEvent(stream);
+        SVR_Stream_notifySync();
     }
+    SVR_UNLOCK(stream);
+    pthread_mutex_unlock(&stream->callback_lock);
 
-    pthread_mutex_lock(&new_global_data_lock);
-    new_global_data = true;
-    pthread_cond_broadcast(&new_global_data_cond);
-    pthread_mutex_unlock(&new_global_data_lock);
+    if(replaced) {
+        SVR_UNREF(replaced);
+    }
+}
+
+/**
+ * Hand a frame decoded by a stream to each of its followers. A follower keeps
+ * only the newest frame until its decode thread passes it on, and its decode
+ * thread is woken for the first. Takes the share lock rather than the list
+ * lock, which the receive thread takes for every message of a stream
+ */
+static void SVR_Stream_shareFrame(SVR_Stream* stream, SVR_Frame* frame) {
+    SVR_Stream* follower;
+    SVR_Frame* replaced;
+
+    pthread_mutex_lock(&stream->context->share_lock);
+    for(int i = 0; (follower = List_get(stream->followers, i)) != NULL; i++) {
+        SVR_REF(frame);
+
+        SVR_LOCK(follower);
+        replaced = follower->shared_frame;
+        follower->shared_frame = frame;
+        SVR_UNLOCK(follower);
+
+        if(replaced) {
+            SVR_UNREF(replaced);
+        } else {
+            pthread_mutex_lock(&follower->chunks_lock);
+            SVR_ChunkQueue_push(follower->chunks, STREAM_CHUNK_SHARED, "", 0);
+            pthread_mutex_unlock(&follower->chunks_lock);
+        }
+    }
+    pthread_mutex_unlock(&stream->context->share_lock);
+}
+
+/**
+ * Deliver the frame a follower was handed by its leader, on the follower's
+ * decode thread
+ */
+static void SVR_Stream_deliverShared(SVR_Stream* stream) {
+    SVR_Frame* frame;
+
+    SVR_LOCK(stream);
+    frame = stream->shared_frame;
+    stream->shared_frame = NULL;
+    SVR_UNLOCK(stream);
+
+    if(frame) {
+        SVR_Stream_deliverFrame(stream, frame);
+        SVR_UNREF(frame);
+    }
+}
+
+/**
+ * Wrap the next decoded frame of a stream in a frame view. Called with the
+ * stream locked. Returns NULL if no frame is ready
+ */
+static SVR_Frame* SVR_Stream_takeFrame(SVR_Stream* stream) {
+    SVR_Frame* frame;
+    IplImage* image;
+
+    if(stream->decoder == NULL || (image = SVR_Decoder_getFrame(stream->decoder)) == NULL) {
+        return NULL;
+    }
+
+    frame = SVR_Frame_new(image, stream->decoder->frame_allocator);
+    frame->sequence = stream->frames_decoded++;
+    frame->degrade_level = stream->degrade_level;
+
+    return frame;
+}
+
+/**
+ * Run the frame callback of a stream with the newest frame, until stopped
+ */
+static void* SVR_Stream_callbackWorker(void* _stream) {
+    SVR_Stream* stream = (SVR_Stream*) _stream;
+    SVR_Frame* frame;
+
+    SVR_LOCK(stream);
+    while(true) {
+        while(stream->callback_frame == NULL && stream->callback_worker_running) {
+            SVR_LOCK_WAIT(stream, &stream->callback_frame_ready);
+        }
+
+        if(stream->callback_worker_running == false) {
+            break;
+        }
+
+        frame = stream->callback_frame;
+        stream->callback_frame = NULL;
+        SVR_UNLOCK(stream);
+
+        /* The callback does not change while its thread runs */
+        stream->frame_callback(stream, frame, stream->frame_callback_data);
+        SVR_UNREF(frame);
+
+        SVR_LOCK(stream);
+    }
+    SVR_UNLOCK(stream);
+
+    return NULL;
+}
+
+/**
+ * Stop the thread of a frame callback, if it has one, and drop the frame
+ * waiting for it
+ */
+static void SVR_Stream_stopCallbackWorker(SVR_Stream* stream) {
+    SVR_Frame* frame;
+    bool running;
+
+    SVR_LOCK(stream);
+    running = stream->callback_worker_running;
+    stream->callback_worker_running = false;
+    pthread_cond_signal(&stream->callback_frame_ready);
+    SVR_UNLOCK(stream);
+
+    if(running) {
+        pthread_join(stream->callback_worker, NULL);
+    }
+
+    SVR_LOCK(stream);
+    frame = stream->callback_frame;
+    stream->callback_frame = NULL;
+    SVR_UNLOCK(stream);
 
+    if(frame) {
+        SVR_UNREF(frame);
+    }
+}
+
+/**
+ * Whether the caller is the stream's decode thread, or the own thread of its
+ * frame callback
+ */
+static bool SVR_Stream_isCallbackThread(SVR_Stream* stream) {
+    pthread_t self = pthread_self();
+    bool callback_thread;
+
+    SVR_LOCK(stream);
+    callback_thread = pthread_equal(self, stream->decode_thread) ||
+                      (stream->callback_worker_running && pthread_equal(self, stream->callback_worker));
     SVR_UNLOCK(stream);
+
+    return callback_thread;
+}
+
+/**
+ * Make an unpausing stream follow a running stream of its context which gets
+ * the same frames, if there is one. Returns true if it does, so its own server
+ * stream stays paused
+ */
+static bool SVR_Stream_share(SVR_Stream* stream) {
+    SVR_Stream* leader = NULL;
+    List* stream_names;
+    const char* stream_name;
+
+    pthread_mutex_lock(&stream->context->stream_list_lock);
+    if(stream->leader) {
+        pthread_mutex_unlock(&stream->context->stream_list_lock);
+        return true;
+    }
+
+    if(stream->state == SVR_PAUSED && stream->shared && stream->receiver == NULL && stream->pull_mode == false) {
+        stream_names = Dictionary_getKeys(stream->context->streams);
+        for(int i = 0; leader == NULL && (stream_name = List_get(stream_names, i)) != NULL; i++) {
+            leader = Dictionary_get(stream->context->streams, stream_name);
+            if(SVR_Stream_canFollow(stream, leader) == false) {
+                leader = NULL;
+            }
+        }
+        List_destroy(stream_names);
+    }
+
+    if(leader) {
+        pthread_mutex_lock(&stream->context->share_lock);
+        stream->leader = leader;
+        stream->state = SVR_UNPAUSED;
+        List_append(leader->followers, stream);
+        pthread_mutex_unlock(&stream->context->share_lock);
+    }
+    pthread_mutex_unlock(&stream->context->stream_list_lock);
+
+    return leader != NULL;
+}
+
+/**
+ * Check whether a stream can be given the frames another stream decodes.
+ * Called with the stream list locked
+ */
+static bool SVR_Stream_canFollow(SVR_Stream* stream, SVR_Stream* leader) {
+    bool same_frames;
+
+    if(leader == stream || leader->leader || leader->shared == false || leader->state != SVR_UNPAUSED ||
+       leader->orphaned || leader->receiver || leader->pull_mode || leader->degrade_level > 0) {
+        return false;
+    }
+
+    if(strcmp(leader->source_name, stream->source_name) != 0 || leader->encoding != stream->encoding ||
+       leader->frame_allocator != stream->frame_allocator || leader->drop_rate != stream->drop_rate ||
+       leader->max_rate != stream->max_rate || leader->max_age != stream->max_age ||
+       leader->priority != stream->priority) {
+        return false;
+    }
+
+    if((leader->encoding_descriptor == NULL) != (stream->encoding_descriptor == NULL) ||
+       (leader->encoding_descriptor && strcmp(leader->encoding_descriptor, stream->encoding_descriptor) != 0)) {
+        return false;
+    }
+
+    /* The leader's decode thread may replace its frame properties */
+    SVR_LOCK(leader);
+    same_frames = (leader->frame_properties && stream->frame_properties &&
+                   leader->frame_properties->width == stream->frame_properties->width &&
+                   leader->frame_properties->height == stream->frame_properties->height &&
+                   leader->frame_properties->depth == stream->frame_properties->depth &&
+                   leader->frame_properties->channels == stream->frame_properties->channels);
+    SVR_UNLOCK(leader);
+
+    return same_frames;
+}
+
+/**
+ * Take a stream out of the frames it shares. The first follower of a leader
+ * leads the others in its place, and its server stream is unpaused. Returns
+ * true if the stream was following another, so its own server stream is
+ * paused
+ */
+static bool SVR_Stream_leave(SVR_Stream* stream) {
+    SVR_Stream* leader;
+    SVR_Stream* follower;
+    char* leader_name = NULL;
+    bool following;
+    int return_code;
+
+    pthread_mutex_lock(&stream->context->stream_list_lock);
+    pthread_mutex_lock(&stream->context->share_lock);
+    following = (stream->leader != NULL);
+    if(following) {
+        List_remove(stream->leader->followers, List_indexOf(stream->leader->followers, stream));
+        stream->leader = NULL;
+    } else if((leader = List_remove(stream->followers, 0)) != NULL) {
+        leader->leader = NULL;
+        while((follower = List_remove(stream->followers, 0)) != NULL) {
+            follower->leader = leader;
+            List_append(leader->followers, follower);
+        }
+
+        /* The new leader may be destroyed once the list is unlocked, so it is
+           unpaused by name */
+        leader_name = strdup(leader->stream_name);
+    }
+    pthread_mutex_unlock(&stream->context->share_lock);
+    pthread_mutex_unlock(&stream->context->stream_list_lock);
+
+    if(leader_name) {
+        return_code = SVR_Stream_sendCommand(stream->context, "Stream.unpause", leader_name);
+        if(return_code != SVR_SUCCESS && return_code != SVR_NOSUCHSTREAM) {
+            SVR_logf(SVR_WARNING, "Unable to unpause stream %s taking over shared frames (error %d)",
+                                  leader_name, return_code);
+        }
+        free(leader_name);
+    }
+
+    return following;
+}
+
+/**
+ * Give a stream its own running server stream again before a setting of it
+ * changes
+ */
+static void SVR_Stream_unshare(SVR_Stream* stream) {
+    int return_code;
+
+    if(SVR_Stream_leave(stream) && stream->state == SVR_UNPAUSED) {
+        return_code = SVR_Stream_sendCommand(stream->context, "Stream.unpause", stream->stream_name);
+        if(return_code != SVR_SUCCESS) {
+            SVR_logf(SVR_WARNING, "Unable to unpause stream %s no longer sharing frames (error %d)",
+                                  stream->stream_name, return_code);
+            stream->state = SVR_PAUSED;
+        }
+    }
+}
+
+/**
+ * Release every frame a destroyed stream still holds, including those lent
+ * by SVR_Stream_getFrame
+ */
+static void SVR_Stream_releaseFrames(SVR_Stream* stream) {
+    SVR_Frame* frame;
+
+    if(stream->current_frame) {
+        SVR_UNREF(stream->current_frame);
+        stream->current_frame = NULL;
+    }
+
+    if(stream->shared_frame) {
+        SVR_UNREF(stream->shared_frame);
+        stream->shared_frame = NULL;
+    }
+
+    while((frame = List_remove(stream->lent_frames, 0)) != NULL) {
+        SVR_UNREF(frame);
+    }
+}
+
+/**
+ * Replace the decoder of a stream with a new one for its current encoding and
+ * frame properties. Called with the stream locked
+ */
+static void SVR_Stream_openDecoder(SVR_Stream* stream) {
+    if(stream->current_frame) {
+        SVR_UNREF(stream->current_frame);
+        stream->current_frame = NULL;
+        SVR_Stream_updateEvent(stream);
+    }
+
+    if(stream->decoder) {
+        SVR_Decoder_destroy(stream->decoder);
+    }
+
+    stream->decoder = SVR_Decoder_new(stream->encoding, stream->frame_properties);
+    SVR_Decoder_setFrameAllocator(stream->decoder, stream->frame_allocator);
 }
 
 /** \} */
@@ -20,6 +20,7 @@ _errors = {
     6: "Invalid argument",
     7: "Invalid state",
     8: "Parse error",
+    9: "Server overloaded",
     255: "Unknown error"
 }
 
@@ -38,6 +39,18 @@ class SVRSourcesList(ctypes.Structure):
         return [str(self.base[i]) for i in range(0, self.items)]
 
 
+class SVRStreamStats(ctypes.Structure):
+
+    """ Stream counters returned by SVR_Stream_getStats """
+
+    _fields_ = [
+        ("frames_sent", ctypes.c_uint),
+        ("frames_dropped", ctypes.c_uint),
+        ("frames_expired", ctypes.c_uint),
+        ("frames_lost", ctypes.c_uint)
+    ]
+
+
 def _check_stream_call(value):
     if value == 0:
         return True
@@ -68,6 +81,18 @@ _svr.SVR_Stream_setGrayscale.argtypes = [ctypes.c_void_p, ctypes.c_bool]
 _svr.SVR_Stream_setGrayscale.restype = _check_stream_call
 _svr.SVR_Stream_setDropRate.argtypes = [ctypes.c_void_p, ctypes.c_int]
 _svr.SVR_Stream_setDropRate.restype = _check_stream_call
+_svr.SVR_Stream_setMaxRate.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_svr.SVR_Stream_setMaxRate.restype = _check_stream_call
+_svr.SVR_Stream_setMaxAge.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_svr.SVR_Stream_setMaxAge.restype = _check_stream_call
+_svr.SVR_Stream_getStats.argtypes = [ctypes.c_void_p, ctypes.POINTER(SVRStreamStats)]
+_svr.SVR_Stream_getStats.restype = _check_stream_call
+_svr.SVR_Stream_setTransport.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+_svr.SVR_Stream_setTransport.restype = _check_stream_call
+_svr.SVR_Stream_setPullMode.argtypes = [ctypes.c_void_p, ctypes.c_bool]
+_svr.SVR_Stream_setPullMode.restype = _check_stream_call
+_svr.SVR_Stream_requestFrame.argtypes = [ctypes.c_void_p]
+_svr.SVR_Stream_requestFrame.restype = _check_stream_call
 _svr.SVR_Stream_setPriority.argtypes = [ctypes.c_void_p, ctypes.c_short]
 _svr.SVR_Stream_setPriority.restype = _check_stream_call
 _svr.SVR_Stream_unpause.argtypes = [ctypes.c_void_p]
@@ -93,6 +118,10 @@ _svr.SVR_openServerSource.restype = _check_source_call
 _svr.SVR_closeServerSource.argtypes = [ctypes.c_char_p]
 _svr.SVR_closeServerSource.restype = _check_source_call
 _svr.SVR_getSourcesList.restype = ctypes.POINTER(SVRSourcesList)
+_svr.SVR_setServerBandwidth.argtypes = [ctypes.c_ulong]
+_svr.SVR_setServerBandwidth.restype = _check_stream_call
+_svr.SVR_setClientBandwidth.argtypes = [ctypes.c_ulong]
+_svr.SVR_setClientBandwidth.restype = _check_stream_call
 
 
 class StreamException(Exception):
@@ -150,6 +179,31 @@ class Stream(object):
     def set_drop_rate(self, drop_rate):
         return self.svr.SVR_Stream_setDropRate(self.handle, drop_rate)
 
+    def set_max_rate(self, max_rate):
+        return self.svr.SVR_Stream_setMaxRate(self.handle, max_rate)
+
+    def set_max_age(self, max_age):
+        return self.svr.SVR_Stream_setMaxAge(self.handle, max_age)
+
+    def get_stats(self):
+        stats = SVRStreamStats()
+        self.svr.SVR_Stream_getStats(self.handle, ctypes.byref(stats))
+        return {
+            "frames_sent": stats.frames_sent,
+            "frames_dropped": stats.frames_dropped,
+            "frames_expired": stats.frames_expired,
+            "frames_lost": stats.frames_lost,
+        }
+
+    def set_transport(self, transport):
+        return self.svr.SVR_Stream_setTransport(self.handle, transport)
+
+    def set_pull_mode(self, pull_mode=True):
+        return self.svr.SVR_Stream_setPullMode(self.handle, ctypes.c_bool(pull_mode))
+
+    def request_frame(self):
+        return self.svr.SVR_Stream_requestFrame(self.handle)
+
     def unpause(self):
         return self.svr.SVR_Stream_unpause(self.handle)
 
@@ -232,6 +286,14 @@ def close_server_source(source_name):
     return _svr.SVR_closeServerSource(source_name)
 
 
+def set_server_bandwidth(bits_per_second):
+    return _svr.SVR_setServerBandwidth(bits_per_second)
+
+
+def set_client_bandwidth(bits_per_second):
+    return _svr.SVR_setClientBandwidth(bits_per_second)
+
+
 def get_sources_list():
     p = _svr.SVR_getSourcesList()
     sources = p.contents.to_list()
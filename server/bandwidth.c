@@ -0,0 +1,141 @@
+
+#include <svr.h>
+#include <svrd.h>
+
+static SVRD_Bandwidth* SVRD_Bandwidth_new(unsigned long bits_per_second);
+static void SVRD_Bandwidth_refill(SVRD_Bandwidth* bandwidth);
+
+/* Shared by all clients */
+static SVRD_Bandwidth* server_bandwidth = NULL;
+
+/* Limit given to each new client, in bits per second */
+static unsigned long default_client_limit = 0;
+
+/**
+ * \brief Initialize bandwidth limiting
+ *
+ * \param server_limit Limit on all data sent by the server in bits per second,
+ * or 0 for no limit
+ * \param client_limit Limit given to each client in bits per second, or 0 for
+ * no limit
+ */
+void SVRD_Bandwidth_init(unsigned long server_limit, unsigned long client_limit) {
+    server_bandwidth = SVRD_Bandwidth_new(server_limit);
+    default_client_limit = client_limit;
+}
+
+/**
+ * \brief Get the bucket shared by all clients
+ */
+SVRD_Bandwidth* SVRD_Bandwidth_getServer(void) {
+    return server_bandwidth;
+}
+
+/**
+ * \brief Create the bucket of a new client, with the default client limit
+ */
+SVRD_Bandwidth* SVRD_Bandwidth_newClient(void) {
+    return SVRD_Bandwidth_new(default_client_limit);
+}
+
+static SVRD_Bandwidth* SVRD_Bandwidth_new(unsigned long bits_per_second) {
+    SVRD_Bandwidth* bandwidth = malloc(sizeof(SVRD_Bandwidth));
+
+    bandwidth->active_weight = 0;
+    SVR_LOCKABLE_INIT(bandwidth);
+    SVRD_Bandwidth_setLimit(bandwidth, bits_per_second);
+
+    return bandwidth;
+}
+
+void SVRD_Bandwidth_destroy(SVRD_Bandwidth* bandwidth) {
+    free(bandwidth);
+}
+
+/**
+ * \brief Change the limit of a bucket
+ *
+ * \param bandwidth The bucket
+ * \param bits_per_second The new limit, or 0 to remove the limit
+ */
+void SVRD_Bandwidth_setLimit(SVRD_Bandwidth* bandwidth, unsigned long bits_per_second) {
+    SVR_LOCK(bandwidth);
+    bandwidth->rate = bits_per_second / 8.0;
+    bandwidth->burst = bandwidth->rate * SVRD_BANDWIDTH_BURST_TIME;
+    bandwidth->tokens = bandwidth->burst;
+    clock_gettime(CLOCK_MONOTONIC, &bandwidth->last_refill);
+    SVR_UNLOCK(bandwidth);
+}
+
+/**
+ * \brief Add to the weight of the running streams of a bucket
+ *
+ * \param bandwidth The bucket
+ * \param weight Weight of a stream which started, or the negative weight of a
+ * stream which stopped
+ */
+void SVRD_Bandwidth_addWeight(SVRD_Bandwidth* bandwidth, int weight) {
+    SVR_LOCK(bandwidth);
+    bandwidth->active_weight += weight;
+    SVR_UNLOCK(bandwidth);
+}
+
+static void SVRD_Bandwidth_refill(SVRD_Bandwidth* bandwidth) {
+    struct timespec now;
+    double elapsed;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - bandwidth->last_refill.tv_sec) +
+              (now.tv_nsec - bandwidth->last_refill.tv_nsec) / 1e9;
+    bandwidth->last_refill = now;
+
+    bandwidth->tokens = Util_min(bandwidth->tokens + elapsed * bandwidth->rate, bandwidth->burst);
+}
+
+/**
+ * \brief Decide whether a stream may send its next frame
+ *
+ * A frame may be sent while the bucket is not in debt. Once the bucket is
+ * half empty it is contended, and only streams sending no more than their
+ * weighted share of the limit may send. Frames are charged once sent, since
+ * their size is not known until encoded.
+ *
+ * \param bandwidth The bucket
+ * \param send_rate Recent rate of the stream in bytes per second
+ * \param weight Weight of the stream
+ * \return True if the frame may be sent
+ */
+bool SVRD_Bandwidth_admit(SVRD_Bandwidth* bandwidth, double send_rate, int weight) {
+    bool admit = true;
+    double share;
+
+    SVR_LOCK(bandwidth);
+    if(bandwidth->rate > 0) {
+        SVRD_Bandwidth_refill(bandwidth);
+
+        if(bandwidth->tokens <= 0) {
+            admit = false;
+        } else if(bandwidth->tokens < bandwidth->burst / 2) {
+            share = bandwidth->rate * weight / Util_max(bandwidth->active_weight, weight);
+            admit = (send_rate <= share);
+        }
+    }
+    SVR_UNLOCK(bandwidth);
+
+    return admit;
+}
+
+/**
+ * \brief Charge sent data to a bucket
+ *
+ * \param bandwidth The bucket
+ * \param n Bytes sent
+ */
+void SVRD_Bandwidth_consume(SVRD_Bandwidth* bandwidth, size_t n) {
+    SVR_LOCK(bandwidth);
+    if(bandwidth->rate > 0) {
+        SVRD_Bandwidth_refill(bandwidth);
+        bandwidth->tokens -= n;
+    }
+    SVR_UNLOCK(bandwidth);
+}
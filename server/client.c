@@ -4,6 +4,12 @@
 #include "svr.h"
 #include "svrd.h"
 
+#include <sys/ioctl.h>
+
+#ifdef __SVR_Linux__
+# include <linux/sockios.h>
+#endif
+
 static void* SVRD_Client_worker(void* _client);
 static void SVRD_Client_cleanup(void* _client);
 
@@ -47,8 +53,8 @@ SVRD_Client* SVRD_Client_new(int socket) {
     client->streams = Dictionary_new();
     client->sources = Dictionary_new();
     client->state = SVR_CONNECTED;
-    client->payload_buffer = NULL;
-    client->payload_buffer_size = 0;
+    client->reader = SVR_NetReader_new(socket);
+    client->bandwidth = SVRD_Bandwidth_newClient();
 
     SVR_REFCOUNTED_INIT(client, SVRD_Client_cleanup);
     SVR_LOCKABLE_INIT(client);
@@ -86,6 +92,7 @@ void SVRD_Client_closeStream(SVRD_Client* client, const char* stream_name) {
     SVR_LOCK(client);
     stream = Dictionary_get(client->streams, stream_name);
     if(stream == NULL) {
+        SVR_UNLOCK(client);
         return;
     }
     Dictionary_remove(client->streams, stream_name);
@@ -112,6 +119,8 @@ static void SVRD_Client_cleanup(void* _client) {
 
     Dictionary_destroy(client->sources);
     Dictionary_destroy(client->streams);
+    SVRD_Bandwidth_destroy(client->bandwidth);
+    SVR_NetReader_destroy(client->reader);
     free(client);
 
     pthread_mutex_lock(&client_thread_count_lock);
@@ -266,6 +275,28 @@ int SVRD_Client_sendMessage(SVRD_Client* client, SVR_Message* message) {
     return n;
 }
 
+/**
+ * \brief Get the number of bytes queued for sending to a client
+ *
+ * Bytes written to the client socket which the kernel has not yet had
+ * acknowledged by the client. A queue which stays full means the link to the
+ * client is slower than the streams being sent over it.
+ *
+ * \param client The client
+ * \return Bytes queued, or -1 if unknown on this platform
+ */
+int SVRD_Client_getSendQueue(SVRD_Client* client) {
+#ifdef SIOCOUTQ
+    int queued;
+
+    if(ioctl(client->socket, SIOCOUTQ, &queued) == 0) {
+        return queued;
+    }
+#endif
+
+    return -1;
+}
+
 /**
  * \brief Client connection thread
  *
@@ -280,7 +311,7 @@ static void* SVRD_Client_worker(void* _client) {
 
     while(client->state != SVR_CLOSED) {
         /* Read message from the client  */
-        message = SVR_Net_receiveMessage(client->socket);
+        message = SVR_NetReader_receiveMessage(client->reader);
 
         if(message == NULL) {
             SVR_log(SVR_WARNING, "Lost client connection");
@@ -288,16 +319,6 @@ static void* SVRD_Client_worker(void* _client) {
             break;
         }
 
-        /* Receive payload */
-        if(message->payload_size > 0) {
-            if(message->payload_size > client->payload_buffer_size) {
-                client->payload_buffer = realloc(client->payload_buffer, message->payload_size);
-                message->payload = client->payload_buffer;
-
-                SVR_Net_receivePayload(client->socket, message);
-            }
-        }
-
         /* Process message */
         SVRD_processMessage(client, message);
 
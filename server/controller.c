@@ -0,0 +1,238 @@
+
+#include <svr.h>
+#include <svrd.h>
+
+#include <unistd.h>
+
+static void* SVRD_Controller_worker(void* unused);
+static void SVRD_Controller_update(uint64_t elapsed);
+static SVRD_Stream* SVRD_Controller_findDegradable(List* streams, SVRD_Stream* exclude);
+static SVRD_Stream* SVRD_Controller_findRestorable(List* streams);
+
+static pthread_t controller_thread;
+static bool controller_running = false;
+static pthread_mutex_t controller_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t controller_wakeup;
+
+/* Fraction of all CPUs stream workers may use before streams are degraded */
+static double load_budget = 0;
+static long cpu_count = 1;
+
+/* Fraction of all CPUs used by stream workers over the last period */
+static double current_load = 0;
+
+/**
+ * \brief Start the overload controller
+ *
+ * Once per period the controller measures the CPU time used by each stream
+ * worker. While the total exceeds the budget the lowest priority stream is
+ * degraded by one level per period. Once load falls the highest priority
+ * degraded stream is restored, if its estimated cost fits in the budget.
+ *
+ * \param budget Fraction of all CPUs the stream workers may use
+ */
+void SVRD_Controller_init(double budget) {
+    pthread_condattr_t wakeup_attr;
+
+    load_budget = budget;
+    cpu_count = Util_max(sysconf(_SC_NPROCESSORS_ONLN), 1);
+
+    pthread_condattr_init(&wakeup_attr);
+    pthread_condattr_setclock(&wakeup_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&controller_wakeup, &wakeup_attr);
+    pthread_condattr_destroy(&wakeup_attr);
+
+    controller_running = true;
+    pthread_create(&controller_thread, NULL, SVRD_Controller_worker, NULL);
+
+    SVR_logf(SVR_INFO, "Overload controller started with a budget of %.0f%% of %ld CPUs",
+                       budget * 100, cpu_count);
+}
+
+/**
+ * \brief Stop the overload controller
+ */
+void SVRD_Controller_close(void) {
+    pthread_mutex_lock(&controller_lock);
+    if(controller_running == false) {
+        pthread_mutex_unlock(&controller_lock);
+        return;
+    }
+
+    controller_running = false;
+    pthread_cond_broadcast(&controller_wakeup);
+    pthread_mutex_unlock(&controller_lock);
+
+    pthread_join(controller_thread, NULL);
+    pthread_cond_destroy(&controller_wakeup);
+}
+
+/**
+ * \brief Decide whether a stream may start
+ *
+ * While the server is over budget a stream is only admitted if some lower
+ * priority stream can still be degraded to make room for it.
+ *
+ * \param stream The stream being unpaused
+ * \param priority Priority the stream will start with, which may not be set
+ * on the stream yet
+ * \return True if the stream may start
+ */
+bool SVRD_Controller_admit(SVRD_Stream* stream, short priority) {
+    SVRD_Stream* victim = NULL;
+    List* streams;
+    double load;
+
+    pthread_mutex_lock(&controller_lock);
+    if(controller_running == false || current_load <= load_budget) {
+        pthread_mutex_unlock(&controller_lock);
+        return true;
+    }
+    load = current_load;
+    pthread_mutex_unlock(&controller_lock);
+
+    SVRD_acquireGlobalStreamsLock();
+    streams = SVRD_getAllStreams();
+    if(streams) {
+        victim = SVRD_Controller_findDegradable(streams, stream);
+        if(victim && victim->priority >= priority) {
+            victim = NULL;
+        }
+    }
+    SVRD_releaseGlobalStreamsLock();
+
+    if(victim == NULL) {
+        SVR_logf(SVR_NORMAL, "Load %.0f%% over budget of %.0f%%, refusing stream %s (priority %d)",
+                             load * 100, load_budget * 100, stream->name, priority);
+        return false;
+    }
+
+    return true;
+}
+
+static void* SVRD_Controller_worker(void* unused) {
+    struct timespec last;
+    struct timespec now;
+    struct timespec deadline;
+    uint64_t elapsed;
+
+    clock_gettime(CLOCK_MONOTONIC, &last);
+
+    pthread_mutex_lock(&controller_lock);
+    while(controller_running) {
+        deadline = last;
+        deadline.tv_sec += SVRD_CONTROLLER_PERIOD;
+        pthread_cond_timedwait(&controller_wakeup, &controller_lock, &deadline);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if(controller_running == false || now.tv_sec < deadline.tv_sec ||
+           (now.tv_sec == deadline.tv_sec && now.tv_nsec < deadline.tv_nsec)) {
+            continue;
+        }
+
+        elapsed = (uint64_t) (now.tv_sec - last.tv_sec) * 1000000000ULL + now.tv_nsec - last.tv_nsec;
+        last = now;
+
+        pthread_mutex_unlock(&controller_lock);
+        SVRD_Controller_update(elapsed);
+        pthread_mutex_lock(&controller_lock);
+    }
+    pthread_mutex_unlock(&controller_lock);
+
+    return NULL;
+}
+
+/**
+ * Measure the load over the last elapsed nanoseconds and take at most one
+ * action
+ */
+static void SVRD_Controller_update(uint64_t elapsed) {
+    SVRD_Stream* stream;
+    List* streams;
+    uint64_t cpu_time;
+    double load = 0;
+
+    SVRD_acquireGlobalStreamsLock();
+    streams = SVRD_getAllStreams();
+    if(streams == NULL) {
+        SVRD_releaseGlobalStreamsLock();
+        return;
+    }
+
+    for(int i = 0; (stream = List_get(streams, i)) != NULL; i++) {
+        cpu_time = stream->cpu_time;
+        stream->load = (double) (cpu_time - stream->last_cpu_time) / elapsed;
+        stream->last_cpu_time = cpu_time;
+        load += stream->load;
+    }
+    load /= cpu_count;
+
+    pthread_mutex_lock(&controller_lock);
+    current_load = load;
+    pthread_mutex_unlock(&controller_lock);
+
+    if(load > load_budget) {
+        stream = SVRD_Controller_findDegradable(streams, NULL);
+        if(stream && SVRD_Stream_degrade(stream)) {
+            SVR_logf(SVR_NORMAL, "Load %.0f%% over budget of %.0f%%, degrading stream %s (priority %d) to level %d",
+                                 load * 100, load_budget * 100, stream->name, stream->priority, stream->target_level);
+        }
+    } else {
+        /* Each level roughly halves the cost of a stream, so restoring one
+           level is estimated to double it */
+        stream = SVRD_Controller_findRestorable(streams);
+        if(stream && load + stream->load / cpu_count < load_budget * SVRD_CONTROLLER_RESTORE_FRACTION &&
+           SVRD_Stream_restore(stream)) {
+            SVR_logf(SVR_NORMAL, "Load %.0f%% under budget of %.0f%%, restoring stream %s (priority %d) to level %d",
+                                 load * 100, load_budget * 100, stream->name, stream->priority, stream->target_level);
+        }
+    }
+
+    SVRD_releaseGlobalStreamsLock();
+}
+
+/**
+ * Find the lowest priority running stream which can be degraded further,
+ * preferring the most expensive on a tie
+ */
+static SVRD_Stream* SVRD_Controller_findDegradable(List* streams, SVRD_Stream* exclude) {
+    SVRD_Stream* victim = NULL;
+    SVRD_Stream* stream;
+
+    for(int i = 0; (stream = List_get(streams, i)) != NULL; i++) {
+        if(stream == exclude || stream->state != SVR_UNPAUSED ||
+           stream->target_level >= SVRD_STREAM_MAX_DEGRADE_LEVEL) {
+            continue;
+        }
+
+        if(victim == NULL || stream->priority < victim->priority ||
+           (stream->priority == victim->priority && stream->load > victim->load)) {
+            victim = stream;
+        }
+    }
+
+    return victim;
+}
+
+/**
+ * Find the highest priority degraded stream whose last change has been
+ * applied, preferring the cheapest on a tie
+ */
+static SVRD_Stream* SVRD_Controller_findRestorable(List* streams) {
+    SVRD_Stream* candidate = NULL;
+    SVRD_Stream* stream;
+
+    for(int i = 0; (stream = List_get(streams, i)) != NULL; i++) {
+        if(stream->state != SVR_UNPAUSED || stream->target_level == 0 ||
+           stream->target_level != stream->degrade_level) {
+            continue;
+        }
+
+        if(candidate == NULL || stream->priority > candidate->priority ||
+           (stream->priority == candidate->priority && stream->load < candidate->load)) {
+            candidate = stream;
+        }
+    }
+
+    return candidate;
+}
@@ -9,6 +9,9 @@
 #include "svrd/server.h"
 #include "svrd/source.h"
 #include "svrd/stream.h"
+#include "svrd/controller.h"
+#include "svrd/bandwidth.h"
+#include "svrd/transport.h"
 #include "svrd/event.h"
 #include "svrd/messagerouting.h"
 #include "svrd/messagehandlers.h"
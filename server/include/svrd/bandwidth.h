@@ -0,0 +1,37 @@
+
+#ifndef __SVR_SERVER_BANDWIDTH_H
+#define __SVR_SERVER_BANDWIDTH_H
+
+#include <svr/forward.h>
+#include <svr/lockable.h>
+#include <svrd/forward.h>
+
+/* Tokens a bucket may hold, in seconds of its limit */
+#define SVRD_BANDWIDTH_BURST_TIME 0.5
+
+/* A token bucket limiting the data sent by the streams drawing from it. While
+   the bucket runs low, streams sending more than their weighted share are
+   refused frames so the others keep theirs */
+struct SVRD_Bandwidth_s {
+    /* Limit in bytes per second, or 0 for no limit */
+    double rate;
+    double burst;
+    double tokens;
+    struct timespec last_refill;
+
+    /* Sum of the weights of the running streams drawing from the bucket */
+    int active_weight;
+
+    SVR_LOCKABLE;
+};
+
+void SVRD_Bandwidth_init(unsigned long server_limit, unsigned long client_limit);
+SVRD_Bandwidth* SVRD_Bandwidth_getServer(void);
+SVRD_Bandwidth* SVRD_Bandwidth_newClient(void);
+void SVRD_Bandwidth_destroy(SVRD_Bandwidth* bandwidth);
+void SVRD_Bandwidth_setLimit(SVRD_Bandwidth* bandwidth, unsigned long bits_per_second);
+void SVRD_Bandwidth_addWeight(SVRD_Bandwidth* bandwidth, int weight);
+bool SVRD_Bandwidth_admit(SVRD_Bandwidth* bandwidth, double send_rate, int weight);
+void SVRD_Bandwidth_consume(SVRD_Bandwidth* bandwidth, size_t n);
+
+#endif // #ifndef __SVR_SERVER_BANDWIDTH_H
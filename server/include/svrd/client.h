@@ -55,8 +55,15 @@ struct SVRD_Client_s {
      */
     Dictionary* sources;
 
-    void* payload_buffer;
-    size_t payload_buffer_size;
+    /**
+     * Buffered reader for messages from the client
+     */
+    SVR_NetReader* reader;
+
+    /**
+     * Limit on data sent to the client
+     */
+    SVRD_Bandwidth* bandwidth;
 
     /* This object is reference counted */
     SVR_REFCOUNTED;
@@ -84,5 +91,6 @@ List* SVRD_getAllClients(void);
 void SVRD_acquireGlobalClientsLock(void);
 void SVRD_releaseGlobalClientsLock(void);
 int SVRD_Client_sendMessage(SVRD_Client* client, SVR_Message* message);
+int SVRD_Client_getSendQueue(SVRD_Client* client);
 
 #endif // #ifndef __SVR_SERVER_CLIENT_H
@@ -0,0 +1,19 @@
+
+#ifndef __SVR_SERVER_CONTROLLER_H
+#define __SVR_SERVER_CONTROLLER_H
+
+#include <svr/forward.h>
+#include <svrd/forward.h>
+
+/* Seconds between overload controller decisions */
+#define SVRD_CONTROLLER_PERIOD 1
+
+/* A degraded stream is restored once the load, including the estimated cost
+   of the restored stream, stays below this fraction of the budget */
+#define SVRD_CONTROLLER_RESTORE_FRACTION 0.9
+
+void SVRD_Controller_init(double budget);
+void SVRD_Controller_close(void);
+bool SVRD_Controller_admit(SVRD_Stream* stream, short priority);
+
+#endif // #ifndef __SVR_SERVER_CONTROLLER_H
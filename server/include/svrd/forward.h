@@ -2,16 +2,22 @@
 #ifndef __SVR_SERVER_FORWARD_H
 #define __SVR_SERVER_FORWARD_H
 
+struct SVRD_Bandwidth_s;
 struct SVRD_Client_s;
 struct SVRD_Source_s;
+struct SVRD_SourceDemand_s;
 struct SVRD_SourceFrame_s;
 struct SVRD_SourceType_s;
 struct SVRD_Stream_s;
+struct SVRD_Transport_s;
 
+typedef struct SVRD_Bandwidth_s SVRD_Bandwidth;
 typedef struct SVRD_Client_s SVRD_Client;
 typedef struct SVRD_Source_s SVRD_Source;
+typedef struct SVRD_SourceDemand_s SVRD_SourceDemand;
 typedef struct SVRD_SourceFrame_s SVRD_SourceFrame;
 typedef struct SVRD_SourceType_s SVRD_SourceType;
 typedef struct SVRD_Stream_s SVRD_Stream;
+typedef struct SVRD_Transport_s SVRD_Transport;
 
 #endif // #ifndef __SVR_SERVER_FORWARD_H
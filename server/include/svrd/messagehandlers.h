@@ -5,6 +5,8 @@
 void SVRD_Stream_rOpen(SVRD_Client* client, SVR_Message* message);
 void SVRD_Stream_rClose(SVRD_Client* client, SVR_Message* message);
 void SVRD_Stream_rGetInfo(SVRD_Client* client, SVR_Message* message);
+void SVRD_Stream_rGetStats(SVRD_Client* client, SVR_Message* message);
+void SVRD_Stream_rConfigure(SVRD_Client* client, SVR_Message* message);
 void SVRD_Stream_rPause(SVRD_Client* client, SVR_Message* message);
 void SVRD_Stream_rUnpause(SVRD_Client* client, SVR_Message* message);
 void SVRD_Stream_rResize(SVRD_Client* client, SVR_Message* message);
@@ -13,6 +15,11 @@ void SVRD_Stream_rAttachSource(SVRD_Client* client, SVR_Message* message);
 void SVRD_Stream_rSetEncoding(SVRD_Client* client, SVR_Message* message);
 void SVRD_Stream_rSetPriority(SVRD_Client* client, SVR_Message* message);
 void SVRD_Stream_rSetDropRate(SVRD_Client* client, SVR_Message* message);
+void SVRD_Stream_rSetMaxRate(SVRD_Client* client, SVR_Message* message);
+void SVRD_Stream_rSetMaxAge(SVRD_Client* client, SVR_Message* message);
+void SVRD_Stream_rSetTransport(SVRD_Client* client, SVR_Message* message);
+void SVRD_Stream_rSetPullMode(SVRD_Client* client, SVR_Message* message);
+void SVRD_Stream_rRequestFrame(SVRD_Client* client, SVR_Message* message);
 
 void SVRD_Source_rOpen(SVRD_Client* client, SVR_Message* message);
 void SVRD_Source_rSetEncoding(SVRD_Client* client, SVR_Message* message);
@@ -20,6 +27,9 @@ void SVRD_Source_rSetFrameProperties(SVRD_Client* client, SVR_Message* message);
 void SVRD_Source_rClose(SVRD_Client* client, SVR_Message* message);
 void SVRD_Source_rData(SVRD_Client* client, SVR_Message* message);
 void SVRD_Source_rGetSourcesList(SVRD_Client* client, SVR_Message* message);
+void SVRD_Source_rGetStats(SVRD_Client* client, SVR_Message* message);
+
+void SVRD_Bandwidth_rSetLimit(SVRD_Client* client, SVR_Message* message);
 
 void SVRD_Event_rRegister(SVRD_Client* client, SVR_Message* message);
 void SVRD_Event_rUnregister(SVRD_Client* client, SVR_Message* message);
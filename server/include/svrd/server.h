@@ -4,7 +4,7 @@
 
 void SVRD_Server_preClose(void);
 void SVRD_Server_close(void);
-void SVRD_Server_mainLoop(const char* bind_address);
+void SVRD_Server_mainLoop(const char* bind_address, const char* unix_path);
 
 #define MAX_CLIENTS 128
 
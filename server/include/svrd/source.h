@@ -4,24 +4,76 @@
 
 #include <svr/forward.h>
 
+/* Frames a client source may have in flight before the server takes one in
+   and grants another. One frame is decoded while the next arrives, and one more
+   covers the round trip of the credit */
+#define SVRD_SOURCE_CREDITS 3
+
 struct SVRD_SourceFrame_s {
     IplImage* frame;
     SVRD_Source* source;
+
+    /* Monotonic time the frame's data was provided */
+    struct timespec timestamp;
+
+    /* The frame as the source provided it, in the source's encoding, or NULL
+       if it was not kept. The buffer is reused once the frame is released */
+    uint8_t* encoded;
+    size_t encoded_size;
+    size_t encoded_buffer_size;
+
+    /* Set once a stream has taken the frame, protected by the source's
+       current_frame_lock */
+    bool taken;
+
     SVR_REFCOUNTED;
 };
 
+/* What the unpaused streams of a source currently need from it */
+struct SVRD_SourceDemand_s {
+    /* Number of unpaused streams */
+    int streams;
+
+    /* Highest frame rate needed in frames per second, or 0 if unlimited */
+    int rate;
+
+    /* Largest frame size needed */
+    int width;
+    int height;
+};
+
 struct SVRD_Source_s {
     char* name;
 
     SVR_Encoding* encoding;
     Dictionary* encoding_options;
     SVR_Decoder* decoder;
+
+    /* Native frame properties of the source, and the properties of the frames
+       currently being captured, which may be smaller while demand is low */
     SVR_FrameProperties* frame_properties;
+    SVR_FrameProperties* capture_properties;
 
     SVRD_SourceFrame* current_frame;
+
+    /* Encoded data of the frame being provided, kept for passing through */
+    uint8_t* encoded;
+    size_t encoded_size;
+    size_t encoded_buffer_size;
     pthread_mutex_t current_frame_lock;
     pthread_cond_t new_frame;
 
+    /* Unpaused streams reading from the source, protected by
+       current_frame_lock */
+    List* consumers;
+    pthread_cond_t demand_changed;
+    struct timespec next_capture;
+
+    /* Frames decoded, and decoded frames replaced by a newer frame before any
+       unpaused stream took them, protected by current_frame_lock */
+    unsigned int frames_received;
+    unsigned int frames_dropped;
+
     SVRD_SourceType* type;
     void* private_data;
 
@@ -52,10 +104,17 @@ void SVRD_Source_destroy(SVRD_Source* source);
 SVR_FrameProperties* SVRD_Source_getFrameProperties(SVRD_Source* source);
 int SVRD_Source_setEncoding(SVRD_Source* source, const char* encoding_descriptor);
 int SVRD_Source_setFrameProperties(SVRD_Source* source, SVR_FrameProperties* frame_properties);
+int SVRD_Source_setCaptureSize(SVRD_Source* source, int width, int height);
+void SVRD_Source_addConsumer(SVRD_Source* source, SVRD_Stream* stream);
+void SVRD_Source_removeConsumer(SVRD_Source* source, SVRD_Stream* stream);
+void SVRD_Source_getDemand(SVRD_Source* source, SVRD_SourceDemand* demand);
+bool SVRD_Source_waitForDemand(SVRD_Source* source, SVRD_SourceDemand* demand);
+void SVRD_Source_throttle(SVRD_Source* source, int rate);
 void SVRD_Source_adjustStreamPriority(SVRD_Source* source, SVRD_Stream* stream);
 void SVRD_Source_dismissPausedStreams(SVRD_Source* source);
 SVRD_SourceFrame* SVRD_Source_getFrame(SVRD_Source* source, SVRD_Stream* stream, SVRD_SourceFrame* last_frame);
 int SVRD_Source_provideData(SVRD_Source* source, void* data, size_t data_available);
+int SVRD_Source_provideEncodedData(SVRD_Source* source, void* data, size_t data_available);
 
 #endif // #ifndef __SVR_SERVER_SOURCE_H
 
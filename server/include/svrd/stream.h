@@ -5,6 +5,21 @@
 #include <svr/forward.h>
 #include <svrd/forward.h>
 
+/* Highest level an overloaded stream is degraded to. Level 1 halves the frame
+   rate, level 2 lowers the JPEG quality and level 3 halves the resolution */
+#define SVRD_STREAM_MAX_DEGRADE_LEVEL 3
+
+/* JPEG quality used from degrade level 2 */
+#define SVRD_STREAM_DEGRADED_QUALITY "30"
+
+/* While the link to the client is backed up, frames are sized to drain the
+   backlog over this many frames, and never targeted below the minimum size */
+#define SVRD_STREAM_BACKLOG_FRAMES 4
+#define SVRD_STREAM_MIN_FRAME_SIZE 2048
+
+/* Time constant in seconds of the recent send rate used for fair sharing */
+#define SVRD_STREAM_RATE_WINDOW 1.0
+
 struct SVRD_Stream_s {
     char* name;
 
@@ -13,6 +28,10 @@ struct SVRD_Stream_s {
 
     SVR_Encoding* encoding;
     Dictionary* encoding_options;
+
+    /* The encoding was given as "auto", and is chosen from the connection to
+       the client */
+    bool auto_encoding;
     SVR_Encoder* encoder;
     SVR_FrameProperties* frame_properties;
 
@@ -24,10 +43,77 @@ struct SVRD_Stream_s {
     int drop_rate;
     int drop_counter;
 
+    /* Highest frame rate the stream needs in frames per second, or 0 if
+       unlimited. Frames are sent no sooner than next_frame_time */
+    int max_rate;
+    struct timespec next_frame_time;
+
+    /* Frames older than max_age milliseconds are discarded rather than sent,
+       if max_age is not 0 */
+    int max_age;
+
+    /* Frames sent, skipped due to the drop rate or bandwidth limits, and
+       discarded for being older than max_age */
+    unsigned int frames_sent;
+    unsigned int frames_dropped;
+    unsigned int frames_expired;
+
+    /* In pull mode a frame is only processed once the client requests it */
+    bool pull_mode;
+    int frames_requested;
+
+    /* Signaled when a frame is requested, the rate changes or the stream is
+       paused */
+    pthread_cond_t wakeup;
+
     short priority;
 
+    /* CPU time spent by the worker thread in nanoseconds, and the fraction of
+       a CPU it used over the last overload controller period */
+    uint64_t cpu_time;
+    uint64_t last_cpu_time;
+    double load;
+
+    /* Degrade level requested by the overload controller, and the level the
+       worker has applied. Levels are applied between frames */
+    int target_level;
+    int degrade_level;
+
+    /* Encoding options overriden by the current degrade level, and the frame
+       size set by the client */
+    Dictionary* degraded_options;
+    int requested_width;
+    int requested_height;
+
     IplImage* temp_frame[2];
 
+    /* Link rate estimate used to set the target frame size of the encoder.
+       The send queue of the client socket is sampled after each frame is sent
+       and again before the next is encoded. The queue is shared by all
+       streams of the client, so the estimate is for the connection */
+    struct timespec last_send_time;
+    struct timespec last_frame_time;
+    int last_send_queue;
+    size_t last_frame_size;
+    double drain_rate;
+    double frame_interval;
+    size_t link_frame_size;
+
+    /* Weight the stream currently adds to the client and server bandwidth
+       limits, and its recent send rate in bytes per second as of
+       send_rate_time */
+    int bandwidth_weight;
+    double send_rate;
+    struct timespec send_rate_time;
+
+    /* Size of the source frames the temporary frames were allocated for */
+    int input_width;
+    int input_height;
+
+    /* Datagram channel frames are sent over, or NULL to send them over the
+       client connection */
+    SVRD_Transport* transport;
+
     pthread_t worker;
     bool worker_started;
 
@@ -44,10 +130,22 @@ int SVRD_Stream_setEncoding(SVRD_Stream* stream, const char* encoding_descriptor
 int SVRD_Stream_setChannels(SVRD_Stream* stream, int channels);
 int SVRD_Stream_setPriority(SVRD_Stream* stream, short priority);
 int SVRD_Stream_setDropRate(SVRD_Stream* stream, int rate);
+int SVRD_Stream_setMaxRate(SVRD_Stream* stream, int rate);
+int SVRD_Stream_setMaxAge(SVRD_Stream* stream, int max_age);
+int SVRD_Stream_setPullMode(SVRD_Stream* stream, bool pull_mode);
+int SVRD_Stream_requestFrame(SVRD_Stream* stream);
 int SVRD_Stream_resize(SVRD_Stream* stream, int width, int height);
+int SVRD_Stream_setTransport(SVRD_Stream* stream, const char* type, const char* group, int port);
 
 void SVRD_Stream_pause(SVRD_Stream* stream);
-void SVRD_Stream_unpause(SVRD_Stream* stream);
+int SVRD_Stream_unpause(SVRD_Stream* stream);
 void SVRD_Stream_inputSourceFrame(SVRD_Stream* stream, IplImage* frame);
 
+bool SVRD_Stream_degrade(SVRD_Stream* stream);
+bool SVRD_Stream_restore(SVRD_Stream* stream);
+
+List* SVRD_getAllStreams(void);
+void SVRD_acquireGlobalStreamsLock(void);
+void SVRD_releaseGlobalStreamsLock(void);
+
 #endif // #ifndef __SVR_SERVER_STREAM_H
@@ -0,0 +1,58 @@
+
+#ifndef __SVR_SERVER_TRANSPORT_H
+#define __SVR_SERVER_TRANSPORT_H
+
+#include <svr/forward.h>
+#include <svr/lockable.h>
+#include <svrd/forward.h>
+
+#include <netinet/in.h>
+
+/* Frame bytes per datagram. Datagrams leaving the machine fit in an Ethernet
+   frame, since losing one IP fragment would lose the whole datagram */
+#define SVRD_TRANSPORT_DATAGRAM_SIZE 1400
+#define SVRD_TRANSPORT_LOCAL_DATAGRAM_SIZE 32768
+
+/* Hops multicast datagrams may travel, enough for one LAN */
+#define SVRD_TRANSPORT_MULTICAST_TTL 1
+
+typedef enum {
+    SVRD_TRANSPORT_UDP,
+    SVRD_TRANSPORT_MULTICAST
+} SVRD_TransportType;
+
+/* A datagram channel frames of a stream are sent over instead of the client's
+   TCP connection. A frame is split into datagrams carrying the frame ID and
+   their offset, and a receiver drops any frame it does not get completely.
+
+   A multicast channel is shared by every stream joined to the same group and
+   port. Only one of them, the first running stream, encodes and sends; the
+   others skip their frames, so any number of receivers costs one send */
+struct SVRD_Transport_s {
+    SVRD_TransportType type;
+
+    int socket;
+    struct sockaddr_in address;
+    size_t datagram_size;
+
+    /* ID of the last frame sent */
+    uint32_t frame_id;
+
+    /* Datagram being built, header included */
+    uint8_t* datagram;
+
+    /* Multicast channels only. Key of the channel in the group registry, and
+       the streams joined to it */
+    char* key;
+    List* streams;
+
+    SVR_LOCKABLE;
+};
+
+SVRD_Transport* SVRD_Transport_newUnicast(SVRD_Client* client, int port);
+SVRD_Transport* SVRD_Transport_joinMulticast(SVRD_Stream* stream, const char* group, int port);
+void SVRD_Transport_release(SVRD_Transport* transport, SVRD_Stream* stream);
+bool SVRD_Transport_isSender(SVRD_Transport* transport, SVRD_Stream* stream);
+int SVRD_Transport_sendFrame(SVRD_Transport* transport, SVR_Encoder* encoder, size_t frame_size);
+
+#endif // #ifndef __SVR_SERVER_TRANSPORT_H
@@ -15,14 +15,21 @@ void SVRD_exitError(void) {
 }
 
 static void SVRD_usage(const char* argv0) {
-    printf("Usage: %s [-hd] [-b ADDRESS] [-l LOG_LEVEL] [-s SOURCES_CONFIG]\n"
+    printf("Usage: %s [-hd] [-b ADDRESS] [-u PATH] [-l LOG_LEVEL] [-s SOURCES_CONFIG] [-L LOAD_BUDGET]\n"
+           "          [-B SERVER_BANDWIDTH] [-c CLIENT_BANDWIDTH]\n"
            "Seawolf Video Router\n"
            "\n"
            "  -h                    Show this help message\n"
            "  -d                    Enable debugging\n"
            "  -b ADDRESS            Address to listen on\n"
+           "  -u PATH               Unix socket to listen on (default " SVR_DEFAULT_UNIX_PATH ",\n"
+           "                        or \"none\" to only listen on TCP)\n"
            "  -l LOG_LEVEL          Log level (DEBUG, INFO, NORMAL, WARNING, ERROR, CRITICAL)\n"
-           "  -s SOURCES_CONFIG     Sources configuration file\n", argv0);
+           "  -s SOURCES_CONFIG     Sources configuration file\n"
+           "  -L LOAD_BUDGET        Fraction of CPU time streams may use before the lowest\n"
+           "                        priority streams are degraded (e.g. 0.8)\n"
+           "  -B SERVER_BANDWIDTH   Limit on all data sent, in bits per second\n"
+           "  -c CLIENT_BANDWIDTH   Limit on data sent to each client, in bits per second\n", argv0);
 }
 
 int main(int argc, char** argv) {
@@ -30,8 +37,12 @@ int main(int argc, char** argv) {
     int debug_level = SVR_WARNING;
     char* source_conf_file = NULL;
     char* bind_address = "0.0.0.0";
+    char* unix_path = SVR_DEFAULT_UNIX_PATH;
+    double load_budget = 0;
+    unsigned long server_bandwidth = 0;
+    unsigned long client_bandwidth = 0;
 
-    while((opt = getopt(argc, argv, ":hdl:s:b:")) != -1) {
+    while((opt = getopt(argc, argv, ":hdl:s:b:u:L:B:c:")) != -1) {
         switch(opt) {
         case 'h':
             SVRD_usage(argv[0]);
@@ -42,6 +53,9 @@ int main(int argc, char** argv) {
         case 'b':
             bind_address = optarg;
             break;
+        case 'u':
+            unix_path = strcmp(optarg, "none") ? optarg : NULL;
+            break;
         case 'l':
             debug_level = SVR_Logging_getLevelFromName(optarg);
             if(debug_level < 0) {
@@ -53,6 +67,20 @@ int main(int argc, char** argv) {
         case 's':
             source_conf_file = optarg;
             break;
+        case 'L':
+            load_budget = atof(optarg);
+            if(load_budget <= 0 || load_budget > 1) {
+                fprintf(stderr, "Invalid load budget '%s'\n", optarg);
+                SVRD_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'B':
+            server_bandwidth = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            client_bandwidth = strtoul(optarg, NULL, 10);
+            break;
         case ':':
             fprintf(stderr, "Missing argument parameter\n");
             SVRD_usage(argv[0]);
@@ -67,10 +95,15 @@ int main(int argc, char** argv) {
     SVR_initCore();
     SVR_Logging_setThreshold(debug_level);
 
+    SVRD_Bandwidth_init(server_bandwidth, client_bandwidth);
     SVRD_Client_init();
     SVRD_Source_init();
     SVRD_MessageRouter_init();
 
+    if(load_budget > 0) {
+        SVRD_Controller_init(load_budget);
+    }
+
     if(source_conf_file) {
         SVRD_Source_fromFile(source_conf_file);
     }
@@ -79,7 +112,7 @@ int main(int argc, char** argv) {
        of writing to a closed socket. We handle this ourselves. */
     signal(SIGPIPE, SIG_IGN);
 
-    SVRD_Server_mainLoop(bind_address);
+    SVRD_Server_mainLoop(bind_address, unix_path);
 
     return 0;
 }
@@ -89,6 +89,37 @@ void SVRD_Stream_rGetInfo(SVRD_Client* client, SVR_Message* message) {
     SVR_Message_release(response);
 }
 
+void SVRD_Stream_rGetStats(SVRD_Client* client, SVR_Message* message) {
+    SVR_Message* response;
+    SVRD_Stream* stream;
+    char* stream_name;
+
+    switch(message->count) {
+    case 2:
+        stream_name = message->components[1];
+        break;
+
+    default:
+        SVRD_Client_kick(client, "Invalid message");
+        return;
+    }
+
+    stream = SVRD_Client_getStream(client, stream_name);
+    if(stream == NULL) {
+        SVRD_Client_replyCode(client, message, SVR_NOSUCHSTREAM);
+        return;
+    }
+
+    response = SVR_Message_new(4);
+    response->components[0] = SVR_Arena_strdup(response->alloc, "Stream.getStats");
+    response->components[1] = SVR_Arena_sprintf(response->alloc, "%u", stream->frames_sent);
+    response->components[2] = SVR_Arena_sprintf(response->alloc, "%u", stream->frames_dropped);
+    response->components[3] = SVR_Arena_sprintf(response->alloc, "%u", stream->frames_expired);
+
+    SVRD_Client_reply(client, message, response);
+    SVR_Message_release(response);
+}
+
 /* stream_name */
 void SVRD_Stream_rPause(SVRD_Client* client, SVR_Message* message) {
     SVRD_Stream* stream;
@@ -135,8 +166,7 @@ void SVRD_Stream_rUnpause(SVRD_Client* client, SVR_Message* message) {
         return;
     }
 
-    SVRD_Stream_unpause(stream);
-    SVRD_Client_replyCode(client, message, SVR_SUCCESS);
+    SVRD_Client_replyCode(client, message, SVRD_Stream_unpause(stream));
 }
 
 void SVRD_Stream_rResize(SVRD_Client* client, SVR_Message* message) {
@@ -279,6 +309,150 @@ void SVRD_Stream_rSetDropRate(SVRD_Client* client, SVR_Message* message) {
     SVRD_Client_replyCode(client, message, SVRD_Stream_setDropRate(stream, drop_rate));
 }
 
+void SVRD_Stream_rSetMaxRate(SVRD_Client* client, SVR_Message* message) {
+    SVRD_Stream* stream;
+    char* stream_name;
+    int max_rate;
+
+    switch(message->count) {
+    case 3:
+        stream_name = message->components[1];
+        max_rate = atoi(message->components[2]);
+        break;
+
+    default:
+        SVRD_Client_kick(client, "Invalid message");
+        return;
+    }
+
+    stream = SVRD_Client_getStream(client, stream_name);
+    if(stream == NULL) {
+        SVRD_Client_replyCode(client, message, SVR_NOSUCHSTREAM);
+        return;
+    }
+
+    SVRD_Client_replyCode(client, message, SVRD_Stream_setMaxRate(stream, max_rate));
+}
+
+void SVRD_Stream_rSetMaxAge(SVRD_Client* client, SVR_Message* message) {
+    SVRD_Stream* stream;
+    char* stream_name;
+    int max_age;
+
+    switch(message->count) {
+    case 3:
+        stream_name = message->components[1];
+        max_age = atoi(message->components[2]);
+        break;
+
+    default:
+        SVRD_Client_kick(client, "Invalid message");
+        return;
+    }
+
+    stream = SVRD_Client_getStream(client, stream_name);
+    if(stream == NULL) {
+        SVRD_Client_replyCode(client, message, SVR_NOSUCHSTREAM);
+        return;
+    }
+
+    SVRD_Client_replyCode(client, message, SVRD_Stream_setMaxAge(stream, max_age));
+}
+
+void SVRD_Stream_rSetTransport(SVRD_Client* client, SVR_Message* message) {
+    SVRD_Stream* stream;
+    char* stream_name;
+    char* type;
+    char* group = NULL;
+    int port = 0;
+
+    switch(message->count) {
+    case 3:
+        stream_name = message->components[1];
+        type = message->components[2];
+        break;
+
+    case 4:
+        stream_name = message->components[1];
+        type = message->components[2];
+        port = atoi(message->components[3]);
+        break;
+
+    case 5:
+        stream_name = message->components[1];
+        type = message->components[2];
+        group = message->components[3];
+        port = atoi(message->components[4]);
+        break;
+
+    default:
+        SVRD_Client_kick(client, "Invalid message");
+        return;
+    }
+
+    stream = SVRD_Client_getStream(client, stream_name);
+    if(stream == NULL) {
+        SVRD_Client_replyCode(client, message, SVR_NOSUCHSTREAM);
+        return;
+    }
+
+    if(strcmp(type, "multicast") == 0 && group == NULL) {
+        SVRD_Client_replyCode(client, message, SVR_INVALIDARGUMENT);
+        return;
+    }
+
+    SVRD_Client_replyCode(client, message, SVRD_Stream_setTransport(stream, type, group, port));
+}
+
+void SVRD_Stream_rSetPullMode(SVRD_Client* client, SVR_Message* message) {
+    SVRD_Stream* stream;
+    char* stream_name;
+    bool pull_mode;
+
+    switch(message->count) {
+    case 3:
+        stream_name = message->components[1];
+        pull_mode = (atoi(message->components[2]) != 0);
+        break;
+
+    default:
+        SVRD_Client_kick(client, "Invalid message");
+        return;
+    }
+
+    stream = SVRD_Client_getStream(client, stream_name);
+    if(stream == NULL) {
+        SVRD_Client_replyCode(client, message, SVR_NOSUCHSTREAM);
+        return;
+    }
+
+    SVRD_Client_replyCode(client, message, SVRD_Stream_setPullMode(stream, pull_mode));
+}
+
+/* Frame requests are not replied to, so they cost the client no round trip */
+void SVRD_Stream_rRequestFrame(SVRD_Client* client, SVR_Message* message) {
+    SVRD_Stream* stream;
+    char* stream_name;
+
+    switch(message->count) {
+    case 2:
+        stream_name = message->components[1];
+        break;
+
+    default:
+        SVRD_Client_kick(client, "Invalid message");
+        return;
+    }
+
+    stream = SVRD_Client_getStream(client, stream_name);
+    if(stream == NULL) {
+        SVR_logf(SVR_DEBUG, "Frame requested for unknown stream '%s'", stream_name);
+        return;
+    }
+
+    SVRD_Stream_requestFrame(stream);
+}
+
 void SVRD_Stream_rSetEncoding(SVRD_Client* client, SVR_Message* message) {
     SVRD_Stream* stream;
     char* stream_name;
@@ -304,6 +478,327 @@ void SVRD_Stream_rSetEncoding(SVRD_Client* client, SVR_Message* message) {
     SVRD_Client_replyCode(client, message, SVRD_Stream_setEncoding(stream, encoding_descriptor));
 }
 
+/* Settings of one stream in a Stream.configure request. Unset values are -1,
+   or NULL for strings */
+typedef struct {
+    const char* stream_name;
+    const char* source_name;
+    const char* encoding;
+    int width;
+    int height;
+    int channels;
+    int drop_rate;
+    int max_rate;
+    int max_age;
+    int priority;
+    bool unpause;
+
+    int return_code;
+} SVRD_StreamConfig;
+
+/**
+ * Read the settings of one stream from a Stream.configure request, starting at
+ * its name. Returns the index of the next stream's name, or -1 if the request
+ * is malformed
+ */
+static int SVRD_Stream_parseConfig(SVR_Message* message, int index, SVRD_StreamConfig* config) {
+    char* setting;
+    char* value;
+
+    config->stream_name = message->components[index++];
+    config->source_name = NULL;
+    config->encoding = NULL;
+    config->width = -1;
+    config->height = -1;
+    config->channels = -1;
+    config->drop_rate = -1;
+    config->max_rate = -1;
+    config->max_age = -1;
+    config->priority = -1;
+    config->unpause = false;
+    config->return_code = SVR_SUCCESS;
+
+    if(config->stream_name[0] == '\0') {
+        return -1;
+    }
+
+    for(; index < message->count && message->components[index][0] != '\0'; index++) {
+        setting = message->components[index];
+        value = strchr(setting, '=');
+        if(value == NULL) {
+            return -1;
+        }
+
+        /* Settings are "key=value", split them in place */
+        *value = '\0';
+        value++;
+
+        if(strcmp(setting, "source") == 0) {
+            config->source_name = value;
+        } else if(strcmp(setting, "encoding") == 0) {
+            config->encoding = value;
+        } else if(strcmp(setting, "width") == 0) {
+            config->width = atoi(value);
+        } else if(strcmp(setting, "height") == 0) {
+            config->height = atoi(value);
+        } else if(strcmp(setting, "channels") == 0) {
+            config->channels = atoi(value);
+        } else if(strcmp(setting, "drop_rate") == 0) {
+            config->drop_rate = atoi(value);
+        } else if(strcmp(setting, "max_rate") == 0) {
+            config->max_rate = atoi(value);
+        } else if(strcmp(setting, "max_age") == 0) {
+            config->max_age = atoi(value);
+        } else if(strcmp(setting, "priority") == 0) {
+            config->priority = atoi(value);
+        } else if(strcmp(setting, "unpause") == 0) {
+            config->unpause = (atoi(value) != 0);
+        } else {
+            config->return_code = SVR_INVALIDARGUMENT;
+        }
+    }
+
+    /* Skip the empty component ending the stream's settings */
+    return index + 1;
+}
+
+/**
+ * Check every setting of a stream before any is applied, so a stream is
+ * either configured completely or left as it was
+ */
+static int SVRD_Stream_checkConfig(SVRD_Client* client, SVRD_StreamConfig* config) {
+    SVRD_Stream* stream = SVRD_Client_getStream(client, config->stream_name);
+    SVRD_Source* source;
+    Dictionary* options;
+    const char* encoding_name;
+    bool exists;
+    bool frame_setting;
+    short priority;
+
+    if((config->width < 0) != (config->height < 0) || config->width == 0 || config->height == 0 ||
+       (config->channels != -1 && config->channels != 1 && config->channels != 3) ||
+       config->drop_rate < -1 || config->max_rate < -1 || config->max_age < -1 || config->priority < -1) {
+        return SVR_INVALIDARGUMENT;
+    }
+
+    if(config->source_name) {
+        source = SVRD_Source_getByName(config->source_name);
+        if(source == NULL) {
+            return SVR_NOSUCHSOURCE;
+        }
+
+        /* Streams can only be attached to sources with frames */
+        exists = (SVRD_Source_getFrameProperties(source) != NULL);
+        SVR_UNREF(source);
+
+        if(exists == false) {
+            return SVR_INVALIDSTATE;
+        }
+    }
+
+    if(config->encoding) {
+        options = SVR_parseOptionString(config->encoding);
+        if(options == NULL) {
+            return SVR_PARSEERROR;
+        }
+
+        encoding_name = Dictionary_get(options, "%name");
+        exists = (strcmp(encoding_name, "auto") == 0 || SVR_Encoding_getByName(encoding_name) != NULL);
+        SVR_freeParsedOptionString(options);
+
+        if(exists == false) {
+            return SVR_NOSUCHENCODING;
+        }
+    }
+
+    if(stream == NULL) {
+        /* A new stream needs a source */
+        return config->source_name ? SVR_SUCCESS : SVR_NOSUCHSTREAM;
+    }
+
+    frame_setting = (config->width > 0 || config->channels > 0);
+    if(stream->state == SVR_UNPAUSED && (config->source_name || config->encoding || frame_setting)) {
+        return SVR_INVALIDSTATE;
+    }
+
+    if(stream->source == NULL && config->source_name == NULL && (frame_setting || config->unpause)) {
+        return SVR_INVALIDSTATE;
+    }
+
+    /* Admission is decided before anything changes, with the priority the
+       stream is about to be given */
+    priority = (config->priority >= 0) ? config->priority : stream->priority;
+    if(config->unpause && stream->state == SVR_PAUSED && SVRD_Controller_admit(stream, priority) == false) {
+        return SVR_OVERLOADED;
+    }
+
+    return SVR_SUCCESS;
+}
+
+/**
+ * Apply the checked settings of a stream, opening it if needed. Once checked,
+ * only attaching the source can still fail, before anything else is applied,
+ * so an existing stream is left as it was. A new stream is admitted here and
+ * closed again on failure. Unpausing is done once the reply is sent
+ */
+static int SVRD_Stream_applyConfig(SVRD_Client* client, SVRD_StreamConfig* config) {
+    SVRD_Stream* stream = SVRD_Client_getStream(client, config->stream_name);
+    SVRD_Source* source;
+    bool opened = false;
+    int return_code = SVR_SUCCESS;
+
+    if(stream == NULL) {
+        SVRD_Client_openStream(client, config->stream_name);
+        stream = SVRD_Client_getStream(client, config->stream_name);
+        if(stream == NULL) {
+            return SVR_INVALIDSTATE;
+        }
+        opened = true;
+    }
+
+    if(config->source_name) {
+        source = SVRD_Source_getByName(config->source_name);
+        if(source == NULL) {
+            return_code = SVR_NOSUCHSOURCE;
+        } else {
+            return_code = SVRD_Stream_attachSource(stream, source);
+            if(return_code != SVR_SUCCESS) {
+                SVR_UNREF(source);
+            }
+        }
+    }
+
+    if(return_code == SVR_SUCCESS && config->encoding) {
+        return_code = SVRD_Stream_setEncoding(stream, config->encoding);
+    }
+
+    if(return_code == SVR_SUCCESS && config->width > 0) {
+        return_code = SVRD_Stream_resize(stream, config->width, config->height);
+    }
+
+    if(return_code == SVR_SUCCESS && config->channels > 0) {
+        return_code = SVRD_Stream_setChannels(stream, config->channels);
+    }
+
+    if(return_code == SVR_SUCCESS && config->drop_rate >= 0) {
+        return_code = SVRD_Stream_setDropRate(stream, config->drop_rate);
+    }
+
+    if(return_code == SVR_SUCCESS && config->max_rate >= 0) {
+        return_code = SVRD_Stream_setMaxRate(stream, config->max_rate);
+    }
+
+    if(return_code == SVR_SUCCESS && config->max_age >= 0) {
+        return_code = SVRD_Stream_setMaxAge(stream, config->max_age);
+    }
+
+    if(return_code == SVR_SUCCESS && config->priority >= 0) {
+        return_code = SVRD_Stream_setPriority(stream, config->priority);
+    }
+
+    if(return_code == SVR_SUCCESS && opened && config->unpause &&
+       SVRD_Controller_admit(stream, stream->priority) == false) {
+        return_code = SVR_OVERLOADED;
+    }
+
+    if(return_code != SVR_SUCCESS && opened) {
+        SVRD_Client_closeStream(client, config->stream_name);
+    }
+
+    return return_code;
+}
+
+/* (stream_name setting... "")... where each setting is "key=value" */
+void SVRD_Stream_rConfigure(SVRD_Client* client, SVR_Message* message) {
+    SVRD_StreamConfig* configs;
+    SVRD_StreamConfig* config;
+    SVR_Message* response;
+    SVRD_Stream* stream;
+    int config_count = 0;
+    int index;
+
+    if(message->count < 2) {
+        SVRD_Client_kick(client, "Invalid message");
+        return;
+    }
+
+    /* Each stream's settings end with an empty component, which the last
+       stream may leave out */
+    configs = malloc(sizeof(SVRD_StreamConfig) * message->count);
+    for(index = 1; index > 0 && index < message->count; config_count++) {
+        index = SVRD_Stream_parseConfig(message, index, &configs[config_count]);
+    }
+
+    if(index < 0) {
+        free(configs);
+        SVRD_Client_kick(client, "Invalid message");
+        return;
+    }
+
+    response = SVR_Message_new(1 + 3 * config_count);
+    response->components[0] = SVR_Arena_strdup(response->alloc, "Stream.configure");
+
+    for(int i = 0; i < config_count; i++) {
+        config = &configs[i];
+
+        if(config->return_code == SVR_SUCCESS) {
+            config->return_code = SVRD_Stream_checkConfig(client, config);
+        }
+
+        if(config->return_code == SVR_SUCCESS) {
+            config->return_code = SVRD_Stream_applyConfig(client, config);
+        }
+
+        stream = SVRD_Client_getStream(client, config->stream_name);
+        response->components[1 + 3 * i] = SVR_Arena_sprintf(response->alloc, "%d", config->return_code);
+        if(stream && stream->source) {
+            response->components[2 + 3 * i] = SVR_Arena_strdup(response->alloc, stream->encoding->name);
+            response->components[3 + 3 * i] = SVR_Arena_sprintf(response->alloc, "%d,%d,%d,%d",
+                                                                stream->frame_properties->width,
+                                                                stream->frame_properties->height,
+                                                                stream->frame_properties->depth,
+                                                                stream->frame_properties->channels);
+        } else {
+            response->components[2 + 3 * i] = SVR_Arena_strdup(response->alloc, "");
+            response->components[3 + 3 * i] = SVR_Arena_strdup(response->alloc, "");
+        }
+    }
+
+    SVRD_Client_reply(client, message, response);
+    SVR_Message_release(response);
+
+    /* Only start streams once the client has the frame properties to decode
+       their frames with */
+    for(int i = 0; i < config_count; i++) {
+        config = &configs[i];
+        if(config->return_code != SVR_SUCCESS || config->unpause == false) {
+            continue;
+        }
+
+        stream = SVRD_Client_getStream(client, config->stream_name);
+        if(stream && stream->state == SVR_PAUSED && SVRD_Stream_unpause(stream) != SVR_SUCCESS) {
+            SVR_logf(SVR_WARNING, "Configured stream '%s' could not be unpaused", config->stream_name);
+        }
+    }
+
+    free(configs);
+}
+
+/**
+ * Grant a client source credit to send more frames
+ */
+static void SVRD_Source_grantCredits(SVRD_Client* client, const char* source_name, int credits) {
+    SVR_Message* message;
+
+    message = SVR_Message_new(3);
+    message->components[0] = SVR_Arena_strdup(message->alloc, "Source.credit");
+    message->components[1] = SVR_Arena_strdup(message->alloc, source_name);
+    message->components[2] = SVR_Arena_sprintf(message->alloc, "%d", credits);
+
+    SVRD_Client_sendMessage(client, message);
+    SVR_Message_release(message);
+}
+
 void SVRD_Source_rOpen(SVRD_Client* client, SVR_Message* message) {
     SVRD_Source* source;
     bool client_source;
@@ -351,6 +846,10 @@ void SVRD_Source_rOpen(SVRD_Client* client, SVR_Message* message) {
 
         SVRD_Source_setEncoding(source, "jpeg");
         SVRD_Client_provideSource(client, source);
+
+        /* Sent ahead of the reply, so the client has its credit before it
+           sends anything */
+        SVRD_Source_grantCredits(client, source_name, SVRD_SOURCE_CREDITS);
     } else {
         source = SVRD_Source_openInstance(source_name, source_descriptor, &err);
 
@@ -419,13 +918,21 @@ void SVRD_Source_rSetFrameProperties(SVRD_Client* client, SVR_Message* message)
     SVRD_Client_replyCode(client, message, return_code);
 }
 
+/* source_name [end], with end on the last message of each frame */
 void SVRD_Source_rData(SVRD_Client* client, SVR_Message* message) {
     SVRD_Source* source;
     char* source_name;
+    bool frame_end;
 
     switch(message->count) {
     case 2:
         source_name = message->components[1];
+        frame_end = false;
+        break;
+
+    case 3:
+        source_name = message->components[1];
+        frame_end = true;
         break;
 
     default:
@@ -440,6 +947,12 @@ void SVRD_Source_rData(SVRD_Client* client, SVR_Message* message) {
     }
 
     SVRD_Source_provideData(source, message->payload, message->payload_size);
+
+    /* The frame is decoded by now, so the client may send another in its
+       place. Credit is only granted at the pace frames are decoded */
+    if(frame_end) {
+        SVRD_Source_grantCredits(client, source_name, 1);
+    }
 }
 
 void SVRD_Source_rClose(SVRD_Client* client, SVR_Message* message) {
@@ -520,6 +1033,78 @@ void SVRD_Source_rGetSourcesList(SVRD_Client* client, SVR_Message* message) {
     SVR_Message_release(response);
 }
 
+/* source_name */
+void SVRD_Source_rGetStats(SVRD_Client* client, SVR_Message* message) {
+    SVR_Message* response;
+    SVRD_Source* source;
+    char* source_name;
+
+    switch(message->count) {
+    case 2:
+        source_name = message->components[1];
+        break;
+
+    default:
+        SVRD_Client_kick(client, "Invalid message");
+        return;
+    }
+
+    source = SVRD_Source_getByName(source_name);
+    if(source == NULL) {
+        SVRD_Client_replyCode(client, message, SVR_NOSUCHSOURCE);
+        return;
+    }
+
+    response = SVR_Message_new(3);
+    response->components[0] = SVR_Arena_strdup(response->alloc, "Source.getStats");
+
+    pthread_mutex_lock(&source->current_frame_lock);
+    response->components[1] = SVR_Arena_sprintf(response->alloc, "%u", source->frames_received);
+    response->components[2] = SVR_Arena_sprintf(response->alloc, "%u", source->frames_dropped);
+    pthread_mutex_unlock(&source->current_frame_lock);
+
+    SVR_UNREF(source);
+
+    SVRD_Client_reply(client, message, response);
+    SVR_Message_release(response);
+}
+
+/* "server" or "client", bits_per_second */
+void SVRD_Bandwidth_rSetLimit(SVRD_Client* client, SVR_Message* message) {
+    SVRD_Bandwidth* bandwidth;
+    char* scope;
+    long limit;
+
+    switch(message->count) {
+    case 3:
+        scope = message->components[1];
+        limit = atol(message->components[2]);
+        break;
+
+    default:
+        SVRD_Client_kick(client, "Invalid message");
+        return;
+    }
+
+    if(strcmp(scope, "server") == 0) {
+        bandwidth = SVRD_Bandwidth_getServer();
+    } else if(strcmp(scope, "client") == 0) {
+        bandwidth = client->bandwidth;
+    } else {
+        SVRD_Client_replyCode(client, message, SVR_INVALIDARGUMENT);
+        return;
+    }
+
+    if(limit < 0) {
+        SVRD_Client_replyCode(client, message, SVR_INVALIDARGUMENT);
+        return;
+    }
+
+    SVR_logf(SVR_NORMAL, "Setting %s bandwidth limit to %ld bits per second", scope, limit);
+    SVRD_Bandwidth_setLimit(bandwidth, limit);
+    SVRD_Client_replyCode(client, message, SVR_SUCCESS);
+}
+
 void SVRD_Event_rRegister(SVRD_Client* client, SVR_Message* message) {
     // --
 }
@@ -9,6 +9,7 @@
  * Source.{open,close,setProp,getProp}
  * Data
  * Event.{register,unregister,notify}
+ * Bandwidth.setLimit
  * SVR.{kick,response}
  */
 
@@ -22,12 +23,19 @@ static SVRD_RequestMapping request_types[] = {
     {"Stream.open", SVRD_Stream_rOpen},
     {"Stream.close", SVRD_Stream_rClose},
     {"Stream.attachSource", SVRD_Stream_rAttachSource},
+    {"Stream.configure", SVRD_Stream_rConfigure},
     {"Stream.resize", SVRD_Stream_rResize},
     {"Stream.setChannels", SVRD_Stream_rSetChannels},
     {"Stream.setEncoding", SVRD_Stream_rSetEncoding},
     {"Stream.setDropRate", SVRD_Stream_rSetDropRate},
+    {"Stream.setMaxRate", SVRD_Stream_rSetMaxRate},
+    {"Stream.setMaxAge", SVRD_Stream_rSetMaxAge},
+    {"Stream.setPullMode", SVRD_Stream_rSetPullMode},
+    {"Stream.setTransport", SVRD_Stream_rSetTransport},
+    {"Stream.requestFrame", SVRD_Stream_rRequestFrame},
     {"Stream.setPriority", SVRD_Stream_rSetPriority},
     {"Stream.getInfo", SVRD_Stream_rGetInfo},
+    {"Stream.getStats", SVRD_Stream_rGetStats},
     {"Stream.pause", SVRD_Stream_rPause},
     {"Stream.unpause", SVRD_Stream_rUnpause},
 
@@ -36,8 +44,11 @@ static SVRD_RequestMapping request_types[] = {
     {"Source.setFrameProperties", SVRD_Source_rSetFrameProperties},
     {"Source.close", SVRD_Source_rClose},
     {"Source.getSourcesList", SVRD_Source_rGetSourcesList},
+    {"Source.getStats", SVRD_Source_rGetStats},
     {"Data", SVRD_Source_rData},
 
+    {"Bandwidth.setLimit", SVRD_Bandwidth_rSetLimit},
+
     {"Event.register", SVRD_Event_rRegister},
     {"Event.unregister", SVRD_Event_rUnregister}
 };
@@ -15,6 +15,7 @@
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/un.h>
 
 /** Server socket */
 static int svr_sock = -1;
@@ -22,6 +23,12 @@ static int svr_sock = -1;
 /** Server socket bind address */
 static struct sockaddr_in svr_addr;
 
+/** Unix domain server socket */
+static int svr_unix_sock = -1;
+
+/** Unix domain server socket path */
+static struct sockaddr_un svr_unix_addr;
+
 /** Flag to keep SVR_mainLoop running */
 static bool run_mainloop = true;
 
@@ -33,6 +40,7 @@ static pthread_cond_t mainloop_done = PTHREAD_COND_INITIALIZER;
 static pthread_mutex_t mainloop_done_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static void SVRD_Server_initServerSocket(const char* bind_address);
+static void SVRD_Server_initUnixSocket(const char* path);
 
 /**
  * \defgroup netloop Net loop
@@ -54,12 +62,12 @@ static void SVRD_Server_initServerSocket(const char* bind_address) {
        interfaces */
     svr_addr.sin_family = AF_INET;
     svr_addr.sin_addr.s_addr = inet_addr(bind_address);
-    svr_addr.sin_port = htons(33560);
+    svr_addr.sin_port = htons(SVR_DEFAULT_PORT);
 
     /* Create the socket */
     svr_sock = socket(AF_INET, SOCK_STREAM, 0);
     if(svr_sock == -1) {
-        SVR_log(SVR_CRITICAL, Util_format("Error creating socket: %s", strerror(errno)));
+        SVR_logf(SVR_CRITICAL, "Error creating socket: %s", strerror(errno));
         SVRD_exitError();
     }
 
@@ -69,13 +77,51 @@ static void SVRD_Server_initServerSocket(const char* bind_address) {
 
     /* Bind the socket to the server port/address */
     if(bind(svr_sock, (struct sockaddr*) &svr_addr, sizeof(svr_addr)) == -1) {
-        SVR_log(SVR_CRITICAL, Util_format("Error binding socket: %s", strerror(errno)));
+        SVR_logf(SVR_CRITICAL, "Error binding socket: %s", strerror(errno));
         SVRD_exitError();
     }
 
     /* Start listening */
     if(listen(svr_sock, MAX_CLIENTS)) {
-        SVR_log(SVR_CRITICAL, Util_format("Error setting socket to listen: %s", strerror(errno)));
+        SVR_logf(SVR_CRITICAL, "Error setting socket to listen: %s", strerror(errno));
+        SVRD_exitError();
+    }
+}
+
+/**
+ * \brief Initialize the Unix domain server socket
+ *
+ * Bind and listen on a Unix domain socket at the given path. Local clients
+ * connecting here skip the TCP stack and can be passed file descriptors. A
+ * socket file left behind by a previous server is removed first.
+ *
+ * \param path Path to bind the socket to
+ */
+static void SVRD_Server_initUnixSocket(const char* path) {
+    if(strlen(path) >= sizeof(svr_unix_addr.sun_path)) {
+        SVR_logf(SVR_CRITICAL, "Unix socket path \"%s\" is too long", path);
+        SVRD_exitError();
+    }
+
+    memset(&svr_unix_addr, 0, sizeof(svr_unix_addr));
+    svr_unix_addr.sun_family = AF_UNIX;
+    strcpy(svr_unix_addr.sun_path, path);
+
+    svr_unix_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(svr_unix_sock == -1) {
+        SVR_logf(SVR_CRITICAL, "Error creating Unix socket: %s", strerror(errno));
+        SVRD_exitError();
+    }
+
+    unlink(path);
+
+    if(bind(svr_unix_sock, (struct sockaddr*) &svr_unix_addr, sizeof(svr_unix_addr)) == -1) {
+        SVR_logf(SVR_CRITICAL, "Error binding Unix socket \"%s\": %s", path, strerror(errno));
+        SVRD_exitError();
+    }
+
+    if(listen(svr_unix_sock, MAX_CLIENTS)) {
+        SVR_logf(SVR_CRITICAL, "Error setting Unix socket to listen: %s", strerror(errno));
         SVRD_exitError();
     }
 }
@@ -120,14 +166,29 @@ void SVRD_Server_close(void) {
  * \brief SVR main loop
  *
  * Main loop which processes client requests and handles all client connections
+ *
+ * \param bind_address Address to accept TCP connections on
+ * \param unix_path Path to accept Unix domain connections on, or NULL to only
+ * listen on TCP
  */
-void SVRD_Server_mainLoop(const char* bind_address) {
+void SVRD_Server_mainLoop(const char* bind_address, const char* unix_path) {
     /* Temporary storage for new client connections until a SVR_Client structure
        can be allocated for them */
     int client_new = 0;
+    struct pollfd listeners[2];
+    int listener_count = 1;
 
     /* Create and ready the server socket */
     SVRD_Server_initServerSocket(bind_address);
+    listeners[0].fd = svr_sock;
+    listeners[0].events = POLLIN;
+
+    if(unix_path) {
+        SVRD_Server_initUnixSocket(unix_path);
+        listeners[1].fd = svr_unix_sock;
+        listeners[1].events = POLLIN;
+        listener_count++;
+    }
 
     /* Begin accepting connections */
     SVR_log(SVR_INFO, "Accepting client connections");
@@ -137,18 +198,26 @@ void SVRD_Server_mainLoop(const char* bind_address) {
 
     /* Start sending/recieving messages */
     while(run_mainloop) {
-        client_new = accept(svr_sock, NULL, 0);
-
-        if(run_mainloop == false ) {
-            break;
-        }
-
-        if(client_new < 0) {
-            SVR_log(SVR_ERROR, "Error accepting new client connection");
+        if(poll(listeners, listener_count, -1) < 0) {
+            if(run_mainloop && errno != EINTR) {
+                SVR_logf(SVR_ERROR, "Error waiting for client connections: %s", strerror(errno));
+            }
             continue;
         }
 
-        SVRD_addClient(client_new);
+        for(int i = 0; i < listener_count && run_mainloop; i++) {
+            if((listeners[i].revents & POLLIN) == 0) {
+                continue;
+            }
+
+            client_new = accept(listeners[i].fd, NULL, 0);
+            if(client_new < 0) {
+                SVR_log(SVR_ERROR, "Error accepting new client connection");
+                continue;
+            }
+
+            SVRD_addClient(client_new);
+        }
     }
 
     /* Signal loop as ended */
@@ -157,6 +226,11 @@ void SVRD_Server_mainLoop(const char* bind_address) {
     shutdown(svr_sock, SHUT_RDWR);
     close(svr_sock);
 
+    if(svr_unix_sock >= 0) {
+        close(svr_unix_sock);
+        unlink(svr_unix_addr.sun_path);
+    }
+
     pthread_cond_broadcast(&mainloop_done);
     pthread_mutex_unlock(&mainloop_done_lock);
 }
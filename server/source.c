@@ -9,12 +9,27 @@
 static void SVRD_Source_addType(SVRD_SourceType* source_type);
 static void SVRD_Source_releaseSourceFrame(void* _source_frame);
 static void SVRD_Source_cleanup(void* _source);
+static int SVRD_Source_decodeData(SVRD_Source* source, void* data, size_t data_available, bool keep_encoded);
+static uint8_t* SVRD_Source_takeEncodedBuffer(size_t* size);
+static void SVRD_Source_returnEncodedBuffer(uint8_t* buffer, size_t size);
+
+/* Encoded buffers kept from released frames for the data of later frames */
+#define SVRD_SOURCE_SPARE_BUFFERS 8
 
 static Dictionary* sources = NULL;
 static Dictionary* source_types = NULL;
 static pthread_mutex_t sources_lock = PTHREAD_MUTEX_INITIALIZER;
 static SVR_BlockAllocator* source_frame_alloc = NULL;
 
+/* Frames may outlive their source, so spare encoded buffers are shared by all
+   sources rather than returned to the one that filled them */
+static struct {
+    uint8_t* buffer;
+    size_t size;
+} spare_buffers[SVRD_SOURCE_SPARE_BUFFERS];
+static int spare_buffer_count = 0;
+static pthread_mutex_t spare_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+
 void SVRD_Source_init(void) {
     sources = Dictionary_new();
     source_types = Dictionary_new();
@@ -23,6 +38,7 @@ void SVRD_Source_init(void) {
     SVRD_Source_addType(&SVR_SOURCE(test));
     SVRD_Source_addType(&SVR_SOURCE(cam));
     SVRD_Source_addType(&SVR_SOURCE(file));
+    SVRD_Source_addType(&SVR_SOURCE(relay));
 
 #ifdef __SVR_Linux__
     SVRD_Source_addType(&SVR_SOURCE(v4l));
@@ -85,8 +101,8 @@ SVRD_Source* SVRD_Source_openInstance(const char* source_name, const char* descr
     options = SVR_parseOptionString(descriptor);
     if(options == NULL) {
         err = SVR_getOptionStringErrorPosition();
-        SVR_log(SVR_ERROR, Util_format("Error parsing source descriptor \"%s\" at position %d, character '%c'",
-                                       descriptor, err, descriptor[err]));
+        SVR_logf(SVR_ERROR, "Error parsing source descriptor \"%s\" at position %d, character '%c'",
+                            descriptor, err, descriptor[err]);
         if(return_code) {
             *return_code = SVR_PARSEERROR;
         }
@@ -95,7 +111,7 @@ SVRD_Source* SVRD_Source_openInstance(const char* source_name, const char* descr
 
     source_type = Dictionary_get(source_types, Dictionary_get(options, "%name"));
     if(source_type == NULL) {
-        SVR_log(SVR_DEBUG, Util_format("No such source type '%s'", Dictionary_get(options, "%name")));
+        SVR_logf(SVR_DEBUG, "No such source type '%s'", (char*) Dictionary_get(options, "%name"));
         SVR_freeParsedOptionString(options);
         if(return_code) {
             *return_code = SVR_INVALIDARGUMENT;
@@ -129,13 +145,13 @@ void SVRD_Source_fromFile(const char* filename) {
     if(source_descriptions == NULL) {
         switch(Config_getError()) {
         case CONFIG_EFILEACCESS:
-            SVR_log(SVR_CRITICAL, Util_format("Failed to open source description file: %s", strerror(errno)));
+            SVR_logf(SVR_CRITICAL, "Failed to open source description file: %s", strerror(errno));
             break;
         case CONFIG_ELINETOOLONG:
-            SVR_log(SVR_CRITICAL, Util_format("Line exceeded maximum allowable length at line %d", Config_getLineNumber()));
+            SVR_logf(SVR_CRITICAL, "Line exceeded maximum allowable length at line %d", Config_getLineNumber());
             break;
         case CONFIG_EPARSE:
-            SVR_log(SVR_CRITICAL, Util_format("Parse error occurred on line %d", Config_getLineNumber()));
+            SVR_logf(SVR_CRITICAL, "Parse error occurred on line %d", Config_getLineNumber());
             break;
         default:
             SVR_log(SVR_CRITICAL, "Unknown error occurred while reading source description file");
@@ -152,7 +168,7 @@ void SVRD_Source_fromFile(const char* filename) {
             SVR_log(SVR_CRITICAL, "Error parsing stream descriptor and/or starting stream");
             SVRD_exitError();
         }
-        SVR_log(SVR_INFO, Util_format("Opened source \"%s\"", source_name));
+        SVR_logf(SVR_INFO, "Opened source \"%s\"", source_name);
     }
 
     List_destroy(source_names);
@@ -161,7 +177,7 @@ void SVRD_Source_fromFile(const char* filename) {
 
 static void SVRD_Source_addType(SVRD_SourceType* source_type) {
     Dictionary_set(source_types, source_type->name, source_type);
-    SVR_log(SVR_DEBUG, Util_format("source_type '%s'", source_type->name));
+    SVR_logf(SVR_DEBUG, "source_type '%s'", source_type->name);
 }
 
 SVRD_Source* SVRD_Source_new(const char* name) {
@@ -176,15 +192,25 @@ SVRD_Source* SVRD_Source_new(const char* name) {
     source = malloc(sizeof(SVRD_Source));
     source->name = strdup(name);
     source->frame_properties = NULL;
+    source->capture_properties = NULL;
     source->encoding = NULL;
     source->decoder = NULL;
     source->type = NULL;
     source->private_data = NULL;
     source->current_frame = NULL;
+    source->encoded = NULL;
+    source->encoded_size = 0;
+    source->encoded_buffer_size = 0;
     source->closed = false;
+    source->consumers = List_new();
+    source->next_capture.tv_sec = 0;
+    source->next_capture.tv_nsec = 0;
+    source->frames_received = 0;
+    source->frames_dropped = 0;
 
     pthread_mutex_init(&source->current_frame_lock, NULL);
     pthread_cond_init(&source->new_frame, NULL);
+    pthread_cond_init(&source->demand_changed, NULL);
     SVR_LOCKABLE_INIT(source);
     SVR_REFCOUNTED_INIT(source, SVRD_Source_cleanup);
 
@@ -201,12 +227,21 @@ static void SVRD_Source_cleanup(void* _source) {
         SVR_FrameProperties_destroy(source->frame_properties);
     }
 
+    if(source->capture_properties) {
+        SVR_FrameProperties_destroy(source->capture_properties);
+    }
+
     if(source->decoder) {
         SVR_Decoder_destroy(source->decoder);
     }
 
+    List_destroy(source->consumers);
+    free(source->encoded);
     free(source->name);
     free(source);
+
+    /* Give memory held for this source's frames back to the system */
+    SVR_BlockAlloc_trim(source_frame_alloc);
 }
 
 void SVRD_Source_destroy(SVRD_Source* source) {
@@ -232,6 +267,11 @@ void SVRD_Source_destroy(SVRD_Source* source) {
     Dictionary_remove(sources, source->name);
     pthread_mutex_unlock(&sources_lock);
 
+    /* Wake up a provider waiting for demand so it can see the source closing */
+    pthread_mutex_lock(&source->current_frame_lock);
+    pthread_cond_broadcast(&source->demand_changed);
+    pthread_mutex_unlock(&source->current_frame_lock);
+
     /* Start shutdown of any provider if this is not a client source */
     if(source->type && source->type->close) {
         source->type->close(source);
@@ -281,10 +321,193 @@ int SVRD_Source_setFrameProperties(SVRD_Source* source, SVR_FrameProperties* fra
         SVR_FrameProperties_destroy(source->frame_properties);
     }
 
+    if(source->capture_properties) {
+        SVR_FrameProperties_destroy(source->capture_properties);
+    }
+
     source->frame_properties = SVR_FrameProperties_clone(frame_properties);
+    source->capture_properties = SVR_FrameProperties_clone(frame_properties);
+    return SVR_SUCCESS;
+}
+
+/**
+ * \brief Change the size of the frames provided by a source
+ *
+ * Called by a source provider when it starts capturing frames of a different
+ * size than before, such as after lowering its capture resolution to match
+ * demand. Data given to SVRD_Source_provideData after this call is decoded as
+ * frames of the new size. The native frame properties of the source, which new
+ * streams start from, are unchanged.
+ *
+ * \param source The source
+ * \param width New capture width
+ * \param height New capture height
+ * \return SVR_SUCCESS, or SVR_INVALIDSTATE if the source has no frame
+ * properties
+ */
+int SVRD_Source_setCaptureSize(SVRD_Source* source, int width, int height) {
+    SVR_LOCK(source);
+    if(source->capture_properties == NULL) {
+        SVR_UNLOCK(source);
+        return SVR_INVALIDSTATE;
+    }
+
+    if(source->capture_properties->width != width || source->capture_properties->height != height) {
+        source->capture_properties->width = width;
+        source->capture_properties->height = height;
+
+        /* Recreated for the new size on the next call to provideData */
+        if(source->decoder) {
+            SVR_Decoder_destroy(source->decoder);
+            source->decoder = NULL;
+        }
+
+        SVR_logf(SVR_DEBUG, "Source '%s' capturing at %dx%d", source->name, width, height);
+    }
+    SVR_UNLOCK(source);
+
     return SVR_SUCCESS;
 }
 
+/**
+ * \brief Register an unpaused stream with a source
+ *
+ * Called when a stream is unpaused. Wakes a provider idling for lack of demand.
+ *
+ * \param source The source
+ * \param stream The stream now reading from the source
+ */
+void SVRD_Source_addConsumer(SVRD_Source* source, SVRD_Stream* stream) {
+    pthread_mutex_lock(&source->current_frame_lock);
+    List_append(source->consumers, stream);
+    pthread_cond_broadcast(&source->demand_changed);
+    pthread_mutex_unlock(&source->current_frame_lock);
+}
+
+/**
+ * \brief Unregister a stream from a source
+ *
+ * Called when a stream is paused. Once the last stream leaves, the current
+ * frame is released so an idle source holds no frames.
+ *
+ * \param source The source
+ * \param stream The stream no longer reading from the source
+ */
+void SVRD_Source_removeConsumer(SVRD_Source* source, SVRD_Stream* stream) {
+    int i;
+
+    pthread_mutex_lock(&source->current_frame_lock);
+    i = List_indexOf(source->consumers, stream);
+    if(i >= 0) {
+        List_remove(source->consumers, i);
+    }
+
+    if(List_getSize(source->consumers) == 0 && source->current_frame) {
+        SVR_UNREF(source->current_frame);
+        source->current_frame = NULL;
+    }
+
+    pthread_cond_broadcast(&source->demand_changed);
+    pthread_mutex_unlock(&source->current_frame_lock);
+}
+
+static void SVRD_Source_computeDemand(SVRD_Source* source, SVRD_SourceDemand* demand) {
+    SVRD_Stream* stream;
+
+    demand->streams = List_getSize(source->consumers);
+    demand->rate = -1;
+    demand->width = 0;
+    demand->height = 0;
+
+    for(int i = 0; (stream = List_get(source->consumers, i)) != NULL; i++) {
+        /* Any unlimited stream makes the demand unlimited */
+        if(stream->max_rate == 0 || demand->rate == 0) {
+            demand->rate = 0;
+        } else {
+            demand->rate = Util_max(demand->rate, stream->max_rate);
+        }
+
+        demand->width = Util_max(demand->width, stream->frame_properties->width);
+        demand->height = Util_max(demand->height, stream->frame_properties->height);
+    }
+
+    if(demand->rate < 0) {
+        demand->rate = 0;
+    }
+}
+
+/**
+ * \brief Get the current demand on a source
+ *
+ * \param source The source
+ * \param demand Filled with the combined needs of the unpaused streams
+ */
+void SVRD_Source_getDemand(SVRD_Source* source, SVRD_SourceDemand* demand) {
+    pthread_mutex_lock(&source->current_frame_lock);
+    SVRD_Source_computeDemand(source, demand);
+    pthread_mutex_unlock(&source->current_frame_lock);
+}
+
+/**
+ * \brief Wait until a source has demand
+ *
+ * Block until at least one stream is reading from the source or the source is
+ * closed. Source providers call this before capturing each frame so that
+ * nothing is captured or decoded while no stream is unpaused.
+ *
+ * \param source The source
+ * \param demand Filled with the combined needs of the unpaused streams
+ * \return False if the source is closing, true otherwise
+ */
+bool SVRD_Source_waitForDemand(SVRD_Source* source, SVRD_SourceDemand* demand) {
+    bool open;
+
+    pthread_mutex_lock(&source->current_frame_lock);
+    while(source->closed == false && List_getSize(source->consumers) == 0) {
+        pthread_cond_wait(&source->demand_changed, &source->current_frame_lock);
+    }
+
+    SVRD_Source_computeDemand(source, demand);
+    open = (source->closed == false);
+    pthread_mutex_unlock(&source->current_frame_lock);
+
+    return open;
+}
+
+/**
+ * \brief Pace the capture of a source
+ *
+ * Sleep until the next frame is due at the given rate. Deadlines are kept in
+ * absolute time so time spent capturing does not lower the rate, and a
+ * provider that falls behind does not try to catch up with a burst.
+ *
+ * \param source The source
+ * \param rate Capture rate in frames per second. If 0, return immediately
+ */
+void SVRD_Source_throttle(SVRD_Source* source, int rate) {
+    struct timespec now;
+    struct timespec* next = &source->next_capture;
+
+    if(rate <= 0) {
+        return;
+    }
+
+    next->tv_nsec += 1000000000L / rate;
+    if(next->tv_nsec >= 1000000000L) {
+        next->tv_sec += 1;
+        next->tv_nsec -= 1000000000L;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(now.tv_sec > next->tv_sec || (now.tv_sec == next->tv_sec && now.tv_nsec >= next->tv_nsec)) {
+        /* Behind schedule, start over from now */
+        *next = now;
+        return;
+    }
+
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, next, NULL) == EINTR);
+}
+
 SVR_FrameProperties* SVRD_Source_getFrameProperties(SVRD_Source* source) {
     return source->frame_properties;
 }
@@ -292,12 +515,8 @@ SVR_FrameProperties* SVRD_Source_getFrameProperties(SVRD_Source* source) {
 SVRD_SourceFrame* SVRD_Source_getFrame(SVRD_Source* source, SVRD_Stream* stream, SVRD_SourceFrame* last_frame) {
     SVRD_SourceFrame* new_frame = NULL;
 
-    /* Dereference the last frame */
-    if(last_frame) {
-        SVR_UNREF(last_frame);
-    }
-
-    /* Wait for a different frame */
+    /* Wait for a different frame. The last frame is only dereferenced after,
+       so a new frame can not take its place in memory and pass for it */
     pthread_mutex_lock(&source->current_frame_lock);
     while(source->closed == false && source->current_frame == last_frame &&
           (stream == NULL || stream->state == SVR_UNPAUSED)) {
@@ -306,11 +525,16 @@ SVRD_SourceFrame* SVRD_Source_getFrame(SVRD_Source* source, SVRD_Stream* stream,
 
     if(source->closed == false && stream->state == SVR_UNPAUSED) {
         new_frame = source->current_frame;
+        new_frame->taken = true;
         SVR_REF(new_frame);
     }
 
     pthread_mutex_unlock(&source->current_frame_lock);
 
+    if(last_frame) {
+        SVR_UNREF(last_frame);
+    }
+
     return new_frame;
 }
 
@@ -321,25 +545,107 @@ void SVRD_Source_dismissPausedStreams(SVRD_Source* source) {
 static void SVRD_Source_releaseSourceFrame(void* _source_frame) {
     SVRD_SourceFrame* source_frame = (SVRD_SourceFrame*) _source_frame;
 
-    SVR_Decoder_returnFrame(source_frame->source->decoder, source_frame->frame);
+    SVR_FramePool_returnFrame(source_frame->frame);
+    if(source_frame->encoded) {
+        SVRD_Source_returnEncodedBuffer(source_frame->encoded, source_frame->encoded_buffer_size);
+    }
     SVR_BlockAlloc_free(source_frame_alloc, source_frame);
 }
 
+/**
+ * Take a spare encoded buffer, or NULL if there is none. The buffer's size is
+ * stored to size
+ */
+static uint8_t* SVRD_Source_takeEncodedBuffer(size_t* size) {
+    uint8_t* buffer = NULL;
+
+    *size = 0;
+    pthread_mutex_lock(&spare_buffers_lock);
+    if(spare_buffer_count > 0) {
+        spare_buffer_count--;
+        buffer = spare_buffers[spare_buffer_count].buffer;
+        *size = spare_buffers[spare_buffer_count].size;
+    }
+    pthread_mutex_unlock(&spare_buffers_lock);
+
+    return buffer;
+}
+
+/**
+ * Keep an encoded buffer for reuse, or free it if enough are kept already
+ */
+static void SVRD_Source_returnEncodedBuffer(uint8_t* buffer, size_t size) {
+    pthread_mutex_lock(&spare_buffers_lock);
+    if(spare_buffer_count < SVRD_SOURCE_SPARE_BUFFERS) {
+        spare_buffers[spare_buffer_count].buffer = buffer;
+        spare_buffers[spare_buffer_count].size = size;
+        spare_buffer_count++;
+        buffer = NULL;
+    }
+    pthread_mutex_unlock(&spare_buffers_lock);
+
+    free(buffer);
+}
+
 int SVRD_Source_provideData(SVRD_Source* source, void* data, size_t data_available) {
+    return SVRD_Source_decodeData(source, data, data_available, false);
+}
+
+/**
+ * \brief Provide encoded data to be passed through
+ *
+ * Like SVRD_Source_provideData, but the data of each frame is also kept with
+ * the decoded frame, so streams using the source's encoding at the source's
+ * frame size can send it on without encoding the frame again. Data must be
+ * provided frame by frame, with no call spanning the end of a frame.
+ *
+ * \param source The source
+ * \param data Encoded data
+ * \param data_available Size of the data
+ * \return An error code
+ */
+int SVRD_Source_provideEncodedData(SVRD_Source* source, void* data, size_t data_available) {
+    return SVRD_Source_decodeData(source, data, data_available, true);
+}
+
+static int SVRD_Source_decodeData(SVRD_Source* source, void* data, size_t data_available, bool keep_encoded) {
     SVRD_SourceFrame* source_frame;
+    struct timespec timestamp;
     IplImage* frame;
+    int frames;
+
+    /* Providers pass frames on as soon as they are captured, so this is
+       taken as the capture time */
+    clock_gettime(CLOCK_MONOTONIC, &timestamp);
 
     SVR_LOCK(source);
     if(source->decoder == NULL) {
-        if(source->encoding == NULL || source->frame_properties == NULL) {
+        if(source->encoding == NULL || source->capture_properties == NULL) {
             SVR_UNLOCK(source);
             return SVR_INVALIDSTATE;
         }
 
-        source->decoder = SVR_Decoder_new(source->encoding, source->frame_properties);
+        source->decoder = SVR_Decoder_new(source->encoding, source->capture_properties);
+    }
+
+    if(keep_encoded) {
+        /* The last buffer went out with a frame */
+        if(source->encoded == NULL) {
+            source->encoded = SVRD_Source_takeEncodedBuffer(&source->encoded_buffer_size);
+        }
+
+        if(source->encoded_size + data_available > source->encoded_buffer_size) {
+            source->encoded_buffer_size = Util_max(source->encoded_buffer_size * 2,
+                                                   source->encoded_size + data_available);
+            source->encoded = realloc(source->encoded, source->encoded_buffer_size);
+        }
+
+        memcpy(source->encoded + source->encoded_size, data, data_available);
+        source->encoded_size += data_available;
     }
 
     SVR_Decoder_decode(source->decoder, data, data_available);
+    frames = SVR_Decoder_framesReady(source->decoder);
     while(SVR_Decoder_framesReady(source->decoder) > 0) {
         frame = SVR_Decoder_getFrame(source->decoder);
 
@@ -347,15 +653,38 @@ int SVRD_Source_provideData(SVRD_Source* source, void* data, size_t data_availab
         source_frame = SVR_BlockAlloc_alloc(source_frame_alloc);
         source_frame->source = source;
         source_frame->frame = frame;
+        source_frame->timestamp = timestamp;
+        source_frame->encoded = NULL;
+        source_frame->encoded_size = 0;
+        source_frame->encoded_buffer_size = 0;
+        source_frame->taken = false;
         SVR_REFCOUNTED_INIT(source_frame, SVRD_Source_releaseSourceFrame);
 
+        /* The encoded data can only be told apart when it holds one frame */
+        if(keep_encoded && frames == 1) {
+            source_frame->encoded = source->encoded;
+            source_frame->encoded_size = source->encoded_size;
+            source_frame->encoded_buffer_size = source->encoded_buffer_size;
+            source->encoded = NULL;
+            source->encoded_buffer_size = 0;
+        }
+
         if(source->current_frame) {
+            /* Only frames some stream was waiting for count as dropped */
+            if(source->current_frame->taken == false && List_getSize(source->consumers) > 0) {
+                source->frames_dropped++;
+            }
             SVR_UNREF(source->current_frame);
         }
         source->current_frame = source_frame;
+        source->frames_received++;
         pthread_cond_broadcast(&source->new_frame);
         pthread_mutex_unlock(&source->current_frame_lock);
     }
+
+    if(frames > 0) {
+        source->encoded_size = 0;
+    }
     SVR_UNLOCK(source);
 
     return SVR_SUCCESS;
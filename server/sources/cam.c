@@ -17,6 +17,12 @@ typedef struct {
     CvCapture* capture;
     pthread_t thread;
     bool close;
+
+    /* Native capture size and the size last requested from the camera */
+    int width;
+    int height;
+    int requested_width;
+    int requested_height;
 } SVRD_CamSource;
 
 static void* CamSource_background(void* _source);
@@ -36,7 +42,7 @@ static SVRD_Source* CamSource_open(const char* name, Dictionary* arguments) {
     source_data->close = false;
 
     if(source_data->capture == NULL) {
-        SVR_log(SVR_ERROR, Util_format("Could not open camera with index %d", index));
+        SVR_logf(SVR_ERROR, "Could not open camera with index %d", index);
         return NULL;
     }
 
@@ -50,10 +56,15 @@ static SVRD_Source* CamSource_open(const char* name, Dictionary* arguments) {
 
     for(int i = 0; (frame = cvQueryFrame(source_data->capture)) == NULL && i < 5; i++);
     if(frame == NULL) {
-        SVR_log(SVR_ERROR, Util_format("Could not query frame from device with index %d", index));
+        SVR_logf(SVR_ERROR, "Could not query frame from device with index %d", index);
         return NULL;
     }
 
+    source_data->width = frame->width;
+    source_data->height = frame->height;
+    source_data->requested_width = frame->width;
+    source_data->requested_height = frame->height;
+
     frame_properties = SVR_FrameProperties_new();
     frame_properties->width = frame->width;
     frame_properties->height = frame->height;
@@ -66,7 +77,7 @@ static SVRD_Source* CamSource_open(const char* name, Dictionary* arguments) {
     SVR_FrameProperties_destroy(frame_properties);
 
     if(source == NULL) {
-        SVR_log(SVR_ERROR, Util_format("Error creating source '%s'", name));
+        SVR_logf(SVR_ERROR, "Error creating source '%s'", name);
         cvReleaseCapture(&source_data->capture);
         free(source_data);
         return NULL;
@@ -81,15 +92,35 @@ static SVRD_Source* CamSource_open(const char* name, Dictionary* arguments) {
 static void* CamSource_background(void* _source) {
     SVRD_Source* source = (SVRD_Source*) _source;
     SVRD_CamSource* source_data = (SVRD_CamSource*) source->private_data;
+    SVRD_SourceDemand demand;
     IplImage* frame;
+    int width;
+    int height;
 
     while(source_data->close == false) {
+        if(SVRD_Source_waitForDemand(source, &demand) == false) {
+            break;
+        }
+
+        /* Ask the camera for the smallest size any stream can use. The camera
+           may pick a different size, so the frames themselves are trusted */
+        width = Util_min(demand.width, source_data->width);
+        height = Util_min(demand.height, source_data->height);
+        if(width != source_data->requested_width || height != source_data->requested_height) {
+            cvSetCaptureProperty(source_data->capture, CV_CAP_PROP_FRAME_WIDTH, width);
+            cvSetCaptureProperty(source_data->capture, CV_CAP_PROP_FRAME_HEIGHT, height);
+            source_data->requested_width = width;
+            source_data->requested_height = height;
+        }
+
         frame = cvQueryFrame(source_data->capture);
         if(frame == NULL) {
-            SVR_log(SVR_CRITICAL, Util_format("Error retrieving frame from camera! (%s)", source->name));
+            SVR_logf(SVR_CRITICAL, "Error retrieving frame from camera! (%s)", source->name);
             Util_usleep(1.0);
         } else {
+            SVRD_Source_setCaptureSize(source, frame->width, frame->height);
             SVRD_Source_provideData(source, (void*) frame->imageData, frame->imageSize);
+            SVRD_Source_throttle(source, demand.rate);
         }
     }
 
@@ -45,14 +45,14 @@ static SVRD_Source* FileSource_open(const char* name, Dictionary* arguments) {
     }
 
     if(source_data->capture == NULL) {
-        SVR_log(SVR_ERROR, Util_format("Could not open capture with file %s", filename));
+        SVR_logf(SVR_ERROR, "Could not open capture with file %s", filename);
         free(source_data);
         return NULL;
     }
 
     frame = cvQueryFrame(source_data->capture);
     if(frame == NULL) {
-        SVR_log(SVR_ERROR, Util_format("Could not query frame from capture with file %s", filename));
+        SVR_logf(SVR_ERROR, "Could not query frame from capture with file %s", filename);
         free(source_data);
         return NULL;
     }
@@ -69,7 +69,7 @@ static SVRD_Source* FileSource_open(const char* name, Dictionary* arguments) {
     SVR_FrameProperties_destroy(frame_properties);
 
     if(source == NULL) {
-        SVR_log(SVR_ERROR, Util_format("Error creating source '%s'", name));
+        SVR_logf(SVR_ERROR, "Error creating source '%s'", name);
         free(source_data);
         return NULL;
     }
@@ -83,22 +83,39 @@ static SVRD_Source* FileSource_open(const char* name, Dictionary* arguments) {
 static void* FileSource_background(void* _source) {
     SVRD_Source* source = (SVRD_Source*) _source;
     SVRD_FileSource* source_data = (SVRD_FileSource*) source->private_data;
+    SVRD_SourceDemand demand;
     IplImage* frame;
-    float sleep = 0;
-
-    if(source_data->rate > 0) {
-        sleep = 1.0 / source_data->rate;
-    }
+    int credit = 0;
 
     while(source_data->close == false) {
-        frame = cvQueryFrame(source_data->capture);
-        if(frame == NULL) {
+        /* Playback is suspended while no stream is reading */
+        if(SVRD_Source_waitForDemand(source, &demand) == false) {
+            break;
+        }
+
+        if(cvGrabFrame(source_data->capture) == 0) {
             /* Reset to beginning */
             cvSetCaptureProperty(source_data->capture, CV_CAP_PROP_POS_AVI_RATIO, 0.0);
-        } else {
+            continue;
+        }
+
+        /* Playback continues at the file's rate, but when every stream wants
+           fewer frames than that the skipped frames are never decoded */
+        if(demand.rate > 0 && source_data->rate > demand.rate) {
+            credit += demand.rate;
+            if(credit < source_data->rate) {
+                SVRD_Source_throttle(source, source_data->rate);
+                continue;
+            }
+            credit -= source_data->rate;
+        }
+
+        frame = cvRetrieveFrame(source_data->capture, 0);
+        if(frame) {
             SVRD_Source_provideData(source, (void*) frame->imageData, frame->imageSize);
-            Util_usleep(sleep);
         }
+
+        SVRD_Source_throttle(source, source_data->rate);
     }
 
     cvReleaseCapture(&source_data->capture);
@@ -0,0 +1,346 @@
+
+#include "svr.h"
+#include "svrd.h"
+
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Seconds to wait for the remote server to answer while opening */
+#define RELAY_REQUEST_TIMEOUT 5
+
+/* Milliseconds between checks of local demand while no message arrives */
+#define RELAY_DEMAND_INTERVAL 100
+
+static SVRD_Source* RelaySource_open(const char* name, Dictionary* arguments);
+static void RelaySource_close(SVRD_Source* source);
+
+SVRD_SourceType SVR_SOURCE(relay) = {
+        .name = "relay",
+        .open = RelaySource_open,
+        .close = RelaySource_close
+};
+
+typedef struct {
+    int socket;
+    SVR_NetReader* reader;
+    char* stream_name;
+    unsigned int request_id;
+
+    /* What the remote stream was last asked for */
+    bool unpaused;
+    int rate;
+
+    pthread_t thread;
+    bool close;
+
+    /* The source was closed from the relay thread, which cleans up itself */
+    bool detached;
+} SVRD_RelaySource;
+
+static void* RelaySource_background(void* _source);
+static SVR_Message* RelaySource_newRequest(SVRD_RelaySource* source_data, int count, ...);
+static SVR_Message* RelaySource_request(SVRD_RelaySource* source_data, SVR_Message* message);
+static int RelaySource_requestCode(SVRD_RelaySource* source_data, SVR_Message* message);
+static void RelaySource_send(SVRD_RelaySource* source_data, SVR_Message* message);
+static void RelaySource_followDemand(SVRD_Source* source);
+static void RelaySource_setReceiveTimeout(SVRD_RelaySource* source_data, long milliseconds);
+static void RelaySource_free(SVRD_RelaySource* source_data);
+
+/**
+ * Open a stream of a source on another server and provide its frames as a
+ * local source. The remote stream runs while any local stream reads from the
+ * relay, at the highest rate any of them needs, and frames encoded the way a
+ * local stream wants them are sent on without encoding them again
+ */
+static SVRD_Source* RelaySource_open(const char* name, Dictionary* arguments) {
+    SVRD_RelaySource* source_data;
+    SVR_FrameProperties* frame_properties = NULL;
+    SVR_Message* response;
+    SVRD_Source* source;
+    const char* server;
+    const char* remote_source;
+    const char* encoding = "jpeg";
+    int return_code = SVR_SUCCESS;
+
+    server = Dictionary_get(arguments, "server");
+    remote_source = Dictionary_get(arguments, "source");
+    if(server == NULL || remote_source == NULL) {
+        SVR_log(SVR_ERROR, "Relay source needs a server and a source");
+        return NULL;
+    }
+
+    if(Dictionary_exists(arguments, "encoding")) {
+        encoding = Dictionary_get(arguments, "encoding");
+    }
+
+    source_data = malloc(sizeof(SVRD_RelaySource));
+    source_data->socket = SVR_Comm_connect(server);
+    source_data->stream_name = strdup(name);
+    source_data->request_id = 0;
+    source_data->unpaused = false;
+    source_data->rate = 0;
+    source_data->close = false;
+    source_data->detached = false;
+
+    if(source_data->socket == -1) {
+        source_data->reader = NULL;
+        RelaySource_free(source_data);
+        return NULL;
+    }
+
+    source_data->reader = SVR_NetReader_new(source_data->socket);
+    RelaySource_setReceiveTimeout(source_data, RELAY_REQUEST_TIMEOUT * 1000);
+
+    /* Open the remote stream, paused until there is local demand */
+    return_code = RelaySource_requestCode(source_data, RelaySource_newRequest(source_data, 2, "Stream.open", name));
+
+    if(return_code == SVR_SUCCESS) {
+        return_code = RelaySource_requestCode(source_data, RelaySource_newRequest(source_data, 3, "Stream.attachSource",
+                                                                                  name, remote_source));
+    }
+
+    if(return_code == SVR_SUCCESS) {
+        return_code = RelaySource_requestCode(source_data, RelaySource_newRequest(source_data, 3, "Stream.setEncoding",
+                                                                                  name, encoding));
+    }
+
+    if(return_code == SVR_SUCCESS) {
+        response = RelaySource_request(source_data, RelaySource_newRequest(source_data, 2, "Stream.getInfo", name));
+        if(response == NULL) {
+            return_code = SVR_UNKNOWNERROR;
+        } else if(response->count == 4 && strcmp(response->components[0], "Stream.getInfo") == 0) {
+            frame_properties = SVR_FrameProperties_fromString(response->components[3]);
+            SVR_Message_release(response);
+        } else {
+            return_code = SVR_Comm_parseResponse(response);
+            SVR_Message_release(response);
+        }
+    }
+
+    if(frame_properties == NULL) {
+        SVR_logf(SVR_ERROR, "Unable to relay source '%s' from %s (error %d)", remote_source, server, return_code);
+        RelaySource_free(source_data);
+        return NULL;
+    }
+
+    source = SVRD_Source_new(name);
+    if(source == NULL) {
+        SVR_logf(SVR_ERROR, "Error creating source '%s'", name);
+        SVR_FrameProperties_destroy(frame_properties);
+        RelaySource_free(source_data);
+        return NULL;
+    }
+
+    /* Frames are decoded from the remote stream's encoding */
+    SVRD_Source_setEncoding(source, encoding);
+    SVRD_Source_setFrameProperties(source, frame_properties);
+    SVR_FrameProperties_destroy(frame_properties);
+
+    source->private_data = source_data;
+
+    RelaySource_setReceiveTimeout(source_data, RELAY_DEMAND_INTERVAL);
+    pthread_create(&source_data->thread, NULL, RelaySource_background, source);
+
+    SVR_logf(SVR_INFO, "Relaying source '%s' from %s as '%s'", remote_source, server, name);
+
+    return source;
+}
+
+static void* RelaySource_background(void* _source) {
+    SVRD_Source* source = (SVRD_Source*) _source;
+    SVRD_RelaySource* source_data = (SVRD_RelaySource*) source->private_data;
+    SVR_FrameProperties* frame_properties;
+    SVR_Message* message;
+    int return_code;
+
+    while(source_data->close == false) {
+        RelaySource_followDemand(source);
+
+        /* Times out to check demand again */
+        errno = 0;
+        message = SVR_NetReader_receiveMessage(source_data->reader);
+        if(message == NULL) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                continue;
+            }
+
+            break;
+        }
+
+        if(message->request_id) {
+            /* Response to a pause, unpause or rate change */
+            return_code = SVR_Comm_parseResponse(message);
+            if(return_code != SVR_SUCCESS) {
+                SVR_logf(SVR_WARNING, "Relayed stream '%s' refused a request (error %d)",
+                                      source_data->stream_name, return_code);
+            }
+        } else if(message->count == 2 && strcmp(message->components[0], "Data") == 0) {
+            SVRD_Source_provideEncodedData(source, message->payload, message->payload_size);
+        } else if(message->count == 4 && strcmp(message->components[0], "Stream.adjusted") == 0) {
+            /* The remote server degraded the stream, frames change size */
+            frame_properties = SVR_FrameProperties_fromString(message->components[3]);
+            if(frame_properties) {
+                SVRD_Source_setCaptureSize(source, frame_properties->width, frame_properties->height);
+                SVR_FrameProperties_destroy(frame_properties);
+            }
+        } else if(message->count > 0 && (strcmp(message->components[0], "Stream.orphaned") == 0 ||
+                                         strcmp(message->components[0], "SVR.kick") == 0)) {
+            SVR_Message_release(message);
+            break;
+        }
+
+        SVR_Message_release(message);
+    }
+
+    if(source_data->close) {
+        return NULL;
+    }
+
+    /* The remote source is gone, so close the relay with it */
+    SVR_logf(SVR_NORMAL, "Lost relayed source '%s'", source->name);
+    SVRD_Source_destroy(source);
+
+    if(source_data->detached) {
+        pthread_detach(pthread_self());
+        RelaySource_free(source_data);
+    }
+
+    return NULL;
+}
+
+/**
+ * Pause, unpause and limit the remote stream to match the local streams
+ * reading from the relay
+ */
+static void RelaySource_followDemand(SVRD_Source* source) {
+    SVRD_RelaySource* source_data = (SVRD_RelaySource*) source->private_data;
+    SVRD_SourceDemand demand;
+    char rate[16];
+
+    SVRD_Source_getDemand(source, &demand);
+
+    if(demand.streams > 0 && demand.rate != source_data->rate) {
+        source_data->rate = demand.rate;
+        snprintf(rate, sizeof(rate), "%d", demand.rate);
+        RelaySource_send(source_data, RelaySource_newRequest(source_data, 3, "Stream.setMaxRate",
+                                                             source_data->stream_name, rate));
+    }
+
+    if((demand.streams > 0) != source_data->unpaused) {
+        source_data->unpaused = (demand.streams > 0);
+        RelaySource_send(source_data, RelaySource_newRequest(source_data, 2,
+                                                             source_data->unpaused ? "Stream.unpause" : "Stream.pause",
+                                                             source_data->stream_name));
+    }
+}
+
+/**
+ * Build a request from count string components
+ */
+static SVR_Message* RelaySource_newRequest(SVRD_RelaySource* source_data, int count, ...) {
+    SVR_Message* message = SVR_Message_new(count);
+    va_list components;
+
+    va_start(components, count);
+    for(int i = 0; i < count; i++) {
+        message->components[i] = SVR_Arena_strdup(message->alloc, va_arg(components, const char*));
+    }
+    va_end(components);
+
+    /* Request IDs of 0 mark messages which are not responses */
+    source_data->request_id = (source_data->request_id % 0xffff) + 1;
+    message->request_id = source_data->request_id;
+
+    return message;
+}
+
+/**
+ * Send a request and release it without waiting for the response, which the
+ * relay thread receives
+ */
+static void RelaySource_send(SVRD_RelaySource* source_data, SVR_Message* message) {
+    SVR_Net_sendMessage(source_data->socket, message);
+    SVR_Message_release(message);
+}
+
+/**
+ * Send a request, release it and wait for its response. Only used while
+ * opening, before any other message can arrive
+ */
+static SVR_Message* RelaySource_request(SVRD_RelaySource* source_data, SVR_Message* message) {
+    SVR_Message* response;
+    unsigned int request_id = message->request_id;
+
+    if(SVR_Net_sendMessage(source_data->socket, message) < 0) {
+        SVR_Message_release(message);
+        return NULL;
+    }
+    SVR_Message_release(message);
+
+    while((response = SVR_NetReader_receiveMessage(source_data->reader)) != NULL) {
+        if(response->request_id == request_id) {
+            SVR_Message_detach(response);
+            return response;
+        }
+
+        SVR_Message_release(response);
+    }
+
+    return NULL;
+}
+
+/**
+ * Send a request and wait for the return code it is answered with
+ */
+static int RelaySource_requestCode(SVRD_RelaySource* source_data, SVR_Message* message) {
+    SVR_Message* response = RelaySource_request(source_data, message);
+    int return_code;
+
+    if(response == NULL) {
+        return SVR_UNKNOWNERROR;
+    }
+
+    return_code = SVR_Comm_parseResponse(response);
+    SVR_Message_release(response);
+
+    return return_code;
+}
+
+static void RelaySource_setReceiveTimeout(SVRD_RelaySource* source_data, long milliseconds) {
+    struct timeval timeout;
+
+    timeout.tv_sec = milliseconds / 1000;
+    timeout.tv_usec = (milliseconds % 1000) * 1000;
+    setsockopt(source_data->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+static void RelaySource_free(SVRD_RelaySource* source_data) {
+    if(source_data->reader) {
+        SVR_NetReader_destroy(source_data->reader);
+    }
+
+    if(source_data->socket != -1) {
+        close(source_data->socket);
+    }
+
+    free(source_data->stream_name);
+    free(source_data);
+}
+
+static void RelaySource_close(SVRD_Source* source) {
+    SVRD_RelaySource* source_data = (SVRD_RelaySource*) source->private_data;
+
+    /* Closing because the remote source went away */
+    if(pthread_equal(pthread_self(), source_data->thread)) {
+        source_data->detached = true;
+        return;
+    }
+
+    /* Wakes the relay thread. The remote server closes the stream along with
+       the connection */
+    source_data->close = true;
+    shutdown(source_data->socket, SHUT_RDWR);
+    pthread_join(source_data->thread, NULL);
+    RelaySource_free(source_data);
+}
@@ -5,6 +5,7 @@
 extern SVRD_SourceType SVR_SOURCE(test);
 extern SVRD_SourceType SVR_SOURCE(cam);
 extern SVRD_SourceType SVR_SOURCE(file);
+extern SVRD_SourceType SVR_SOURCE(relay);
 
 #ifdef __SVR_Linux__
 extern SVRD_SourceType SVR_SOURCE(v4l);
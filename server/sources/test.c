@@ -71,7 +71,7 @@ static SVRD_Source* TestSource_open(const char* name, Dictionary* arguments) {
     SVR_FrameProperties_destroy(frame_properties);
 
     if(source == NULL) {
-        SVR_log(SVR_ERROR, Util_format("Error creating source '%s'", name));
+        SVR_logf(SVR_ERROR, "Error creating source '%s'", name);
         free(source_data);
         return NULL;
     }
@@ -86,24 +86,40 @@ static SVRD_Source* TestSource_open(const char* name, Dictionary* arguments) {
 static void* TestSource_background(void* _source) {
     SVRD_Source* source = (SVRD_Source*) _source;
     SVRD_TestSource* source_data = (SVRD_TestSource*) source->private_data;
+    SVR_FrameProperties* frame_properties;
+    SVRD_SourceDemand demand;
     IplImage* frame;
     int width = source_data->width;
     int height = source_data->height;
+    int rate;
     int block_x = 0;
     int block_y = 0;
-    float sleep = 0;
     CvScalar colors[] = {CV_RGB(255, 0, 0),
                          CV_RGB(0, 255, 0),
                          CV_RGB(0, 0, 255)
     };
 
-    frame = SVR_FrameProperties_imageFromProperties(SVRD_Source_getFrameProperties(source));
-
-    if(source_data->rate > 0) {
-        sleep = 1.0 / source_data->rate;
-    }
+    frame_properties = SVR_FrameProperties_clone(SVRD_Source_getFrameProperties(source));
+    frame = SVR_FrameProperties_imageFromProperties(frame_properties);
 
     while(source_data->close == false) {
+        if(SVRD_Source_waitForDemand(source, &demand) == false) {
+            break;
+        }
+
+        /* Generate frames no larger than any stream needs */
+        width = Util_min(demand.width, source_data->width);
+        height = Util_min(demand.height, source_data->height);
+        if(width != frame->width || height != frame->height) {
+            cvReleaseImage(&frame);
+            frame_properties->width = width;
+            frame_properties->height = height;
+            frame = SVR_FrameProperties_imageFromProperties(frame_properties);
+            SVRD_Source_setCaptureSize(source, width, height);
+            block_x = 0;
+            block_y = 0;
+        }
+
         /* Generate image with a colored rectangle that moves */
         cvSetImageROI(frame, cvRect(0, 0, width, height));
         cvSet(frame, CV_RGB(0, 0, 0), NULL);
@@ -117,10 +133,16 @@ static void* TestSource_background(void* _source) {
         }
 
         SVRD_Source_provideData(source, (void*) frame->imageData, frame->imageSize);
-        Util_usleep(sleep);
+
+        rate = source_data->rate;
+        if(demand.rate > 0 && (rate <= 0 || demand.rate < rate)) {
+            rate = demand.rate;
+        }
+        SVRD_Source_throttle(source, rate);
     }
 
     cvReleaseImage(&frame);
+    SVR_FrameProperties_destroy(frame_properties);
 
     return NULL;
 }
@@ -42,10 +42,19 @@ typedef struct {
     unsigned int buffer_count;
     pthread_t thread;
     bool close;
+
+    /* Whether the device is streaming. Streaming is stopped while no stream
+       is reading from the source */
+    bool streaming;
+
+    /* Time the next frame should be decoded when a stream limits the rate */
+    struct timespec next_decode;
 } SVRD_V4LSource;
 
 static bool V4LSource_get_frame(SVRD_Source* source, struct v4l2_buffer* buf);
 static void V4LSource_enqueue(SVRD_Source* source_data, struct v4l2_buffer* buf);
+static bool V4LSource_set_streaming(SVRD_Source* source, bool streaming);
+static bool V4LSource_frame_due(SVRD_V4LSource* source_data, int rate);
 static void* V4LSource_background(void* _source);
 static void V4LSource_close_data(SVRD_V4LSource* source_data, const char* name, bool show_errors);
 
@@ -69,7 +78,7 @@ static SVRD_Source* V4LSource_open(const char* name, Dictionary* arguments) {
     /* Open device */
 
     if(!Dictionary_exists(arguments, "dev")) {
-        SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": dev argument must be specified", name));
+        SVR_logf(SVR_ERROR, "Error opening \"%s\": dev argument must be specified", name);
         return NULL;
     }
 
@@ -77,29 +86,29 @@ static SVRD_Source* V4LSource_open(const char* name, Dictionary* arguments) {
     if(stat(dev, &st) == -1) {
         switch (errno) {
             case EACCES:
-                SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Access denied for deviec: \"%s\"", name, dev));
+                SVR_logf(SVR_ERROR, "Error opening \"%s\": Access denied for deviec: \"%s\"", name, dev);
             break;
             case ENAMETOOLONG:
-                SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Device filename too long", name));
+                SVR_logf(SVR_ERROR, "Error opening \"%s\": Device filename too long", name);
             break;
             case ENOENT:
             case ENOTDIR:
-                SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Device not Found: \"%s\"", name, dev));
+                SVR_logf(SVR_ERROR, "Error opening \"%s\": Device not Found: \"%s\"", name, dev);
             break;
             default:
-                SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": stat call on \"%s\" failed (errno %d)", name, dev, errno));
+                SVR_logf(SVR_ERROR, "Error opening \"%s\": stat call on \"%s\" failed (errno %d)", name, dev, errno);
         }
         return NULL;
     }
 
     if(!S_ISCHR(st.st_mode)) {
-        SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": \"%s\" is not a video device.  Try /dev/video[0-63] or /dev/video", name, dev));
+        SVR_logf(SVR_ERROR, "Error opening \"%s\": \"%s\" is not a video device.  Try /dev/video[0-63] or /dev/video", name, dev);
         return NULL;
     }
 
     source_data->fd = open(dev, O_RDWR | O_NONBLOCK, 0);
     if(source_data->fd == -1) {
-        SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Open call on \"%s\" failed (errno %d)", name, dev, errno));
+        SVR_logf(SVR_ERROR, "Error opening \"%s\": Open call on \"%s\" failed (errno %d)", name, dev, errno);
         return NULL;
     }
 
@@ -107,22 +116,22 @@ static SVRD_Source* V4LSource_open(const char* name, Dictionary* arguments) {
 
     if(ioctl(source_data->fd, VIDIOC_QUERYCAP, &cap) == -1) {
         if(errno == EINVAL) {
-            SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Not a V4L2 device: %s", name, dev));
+            SVR_logf(SVR_ERROR, "Error opening \"%s\": Not a V4L2 device: %s", name, dev);
         } else {
-            SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": VIDIOC_QUERYCAP failed (ioctl errno %d)", name, errno));
+            SVR_logf(SVR_ERROR, "Error opening \"%s\": VIDIOC_QUERYCAP failed (ioctl errno %d)", name, errno);
         }
         V4LSource_close_data(source_data, name, false);
         return NULL;
     }
 
     if(!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)) {
-        SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Not a V4L2 device: %s", name, dev));
+        SVR_logf(SVR_ERROR, "Error opening \"%s\": Not a V4L2 device: %s", name, dev);
         V4LSource_close_data(source_data, name, false);
         return NULL;
     }
 
     if(!(cap.capabilities & V4L2_CAP_STREAMING)) {
-        SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Device does not support streaming", name));
+        SVR_logf(SVR_ERROR, "Error opening \"%s\": Device does not support streaming", name);
         V4LSource_close_data(source_data, name, false);
         return NULL;
     }
@@ -139,7 +148,7 @@ static SVRD_Source* V4LSource_open(const char* name, Dictionary* arguments) {
 
         if(ioctl(source_data->fd, VIDIOC_S_FMT, &format) == -1) {
             if(errno == EBUSY) {
-                SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Device is busy: \"%s\"", name, dev));
+                SVR_logf(SVR_ERROR, "Error opening \"%s\": Device is busy: \"%s\"", name, dev);
                 V4LSource_close_data(source_data, name, false);
                 return NULL;
             }
@@ -150,7 +159,7 @@ static SVRD_Source* V4LSource_open(const char* name, Dictionary* arguments) {
 
     }
     if(n>=sizeof(format_order)) {
-        SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Device does not support any implemented pixel formats", name));
+        SVR_logf(SVR_ERROR, "Error opening \"%s\": Device does not support any implemented pixel formats", name);
         V4LSource_close_data(source_data, name, false);
         return NULL;
     }
@@ -164,9 +173,9 @@ static SVRD_Source* V4LSource_open(const char* name, Dictionary* arguments) {
 
     if(ioctl(source_data->fd, VIDIOC_REQBUFS, &buffer_request) == -1) {
         if(errno == EINVAL) {
-            SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Device does not support memory mapping", name));
+            SVR_logf(SVR_ERROR, "Error opening \"%s\": Device does not support memory mapping", name);
         } else {
-            SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Buffer memory request failed (ioctl errno %d)", name, errno));
+            SVR_logf(SVR_ERROR, "Error opening \"%s\": Buffer memory request failed (ioctl errno %d)", name, errno);
         }
         V4LSource_close_data(source_data, name, false);
         return NULL;
@@ -174,14 +183,14 @@ static SVRD_Source* V4LSource_open(const char* name, Dictionary* arguments) {
     source_data->buffer_count = buffer_request.count;
 
     if(source_data->buffer_count < 2) {
-        SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Device has insufficient buffer memory", name));
+        SVR_logf(SVR_ERROR, "Error opening \"%s\": Device has insufficient buffer memory", name);
         V4LSource_close_data(source_data, name, false);
         return NULL;
     }
 
     source_data->buffers = calloc(source_data->buffer_count, sizeof(struct v4l2_buffer));
     if(source_data->buffers == NULL) {
-        SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Not enough memory for buffers available on device", name));
+        SVR_logf(SVR_ERROR, "Error opening \"%s\": Not enough memory for buffers available on device", name);
         V4LSource_close_data(source_data, name, false);
         return NULL;
     }
@@ -194,7 +203,7 @@ static SVRD_Source* V4LSource_open(const char* name, Dictionary* arguments) {
         buf.index = n;
 
         if(ioctl(source_data->fd, VIDIOC_QUERYBUF, &buf) == -1) {
-            SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Could not set up buffers (ioctl errno %d)", name, errno));
+            SVR_logf(SVR_ERROR, "Error opening \"%s\": Could not set up buffers (ioctl errno %d)", name, errno);
             V4LSource_close_data(source_data, name, false);
             return NULL;
         }
@@ -203,7 +212,7 @@ static SVRD_Source* V4LSource_open(const char* name, Dictionary* arguments) {
         source_data->buffers[n].start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, source_data->fd, buf.m.offset);
 
         if(source_data->buffers[n].start == MAP_FAILED) {
-            SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Memory map failed", name));
+            SVR_logf(SVR_ERROR, "Error opening \"%s\": Memory map failed", name);
             V4LSource_close_data(source_data, name, false);
             return NULL;
         }
@@ -219,7 +228,7 @@ static SVRD_Source* V4LSource_open(const char* name, Dictionary* arguments) {
         buf.index = n;
 
         if(ioctl(source_data->fd, VIDIOC_QBUF, &buf) == -1) {
-            SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Could not enqueue initial buffers (ioctl errno %d)", name, errno));
+            SVR_logf(SVR_ERROR, "Error opening \"%s\": Could not enqueue initial buffers (ioctl errno %d)", name, errno);
             V4LSource_close_data(source_data, name, false);
             return NULL;
         }
@@ -228,10 +237,11 @@ static SVRD_Source* V4LSource_open(const char* name, Dictionary* arguments) {
 
     /* Stream On */
     if(ioctl(source_data->fd, VIDIOC_STREAMON, &buf.type) == -1) {
-        SVR_log(SVR_ERROR, Util_format("Error opening \"%s\": Could not turn on stream (ioctl errno %d)", name, errno));
+        SVR_logf(SVR_ERROR, "Error opening \"%s\": Could not turn on stream (ioctl errno %d)", name, errno);
         V4LSource_close_data(source_data, name, false);
         return NULL;
     }
+    source_data->streaming = true;
 
     /* Create source */
 
@@ -247,7 +257,7 @@ static SVRD_Source* V4LSource_open(const char* name, Dictionary* arguments) {
     SVR_FrameProperties_destroy(frame_properties);
 
     if(source == NULL) {
-        SVR_log(SVR_ERROR, Util_format("Error creating source '%s'", name));
+        SVR_logf(SVR_ERROR, "Error creating source '%s'", name);
         V4LSource_close_data(source_data, name, true);
         return NULL;
     }
@@ -261,25 +271,46 @@ static SVRD_Source* V4LSource_open(const char* name, Dictionary* arguments) {
 static void* V4LSource_background(void* _source) {
     SVRD_Source* source = (SVRD_Source*) _source;
     SVRD_V4LSource* source_data = (SVRD_V4LSource*) source->private_data;
+    SVRD_SourceDemand demand;
     struct v4l2_buffer buf;
     bool ret;
     IplImage* frame;
     CvMat mat;
 
     while(source_data->close == false) {
+        /* Turn the device off while nobody is reading */
+        SVRD_Source_getDemand(source, &demand);
+        if(demand.streams == 0 && source_data->streaming) {
+            V4LSource_set_streaming(source, false);
+        }
+
+        if(SVRD_Source_waitForDemand(source, &demand) == false) {
+            break;
+        }
+
+        if(source_data->streaming == false && V4LSource_set_streaming(source, true) == false) {
+            Util_usleep(1.0);
+            continue;
+        }
+
         ret = V4LSource_get_frame(source, &buf);
         if(ret) {
 
-            /* Convert image to bgr
-             * For now this converts from mjpeg to bgr, but in the future more
-             * formats may be implemented.
-             */
-            mat = cvMat(source->frame_properties->width, source->frame_properties->height, CV_8UC1, source_data->buffers[buf.index].start);
-            frame = cvDecodeImage(&mat, 1);
+            /* Frames beyond the rate any stream needs are handed straight
+               back to the device without being decoded */
+            if(V4LSource_frame_due(source_data, demand.rate)) {
+                /* Convert image to bgr
+                 * For now this converts from mjpeg to bgr, but in the future more
+                 * formats may be implemented.
+                 */
+                mat = cvMat(1, buf.bytesused, CV_8UC1, source_data->buffers[buf.index].start);
+                frame = cvDecodeImage(&mat, 1);
+
+                SVRD_Source_provideData(source, (void*) frame->imageData, frame->imageSize);
+                cvReleaseImage(&frame);
+            }
 
-            SVRD_Source_provideData(source, (void*) frame->imageData, frame->imageSize);
             V4LSource_enqueue(source, &buf);
-            cvReleaseImage(&frame);
 
         } else {
             Util_usleep(1.0);
@@ -309,11 +340,11 @@ static bool V4LSource_get_frame(SVRD_Source* source, struct v4l2_buffer* buf) {
             /* Signal was caught */
             return false;
         }
-        SVR_log(SVR_ERROR, Util_format("Select error on camera \"%s\"", source->name));
+        SVR_logf(SVR_ERROR, "Select error on camera \"%s\"", source->name);
         return false;
     }
     if(ret == 0) {
-        SVR_log(SVR_ERROR, Util_format("Select timeout on camera \"%s\"", source->name));
+        SVR_logf(SVR_ERROR, "Select timeout on camera \"%s\"", source->name);
         return false;
     }
 
@@ -331,14 +362,14 @@ static bool V4LSource_get_frame(SVRD_Source* source, struct v4l2_buffer* buf) {
             /* Try again later */
             return false;
         } else {
-            SVR_log(SVR_ERROR, Util_format("Error capturing \"%s\": Dequeing buffer failed (ioctl errno %d)", source->name, errno));
+            SVR_logf(SVR_ERROR, "Error capturing \"%s\": Dequeing buffer failed (ioctl errno %d)", source->name, errno);
             return false;
         }
 
     }
 
     if(buf->index >= source_data->buffer_count) {
-        SVR_log(SVR_ERROR, Util_format("Error capturing \"%s\": Dequeing buffer failed, invalid buffer index", source->name));
+        SVR_logf(SVR_ERROR, "Error capturing \"%s\": Dequeing buffer failed, invalid buffer index", source->name);
         V4LSource_enqueue(source, buf);
         return false;
     }
@@ -350,8 +381,75 @@ static bool V4LSource_get_frame(SVRD_Source* source, struct v4l2_buffer* buf) {
 static void V4LSource_enqueue(SVRD_Source* source, struct v4l2_buffer* buf) {
     SVRD_V4LSource* source_data = (SVRD_V4LSource*) source->private_data;
     if(ioctl(source_data->fd, VIDIOC_QBUF, buf) == -1) {
-        SVR_log(SVR_ERROR, Util_format("Error capturing \"%s\": Enqueing buffer failed (ioctl errno %d)", source->name, errno));
+        SVR_logf(SVR_ERROR, "Error capturing \"%s\": Enqueing buffer failed (ioctl errno %d)", source->name, errno);
+    }
+}
+
+static bool V4LSource_set_streaming(SVRD_Source* source, bool streaming) {
+    SVRD_V4LSource* source_data = (SVRD_V4LSource*) source->private_data;
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    struct v4l2_buffer buf;
+
+    if(streaming == false) {
+        /* Stream off also dequeues every buffer */
+        if(ioctl(source_data->fd, VIDIOC_STREAMOFF, &type) == -1) {
+            SVR_logf(SVR_ERROR, "Error stopping \"%s\": Could not turn off stream (ioctl errno %d)", source->name, errno);
+            return false;
+        }
+
+        source_data->streaming = false;
+        SVR_logf(SVR_DEBUG, "Stopped idle camera \"%s\"", source->name);
+        return true;
+    }
+
+    for(unsigned int n = 0; n < source_data->buffer_count; n++) {
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = n;
+
+        if(ioctl(source_data->fd, VIDIOC_QBUF, &buf) == -1) {
+            SVR_logf(SVR_ERROR, "Error starting \"%s\": Could not enqueue buffers (ioctl errno %d)", source->name, errno);
+            return false;
+        }
+    }
+
+    if(ioctl(source_data->fd, VIDIOC_STREAMON, &type) == -1) {
+        SVR_logf(SVR_ERROR, "Error starting \"%s\": Could not turn on stream (ioctl errno %d)", source->name, errno);
+        return false;
+    }
+
+    source_data->streaming = true;
+    SVR_logf(SVR_DEBUG, "Started camera \"%s\"", source->name);
+    return true;
+}
+
+static bool V4LSource_frame_due(SVRD_V4LSource* source_data, int rate) {
+    struct timespec now;
+    struct timespec* next = &source_data->next_decode;
+
+    if(rate <= 0) {
+        return true;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(now.tv_sec < next->tv_sec || (now.tv_sec == next->tv_sec && now.tv_nsec < next->tv_nsec)) {
+        return false;
     }
+
+    /* Schedule the next frame from the deadline rather than from now so the
+       average rate matches even though frames arrive at the camera's pace */
+    next->tv_nsec += 1000000000L / rate;
+    if(next->tv_nsec >= 1000000000L) {
+        next->tv_sec += 1;
+        next->tv_nsec -= 1000000000L;
+    }
+
+    if(now.tv_sec > next->tv_sec || (now.tv_sec == next->tv_sec && now.tv_nsec >= next->tv_nsec)) {
+        *next = now;
+    }
+
+    return true;
 }
 
 static void V4LSource_close(SVRD_Source* source) {
@@ -373,7 +471,7 @@ static void V4LSource_close_data(SVRD_V4LSource* source_data, const char* name,
     if(source_data->fd) {
         type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         if(ioctl(source_data->fd, VIDIOC_STREAMOFF, &type) == -1 && show_errors) {
-                SVR_log(SVR_ERROR, Util_format("Error closing \"%s\": Could not turn off stream (ioctl errno %d)", name, errno));
+                SVR_logf(SVR_ERROR, "Error closing \"%s\": Could not turn off stream (ioctl errno %d)", name, errno);
         }
 
     }
@@ -383,7 +481,7 @@ static void V4LSource_close_data(SVRD_V4LSource* source_data, const char* name,
         for(i=0; i<source_data->buffer_count; i++) {
             if(munmap(source_data->buffers[i].start, source_data->buffers[i].length) == -1 && !munmap_error && show_errors) {
                 munmap_error = true;
-                SVR_log(SVR_ERROR, Util_format("Error closing \"%s\": Could not unmap memory (munmap errno %d)", name, errno));
+                SVR_logf(SVR_ERROR, "Error closing \"%s\": Could not unmap memory (munmap errno %d)", name, errno);
             }
         }
         free(source_data->buffers);
@@ -2,13 +2,33 @@
 #include <svr.h>
 #include <svrd.h>
 
+#include <math.h>
+
 static void SVRD_Stream_initializeEncoder(SVRD_Stream* stream);
+static SVR_Encoding* SVRD_Stream_resolveAutoEncoding(SVRD_Stream* stream);
 static void SVRD_Stream_reallocateTemporaryFrames(SVRD_Stream* stream);
 static IplImage* SVRD_Stream_preprocessFrame(SVRD_Stream* stream, IplImage* frame);
+static bool SVRD_Stream_waitForTurn(SVRD_Stream* stream);
+static bool SVRD_Stream_frameExpired(SVRD_Stream* stream, SVRD_SourceFrame* source_frame);
+static bool SVRD_Stream_canPassThrough(SVRD_Stream* stream, SVRD_SourceFrame* source_frame);
+static void SVRD_Stream_applyDegradeLevel(SVRD_Stream* stream, int level);
+static void SVRD_Stream_updateCpuTime(SVRD_Stream* stream, uint64_t base);
+static void SVRD_Stream_adaptToLink(SVRD_Stream* stream);
+static void SVRD_Stream_recordSend(SVRD_Stream* stream, size_t frame_size);
+static void SVRD_Stream_resetLinkEstimate(SVRD_Stream* stream);
+static void SVRD_Stream_setBandwidthWeight(SVRD_Stream* stream, int weight);
+static void SVRD_Stream_decaySendRate(SVRD_Stream* stream);
+static bool SVRD_Stream_admitFrame(SVRD_Stream* stream);
+static void SVRD_Stream_chargeFrame(SVRD_Stream* stream, size_t frame_size);
 static void* SVRD_Stream_worker(void* _stream);
 
+/* List of all streams, for the overload controller */
+static List* streams = NULL;
+static pthread_mutex_t global_streams_lock = PTHREAD_MUTEX_INITIALIZER;
+
 SVRD_Stream* SVRD_Stream_new(const char* name) {
     SVRD_Stream* stream = malloc(sizeof(SVRD_Stream));
+    pthread_condattr_t wakeup_attr;
 
     stream->client = NULL;
     stream->name = strdup(name);
@@ -19,6 +39,7 @@ SVRD_Stream* SVRD_Stream_new(const char* name) {
     stream->encoder = NULL;
     stream->encoding = NULL;
     stream->encoding_options = NULL;
+    stream->auto_encoding = false;
 
     stream->payload_buffer_size = 8 * 1024;
     stream->payload_buffer = malloc(stream->payload_buffer_size);
@@ -30,6 +51,39 @@ SVRD_Stream* SVRD_Stream_new(const char* name) {
 
     stream->drop_counter = 0;
     stream->drop_rate = 0;
+    stream->max_rate = 0;
+    stream->pull_mode = false;
+    stream->frames_requested = 0;
+
+    stream->max_age = 0;
+    stream->frames_sent = 0;
+    stream->frames_dropped = 0;
+    stream->frames_expired = 0;
+
+    /* Frame deadlines are in monotonic time */
+    pthread_condattr_init(&wakeup_attr);
+    pthread_condattr_setclock(&wakeup_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&stream->wakeup, &wakeup_attr);
+    pthread_condattr_destroy(&wakeup_attr);
+
+    stream->input_width = 0;
+    stream->input_height = 0;
+
+    stream->cpu_time = 0;
+    stream->last_cpu_time = 0;
+    stream->load = 0;
+    stream->target_level = 0;
+    stream->degrade_level = 0;
+    stream->degraded_options = NULL;
+    stream->requested_width = 0;
+    stream->requested_height = 0;
+
+    SVRD_Stream_resetLinkEstimate(stream);
+
+    stream->bandwidth_weight = 0;
+    stream->send_rate = 0;
+
+    stream->transport = NULL;
 
     memset(&stream->worker, 1, sizeof(pthread_t));
     stream->worker_started = false;
@@ -39,6 +93,13 @@ SVRD_Stream* SVRD_Stream_new(const char* name) {
     /* Set default encoding */
     SVRD_Stream_setEncoding(stream, "raw");
 
+    SVRD_acquireGlobalStreamsLock();
+    if(streams == NULL) {
+        streams = List_new();
+    }
+    List_append(streams, stream);
+    SVRD_releaseGlobalStreamsLock();
+
     return stream;
 }
 
@@ -51,6 +112,11 @@ void SVRD_Stream_setClient(SVRD_Stream* stream, SVRD_Client* client) {
 
     stream->client = client;
     SVR_REF(stream->client);
+
+    /* The link frames are sent over has changed */
+    if(stream->auto_encoding && stream->state == SVR_PAUSED) {
+        stream->encoding = SVRD_Stream_resolveAutoEncoding(stream);
+    }
     SVR_UNLOCK(stream);
 }
 
@@ -60,7 +126,15 @@ static void SVRD_Stream_initializeEncoder(SVRD_Stream* stream) {
         SVR_Encoder_destroy(stream->encoder);
     }
 
-    stream->encoder = SVR_Encoder_new(stream->encoding, stream->encoding_options, stream->frame_properties);
+    if(stream->degraded_options) {
+        stream->encoder = SVR_Encoder_new(stream->encoding, stream->degraded_options, stream->frame_properties);
+    } else {
+        stream->encoder = SVR_Encoder_new(stream->encoding, stream->encoding_options, stream->frame_properties);
+    }
+
+    if(stream->link_frame_size) {
+        SVR_Encoder_setTargetFrameSize(stream->encoder, stream->link_frame_size);
+    }
     SVR_UNLOCK(stream);
 }
 
@@ -80,6 +154,8 @@ int SVRD_Stream_attachSource(SVRD_Stream* stream, SVRD_Source* source) {
     }
 
     stream->frame_properties = SVR_FrameProperties_clone(SVRD_Source_getFrameProperties(source));
+    stream->input_width = stream->frame_properties->width;
+    stream->input_height = stream->frame_properties->height;
 
     return SVR_SUCCESS;
 }
@@ -126,7 +202,12 @@ int SVRD_Stream_setEncoding(SVRD_Stream* stream, const char* encoding_descriptor
         return SVR_PARSEERROR;
     }
 
-    encoding = SVR_Encoding_getByName(Dictionary_get(options, "%name"));
+    if(strcmp(Dictionary_get(options, "%name"), "auto") == 0) {
+        encoding = SVRD_Stream_resolveAutoEncoding(stream);
+    } else {
+        encoding = SVR_Encoding_getByName(Dictionary_get(options, "%name"));
+    }
+
     if(encoding == NULL) {
         SVR_freeParsedOptionString(options);
         return SVR_NOSUCHENCODING;
@@ -137,10 +218,28 @@ int SVRD_Stream_setEncoding(SVRD_Stream* stream, const char* encoding_descriptor
     }
     stream->encoding = encoding;
     stream->encoding_options = options;
+    stream->auto_encoding = (strcmp(Dictionary_get(options, "%name"), "auto") == 0);
 
     return SVR_SUCCESS;
 }
 
+/**
+ * Choose the encoding for a stream set to "auto" from the connection to its
+ * client. A multicast channel may reach receivers on other machines, so it is
+ * always treated as remote. The options given with "auto" are passed to the
+ * chosen encoding
+ */
+static SVR_Encoding* SVRD_Stream_resolveAutoEncoding(SVRD_Stream* stream) {
+    bool multicast = (stream->transport && stream->transport->type == SVRD_TRANSPORT_MULTICAST);
+    bool local = (!multicast && stream->client && SVR_Net_isLocal(stream->client->socket));
+    SVR_Encoding* encoding = SVR_Encoding_getAuto(local);
+
+    SVR_logf(SVR_DEBUG, "Using %s encoding for stream %s over a %s connection",
+                        encoding->name, stream->name, local ? "local" : "remote");
+
+    return encoding;
+}
+
 /* Only process 1 of every rate frames */
 int SVRD_Stream_setDropRate(SVRD_Stream* stream, int rate) {
     stream->drop_rate = rate;
@@ -149,25 +248,187 @@ int SVRD_Stream_setDropRate(SVRD_Stream* stream, int rate) {
     return SVR_SUCCESS;
 }
 
+/**
+ * \brief Limit the frame rate of a stream
+ *
+ * Frames are sent at most rate times per second, paced against absolute
+ * deadlines. Frames arriving from the source in between are skipped without
+ * being preprocessed or encoded, and the source is asked for no more frames
+ * than its fastest stream needs.
+ *
+ * \param stream The stream
+ * \param rate Maximum rate in frames per second, or 0 for no limit
+ */
+int SVRD_Stream_setMaxRate(SVRD_Stream* stream, int rate) {
+    if(rate < 0) {
+        return SVR_INVALIDARGUMENT;
+    }
+
+    SVR_LOCK(stream);
+    stream->max_rate = rate;
+    clock_gettime(CLOCK_MONOTONIC, &stream->next_frame_time);
+    pthread_cond_broadcast(&stream->wakeup);
+    SVR_UNLOCK(stream);
+
+    return SVR_SUCCESS;
+}
+
+/**
+ * \brief Set the maximum age of frames sent by a stream
+ *
+ * Frames older than max_age milliseconds, measured from capture, are discarded
+ * and counted instead of being sent. Age is checked when the frame is taken
+ * from the source, before it is encoded, and before it is sent.
+ *
+ * \param stream The stream
+ * \param max_age Maximum age in milliseconds, or 0 to send frames of any age
+ */
+int SVRD_Stream_setMaxAge(SVRD_Stream* stream, int max_age) {
+    if(max_age < 0) {
+        return SVR_INVALIDARGUMENT;
+    }
+
+    stream->max_age = max_age;
+    return SVR_SUCCESS;
+}
+
+/**
+ * \brief Switch a stream between push and pull mode
+ *
+ * In pull mode a frame is only preprocessed, encoded and sent after the client
+ * requests one with SVRD_Stream_requestFrame. Requests made before switching
+ * are discarded.
+ *
+ * \param stream The stream
+ * \param pull_mode True for pull mode, false to send every frame
+ */
+int SVRD_Stream_setPullMode(SVRD_Stream* stream, bool pull_mode) {
+    SVR_LOCK(stream);
+    stream->pull_mode = pull_mode;
+    stream->frames_requested = 0;
+    pthread_cond_broadcast(&stream->wakeup);
+    SVR_UNLOCK(stream);
+
+    return SVR_SUCCESS;
+}
+
+/**
+ * \brief Request a frame from a stream in pull mode
+ *
+ * The next frame from the source is sent to the client. Requests accumulate,
+ * so a client may keep several frames in flight.
+ *
+ * \param stream The stream
+ */
+int SVRD_Stream_requestFrame(SVRD_Stream* stream) {
+    SVR_LOCK(stream);
+    if(stream->pull_mode == false) {
+        SVR_UNLOCK(stream);
+        return SVR_INVALIDSTATE;
+    }
+
+    stream->frames_requested++;
+    pthread_cond_broadcast(&stream->wakeup);
+    SVR_UNLOCK(stream);
+
+    return SVR_SUCCESS;
+}
+
+/**
+ * \brief Set the priority of a stream
+ *
+ * When the server is overloaded the lowest priority streams are degraded first
+ * and restored last. Higher values are more important.
+ *
+ * \param stream The stream
+ * \param priority The new priority
+ */
 int SVRD_Stream_setPriority(SVRD_Stream* stream, short priority) {
+    SVR_LOCK(stream);
     stream->priority = priority;
+    if(stream->state == SVR_UNPAUSED) {
+        SVRD_Stream_setBandwidthWeight(stream, Util_max(priority, 1));
+    }
+    SVR_UNLOCK(stream);
+
     return SVR_SUCCESS;
 }
 
+/**
+ * Set the weight the stream adds to the bandwidth limits it draws from. The
+ * weight is its priority while running, and 0 while paused
+ */
+static void SVRD_Stream_setBandwidthWeight(SVRD_Stream* stream, int weight) {
+    int change = weight - stream->bandwidth_weight;
+
+    if(change) {
+        SVRD_Bandwidth_addWeight(SVRD_Bandwidth_getServer(), change);
+        SVRD_Bandwidth_addWeight(stream->client->bandwidth, change);
+        stream->bandwidth_weight = weight;
+    }
+}
+
+/**
+ * \brief Degrade a stream one level further
+ *
+ * Ask the worker to lower the cost of the stream by one level. The lower JPEG
+ * quality level is skipped for other encodings.
+ *
+ * \param stream The stream
+ * \return False if the stream is paused or already at the highest level
+ */
+bool SVRD_Stream_degrade(SVRD_Stream* stream) {
+    bool degraded = false;
+
+    SVR_LOCK(stream);
+    if(stream->state == SVR_UNPAUSED && stream->target_level < SVRD_STREAM_MAX_DEGRADE_LEVEL) {
+        stream->target_level++;
+        if(stream->target_level == 2 && strcmp(stream->encoding->name, "jpeg") != 0) {
+            stream->target_level++;
+        }
+        degraded = true;
+    }
+    SVR_UNLOCK(stream);
+
+    return degraded;
+}
+
+/**
+ * \brief Restore a degraded stream by one level
+ *
+ * \param stream The stream
+ * \return False if the stream is paused or not degraded
+ */
+bool SVRD_Stream_restore(SVRD_Stream* stream) {
+    bool restored = false;
+
+    SVR_LOCK(stream);
+    if(stream->state == SVR_UNPAUSED && stream->target_level > 0) {
+        stream->target_level--;
+        if(stream->target_level == 2 && strcmp(stream->encoding->name, "jpeg") != 0) {
+            stream->target_level--;
+        }
+        restored = true;
+    }
+    SVR_UNLOCK(stream);
+
+    return restored;
+}
+
 static void SVRD_Stream_reallocateTemporaryFrames(SVRD_Stream* stream) {
     SVR_FrameProperties* source_frame_properties = SVRD_Source_getFrameProperties(stream->source);
     SVR_FrameProperties* temp_frame_properties;
 
-    bool resize = (stream->frame_properties->width != source_frame_properties->width ||
-                   stream->frame_properties->height != source_frame_properties->height);
+    bool resize = (stream->frame_properties->width != stream->input_width ||
+                   stream->frame_properties->height != stream->input_height);
     bool color_convert = (stream->frame_properties->channels != source_frame_properties->channels);
 
     if(stream->temp_frame[0]) {
-        cvReleaseImage(&stream->temp_frame[0]);
+        SVR_FramePool_returnFrame(stream->temp_frame[0]);
     }
 
     if(stream->temp_frame[1]) {
-        cvReleaseImage(&stream->temp_frame[1]);
+        SVR_FramePool_returnFrame(stream->temp_frame[1]);
     }
 
     stream->temp_frame[0] = NULL;
@@ -177,12 +438,12 @@ static void SVRD_Stream_reallocateTemporaryFrames(SVRD_Stream* stream) {
         temp_frame_properties = SVR_FrameProperties_clone(stream->frame_properties);
         temp_frame_properties->channels = source_frame_properties->channels;
 
-        stream->temp_frame[0] = SVR_FrameProperties_imageFromProperties(temp_frame_properties);
-        stream->temp_frame[1] = SVR_FrameProperties_imageFromProperties(stream->frame_properties);
+        stream->temp_frame[0] = SVR_FramePool_getFrame(temp_frame_properties);
+        stream->temp_frame[1] = SVR_FramePool_getFrame(stream->frame_properties);
 
         SVR_FrameProperties_destroy(temp_frame_properties);
     } else if(resize || color_convert) {
-        stream->temp_frame[0] = SVR_FrameProperties_imageFromProperties(stream->frame_properties);
+        stream->temp_frame[0] = SVR_FramePool_getFrame(stream->frame_properties);
     }
 }
 
@@ -199,6 +460,61 @@ int SVRD_Stream_resize(SVRD_Stream* stream, int width, int height) {
     return SVR_SUCCESS;
 }
 
+/**
+ * \brief Choose how frames of a stream are delivered
+ *
+ * Frames are sent over the client connection ("tcp"), as datagrams to a UDP
+ * port of the client ("udp"), or as datagrams to a multicast group shared with
+ * other streams ("multicast"). The stream must be paused.
+ *
+ * \param stream The stream
+ * \param type One of "tcp", "udp" or "multicast"
+ * \param group Multicast group address, for the multicast transport
+ * \param port UDP port, for the udp and multicast transports
+ * \return An SVR return code
+ */
+int SVRD_Stream_setTransport(SVRD_Stream* stream, const char* type, const char* group, int port) {
+    SVRD_Transport* transport = NULL;
+
+    if(stream->state == SVR_UNPAUSED) {
+        return SVR_INVALIDSTATE;
+    }
+
+    if(strcmp(type, "udp") == 0) {
+        transport = SVRD_Transport_newUnicast(stream->client, port);
+        if(transport == NULL) {
+            return SVR_INVALIDARGUMENT;
+        }
+    } else if(strcmp(type, "multicast") == 0) {
+        transport = SVRD_Transport_joinMulticast(stream, group, port);
+        if(transport == NULL) {
+            return SVR_INVALIDARGUMENT;
+        }
+    } else if(strcmp(type, "tcp") != 0) {
+        return SVR_INVALIDARGUMENT;
+    }
+
+    /* The previous worker may still be sending over the old channel */
+    if(stream->worker_started) {
+        pthread_join(stream->worker, NULL);
+        stream->worker_started = false;
+    }
+
+    SVR_LOCK(stream);
+    if(stream->transport) {
+        SVRD_Transport_release(stream->transport, stream);
+    }
+    stream->transport = transport;
+
+    /* The link frames are sent over has changed */
+    if(stream->auto_encoding) {
+        stream->encoding = SVRD_Stream_resolveAutoEncoding(stream);
+    }
+    SVR_UNLOCK(stream);
+
+    return SVR_SUCCESS;
+}
+
 int SVRD_Stream_setChannels(SVRD_Stream* stream, int channels) {
     if(channels != 1 && channels != 3) {
         return SVR_INVALIDARGUMENT;
@@ -229,32 +545,75 @@ void SVRD_Stream_pause(SVRD_Stream* stream) {
         return;
     }
     stream->state = SVR_PAUSED;
+    SVRD_Stream_setBandwidthWeight(stream, 0);
+    pthread_cond_broadcast(&stream->wakeup);
     SVR_UNLOCK(stream);
 
     /* Request that the source dismiss the streams getFrame request */
+    SVRD_Source_removeConsumer(stream->source, stream);
     SVRD_Source_dismissPausedStreams(stream->source);
 }
 
-void SVRD_Stream_unpause(SVRD_Stream* stream) {
+/**
+ * \brief Unpause a stream
+ *
+ * Start the delivery of frame data. While the server is overloaded a stream is
+ * only admitted if a stream of lower priority can still be degraded.
+ *
+ * \param stream The stream to unpause
+ * \return SVR_OVERLOADED if the stream was refused, SVR_SUCCESS otherwise
+ */
+int SVRD_Stream_unpause(SVRD_Stream* stream) {
+    if(stream->state == SVR_UNPAUSED) {
+        return SVR_SUCCESS;
+    }
+
+    /* Collect the worker of a previous run, which exits once paused */
+    if(stream->worker_started) {
+        pthread_join(stream->worker, NULL);
+        stream->worker_started = false;
+    }
+
+    if(SVRD_Controller_admit(stream, stream->priority) == false) {
+        return SVR_OVERLOADED;
+    }
+
     SVR_LOCK(stream);
     if(stream->state == SVR_PAUSED && stream->client != NULL &&
        stream->encoding != NULL && stream->source != NULL) {
         stream->state = SVR_UNPAUSED;
+        stream->target_level = 0;
+        stream->degrade_level = 0;
+        stream->requested_width = stream->frame_properties->width;
+        stream->requested_height = stream->frame_properties->height;
+        SVRD_Stream_resetLinkEstimate(stream);
+        SVRD_Stream_setBandwidthWeight(stream, Util_max(stream->priority, 1));
+        stream->send_rate = 0;
+        clock_gettime(CLOCK_MONOTONIC, &stream->send_rate_time);
+        clock_gettime(CLOCK_MONOTONIC, &stream->next_frame_time);
         SVRD_Stream_initializeEncoder(stream);
+        SVRD_Source_addConsumer(stream->source, stream);
         pthread_create(&stream->worker, NULL, SVRD_Stream_worker, stream);
         stream->worker_started = true;
     }
     SVR_UNLOCK(stream);
+
+    return SVR_SUCCESS;
 }
 
 void SVRD_Stream_destroy(SVRD_Stream* stream) {
-    SVR_LOCK(stream);
+    SVRD_acquireGlobalStreamsLock();
+    List_remove(streams, List_indexOf(streams, stream));
+    SVRD_releaseGlobalStreamsLock();
 
+    /* The worker takes the stream lock, so join it before locking */
     SVRD_Stream_pause(stream);
     if(stream->worker_started) {
         pthread_join(stream->worker, NULL);
     }
 
+    SVR_LOCK(stream);
+
     /* Detach the source without a lock to avoid a deadlock */
     SVRD_Stream_detachSource(stream);
 
@@ -274,23 +633,39 @@ void SVRD_Stream_destroy(SVRD_Stream* stream) {
     }
 
     if(stream->temp_frame[0]) {
-        cvReleaseImage(&stream->temp_frame[0]);
+        SVR_FramePool_returnFrame(stream->temp_frame[0]);
     }
 
     if(stream->temp_frame[1]) {
-        cvReleaseImage(&stream->temp_frame[1]);
+        SVR_FramePool_returnFrame(stream->temp_frame[1]);
+    }
+
+    if(stream->transport) {
+        SVRD_Transport_release(stream->transport, stream);
+        stream->transport = NULL;
     }
 
     SVR_UNREF(stream->client);
     SVR_UNLOCK(stream);
+    pthread_cond_destroy(&stream->wakeup);
     free(stream);
 }
 
 static IplImage* SVRD_Stream_preprocessFrame(SVRD_Stream* stream, IplImage* frame) {
-    SVR_FrameProperties* source_frame_properties = SVRD_Source_getFrameProperties(stream->source);
-    bool resize = (stream->frame_properties->width != source_frame_properties->width ||
-                   stream->frame_properties->height != source_frame_properties->height);
-    bool color_convert = (stream->frame_properties->channels != source_frame_properties->channels);
+    bool resize;
+    bool color_convert;
+
+    /* The source may capture below its native size while demand is low, so
+       work from the size of the frame itself */
+    if(frame->width != stream->input_width || frame->height != stream->input_height) {
+        stream->input_width = frame->width;
+        stream->input_height = frame->height;
+        SVRD_Stream_reallocateTemporaryFrames(stream);
+    }
+
+    resize = (stream->frame_properties->width != frame->width ||
+              stream->frame_properties->height != frame->height);
+    color_convert = (stream->frame_properties->channels != frame->nChannels);
 
     if(resize && color_convert) {
         cvResize(frame, stream->temp_frame[0], CV_INTER_NN);
@@ -320,13 +695,305 @@ static IplImage* SVRD_Stream_preprocessFrame(SVRD_Stream* stream, IplImage* fram
     return frame;
 }
 
+/**
+ * \brief Wait until the stream should process its next frame
+ *
+ * In pull mode, wait for the client to request a frame. With a maximum rate,
+ * wait for the next frame deadline. The deadline then advances by one period,
+ * or restarts from now if the stream has fallen behind.
+ *
+ * \param stream The stream
+ * \return False if the stream was paused while waiting
+ */
+static bool SVRD_Stream_waitForTurn(SVRD_Stream* stream) {
+    struct timespec now;
+    struct timespec* next = &stream->next_frame_time;
+    bool unpaused;
+
+    SVR_LOCK(stream);
+    while(stream->state == SVR_UNPAUSED && stream->pull_mode && stream->frames_requested == 0) {
+        SVR_LOCK_WAIT(stream, &stream->wakeup);
+    }
+
+    while(stream->state == SVR_UNPAUSED && stream->max_rate > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if(now.tv_sec > next->tv_sec || (now.tv_sec == next->tv_sec && now.tv_nsec >= next->tv_nsec)) {
+            next->tv_nsec += 1000000000L / stream->max_rate;
+            if(next->tv_nsec >= 1000000000L) {
+                next->tv_sec += 1;
+                next->tv_nsec -= 1000000000L;
+            }
+
+            if(now.tv_sec > next->tv_sec || (now.tv_sec == next->tv_sec && now.tv_nsec > next->tv_nsec)) {
+                *next = now;
+            }
+            break;
+        }
+
+        pthread_cond_timedwait(&stream->wakeup, SVR_GET_LOCK(stream), next);
+    }
+
+    unpaused = (stream->state == SVR_UNPAUSED);
+    SVR_UNLOCK(stream);
+
+    return unpaused;
+}
+
+static bool SVRD_Stream_frameExpired(SVRD_Stream* stream, SVRD_SourceFrame* source_frame) {
+    struct timespec now;
+    long age;
+
+    if(stream->max_age == 0) {
+        return false;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    age = (now.tv_sec - source_frame->timestamp.tv_sec) * 1000 +
+          (now.tv_nsec - source_frame->timestamp.tv_nsec) / 1000000;
+
+    if(age > stream->max_age) {
+        stream->frames_expired++;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Check whether a frame can be sent as the source encoded it. The stream must
+ * use the source's encoding and frame properties, and not be adapting frames
+ * to its link or the server load. The stream's encoding options are then not
+ * applied
+ */
+static bool SVRD_Stream_canPassThrough(SVRD_Stream* stream, SVRD_SourceFrame* source_frame) {
+    IplImage* frame = source_frame->frame;
+
+    return source_frame->encoded != NULL &&
+           stream->encoding == stream->source->encoding &&
+           stream->degrade_level == 0 &&
+           stream->link_frame_size == 0 &&
+           stream->frame_properties->width == frame->width &&
+           stream->frame_properties->height == frame->height &&
+           stream->frame_properties->channels == frame->nChannels;
+}
+
+/**
+ * \brief Apply a degrade level to a stream
+ *
+ * Called by the worker between frames. The encoder is reopened with the
+ * options and frame size of the new level, and the client is told the new
+ * frame properties before any frame encoded with them.
+ *
+ * \param stream The stream
+ * \param level The level to apply, 0 to restore the stream
+ */
+static void SVRD_Stream_applyDegradeLevel(SVRD_Stream* stream, int level) {
+    SVR_FrameProperties* frame_properties = stream->frame_properties;
+    SVR_Message* message;
+    List* keys;
+    char* key;
+    int width = stream->requested_width;
+    int height = stream->requested_height;
+
+    if(level >= 3) {
+        width = Util_max(width / 2, 1);
+        height = Util_max(height / 2, 1);
+    }
+
+    if(frame_properties->width != width || frame_properties->height != height) {
+        frame_properties->width = width;
+        frame_properties->height = height;
+        SVRD_Stream_reallocateTemporaryFrames(stream);
+    }
+
+    if(stream->degraded_options) {
+        Dictionary_destroy(stream->degraded_options);
+        stream->degraded_options = NULL;
+    }
+
+    if(level >= 2 && strcmp(stream->encoding->name, "jpeg") == 0) {
+        /* Share the option strings, overriding only the quality */
+        stream->degraded_options = Dictionary_new();
+        keys = Dictionary_getKeys(stream->encoding_options);
+        for(int i = 0; (key = List_get(keys, i)) != NULL; i++) {
+            Dictionary_set(stream->degraded_options, key, Dictionary_get(stream->encoding_options, key));
+        }
+        List_destroy(keys);
+
+        Dictionary_set(stream->degraded_options, "quality", SVRD_STREAM_DEGRADED_QUALITY);
+    }
+
+    SVRD_Stream_initializeEncoder(stream);
+    stream->degrade_level = level;
+
+    message = SVR_Message_new(4);
+    message->components[0] = SVR_Arena_strdup(message->alloc, "Stream.adjusted");
+    message->components[1] = SVR_Arena_strdup(message->alloc, stream->name);
+    message->components[2] = SVR_Arena_sprintf(message->alloc, "%d", level);
+    message->components[3] = SVR_Arena_sprintf(message->alloc, "%d,%d,%d,%d", frame_properties->width,
+                                                                              frame_properties->height,
+                                                                              frame_properties->depth,
+                                                                              frame_properties->channels);
+
+    SVRD_Client_sendMessage(stream->client, message);
+    SVR_Message_release(message);
+}
+
+static void SVRD_Stream_resetLinkEstimate(SVRD_Stream* stream) {
+    stream->last_send_time.tv_sec = 0;
+    stream->last_send_time.tv_nsec = 0;
+    stream->last_frame_time = stream->last_send_time;
+    stream->last_send_queue = 0;
+    stream->last_frame_size = 0;
+    stream->drain_rate = 0;
+    stream->frame_interval = 0;
+    stream->link_frame_size = 0;
+}
+
+/**
+ * \brief Size the next frame to the link to the client
+ *
+ * If bytes queued when the last frame was sent are still queued now, the link
+ * has been busy since and the bytes acknowledged in between give its rate. The
+ * encoder is then asked for frames the link can carry in one frame interval,
+ * less a share of the backlog. Once the queue empties the target is raised
+ * gradually, and dropped once frames no longer come near it.
+ *
+ * \param stream The stream
+ */
+static void SVRD_Stream_adaptToLink(SVRD_Stream* stream) {
+    struct timespec now;
+    double elapsed;
+    double target;
+    int queued;
+
+    queued = SVRD_Client_getSendQueue(stream->client);
+    if(queued < 0) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if(stream->last_frame_time.tv_sec) {
+        elapsed = (now.tv_sec - stream->last_frame_time.tv_sec) +
+                  (now.tv_nsec - stream->last_frame_time.tv_nsec) / 1e9;
+        stream->frame_interval = stream->frame_interval ? 0.75 * stream->frame_interval + 0.25 * elapsed : elapsed;
+    }
+    stream->last_frame_time = now;
+
+    if(stream->last_send_time.tv_sec == 0) {
+        return;
+    }
+
+    elapsed = (now.tv_sec - stream->last_send_time.tv_sec) +
+              (now.tv_nsec - stream->last_send_time.tv_nsec) / 1e9;
+
+    if(queued > 0 && elapsed > 0.001 && stream->last_send_queue > queued) {
+        target = (stream->last_send_queue - queued) / elapsed;
+        stream->drain_rate = stream->drain_rate ? 0.5 * stream->drain_rate + 0.5 * target : target;
+    }
+
+    if(queued > 0 && stream->drain_rate > 0) {
+        target = stream->drain_rate * stream->frame_interval - (double) queued / SVRD_STREAM_BACKLOG_FRAMES;
+        stream->link_frame_size = Util_max(target, SVRD_STREAM_MIN_FRAME_SIZE);
+    } else if(stream->link_frame_size) {
+        stream->link_frame_size += stream->link_frame_size / 8;
+        if(stream->link_frame_size > 4 * stream->last_frame_size) {
+            stream->link_frame_size = 0;
+        }
+    } else {
+        return;
+    }
+
+    SVR_Encoder_setTargetFrameSize(stream->encoder, stream->link_frame_size);
+}
+
+/**
+ * Record the send queue once a frame of frame_size bytes has been sent
+ */
+static void SVRD_Stream_recordSend(SVRD_Stream* stream, size_t frame_size) {
+    stream->last_send_queue = SVRD_Client_getSendQueue(stream->client);
+    stream->last_frame_size = frame_size;
+    clock_gettime(CLOCK_MONOTONIC, &stream->last_send_time);
+}
+
+/**
+ * Decay the recent send rate of the stream to the current time
+ */
+static void SVRD_Stream_decaySendRate(SVRD_Stream* stream) {
+    struct timespec now;
+    double elapsed;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - stream->send_rate_time.tv_sec) +
+              (now.tv_nsec - stream->send_rate_time.tv_nsec) / 1e9;
+
+    stream->send_rate *= exp(-elapsed / SVRD_STREAM_RATE_WINDOW);
+    stream->send_rate_time = now;
+}
+
+/**
+ * \brief Check the bandwidth limits before processing a frame
+ *
+ * Frames over the server or client limit are dropped rather than queued, so
+ * the frames which are sent stay fresh.
+ *
+ * \param stream The stream
+ * \return True if the frame may be sent
+ */
+static bool SVRD_Stream_admitFrame(SVRD_Stream* stream) {
+    SVRD_Stream_decaySendRate(stream);
+
+    return SVRD_Bandwidth_admit(SVRD_Bandwidth_getServer(), stream->send_rate, stream->bandwidth_weight) &&
+           SVRD_Bandwidth_admit(stream->client->bandwidth, stream->send_rate, stream->bandwidth_weight);
+}
+
+/**
+ * Charge a sent frame to the bandwidth limits and the stream's send rate
+ */
+static void SVRD_Stream_chargeFrame(SVRD_Stream* stream, size_t frame_size) {
+    SVRD_Bandwidth_consume(SVRD_Bandwidth_getServer(), frame_size);
+    SVRD_Bandwidth_consume(stream->client->bandwidth, frame_size);
+
+    SVRD_Stream_decaySendRate(stream);
+    stream->send_rate += frame_size / SVRD_STREAM_RATE_WINDOW;
+}
+
+/**
+ * Update the worker CPU time of the stream. base is the CPU time accumulated
+ * by previous workers of the stream
+ */
+static void SVRD_Stream_updateCpuTime(SVRD_Stream* stream, uint64_t base) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    stream->cpu_time = base + (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
 static void* SVRD_Stream_worker(void* _stream) {
     SVRD_Stream* stream = (SVRD_Stream*) _stream;
     SVRD_SourceFrame* source_frame = NULL;
+    SVR_Arena* message_arena = SVR_Message_newArena();
+    uint64_t cpu_time_base = stream->cpu_time;
     IplImage* frame;
     SVR_Message* message;
+    size_t frame_size;
+    bool sent;
+    int drop_rate;
+    int level;
+
+    while(SVRD_Stream_waitForTurn(stream)) {
+        /* Waiting costs no CPU time, so sampling once per frame is enough */
+        SVRD_Stream_updateCpuTime(stream, cpu_time_base);
+
+        SVR_LOCK(stream);
+        level = stream->target_level;
+        SVR_UNLOCK(stream);
+
+        if(level != stream->degrade_level) {
+            SVRD_Stream_applyDegradeLevel(stream, level);
+        }
 
-    while(stream->state == SVR_UNPAUSED) {
         source_frame = SVRD_Source_getFrame(stream->source, stream, source_frame);
 
         if(source_frame == NULL) {
@@ -338,22 +1005,70 @@ static void* SVRD_Stream_worker(void* _stream) {
             break;
         }
 
-        if(stream->drop_rate) {
-            stream->drop_counter = (stream->drop_counter + 1) % stream->drop_rate;
+        /* Another stream sends the frames of a shared multicast channel */
+        if(stream->transport && SVRD_Transport_isSender(stream->transport, stream) == false) {
+            continue;
+        }
+
+        drop_rate = stream->drop_rate;
+        if(stream->degrade_level >= 1) {
+            drop_rate = Util_max(drop_rate, 1) * 2;
+        }
+
+        if(drop_rate) {
+            stream->drop_counter = (stream->drop_counter + 1) % drop_rate;
 
             if(stream->drop_counter != 0) {
+                stream->frames_dropped++;
                 continue;
             }
         }
 
+        /* Frame may have waited behind a slow send */
+        if(SVRD_Stream_frameExpired(stream, source_frame)) {
+            continue;
+        }
+
+        if(SVRD_Stream_admitFrame(stream) == false) {
+            stream->frames_dropped++;
+            continue;
+        }
 
-        frame = SVRD_Stream_preprocessFrame(stream, source_frame->frame);
-        SVR_Encoder_encode(stream->encoder, frame);
+        SVRD_Stream_adaptToLink(stream);
 
-        /* Send all the encoded data out in chunks */
+        /* Frames relayed from another server go out as they arrived */
+        if(SVRD_Stream_canPassThrough(stream, source_frame)) {
+            frame_size = SVR_Encoder_passThrough(stream->encoder, source_frame->encoded, source_frame->encoded_size);
+        } else {
+            frame = SVRD_Stream_preprocessFrame(stream, source_frame->frame);
+            if(SVRD_Stream_frameExpired(stream, source_frame)) {
+                continue;
+            }
+
+            frame_size = SVR_Encoder_encode(stream->encoder, frame);
+        }
+
+        /* Once sending starts the whole frame must go out */
+        if(SVRD_Stream_frameExpired(stream, source_frame)) {
+            while(SVR_Encoder_readData(stream->encoder, stream->payload_buffer, stream->payload_buffer_size) > 0);
+            continue;
+        }
+
+        /* Datagrams which can not be sent lose the frame, but not the stream */
+        sent = true;
+        if(stream->transport) {
+            if(SVRD_Transport_sendFrame(stream->transport, stream->encoder, frame_size)) {
+                SVR_log(SVR_DEBUG, "Can not send datagram");
+                sent = false;
+            }
+        }
+
+        /* Otherwise send all the encoded data out in chunks over the client
+           connection */
         while(SVR_Encoder_dataReady(stream->encoder) > 0) {
-            /* Build the data message */
-            message = SVR_Message_new(2);
+            /* Build the data message, reusing the arena of the last one */
+            SVR_Arena_reset(message_arena);
+            message = SVR_Message_newWithAlloc(2, message_arena);
             message->components[0] = "Data";
             message->components[1] = stream->name;
             message->payload = stream->payload_buffer;
@@ -367,10 +1082,26 @@ static void* SVRD_Stream_worker(void* _stream) {
             if(SVRD_Client_sendMessage(stream->client, message) < 0) {
                 SVRD_Stream_pause(stream);
                 SVR_log(SVR_DEBUG, "Can not send message");
+                sent = false;
                 break;
             }
+        }
+
+        /* A frame the client never gets is neither sent nor charged */
+        if(sent == false) {
+            continue;
+        }
+
+        SVRD_Stream_recordSend(stream, frame_size);
+        SVRD_Stream_chargeFrame(stream, frame_size);
+        stream->frames_sent++;
 
-            SVR_Message_release(message);
+        if(stream->pull_mode) {
+            SVR_LOCK(stream);
+            if(stream->frames_requested > 0) {
+                stream->frames_requested--;
+            }
+            SVR_UNLOCK(stream);
         }
     }
 
@@ -378,5 +1109,54 @@ static void* SVRD_Stream_worker(void* _stream) {
         SVR_UNREF(source_frame);
     }
 
+    SVRD_Stream_updateCpuTime(stream, cpu_time_base);
+
+    /* Leave the stream as the client configured it */
+    if(stream->degrade_level != 0) {
+        if(stream->source && stream->frame_properties) {
+            stream->frame_properties->width = stream->requested_width;
+            stream->frame_properties->height = stream->requested_height;
+            SVRD_Stream_reallocateTemporaryFrames(stream);
+        }
+
+        if(stream->degraded_options) {
+            Dictionary_destroy(stream->degraded_options);
+            stream->degraded_options = NULL;
+        }
+
+        stream->degrade_level = 0;
+    }
+
+    SVR_Arena_free(message_arena);
+
     return NULL;
 }
+
+/**
+ * \brief Get streams
+ *
+ * Get a list of all streams. Access to the list should be protected by calls to
+ * SVRD_acquireGlobalStreamsLock and SVRD_releaseGlobalStreamsLock
+ *
+ * \return The list of streams, or NULL if no stream has been created
+ */
+List* SVRD_getAllStreams(void) {
+    return streams;
+}
+
+/**
+ * \brief Acquire the streams list lock
+ *
+ * Acquire a global lock on the streams list. Stream locks may be taken while
+ * it is held, but not the other way around.
+ */
+void SVRD_acquireGlobalStreamsLock(void) {
+    pthread_mutex_lock(&global_streams_lock);
+}
+
+/**
+ * \brief Release the streams list lock
+ */
+void SVRD_releaseGlobalStreamsLock(void) {
+    pthread_mutex_unlock(&global_streams_lock);
+}
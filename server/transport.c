@@ -0,0 +1,257 @@
+
+#include <svr.h>
+#include <svrd.h>
+
+#include <arpa/inet.h>
+
+static SVRD_Transport* SVRD_Transport_new(SVRD_TransportType type, struct sockaddr_in* address, size_t datagram_size);
+static void SVRD_Transport_destroy(SVRD_Transport* transport);
+
+/* Multicast channels by "group:port" */
+static Dictionary* multicast_channels = NULL;
+static pthread_mutex_t multicast_channels_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static SVRD_Transport* SVRD_Transport_new(SVRD_TransportType type, struct sockaddr_in* address, size_t datagram_size) {
+    SVRD_Transport* transport;
+    int sock;
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if(sock < 0) {
+        SVR_logf(SVR_ERROR, "Error creating datagram socket: %s", strerror(errno));
+        return NULL;
+    }
+
+    transport = malloc(sizeof(SVRD_Transport));
+    transport->type = type;
+    transport->socket = sock;
+    transport->address = *address;
+    transport->datagram_size = datagram_size;
+    transport->frame_id = 0;
+    transport->datagram = malloc(SVR_DATAGRAM_HEADER_LEN + datagram_size);
+    transport->key = NULL;
+    transport->streams = NULL;
+    SVR_LOCKABLE_INIT(transport);
+
+    return transport;
+}
+
+static void SVRD_Transport_destroy(SVRD_Transport* transport) {
+    close(transport->socket);
+
+    if(transport->streams) {
+        List_destroy(transport->streams);
+        free(transport->key);
+    }
+
+    free(transport->datagram);
+    free(transport);
+}
+
+/**
+ * \brief Create a datagram channel to a client
+ *
+ * Datagrams are sent to the given port at the address the client is connected
+ * from. Clients connected over a Unix socket receive on the loopback address.
+ *
+ * \param client The client the channel leads to
+ * \param port UDP port the client receives on
+ * \return A new channel, or NULL on failure
+ */
+SVRD_Transport* SVRD_Transport_newUnicast(SVRD_Client* client, int port) {
+    struct sockaddr_storage peer;
+    socklen_t peer_length = sizeof(peer);
+    struct sockaddr_in address;
+    size_t datagram_size;
+
+    if(port <= 0 || port > 0xffff || getpeername(client->socket, (struct sockaddr*) &peer, &peer_length)) {
+        return NULL;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+
+    if(peer.ss_family == AF_INET) {
+        address.sin_addr = ((struct sockaddr_in*) &peer)->sin_addr;
+    } else if(peer.ss_family == AF_UNIX) {
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    } else {
+        return NULL;
+    }
+
+    datagram_size = SVRD_TRANSPORT_DATAGRAM_SIZE;
+    if(SVR_Net_isLocal(client->socket)) {
+        datagram_size = SVRD_TRANSPORT_LOCAL_DATAGRAM_SIZE;
+    }
+
+    return SVRD_Transport_new(SVRD_TRANSPORT_UDP, &address, datagram_size);
+}
+
+/**
+ * \brief Join a stream to a multicast channel
+ *
+ * The channel for the group and port is created by the first stream to join
+ * it. Streams joining an existing channel receive the frames of its sender, so
+ * should use the same source, encoding and frame size.
+ *
+ * \param stream The joining stream
+ * \param group IPv4 multicast group address
+ * \param port UDP port of the group
+ * \return The channel, or NULL if the group is invalid
+ */
+SVRD_Transport* SVRD_Transport_joinMulticast(SVRD_Stream* stream, const char* group, int port) {
+    const unsigned char ttl = SVRD_TRANSPORT_MULTICAST_TTL;
+    const unsigned char loop = 1;
+    SVRD_Transport* transport;
+    struct sockaddr_in address;
+    char address_string[INET_ADDRSTRLEN + 8];
+    char* key;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+
+    if(port <= 0 || port > 0xffff || inet_pton(AF_INET, group, &address.sin_addr) != 1 ||
+       IN_MULTICAST(ntohl(address.sin_addr.s_addr)) == false) {
+        return NULL;
+    }
+
+    snprintf(address_string, sizeof(address_string), "%s:%d", group, port);
+    key = strdup(address_string);
+
+    pthread_mutex_lock(&multicast_channels_lock);
+    if(multicast_channels == NULL) {
+        multicast_channels = Dictionary_new();
+    }
+
+    transport = Dictionary_get(multicast_channels, key);
+    if(transport == NULL) {
+        transport = SVRD_Transport_new(SVRD_TRANSPORT_MULTICAST, &address, SVRD_TRANSPORT_DATAGRAM_SIZE);
+        if(transport == NULL) {
+            pthread_mutex_unlock(&multicast_channels_lock);
+            free(key);
+            return NULL;
+        }
+
+        /* Keep the group on the LAN, and deliver to receivers on this machine
+           too */
+        setsockopt(transport->socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        setsockopt(transport->socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+        transport->key = key;
+        transport->streams = List_new();
+        Dictionary_set(multicast_channels, key, transport);
+    } else {
+        free(key);
+    }
+
+    SVR_LOCK(transport);
+    List_append(transport->streams, stream);
+    SVR_UNLOCK(transport);
+    pthread_mutex_unlock(&multicast_channels_lock);
+
+    return transport;
+}
+
+/**
+ * \brief Stop using a channel
+ *
+ * A unicast channel is destroyed. A stream leaving a multicast channel hands
+ * sending over to the next running stream, and the channel is destroyed once
+ * no stream remains. The stream must not be running.
+ *
+ * \param transport The channel
+ * \param stream The stream leaving the channel
+ */
+void SVRD_Transport_release(SVRD_Transport* transport, SVRD_Stream* stream) {
+    int index;
+
+    if(transport->type == SVRD_TRANSPORT_UDP) {
+        SVRD_Transport_destroy(transport);
+        return;
+    }
+
+    pthread_mutex_lock(&multicast_channels_lock);
+    SVR_LOCK(transport);
+    index = List_indexOf(transport->streams, stream);
+    if(index >= 0) {
+        List_remove(transport->streams, index);
+    }
+
+    if(List_getSize(transport->streams) > 0) {
+        SVR_UNLOCK(transport);
+        pthread_mutex_unlock(&multicast_channels_lock);
+        return;
+    }
+
+    Dictionary_remove(multicast_channels, transport->key);
+    SVR_UNLOCK(transport);
+    pthread_mutex_unlock(&multicast_channels_lock);
+
+    SVRD_Transport_destroy(transport);
+}
+
+/**
+ * \brief Check whether a stream sends the frames of a channel
+ *
+ * \param transport The channel
+ * \param stream A stream using the channel
+ * \return True if the stream should encode and send its frames
+ */
+bool SVRD_Transport_isSender(SVRD_Transport* transport, SVRD_Stream* stream) {
+    SVRD_Stream* sender = NULL;
+    SVRD_Stream* joined;
+
+    if(transport->type == SVRD_TRANSPORT_UDP) {
+        return true;
+    }
+
+    SVR_LOCK(transport);
+    for(int i = 0; (joined = List_get(transport->streams, i)) != NULL; i++) {
+        if(joined->state == SVR_UNPAUSED) {
+            sender = joined;
+            break;
+        }
+    }
+    SVR_UNLOCK(transport);
+
+    return sender == stream;
+}
+
+/**
+ * \brief Send an encoded frame
+ *
+ * Read a whole frame from the encoder and send it as a series of datagrams.
+ * Datagrams which can not be sent are lost like any other, and the receiver
+ * drops the frame.
+ *
+ * \param transport The channel
+ * \param encoder An encoder holding one encoded frame
+ * \param frame_size Size of the encoded frame
+ * \return The number of datagrams which could not be sent
+ */
+int SVRD_Transport_sendFrame(SVRD_Transport* transport, SVR_Encoder* encoder, size_t frame_size) {
+    uint8_t* payload = transport->datagram + SVR_DATAGRAM_HEADER_LEN;
+    uint32_t offset = 0;
+    size_t n;
+    int failed = 0;
+
+    /* A multicast sender hands over to another stream when it pauses, and may
+       still be sending as the next one starts */
+    SVR_LOCK(transport);
+    transport->frame_id++;
+
+    while((n = SVR_Encoder_readData(encoder, payload, transport->datagram_size)) > 0) {
+        SVR_pack(transport->datagram, 0, "hiii", SVR_DATAGRAM_MAGIC, transport->frame_id, frame_size, offset);
+
+        if(sendto(transport->socket, transport->datagram, SVR_DATAGRAM_HEADER_LEN + n, 0,
+                  (struct sockaddr*) &transport->address, sizeof(transport->address)) < 0) {
+            failed++;
+        }
+
+        offset += n;
+    }
+    SVR_UNLOCK(transport);
+
+    return failed;
+}
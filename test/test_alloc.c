@@ -0,0 +1,169 @@
+/* Check that the steady state frame path does not touch the heap. svrd runs in
+   this process with a test source, and a client connected to it over a socket
+   pair streams that source: the source thread captures, the stream worker
+   encodes and sends, and the client's receive thread routes the Data messages
+   to the stream's decoder. The stream runs once raw and once as jpeg, so the
+   jpeg encoder's and decoder's buffers are covered too. After a warm up period
+   every call to the malloc family, from any thread, is counted and any
+   allocation is a failure. */
+
+#include <svr.h>
+#include <svrd.h>
+
+#include <signal.h>
+
+#define WARMUP_FRAMES 64
+#define TEST_FRAMES 256
+
+/* Frames taken from the pool and returned before counting starts, so the
+   pool's high-water mark does not depend on how the threads were scheduled
+   during warm up */
+#define PRIMED_FRAMES 16
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void* ptr);
+
+static volatile bool counting = false;
+static volatile size_t allocations = 0;
+
+void* malloc(size_t size) {
+    if(counting) {
+        __sync_fetch_and_add(&allocations, 1);
+    }
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size) {
+    if(counting) {
+        __sync_fetch_and_add(&allocations, 1);
+    }
+    return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    if(counting) {
+        __sync_fetch_and_add(&allocations, 1);
+    }
+    return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    if(counting) {
+        __sync_fetch_and_add(&allocations, 1);
+    }
+
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr ? 0 : ENOMEM;
+}
+
+void free(void* ptr) {
+    __libc_free(ptr);
+}
+
+/* Normally provided by svrd's main */
+void SVRD_exit(void) {
+    exit(0);
+}
+
+void SVRD_exitError(void) {
+    exit(-1);
+}
+
+static void startServer(int socket) {
+    SVRD_Bandwidth_init(0, 0);
+    SVRD_Client_init();
+    SVRD_Source_init();
+    SVRD_MessageRouter_init();
+
+    signal(SIGPIPE, SIG_IGN);
+    SVRD_addClient(socket);
+}
+
+static void primeFramePool(SVR_FrameProperties* frame_properties) {
+    IplImage* frames[PRIMED_FRAMES];
+
+    for(int i = 0; i < PRIMED_FRAMES; i++) {
+        frames[i] = SVR_FramePool_getFrame(frame_properties);
+    }
+
+    for(int i = 0; i < PRIMED_FRAMES; i++) {
+        SVR_FramePool_returnFrame(frames[i]);
+    }
+}
+
+static int runStream(SVR_Context* context, const char* encoding) {
+    SVR_Stream* stream;
+    IplImage* frame;
+
+    stream = SVR_Stream_newOn(context, "test");
+    if(stream == NULL ||
+       SVR_Stream_setEncoding(stream, encoding) != SVR_SUCCESS ||
+       SVR_Stream_unpause(stream) != SVR_SUCCESS) {
+        fprintf(stderr, "Error opening %s stream\n", encoding);
+        return -1;
+    }
+
+    allocations = 0;
+    for(int i = 0; i < WARMUP_FRAMES + TEST_FRAMES; i++) {
+        if(i == WARMUP_FRAMES) {
+            primeFramePool(SVR_Stream_getFrameProperties(stream));
+            counting = true;
+        }
+
+        frame = SVR_Stream_getFrame(stream, true);
+        if(frame == NULL) {
+            counting = false;
+            fprintf(stderr, "Error receiving %s frame %d\n", encoding, i);
+            return -1;
+        }
+
+        SVR_Stream_returnFrame(stream, frame);
+    }
+
+    counting = false;
+    SVR_Stream_destroy(stream);
+
+    if(allocations) {
+        fprintf(stderr, "%zu allocations over %d steady state %s frames\n", allocations, TEST_FRAMES, encoding);
+        return -1;
+    }
+
+    printf("No allocations over %d steady state %s frames\n", TEST_FRAMES, encoding);
+    return 0;
+}
+
+int main(void) {
+    SVR_Context* context;
+    int sockets[2];
+
+    SVR_initCore();
+    SVR_Logging_setThreshold(SVR_NORMAL);
+    SVR_Stream_init();
+    SVR_MessageRouter_init();
+
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) {
+        fprintf(stderr, "Error creating socket pair\n");
+        return -1;
+    }
+
+    startServer(sockets[0]);
+    context = SVR_Context_newWithSocket(sockets[1]);
+    if(context == NULL) {
+        fprintf(stderr, "Error connecting to server\n");
+        return -1;
+    }
+
+    if(SVR_openServerSourceOn(context, "test", "test:rate=200") != SVR_SUCCESS) {
+        fprintf(stderr, "Error opening test source\n");
+        return -1;
+    }
+
+    if(runStream(context, "raw") < 0 || runStream(context, "jpeg") < 0) {
+        return -1;
+    }
+
+    return 0;
+}
@@ -6,7 +6,8 @@ enum svrctl_job_type {
     SVRCTL_OPEN,
     SVRCTL_CLOSE,
     SVRCTL_CLOSEALL,
-    SVRCTL_LISTALL
+    SVRCTL_LISTALL,
+    SVRCTL_STATS
 };
 
 struct svrctl_job {
@@ -18,7 +19,7 @@ struct svrctl_job {
 static void svrctl_usage(const char* argv0);
 
 static void svrctl_usage(const char* argv0) {
-    printf("Usage: %s [-hd] [-s ADDRESS] [-o NAME,SOURCE_DESCRIPTOR] [-c NAME] [--close-all] [--list-all]\n"
+    printf("Usage: %s [-hd] [-s ADDRESS] [-o NAME,SOURCE_DESCRIPTOR] [-c NAME] [--close-all] [--list-all] [-S NAME]\n"
            "Seawolf Video Router Control\n"
            "\n"
            "  -h, --help                            Show this help message\n"
@@ -27,6 +28,7 @@ static void svrctl_usage(const char* argv0) {
            "  -o, --open NAME,SOURCE_DESCRIPTOR     Open a new server source\n"
            "  -c, --close NAME                      Close a server source\n"
            "  -l, --list-all                        List all sources\n"
+           "  -S, --stats NAME                      Show the frame counters of a source\n"
            "      --close-all                       Close all server sources\n\n", argv0);
 }
 
@@ -34,6 +36,7 @@ int main(int argc, char** argv) {
     int opt, indexptr, i, err;
     char* source_name;
     List* sources;
+    SVR_SourceStats stats;
 
     struct option long_options[] = {
         {"help", 0, NULL, 'h'},
@@ -43,6 +46,7 @@ int main(int argc, char** argv) {
         {"close", 1, NULL, 'c'},
         {"close-all", 0, NULL, 'C'},
         {"list-all", 0, NULL, 'l'},
+        {"stats", 1, NULL, 'S'},
         {NULL, 0, NULL, 0}
     };
 
@@ -51,7 +55,7 @@ int main(int argc, char** argv) {
 
     SVR_Logging_setThreshold(SVR_LOGGING_OFF);
 
-    while((opt = getopt_long(argc, argv, ":hdls:o:c:", long_options, &indexptr)) != -1) {
+    while((opt = getopt_long(argc, argv, ":hdls:o:c:S:", long_options, &indexptr)) != -1) {
         switch(opt) {
         case 'h':
             svrctl_usage(argv[0]);
@@ -98,6 +102,12 @@ int main(int argc, char** argv) {
             jobs[job_count++].type = SVRCTL_LISTALL;
             break;
 
+        case 'S':
+            jobs = realloc(jobs, sizeof(struct svrctl_job) * (job_count + 1));
+            jobs[job_count].type = SVRCTL_STATS;
+            jobs[job_count++].arg0 = optarg;
+            break;
+
         case 'C':
             jobs = realloc(jobs, sizeof(struct svrctl_job) * (job_count + 1));
             jobs[job_count++].type = SVRCTL_CLOSEALL;
@@ -199,6 +209,24 @@ int main(int argc, char** argv) {
 
             SVR_freeSourcesList(sources);
             break;
+
+        case SVRCTL_STATS:
+            err = SVR_getSourceStats(jobs[i].arg0, &stats);
+            switch(err) {
+            case SVR_SUCCESS:
+                printf("%s: %u frames received, %u dropped\n", jobs[i].arg0, stats.frames_received,
+                                                                 stats.frames_dropped);
+                break;
+
+            case SVR_NOSUCHSOURCE:
+                fprintf(stderr, "Source '%s' does not exist\n", jobs[i].arg0);
+                break;
+
+            default:
+                fprintf(stderr, "Uknown error getting counters of '%s'\n", jobs[i].arg0);
+                break;
+            }
+            break;
         }
     }
 
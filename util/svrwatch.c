@@ -6,52 +6,68 @@
 
 #define POLLING_FREQ 5
 
+static const char* encoding_name = "auto";
 static int quality = 70;
+static const char* transport = NULL;
 static bool list_stale = false;
 static pthread_mutex_t list_stale_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static void svrwatch_usage(const char* argv0) {
-    printf("Usage: %s [-hdra] [-q QUALITY] [-s ADDRESS] SOURCE_NAME...\n"
+    printf("Usage: %s [-hdrja] [-q QUALITY] [-s ADDRESS] [-t TRANSPORT] SOURCE_NAME...\n"
            "Seawolf Video Router Stream Watcher\n"
            "\n"
            "  -h, --help                            Show this help message\n"
            "  -d, --debug                           Enable debugging\n"
            "  -s, --server=ADDRESS                  Address of SVR server\n"
-           "  -r, --raw                             Use raw encoding (default is JPEG)\n"
+           "  -r, --raw                             Use raw encoding\n"
+           "  -j, --jpeg                            Use JPEG encoding (default is raw for\n"
+           "                                        a local server and JPEG otherwise)\n"
            "  -q, --quality=VALUE                   JPEG stream quality\n"
+           "  -t, --transport=TRANSPORT             Deliver frames over \"udp\", or a multicast\n"
+           "                                        group given as\n"
+           "                                        \"multicast:group=ADDRESS,port=PORT\"\n"
            "  -a, --all                             Watch all streams\n", argv0);
 }
 
-static SVR_Stream* svrwatch_open_stream(const char* source_name) {
-    SVR_Stream* stream;
-    char* encoding;
+/* Open and start streams for the given sources, configured in a single
+   request. Streams which fail are left NULL */
+static int svrwatch_open_streams(const char** source_names, int count, SVR_Stream** streams) {
+    SVR_StreamConfig config;
+    int opened;
 
-    stream = SVR_Stream_new(source_name);
-    if(stream == NULL) {
-        fprintf(stderr, "Could not open stream for '%s'\n", source_name);
-        return NULL;
-    }
+    /* Quality is ignored if auto picks raw */
+    SVR_StreamConfig_init(&config);
+    config.encoding = Util_format("%s:quality=%d", encoding_name, quality);
 
-    if(quality == -1) {
-        /* Raw encoding */
-        encoding = "raw";
-    } else {
-        encoding = Util_format("jpeg:quality=%d", quality);
-    }
+    /* The transport must be set before the streams start */
+    config.unpause = (transport == NULL);
 
-    if(SVR_Stream_setEncoding(stream, encoding)) {
-        fprintf(stderr, "Error setting encoding for '%s'\n", source_name);
-        SVR_Stream_destroy(stream);
-        return NULL;
-    }
+    opened = SVR_Stream_newConfigured(source_names, count, &config, streams);
+
+    for(int i = 0; i < count; i++) {
+        if(streams[i] == NULL) {
+            fprintf(stderr, "Could not open stream for '%s'\n", source_names[i]);
+            continue;
+        }
 
-    if(SVR_Stream_unpause(stream)) {
-        fprintf(stderr, "Error unpausing stream for '%s'\n", source_name);
-        SVR_Stream_destroy(stream);
-        return NULL;
+        if(transport == NULL) {
+            continue;
+        }
+
+        if(SVR_Stream_setTransport(streams[i], transport)) {
+            fprintf(stderr, "Error setting transport for '%s'\n", source_names[i]);
+        } else if(SVR_Stream_unpause(streams[i])) {
+            fprintf(stderr, "Error unpausing stream for '%s'\n", source_names[i]);
+        } else {
+            continue;
+        }
+
+        SVR_Stream_destroy(streams[i]);
+        streams[i] = NULL;
+        opened--;
     }
 
-    return stream;
+    return opened;
 }
 
 static List* svrwatch_streams_list(Dictionary* streams) {
@@ -69,31 +85,42 @@ static List* svrwatch_streams_list(Dictionary* streams) {
 }
 
 static bool svrwatch_open_new(Dictionary* streams) {
-    SVR_Stream* stream;
+    SVR_Stream** new_streams;
+    const char** new_names;
     List* sources;
-    int stream_count;
+    int source_count;
+    int new_count = 0;
     char* source_name;
-    bool new_stream = false;
 
     sources = SVR_getSourcesList();
-    stream_count = List_getSize(sources);
+    source_count = List_getSize(sources);
+    new_names = malloc(sizeof(char*) * (source_count + 1));
+    new_streams = malloc(sizeof(SVR_Stream*) * (source_count + 1));
 
-    for(int i = 0; i < stream_count; i++) {
+    for(int i = 0; i < source_count; i++) {
         source_name = List_get(sources, i);
         source_name = source_name + 2;
 
         if(Dictionary_exists(streams, source_name) == false) {
-            stream = svrwatch_open_stream(source_name);
+            new_names[new_count++] = source_name;
+        }
+    }
 
-            if(stream) {
-                Dictionary_set(streams, source_name, stream);
-                new_stream = true;
+    /* Subscribe to every new source in one round trip */
+    if(new_count > 0 && svrwatch_open_streams(new_names, new_count, new_streams) > 0) {
+        for(int i = 0; i < new_count; i++) {
+            if(new_streams[i]) {
+                Dictionary_set(streams, new_names[i], new_streams[i]);
             }
         }
+    } else {
+        new_count = 0;
     }
 
+    free(new_names);
+    free(new_streams);
     SVR_freeSourcesList(sources);
-    return new_stream;
+    return new_count > 0;
 }
 
 static void* svrwatch_polling_thread(void* _streams) {
@@ -115,12 +142,11 @@ int main(int argc, char** argv) {
     IplImage* frame;
     Dictionary* streams;
     SVR_Stream* stream;
+    SVR_Stream** new_streams;
     List* streams_list;
     int stream_count;
     int opt, indexptr;
-    char* source_name;
     bool watch_all = false;
-    bool raw = false;
     pthread_t polling_thread;
 
     struct option long_options[] = {
@@ -128,14 +154,16 @@ int main(int argc, char** argv) {
         {"debug", 0, NULL, 'd'},
         {"server", 1, NULL, 's'},
         {"raw", 0, NULL, 'r'},
+        {"jpeg", 0, NULL, 'j'},
         {"quality", 1, NULL, 'q'},
+        {"transport", 1, NULL, 't'},
         {"all", 0, NULL, 'a'},
         {NULL, 0, NULL, 0}
     };
 
     SVR_Logging_setThreshold(SVR_LOGGING_OFF);
 
-    while((opt = getopt_long(argc, argv, ":hdrs:aq:", long_options, &indexptr)) != -1) {
+    while((opt = getopt_long(argc, argv, ":hdrjs:aq:t:", long_options, &indexptr)) != -1) {
         switch(opt) {
         case 'h':
             svrwatch_usage(argv[0]);
@@ -154,7 +182,11 @@ int main(int argc, char** argv) {
             break;
 
         case 'r':
-            raw = true;
+            encoding_name = "raw";
+            break;
+
+        case 'j':
+            encoding_name = "jpeg";
             break;
 
         case 'q':
@@ -166,6 +198,10 @@ int main(int argc, char** argv) {
             }
             break;
 
+        case 't':
+            transport = optarg;
+            break;
+
         case '?':
             fprintf(stderr, "Unknown switch '%s'\n\n", argv[optind - 1]);
             svrwatch_usage(argv[0]);
@@ -187,10 +223,6 @@ int main(int argc, char** argv) {
         return -1;
     }
 
-    if(raw) {
-        quality = -1;
-    }
-
     streams = Dictionary_new();
 
     if(watch_all) {
@@ -198,16 +230,15 @@ int main(int argc, char** argv) {
         pthread_create(&polling_thread, NULL, svrwatch_polling_thread, streams);
     } else {
         stream_count = argc - optind;
-        for(int i = 0; i < stream_count; i++) {
-            source_name = argv[optind + i];
-            stream = svrwatch_open_stream(source_name);
+        new_streams = malloc(sizeof(SVR_Stream*) * (stream_count + 1));
+        if(svrwatch_open_streams((const char**) argv + optind, stream_count, new_streams) < stream_count) {
+            exit(-1);
+        }
 
-            if(stream) {
-                Dictionary_set(streams, source_name, stream);
-            } else {
-                exit(-1);
-            }
+        for(int i = 0; i < stream_count; i++) {
+            Dictionary_set(streams, argv[optind + i], new_streams[i]);
         }
+        free(new_streams);
     }
 
     streams_list = svrwatch_streams_list(streams);